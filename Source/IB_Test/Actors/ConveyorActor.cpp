@@ -0,0 +1,316 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ConveyorActor.h"
+
+#include "MachineActor.h"
+#include "ShapeActor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/SphereComponent.h"
+#include "Components/SplineComponent.h"
+#include "IB_Test/Subsystems/ConveyorSubsystem.h"
+#include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "IB_Test/Utilities/HelperClass.h"
+#include "Net/UnrealNetwork.h"
+
+AConveyorActor::AConveyorActor()
+{
+	// Every belt is advanced by the conveyor subsystem
+	PrimaryActorTick.bCanEverTick = false;
+
+	bReplicates = true;
+
+	Spline = CreateDefaultSubobject<USplineComponent>(FName("Spline"));
+	SetRootComponent(Spline);
+
+	Intake = CreateDefaultSubobject<USphereComponent>(FName("Intake"));
+	Intake->SetupAttachment(Spline);
+	Intake->InitSphereRadius(50.f);
+}
+
+void AConveyorActor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UWorld* World = GetWorld();
+	if(!World)
+	{
+		UE_LOG(LogTemp, Error, TEXT("AConveyorActor::BeginPlay - World is nullptr. Failed to proceed in BeginPlay"));
+		return;
+	}
+
+	RecipeSubsystem = World->GetSubsystem<URecipeSubsystem>();
+	SplineLength = Spline->GetSplineLength();
+	Intake->SetWorldLocation(Spline->GetLocationAtDistanceAlongSpline(0.f, ESplineCoordinateSpace::World));
+
+	if(HasAuthority())
+	{
+		Intake->OnComponentBeginOverlap.AddDynamic(this, &AConveyorActor::OnIntakeBeginOverlap);
+		Intake->OnComponentEndOverlap.AddDynamic(this, &AConveyorActor::OnIntakeEndOverlap);
+	}
+
+	if(UConveyorSubsystem* ConveyorSubsystem = World->GetSubsystem<UConveyorSubsystem>())
+	{
+		ConveyorSubsystem->RegisterConveyor(*this);
+	}
+}
+
+void AConveyorActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if(UConveyorSubsystem* ConveyorSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UConveyorSubsystem>() : nullptr)
+	{
+		ConveyorSubsystem->UnregisterConveyor(*this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AConveyorActor::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AConveyorActor, ItemsSnapshot);
+}
+
+bool AConveyorActor::CanPushItem() const
+{
+	return ItemDistances.IsEmpty() || ItemDistances.Last() >= ItemSpacing;
+}
+
+bool AConveyorActor::PushItem(const FName& ShapeName)
+{
+	if(!CanPushItem() || !RecipeSubsystem.IsValid())
+	{
+		return false;
+	}
+
+	const int32 ShapeId = RecipeSubsystem->GetShapeId(ShapeName);
+	if(ShapeId == INDEX_NONE)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("AConveyorActor::PushItem - Unknown shape : %s"), *ShapeName.ToString());
+		return false;
+	}
+
+	AddItem(ShapeId);
+	return true;
+}
+
+void AConveyorActor::AddItem(int32 ShapeId)
+{
+	ItemShapeIds.Add(static_cast<uint16>(ShapeId));
+	ItemDistances.Add(0.f);
+	bItemsChanged = true;
+}
+
+void AConveyorActor::UpdateItemsSnapshot()
+{
+	if(!bItemsChanged || !HasAuthority())
+	{
+		return;
+	}
+
+	ItemsSnapshot.ShapeIds = ItemShapeIds;
+	ItemsSnapshot.Distances = ItemDistances;
+	++ItemsSnapshot.Sequence;
+	bItemsChanged = false;
+}
+
+void AConveyorActor::OnRep_ItemsSnapshot()
+{
+	// The server items replace the simulated ones, clients keep moving them until the next snapshot
+	ItemShapeIds = ItemsSnapshot.ShapeIds;
+	ItemDistances = ItemsSnapshot.Distances;
+}
+
+void AConveyorActor::AdvanceItems(float DeltaTime)
+{
+	const int32 NumItems = ItemDistances.Num();
+	float* Distances = ItemDistances.GetData();
+
+	// Every item moves the same step, four at a time
+	const float Step = Speed * DeltaTime;
+	const VectorRegister4Float StepVector = VectorSetFloat1(Step);
+	int32 ItemIndex = 0;
+	for(; ItemIndex + 4 <= NumItems; ItemIndex += 4)
+	{
+		VectorStore(VectorAdd(VectorLoad(Distances + ItemIndex), StepVector), Distances + ItemIndex);
+	}
+	for(; ItemIndex < NumItems; ++ItemIndex)
+	{
+		Distances[ItemIndex] += Step;
+	}
+
+	// Then items are stopped by the end of the belt or by the item ahead
+	float Limit = SplineLength;
+	for(ItemIndex = 0; ItemIndex < NumItems; ++ItemIndex)
+	{
+		Distances[ItemIndex] = FMath::Min(Distances[ItemIndex], Limit);
+		Limit = Distances[ItemIndex] - ItemSpacing;
+	}
+
+	// Clients only display the items, they wait at the end of the belt until the server hands them off
+	if(!HasAuthority())
+	{
+		return;
+	}
+
+	HandOffItems();
+	AbsorbIntakeShapes();
+	UpdateItemsSnapshot();
+}
+
+void AConveyorActor::HandOffItems()
+{
+	int32 NumHandedOff = 0;
+	while(NumHandedOff < ItemDistances.Num() && ItemDistances[NumHandedOff] >= SplineLength)
+	{
+		const FName ShapeName = RecipeSubsystem.IsValid() ? RecipeSubsystem->GetShapeNameById(ItemShapeIds[NumHandedOff]) : NAME_None;
+		if(!DestinationMachine.IsValid() || DestinationMachine->AddShapes(ShapeName, 1) == 0)
+		{
+			break;
+		}
+		++NumHandedOff;
+	}
+
+	if(NumHandedOff > 0)
+	{
+		ItemShapeIds.RemoveAt(0, NumHandedOff, false);
+		ItemDistances.RemoveAt(0, NumHandedOff, false);
+		bItemsChanged = true;
+	}
+}
+
+void AConveyorActor::AbsorbIntakeShapes()
+{
+	while(!IntakeShapes.IsEmpty() && CanPushItem())
+	{
+		// Shapes merged into another stack meanwhile are gone
+		const TWeakObjectPtr<AShapeActor> Shape = IntakeShapes[0];
+		if(!Shape.IsValid() || Shape->IsRetired())
+		{
+			IntakeShapes.RemoveAt(0);
+			continue;
+		}
+
+		// Shapes counted by a machine or reserved by a job belong to someone else
+		if(Shape->IsInInventory() || !RecipeSubsystem.IsValid() || Shape->IsClaimed(RecipeSubsystem->GetShapeClaims()))
+		{
+			IntakeShapes.RemoveAt(0);
+			continue;
+		}
+
+		if(!PushItem(Shape->GetShapeKey()))
+		{
+			IntakeShapes.RemoveAt(0);
+			continue;
+		}
+
+		// A stack is absorbed unit by unit, the rest waits at the intake for room on the belt
+		if(Shape->GetStackCount() > 1)
+		{
+			Shape->AddToStack(-1);
+			continue;
+		}
+
+		IntakeShapes.RemoveAt(0);
+		RecipeSubsystem->DestroyShape(*Shape);
+	}
+}
+
+void AConveyorActor::UpdateInstances()
+{
+	for(TPair<int32, TArray<FTransform>>& Pair : InstanceTransformsByShape)
+	{
+		Pair.Value.Reset();
+	}
+
+	// Items are bucketed by shape in a single pass, each of them is evaluated once along the spline
+	for(int32 ItemIndex = 0; ItemIndex < ItemShapeIds.Num(); ++ItemIndex)
+	{
+		InstanceTransformsByShape.FindOrAdd(ItemShapeIds[ItemIndex]).Add(Spline->GetTransformAtDistanceAlongSpline(ItemDistances[ItemIndex], ESplineCoordinateSpace::World));
+	}
+
+	// Buckets are kept once created, so that the instances of the shapes which left the belt are cleared
+	for(const TPair<int32, TArray<FTransform>>& Pair : InstanceTransformsByShape)
+	{
+		UInstancedStaticMeshComponent* Instances = GetOrCreateInstances(Pair.Key);
+		if(!Instances)
+		{
+			continue;
+		}
+
+		// Instances are only rebuilt when items were pushed or handed off, moved otherwise
+		const TArray<FTransform>& InstanceTransforms = Pair.Value;
+		if(Instances->GetInstanceCount() != InstanceTransforms.Num())
+		{
+			Instances->ClearInstances();
+			Instances->AddInstances(InstanceTransforms, false, true);
+		}
+		else if(!InstanceTransforms.IsEmpty())
+		{
+			Instances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+		}
+	}
+}
+
+UInstancedStaticMeshComponent* AConveyorActor::GetOrCreateInstances(int32 ShapeId)
+{
+	if(const TObjectPtr<UInstancedStaticMeshComponent>* Instances = InstancesByShape.Find(ShapeId))
+	{
+		return *Instances;
+	}
+
+	// Looks like the shape actor class, scale excepted. Items stay hidden while the class is streamed
+	const TSubclassOf<AShapeActor> ShapeClass = RecipeSubsystem.IsValid() ? RecipeSubsystem->GetShapeActorClassByName(RecipeSubsystem->GetShapeNameById(ShapeId)) : nullptr;
+	if(!ShapeClass)
+	{
+		return nullptr;
+	}
+
+	UInstancedStaticMeshComponent* Instances = NewObject<UInstancedStaticMeshComponent>(this);
+	Instances->SetupAttachment(Spline);
+	Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Instances->RegisterComponent();
+
+	const UStaticMeshComponent* ShapeMesh = ShapeClass->GetDefaultObject<AShapeActor>()->GetShapeMesh();
+	if(ShapeMesh)
+	{
+		Instances->SetStaticMesh(ShapeMesh->GetStaticMesh());
+		for(int32 MaterialIndex = 0; MaterialIndex < ShapeMesh->GetNumMaterials(); ++MaterialIndex)
+		{
+			Instances->SetMaterial(MaterialIndex, ShapeMesh->GetMaterial(MaterialIndex));
+		}
+	}
+
+	InstancesByShape.Add(ShapeId, Instances);
+	return Instances;
+}
+
+void AConveyorActor::OnIntakeBeginOverlap(
+	UPrimitiveComponent* OverlappedComponent,
+	AActor* OtherActor,
+	UPrimitiveComponent* OtherComp,
+	int32 OtherBodyIndex,
+	bool bFromSweep,
+	const FHitResult& SweepResult)
+{
+	AShapeActor* Shape = Cast<AShapeActor>(OtherActor);
+	if(!Shape || Shape->IsProvisional())
+	{
+		return;
+	}
+
+	IntakeShapes.AddUnique(Shape);
+	AbsorbIntakeShapes();
+}
+
+void AConveyorActor::OnIntakeEndOverlap(
+	UPrimitiveComponent* OverlappedComponent,
+	AActor* OtherActor,
+	UPrimitiveComponent* OtherComp,
+	int32 OtherBodyIndex)
+{
+	if(AShapeActor* Shape = Cast<AShapeActor>(OtherActor))
+	{
+		IntakeShapes.Remove(Shape);
+	}
+}
@@ -0,0 +1,231 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "ConveyorActor.generated.h"
+
+class AMachineActor;
+class AShapeActor;
+class URecipeSubsystem;
+class USphereComponent;
+class USplineComponent;
+class UInstancedStaticMeshComponent;
+
+/**
+ * Items of a belt as decided by the server, replicated to clients each time an item is pushed or handed off
+ */
+USTRUCT()
+struct FConveyorItemsSnapshot
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<uint16> ShapeIds;
+
+	UPROPERTY()
+	TArray<float> Distances;
+
+	/* Bumped with every snapshot, so that clients are notified even if the items look the same */
+	UPROPERTY()
+	uint32 Sequence = 0;
+};
+
+/**
+ * Belt moving shapes along a spline without any actor, items are handed to the destination machine inventory at its end.
+ *
+ * Items are stored as packed arrays of (shape id, distance along the spline) and rendered with one instanced mesh per shape.
+ * The server owns the items, clients move the replicated items between two snapshots for display only.
+ */
+UCLASS()
+class IB_TEST_API AConveyorActor : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AConveyorActor();
+
+	/**
+	 * @brief Puts a shape at the start of the belt, as an item without actor.
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @return False if the start of the belt is occupied or the shape is unknown.
+	 */
+	bool PushItem(const FName& ShapeName);
+
+	/**
+	 * @return True if the start of the belt has room for another item.
+	 */
+	bool CanPushItem() const;
+
+	/**
+	 * @brief Moves every item along the belt and hands the items reaching its end to the destination machine.
+	 *
+	 * Called by the conveyor subsystem, once per frame for every belt.
+	 *
+	 * @param DeltaTime Time elapsed since the last update.
+	 */
+	void AdvanceItems(float DeltaTime);
+
+	/**
+	 * @brief Moves the instanced meshes to the items position.
+	 */
+	void UpdateInstances();
+
+	/**
+	 * @return The number of items on the belt.
+	 */
+	int32 GetNumItems() const
+	{
+		return ItemShapeIds.Num();
+	}
+
+	/**
+	 * @return The machine receiving the items, nullptr if it isn't set or loaded.
+	 */
+	AMachineActor* GetDestinationMachine() const
+	{
+		return DestinationMachine.Get();
+	}
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	/**
+	 * Called on clients when the server pushed or handed off items
+	 */
+	UFUNCTION()
+	void OnRep_ItemsSnapshot();
+
+	/**
+	 * Called when a shape actor reaches the start of the belt
+	 */
+	UFUNCTION()
+	void OnIntakeBeginOverlap(
+		UPrimitiveComponent* OverlappedComponent,
+		AActor* OtherActor,
+		UPrimitiveComponent* OtherComp,
+		int32 OtherBodyIndex,
+		bool bFromSweep,
+		const FHitResult& SweepResult);
+
+	/**
+	 * Called when a shape actor leaves the start of the belt
+	 */
+	UFUNCTION()
+	void OnIntakeEndOverlap(
+		UPrimitiveComponent* OverlappedComponent,
+		AActor* OtherActor,
+		UPrimitiveComponent* OtherComp,
+		int32 OtherBodyIndex);
+
+	/**
+	 * Path of the belt, items go from the first to the last point.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Config")
+	USplineComponent* Spline;
+
+	/**
+	 * Shape actors overlapping it are turned into belt items.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Config")
+	USphereComponent* Intake;
+
+	/**
+	 * Machine receiving the items at the end of the belt, items wait at the end without one.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Config")
+	TSoftObjectPtr<AMachineActor> DestinationMachine;
+
+	/**
+	 * Speed of the items along the belt.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Config", meta = (ClampMin = "0", Units = "cm/s"))
+	float Speed = 200.f;
+
+	/**
+	 * Minimum distance between two items.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Config", meta = (ClampMin = "1", Units = "cm"))
+	float ItemSpacing = 50.f;
+
+private:
+	/**
+	 * Appends an item at the start of the belt.
+	 */
+	void AddItem(int32 ShapeId);
+
+	/**
+	 * Removes the items which reached the end of the belt, as long as the destination machine accepts them.
+	 */
+	void HandOffItems();
+
+	/**
+	 * Turns the waiting intake shapes into items while the belt has room.
+	 */
+	void AbsorbIntakeShapes();
+
+	/**
+	 * Copies the items into the replicated snapshot if they changed since the last one (server only).
+	 */
+	void UpdateItemsSnapshot();
+
+	/**
+	 * @return The instanced mesh of a shape, created the first time it is needed.
+	 */
+	UInstancedStaticMeshComponent* GetOrCreateInstances(int32 ShapeId);
+
+	/*
+	* Shape id of each item, the item closest to the end of the belt first
+	*/
+	TArray<uint16> ItemShapeIds;
+
+	/*
+	* Distance along the spline of each item, indexed like ItemShapeIds
+	*/
+	TArray<float> ItemDistances;
+
+	/*
+	* One instanced mesh per shape id
+	*/
+	UPROPERTY(Transient)
+	TMap<int32, TObjectPtr<UInstancedStaticMeshComponent>> InstancesByShape;
+
+	/*
+	* Shape actors at the start of the belt which couldn't be absorbed yet
+	*/
+	UPROPERTY(Transient)
+	TArray<TWeakObjectPtr<AShapeActor>> IntakeShapes;
+
+	/*
+	* Server items replicated to clients, only updated when items are pushed or handed off
+	*/
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_ItemsSnapshot)
+	FConveyorItemsSnapshot ItemsSnapshot;
+
+	/*
+	* True if items were pushed or handed off since the last snapshot
+	*/
+	bool bItemsChanged = false;
+
+	/*
+	* Scratch transforms of the items of each shape id, reused by UpdateInstances()
+	*/
+	TMap<int32, TArray<FTransform>> InstanceTransformsByShape;
+
+	/*
+	* Length of the spline, cached in BeginPlay()
+	*/
+	float SplineLength = 0.f;
+
+	/*
+	* Recipe subsystem simply stored in BeginPlay() to be easily accessed
+	*/
+	UPROPERTY(Transient)
+	TSoftObjectPtr<URecipeSubsystem> RecipeSubsystem;
+};
@@ -2,15 +2,34 @@
 
 #include "MachineActor.h"
 
+#include "Algo/Count.h"
 #include "IB_Test/Utilities/HelperClass.h"
+#include "IB_Test/Settings/RecipeSettings.h"
+#include "ConveyorActor.h"
 #include "IB_Test/Datas/RecipeData.h"
+#include "IB_Test/Subsystems/ProductionPlannerSubsystem.h"
 #include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "IB_Test/Subsystems/SimulationLodSubsystem.h"
+#include "Net/UnrealNetwork.h"
 #include "ShapeActor.h"
 
+int32 FShapeCollection::Num() const
+{
+	int32 NumShapes = 0;
+	for(const TSoftObjectPtr<AShapeActor>& Shape : Shapes)
+	{
+		NumShapes += Shape.IsValid() ? Shape->GetStackCount() : 0;
+	}
+	return NumShapes;
+}
+
 AMachineActor::AMachineActor()
 {
 	PrimaryActorTick.bCanEverTick = false;
 
+	// Machines are server-authoritative, clients receive the recipe states and conversion events
+	bReplicates = true;
+
 	MachineMesh = CreateDefaultSubobject<UStaticMeshComponent>(FName("MachineMesh"));
 	SetRootComponent(MachineMesh);
 
@@ -19,10 +38,39 @@ AMachineActor::AMachineActor()
 	Collider->InitSphereRadius(200.f);	
 }
 
+void AMachineActor::SetupMachine(const FText& InMachineName, const TArray<FText>& InAffectedRecipes, EMachineOutputTarget InOutputTarget)
+{
+	if(!ensure(!HasActorBegunPlay()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("AMachineActor::SetupMachine - Machine %s already began play"), *GetMachineName());
+		return;
+	}
+
+	MachineName = InMachineName;
+	AffectedRecipes = InAffectedRecipes;
+	OutputTarget = InOutputTarget;
+}
+
+void AMachineActor::SetupPipeline(ERecipeAllocationMode InAllocationMode, int32 InParallelSlots, int32 InInputBufferCapacity, int32 InOutputBufferCapacity, float InOutputInterval)
+{
+	if(!ensure(!HasActorBegunPlay()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("AMachineActor::SetupPipeline - Machine %s already began play"), *GetMachineName());
+		return;
+	}
+
+	AllocationMode = InAllocationMode;
+	ParallelSlots = FMath::Max(InParallelSlots, 1);
+	InputBufferCapacity = FMath::Max(InInputBufferCapacity, 0);
+	OutputBufferCapacity = FMath::Max(InOutputBufferCapacity, 0);
+	OutputInterval = FMath::Max(InOutputInterval, 0.f);
+}
+
 TArray<URecipeDataItem*> AMachineActor::GetRecipeEntries() const
 {
 	TArray<URecipeDataItem*> RecipeEntries = {};
-	for(const TPair<FName, URecipeDataItem*> Pair : RecipeDataEntries)
+	RecipeEntries.Reserve(RecipeDataEntries.Num());
+	for(const TPair<FName, URecipeDataItem*>& Pair : RecipeDataEntries)
 	{
 		RecipeEntries.AddUnique(Pair.Value);
 	}
@@ -31,17 +79,75 @@ TArray<URecipeDataItem*> AMachineActor::GetRecipeEntries() const
 
 bool AMachineActor::SetRecipeAvailability(const FText& RecipeName, bool bIsActivated)
 {
-	URecipeDataItem* RecipeDataEntry = RecipeDataEntries.FindChecked(UHelperClass::ConvertToName(RecipeName));
-	if(!ensure(RecipeDataEntry))
+	const FName RecipeKey = UHelperClass::ConvertToName(RecipeName);
+
+	// Not ensured, the recipe name may come from a client request
+	URecipeDataItem** RecipeDataEntry = RecipeDataEntries.Find(RecipeKey);
+	if(!RecipeDataEntry || !*RecipeDataEntry)
 	{
 		UE_LOG(LogTemp, Error, TEXT("AMachineActor::SetRecipeAvailability - Couldn't Find Recipe %s"), *RecipeName.ToString());
 		return false;
 	}
 	
-	RecipeDataEntry->bIsActivated = bIsActivated;
+	(*RecipeDataEntry)->bIsActivated = bIsActivated;
+	MarkRecipesChanged();
+
+	// Only the server is allowed to change the replicated state, clients are only predicting it
+	if(HasAuthority())
+	{
+		FMachineRecipeState* RecipeState = RecipeStates.FindByPredicate([&RecipeKey](const FMachineRecipeState& State)
+		{
+			return State.RecipeName == RecipeKey;
+		});
+		if(ensure(RecipeState))
+		{
+			RecipeState->bIsActivated = bIsActivated;
+		}
+	}
 	return true;
 }
 
+void AMachineActor::ApplyAuthoritativeRecipeStates()
+{
+	for(const FMachineRecipeState& RecipeState : RecipeStates)
+	{
+		URecipeDataItem** RecipeDataEntry = RecipeDataEntries.Find(RecipeState.RecipeName);
+		if(RecipeDataEntry && *RecipeDataEntry)
+		{
+			(*RecipeDataEntry)->bIsActivated = RecipeState.bIsActivated;
+		}
+	}
+}
+
+void AMachineActor::MulticastConversionPerformed_Implementation(int32 ConversionId, APlayerState* PredictingPlayer, int32 PredictionKey, bool bIsOutputStacked)
+{
+	// The server already spawned the output and its VFX
+	if(HasAuthority() || !RecipeSubsystem.IsValid())
+	{
+		return;
+	}
+
+	RecipeSubsystem->HandleRemoteConversion(*this, ConversionId, PredictingPlayer, PredictionKey, bIsOutputStacked);
+}
+
+void AMachineActor::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AMachineActor, RecipeStates);
+}
+
+void AMachineActor::OnRep_RecipeStates()
+{
+	ApplyAuthoritativeRecipeStates();
+
+	// Predicted toggles not yet acknowledged by the server stay applied on top of the replicated state
+	if(RecipeSubsystem.IsValid())
+	{
+		RecipeSubsystem->ReapplyPredictedToggles(*this);
+	}
+}
+
 void AMachineActor::BeginPlay()
 {
 	Super::BeginPlay();
@@ -52,6 +158,13 @@ void AMachineActor::BeginPlay()
 		UE_LOG(LogTemp, Error, TEXT("AMachineActor::BeginPlay - World is nullptr. Failed to proceed in BeginPlay"));
 		return;
 	}
+
+	// Machines spawned after the world began play are managed too, unregistered in EndPlay()
+	if(USimulationLodSubsystem* SimulationLodSubsystem = HasAuthority() ? World->GetSubsystem<USimulationLodSubsystem>() : nullptr)
+	{
+		SimulationLodSubsystem->RegisterMachine(*this);
+	}
+
 	if(AffectedRecipes.IsEmpty())
 	{
 		UE_LOG(LogTemp, Warning, TEXT("AMachineActor::BeginPlay - No recipes provided in AffectedRecipes for Machine %s"), *GetName());
@@ -63,44 +176,117 @@ void AMachineActor::BeginPlay()
 	if(RecipeSubsystem.IsValid())
 	{
 		// Cache RecipeData for the Recipes associated with this machine.
-		TArray<FRecipeData> RecipesData = RecipeSubsystem->GetRecipeDataByNames(AffectedRecipes);
-
-		for(const FRecipeData RecipeData : RecipesData)
+		for(const FText& AffectedRecipe : AffectedRecipes)
 		{
+			const FRecipeData* RecipeData = RecipeSubsystem->FindRecipeData(UHelperClass::ConvertToName(AffectedRecipe));
+			if(!RecipeData)
+			{
+				UE_LOG(LogTemp, Error, TEXT("AMachineActor::BeginPlay - Couldn't Find Recipe %s for Machine %s"), *AffectedRecipe.ToString(), *GetName());
+				continue;
+			}
+
 			URecipeDataItem* RecipeItem = NewObject<URecipeDataItem>(this);
-			RecipeItem->Initialize(RecipeData.Name, RecipeData.InputShape, RecipeData.OutputShape);
+			InitializeRecipeEntry(*RecipeItem, *RecipeData);
 			
-			RecipeDataEntries.Add(UHelperClass::ConvertToName(RecipeData.Name), RecipeItem);
+			RecipeDataEntries.Add(RecipeItem->NameKey, RecipeItem);
+
+			if(HasAuthority())
+			{
+				RecipeStates.Emplace(RecipeItem->NameKey, RecipeItem->bIsActivated);
+			}
 		}
+
+		// The allocation modes break ties by recipe order, which must not depend on the DataTable order
+		RecipeDataEntries.KeySort(FNameLexicalLess());
+	}
+
+	// The replicated states may have been received before the entries were created
+	if(!HasAuthority())
+	{
+		ApplyAuthoritativeRecipeStates();
+		return;
 	}
 
 	// Populate the NearbyShapes array with keys for each possible Shape.
+	// Stored counts get the same keys, so conversions never grow the map
 	for(const FName& ShapeName : RecipeSubsystem->GetAllShapeNames())
 	{
 		NearbyShapes.Add(ShapeName);
+		StoredShapes.Add(ShapeName, 0);
 	}
 	
 	Collider->OnComponentBeginOverlap.AddDynamic(this, &AMachineActor::OnColliderBeginOverlap);
 	Collider->OnComponentEndOverlap.AddDynamic(this, &AMachineActor::OnColliderEndOverlap);
 }
 
+void AMachineActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	ResetPipeline();
+
+	if(USimulationLodSubsystem* SimulationLodSubsystem = GetWorld() ? GetWorld()->GetSubsystem<USimulationLodSubsystem>() : nullptr)
+	{
+		SimulationLodSubsystem->UnregisterMachine(*this);
+	}
+
+	// The shapes left in the inventory are loose again and can be claimed by another machine
+	if(RecipeSubsystem.IsValid())
+	{
+		for(const TPair<FName, FShapeCollection>& Pair : NearbyShapes)
+		{
+			for(const TSoftObjectPtr<AShapeActor>& Shape : Pair.Value.Shapes)
+			{
+				if(Shape.IsValid())
+				{
+					Shape->LeaveInventory(*this);
+					ReleaseClaim(*Shape);
+				}
+			}
+		}
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 bool AMachineActor::DestroyShapeByName(const FName& ShapeName)
 {
+	// Stored shapes have no actor, consuming them is just a decrement
+	int32* StoredCount = StoredShapes.Find(ShapeName);
+	if(StoredCount && *StoredCount > 0)
+	{
+		--(*StoredCount);
+		MarkInventoryChanged(ShapeName, -1);
+		return true;
+	}
+
 	FShapeCollection* ShapeCollection = NearbyShapes.Find(ShapeName);
-	if(!ensure(ShapeCollection))
+	if(!ensure(ShapeCollection && ShapeCollection->Shapes.Num() > 0))
 	{
 		return false;
 	}
 
+	// A stack only loses a unit, its actor stays in the inventory
+	AShapeActor* LastShape = ShapeCollection->Shapes.Last().Get();
+	if(LastShape && LastShape->GetStackCount() > 1)
+	{
+		LastShape->AddToStack(-1);
+		MarkInventoryChanged(ShapeName, -1);
+		return true;
+	}
+
 	// We first remove the Shape from NearbyShapes
 	TSoftObjectPtr<AShapeActor> ShapeToDestroy = ShapeCollection->Shapes.Pop();
+	if(!ShapeToDestroy.IsValid())
+	{
+		return false;
+	}
+	MarkInventoryChanged(ShapeName, -1);
 
-	// Then we destroy it
-	return ShapeToDestroy->Destroy();
-
+	// Then we destroy it, the claim is kept until the queued destruction so no other machine can count it meanwhile
+	RecipeSubsystem->DestroyShape(*ShapeToDestroy);
+	return true;
 }
 
-bool AMachineActor::DestroyShapesByName(const TArray<FName>& ShapeNames)
+bool AMachineActor::DestroyShapesByName(TConstArrayView<FName> ShapeNames)
 {
 	bool ShapeAllDestroyed = true;
 	for(const FName& ShapeName : ShapeNames)
@@ -115,104 +301,1403 @@ void AMachineActor::ProceedValidRecipe(const URecipeDataItem& Recipe)
 {
 	if(DoesRecipeHaveAllInputShapes(Recipe) && Recipe.bIsActivated)
 	{
-		DestroyShapesByName(UHelperClass::ConvertToNames(Recipe.InputNames));
-			
-		RecipeSubsystem->SpawnShapeByName(UHelperClass::ConvertToName(Recipe.OutputShape), *this);
+		if(Recipe.Duration > 0.f)
+		{
+			StartJob(Recipe);
+			return;
+		}
+
+		ConvertRecipe(Recipe);
 	}
 }
 
-void AMachineActor::ProcessValidRecipes()
+void AMachineActor::ConvertRecipe(const URecipeDataItem& Recipe)
 {
-	for(const TPair<FName, URecipeDataItem*> Pair : RecipeDataEntries)
+	FRecipeInputs Inputs = {};
+	if(!GetRecipeInputs(Recipe, Inputs) || !DestroyShapesByName(Inputs))
+	{
+		UE_LOG(LogTemp, Error, TEXT("AMachineActor::ConvertRecipe - Missing inputs for recipe %s on machine %s"), *Recipe.NameKey.ToString(), *GetMachineName());
+		return;
+	}
+
+	if(DeliverOutput(Recipe.OutputKey))
 	{
-		ProceedValidRecipe(*Pair.Value);
+		RecipeSubsystem->OnRecipeConverted.Broadcast(*this, Recipe.NameKey, Inputs);
 	}
 }
 
-bool AMachineActor::DoesRecipeHaveAllInputShapes(const URecipeDataItem& RecipeData) const
+void AMachineActor::ProcessValidRecipes()
 {
-	if(!ensure(RecipeData.InputNames.Num() > 0))
+	// Conversions are server-authoritative
+	if(!HasAuthority())
 	{
-		UE_LOG(LogTemp, Error, TEXT("AMachineActor::AreAllShapesInRecipe - No InputShape provided for recipe : %s"), *(RecipeData.Name.ToString()));
-		return false;
+		return;
 	}
-	
-	for (const FText& ShapeName : RecipeData.InputNames)
+
+	// Distant machines wait for their next coarse step
+	if(SimulationLod == EMachineSimulationLod::Analytical)
+	{
+		bHasPendingEvaluation = true;
+		return;
+	}
+
+	// Runs until a fixed point: cascaded outputs may complete another recipe, consumed inputs make room for the shapes waiting outside
+	const int32 MaxCascadePasses = GetDefault<URecipeSettings>()->MaxCascadePasses;
+	for(int32 Pass = 0; Pass < MaxCascadePasses; ++Pass)
 	{
-		const FShapeCollection* ShapeCollection = NearbyShapes.Find(UHelperClass::ConvertToName(ShapeName));
-		if(!ensure(ShapeCollection))
+		const int32 PreviousNumCascadedOutputs = NumCascadedOutputs;
+		ProcessAllocationPass();
+
+		if(NumCascadedOutputs == PreviousNumCascadedOutputs && AdmitWaitingShapes() == 0)
 		{
-			UE_LOG(LogTemp, Error, TEXT("AMachineActor::AreAllShapesInRecipe - Unknown shape : %s"), *ShapeName.ToString());
-			return false;
+			return;
 		}
+	}
 
-		// We return as soon as we notice that we are missing a shape for the recipe
-		if(ShapeCollection->Shapes.Num() == 0)
+	UE_LOG(LogTemp, Warning, TEXT("AMachineActor::ProcessValidRecipes - No fixed point after %d passes on machine %s, check its recipes for cycles"), MaxCascadePasses, *GetMachineName());
+}
+
+void AMachineActor::ProcessAllocationPass()
+{
+	// A conversion feeding another machine starts a nested pass there, which gets its own frame
+	FRecipeScratchArena::FScope Scratch(RecipeSubsystem->GetRecipeScratch());
+	BuildAllocation(*Scratch);
+
+	for(int32 RecipeIndex = 0; RecipeIndex < Scratch->CandidateRecipes.Num(); ++RecipeIndex)
+	{
+		// Each conversion re-checks its inputs, an output shape may have started another pass meanwhile
+		for(int32 Batch = 0; Batch < Scratch->Batches[RecipeIndex]; ++Batch)
 		{
-			return false;
+			ProceedValidRecipe(*Scratch->CandidateRecipes[RecipeIndex]);
 		}
 	}
+}
 
-	return true;
+void AMachineActor::ProcessAnalyticalPass()
+{
+	FRecipeScratchArena::FScope Scratch(RecipeSubsystem->GetRecipeScratch());
+	BuildAllocation(*Scratch);
+
+	for(int32 RecipeIndex = 0; RecipeIndex < Scratch->CandidateRecipes.Num(); ++RecipeIndex)
+	{
+		const URecipeDataItem& Recipe = *Scratch->CandidateRecipes[RecipeIndex];
+		int32 NumBatches = Scratch->Batches[RecipeIndex];
+		if(Recipe.Duration > 0.f)
+		{
+			// The conversions not affordable this step are evaluated again at the next one
+			const int32 NumAffordable = FMath::FloorToInt(AnalyticalSlotSeconds / Recipe.Duration);
+			bHasPendingEvaluation |= NumAffordable < NumBatches;
+			NumBatches = FMath::Min(NumBatches, NumAffordable);
+			AnalyticalSlotSeconds -= NumBatches * Recipe.Duration;
+		}
+
+		for(int32 Batch = 0; Batch < NumBatches && DoesRecipeHaveAllInputShapes(Recipe); ++Batch)
+		{
+			ConvertRecipe(Recipe);
+		}
+	}
 }
 
-void AMachineActor::OnColliderBeginOverlap(
-	UPrimitiveComponent* OverlappedComponent,
-	AActor* OtherActor,
-	UPrimitiveComponent* OtherComp,
-	int32 OtherBodyIndex,
-	bool bFromSweep,
-	const FHitResult& SweepResult)
+void AMachineActor::AdvanceAnalytically(float DeltaSeconds)
 {
-	if(OtherActor == nullptr)
+	if(!HasAuthority() || SimulationLod != EMachineSimulationLod::Analytical)
 	{
 		return;
 	}
-	
-	const AShapeActor* Shape = Cast<AShapeActor>(OtherActor);
-	if(!Shape)
+
+	// Idle slots don't bank any time
+	if(!bHasPendingEvaluation)
 	{
+		AnalyticalSlotSeconds = 0.f;
 		return;
 	}
-	
-	FShapeCollection* ShapeCollection = NearbyShapes.Find(UHelperClass::ConvertToName(Shape->GetShapeName()));
-	if(!ensure(ShapeCollection))
+	bHasPendingEvaluation = false;
+	AnalyticalSlotSeconds += ParallelSlots * DeltaSeconds;
+
+	const int32 MaxCascadePasses = GetDefault<URecipeSettings>()->MaxCascadePasses;
+	for(int32 Pass = 0; Pass < MaxCascadePasses; ++Pass)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("AMachineActor::OnColliderBeginOverlap - Unknown shape : %s. It's likely that the shape was forgotten to be added in the data table."), *Shape->GetShapeName().ToString());
-		return;
+		const int32 PreviousNumCascadedOutputs = NumCascadedOutputs;
+		ProcessAnalyticalPass();
+
+		if(NumCascadedOutputs == PreviousNumCascadedOutputs && AdmitWaitingShapes() == 0)
+		{
+			break;
+		}
+	}
+
+	if(!bHasPendingEvaluation)
+	{
+		AnalyticalSlotSeconds = 0.f;
 	}
-	
-	// Add the Detected Shape in the NearbyShapes
-	ShapeCollection->Shapes.Add(Shape);
-	
-	// Look up if there is enough ingredients for a valid recipe
-	ProcessValidRecipes();
 }
 
-void AMachineActor::OnColliderEndOverlap(
-	UPrimitiveComponent* OverlappedComponent,
-	AActor* OtherActor,
-	UPrimitiveComponent* OtherComp,
-	int32 OtherBodyIndex)
+void AMachineActor::SetSimulationLod(EMachineSimulationLod InSimulationLod)
 {
-	if(OtherActor == nullptr)
+	if(!HasAuthority() || SimulationLod == InSimulationLod)
 	{
 		return;
 	}
-	
-	AShapeActor* Shape = Cast<AShapeActor>(OtherActor);
-	if(!Shape)
+
+	const EMachineSimulationLod PreviousLod = SimulationLod;
+	SimulationLod = InSimulationLod;
+
+	if(PreviousLod == EMachineSimulationLod::Full)
 	{
-		return;
+		DematerializeInventory();
+	}
+	else if(SimulationLod == EMachineSimulationLod::Full)
+	{
+		MaterializeProducts();
 	}
 
-	FShapeCollection* ShapeCollection = NearbyShapes.Find(UHelperClass::ConvertToName(Shape->GetShapeName()));
-	if(!ensure(ShapeCollection))
+	// Conversions deferred to the next coarse step are run right away
+	if(PreviousLod == EMachineSimulationLod::Analytical)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("AMachineActor::OnColliderEndOverlap - Unknown shape : %s. It's likely that the shape was forgotten to be added in the data table."), *Shape->GetShapeName().ToString());
+		AnalyticalSlotSeconds = 0.f;
+		if(bHasPendingEvaluation)
+		{
+			bHasPendingEvaluation = false;
+			ProcessValidRecipes();
+		}
+	}
+}
+
+void AMachineActor::DematerializeInventory()
+{
+	// The destroyed shapes must not leave the inventory through the collider
+	TGuardValue<bool> OverlapGuard(bIsOverlapProcessingEnabled, false);
+
+	for(TPair<FName, FShapeCollection>& Pair : NearbyShapes)
+	{
+		for(const TSoftObjectPtr<AShapeActor>& Shape : Pair.Value.Shapes)
+		{
+			if(Shape.IsValid())
+			{
+				StoredShapes.FindOrAdd(Pair.Key) += Shape->GetStackCount();
+				RecipeSubsystem->DestroyShape(*Shape);
+			}
+		}
+		Pair.Value.Shapes.Reset();
+	}
+}
+
+void AMachineActor::MaterializeProducts()
+{
+	TArray<TPair<FName, int32>, TInlineAllocator<16>> Products = {};
+	for(const TPair<FName, int32>& StoredShape : StoredShapes)
+	{
+		// Intermediate shapes are converted again anyway, only the products are visible in a fully simulated machine
+		if(StoredShape.Value > 0 && !IsConsumedByRecipes(StoredShape.Key))
+		{
+			Products.Emplace(StoredShape.Key, StoredShape.Value);
+		}
+	}
+
+	const int32 MaterializeLimit = GetDefault<URecipeSettings>()->PromotionMaterializeLimit;
+	for(const TPair<FName, int32>& Product : Products)
+	{
+		MaterializeShapes(Product.Key, FMath::Min(Product.Value, MaterializeLimit));
+	}
+}
+
+void AMachineActor::BuildAllocation(FRecipeScratchFrame& Scratch)
+{
+	// Only activated recipes compete, shapes are mapped to local indices for the allocator
+	FRecipeInputs Inputs = {};
+	for(const TPair<FName, URecipeDataItem*>& Pair : RecipeDataEntries)
+	{
+		// Wildcard ingredients compete as the shapes they resolve to now
+		if(!Pair.Value->bIsActivated || !Pair.Value->HasInputs() || !GetRecipeInputs(*Pair.Value, Inputs))
+		{
+			continue;
+		}
+
+		FAllocationRecipe& AllocationRecipe = Scratch.AllocationRecipes.AddDefaulted_GetRef();
+		AllocationRecipe.Priority = Pair.Value->Priority;
+		AllocationRecipe.Weight = Pair.Value->Weight;
+		AllocationRecipe.Value = RecipeSubsystem->GetShapeValue(Pair.Value->OutputKey);
+		for(const FName& ShapeName : Inputs)
+		{
+			int32 ShapeIndex = Scratch.LocalShapeNames.Find(ShapeName);
+			if(ShapeIndex == INDEX_NONE)
+			{
+				ShapeIndex = Scratch.LocalShapeNames.Add(ShapeName);
+				Scratch.ShapeCounts.Add(GetShapeCount(ShapeName));
+			}
+
+			TPair<int32, int32>* Requirement = AllocationRecipe.Requirements.FindByPredicate([ShapeIndex](const TPair<int32, int32>& Item)
+			{
+				return Item.Key == ShapeIndex;
+			});
+			if(Requirement)
+			{
+				++Requirement->Value;
+			}
+			else
+			{
+				AllocationRecipe.Requirements.Emplace(ShapeIndex, 1);
+			}
+		}
+		Scratch.CandidateRecipes.Add(Pair.Value);
+	}
+
+	FRecipeAllocator::Allocate(AllocationMode, Scratch.AllocationRecipes, Scratch.ShapeCounts, RoundRobinCursor, Scratch.Batches);
+}
+
+bool AMachineActor::StartJob(const URecipeDataItem& Recipe)
+{
+	if(Jobs.Num() >= ParallelSlots)
+	{
+		return false;
+	}
+
+	FRecipeInputs Inputs = {};
+	if(!GetRecipeInputs(Recipe, Inputs) || !DestroyShapesByName(Inputs))
+	{
+		UE_LOG(LogTemp, Error, TEXT("AMachineActor::StartJob - Missing inputs for recipe %s on machine %s"), *Recipe.NameKey.ToString(), *GetMachineName());
+		return false;
+	}
+
+	FMachineJob& Job = Jobs.AddDefaulted_GetRef();
+	Job.Inputs = MoveTemp(Inputs);
+	Job.JobId = NextJobId++;
+	Job.RecipeName = Recipe.NameKey;
+	Job.OutputShape = Recipe.OutputKey;
+	Job.TimerHandle = RecipeSubsystem->ScheduleMachineTimer(*this, Job.JobId, Recipe.Duration);
+	return true;
+}
+
+bool AMachineActor::StartOrderedJob(const FName& RecipeName, TConstArrayView<FName> InventoryInputs, int32 OrderTaskId)
+{
+	const URecipeDataItem* Recipe = GetRecipeEntry(RecipeName);
+	if(!HasAuthority() || !Recipe || !Recipe->bIsActivated || !HasIdleSlot())
+	{
+		return false;
+	}
+
+	// Wildcard ingredients are always taken from the inventory
+	FRecipeInputs Inputs(InventoryInputs);
+	if(!ResolveInputQueries(*Recipe, Inputs))
+	{
+		return false;
+	}
+
+	for(const FName& InputName : Inputs)
+	{
+		if(GetShapeCount(InputName) < Algo::Count(Inputs, InputName))
+		{
+			return false;
+		}
+	}
+
+	if(!DestroyShapesByName(Inputs))
+	{
+		UE_LOG(LogTemp, Error, TEXT("AMachineActor::StartOrderedJob - Missing inputs for recipe %s on machine %s"), *RecipeName.ToString(), *GetMachineName());
+		return false;
+	}
+
+	FMachineJob Job;
+	Job.Inputs = Recipe->InputKeys;
+	Job.Inputs.Append(Inputs.GetData() + InventoryInputs.Num(), Inputs.Num() - InventoryInputs.Num());
+	Job.JobId = NextJobId++;
+	Job.RecipeName = RecipeName;
+	Job.OutputShape = Recipe->OutputKey;
+	Job.OrderTaskId = OrderTaskId;
+	if(Recipe->Duration <= 0.f)
+	{
+		EmitOutput(Job);
+		return true;
+	}
+
+	Job.TimerHandle = RecipeSubsystem->ScheduleMachineTimer(*this, Job.JobId, Recipe->Duration);
+	Jobs.Add(Job);
+	return true;
+}
+
+void AMachineActor::OnMachineTimerExpired(int32 JobId)
+{
+	if(JobId == DwellTimerId)
+	{
+		DwellTimerHandle.Invalidate();
+		UpdateShapeCandidates();
 		return;
 	}
-	
-	// Remove the previously Detected Shape in the NearbyShapes
-	ShapeCollection->Shapes.RemoveSingle(Shape);
+
+	if(JobId == INDEX_NONE)
+	{
+		EmitTimerHandle.Invalidate();
+	}
+	else if(FMachineJob* Job = Jobs.FindByPredicate([JobId](const FMachineJob& Item) { return Item.JobId == JobId; }))
+	{
+		Job->TimerHandle.Invalidate();
+		Job->bIsFinished = true;
+	}
+
+	AdvancePipeline();
+}
+
+void AMachineActor::AdvancePipeline()
+{
+	// Emitting makes room for finished jobs, which make room for their outputs to be emitted
+	int32 NumMoved = 0;
+	do
+	{
+		NumMoved = FlushFinishedJobs();
+		NumMoved += EmitOutputs();
+	}
+	while(NumMoved > 0);
+
+	ProcessValidRecipes();
+}
+
+int32 AMachineActor::FlushFinishedJobs()
+{
+	int32 NumFlushed = 0;
+	for(int32 JobIndex = 0; JobIndex < Jobs.Num(); ++JobIndex)
+	{
+		if(OutputBufferCapacity > 0 && OutputBuffer.Num() >= OutputBufferCapacity)
+		{
+			break;
+		}
+
+		if(Jobs[JobIndex].bIsFinished)
+		{
+			OutputBuffer.Add(Jobs[JobIndex]);
+			Jobs.RemoveAt(JobIndex--);
+			++NumFlushed;
+		}
+	}
+	return NumFlushed;
+}
+
+int32 AMachineActor::EmitOutputs()
+{
+	int32 NumEmitted = 0;
+	while(!OutputBuffer.IsEmpty() && !EmitTimerHandle.IsValid())
+	{
+		// Popped before spawning, the spawned output may start another pass on this machine
+		const FMachineJob Job = OutputBuffer[0];
+		OutputBuffer.RemoveAt(0);
+		++NumEmitted;
+
+		if(OutputInterval > 0.f)
+		{
+			EmitTimerHandle = RecipeSubsystem->ScheduleMachineTimer(*this, INDEX_NONE, OutputInterval);
+		}
+		EmitOutput(Job);
+	}
+	return NumEmitted;
+}
+
+void AMachineActor::EmitOutput(const FMachineJob& Job)
+{
+	// Intermediate products of an order are kept by the planner for the conversion consuming them
+	UProductionPlannerSubsystem* ProductionPlanner = Job.OrderTaskId != INDEX_NONE ? GetWorld()->GetSubsystem<UProductionPlannerSubsystem>() : nullptr;
+	if(ProductionPlanner && ProductionPlanner->CompleteTask(Job.OrderTaskId))
+	{
+		RecipeSubsystem->OnRecipeConverted.Broadcast(*this, Job.RecipeName, Job.Inputs);
+		return;
+	}
+
+	if(DeliverOutput(Job.OutputShape))
+	{
+		RecipeSubsystem->OnRecipeConverted.Broadcast(*this, Job.RecipeName, Job.Inputs);
+	}
+}
+
+bool AMachineActor::DeliverOutput(const FName& OutputShape)
+{
+	switch(OutputTarget)
+	{
+	case EMachineOutputTarget::Machine:
+		if(OutputMachine.IsValid() && OutputMachine.Get() != this && OutputMachine->AddShapes(OutputShape, 1) == 1)
+		{
+			return true;
+		}
+		break;
+	case EMachineOutputTarget::Conveyor:
+		if(OutputConveyor.IsValid() && OutputConveyor->PushItem(OutputShape))
+		{
+			return true;
+		}
+		break;
+	case EMachineOutputTarget::Sink:
+		RecipeSubsystem->AddToSink(OutputShape, 1);
+		return true;
+	case EMachineOutputTarget::World:
+	{
+		// Every known shape has a key, an unknown output is spawned
+		int32* StoredCount = StoredShapes.Find(OutputShape);
+		if(!StoredCount)
+		{
+			break;
+		}
+
+		// A spawned output would enter the inventory again and be converted frames later, it is kept as a count instead
+		if(IsConsumedByRecipes(OutputShape))
+		{
+			++(*StoredCount);
+			++NumCascadedOutputs;
+			MarkInventoryChanged(OutputShape, 1);
+			RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Arrive, OutputShape);
+			return true;
+		}
+
+		// No player is close enough to see the output
+		if(SimulationLod != EMachineSimulationLod::Full)
+		{
+			++(*StoredCount);
+			MarkInventoryChanged(OutputShape, 1);
+			RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Arrive, OutputShape);
+			return true;
+		}
+		break;
+	}
+	}
+
+	// The inputs are already consumed, a refused output is materialized rather than lost
+	return RecipeSubsystem->SpawnConversionOutput(OutputShape, *this) != INDEX_NONE;
+}
+
+int32 AMachineActor::FastForward(float ElapsedSeconds, const TMap<FName, float>& SupplyRates, const TMap<FName, int32>& SuppliedShapes, TMap<FName, int32>& OutProducts)
+{
+	if(!HasAuthority() || ElapsedSeconds <= 0.f)
+	{
+		return 0;
+	}
+
+	// Shapes resting in the collider or waiting outside would be captured during the period, the input buffer is ignored.
+	// Shapes owned by another machine keep waiting
+	RecipeSubsystem->CancelMachineTimer(DwellTimerHandle);
+	DwellTimerHandle.Invalidate();
+	for(const FShapeCandidate& Candidate : ShapeCandidates)
+	{
+		AShapeActor* Shape = Candidate.Shape.Get();
+		if(Shape && !Shape->IsRetired() && !AddToInventory(*Shape) && !WaitingShapes.Contains(Shape))
+		{
+			WaitingShapes.Add(Shape);
+			Shape->SetWaiting(true);
+		}
+	}
+	ShapeCandidates.Reset();
+	for(int32 ShapeIndex = 0; ShapeIndex < WaitingShapes.Num(); ++ShapeIndex)
+	{
+		AShapeActor* Shape = WaitingShapes[ShapeIndex].Get();
+		if(!Shape || Shape->IsRetired() || AddToInventory(*Shape))
+		{
+			if(Shape)
+			{
+				Shape->SetWaiting(false);
+			}
+			WaitingShapes.RemoveAt(ShapeIndex--);
+		}
+	}
+	DematerializeInventory();
+
+	// Fast-forwarded periods are long, every job is done. Popped first, completing an order may start the next one here
+	TArray<FMachineJob> FinishedJobs = MoveTemp(OutputBuffer);
+	FinishedJobs.Append(MoveTemp(Jobs));
+	OutputBuffer.Reset();
+	Jobs.Reset();
+	RecipeSubsystem->CancelMachineTimer(EmitTimerHandle);
+	EmitTimerHandle.Invalidate();
+
+	UProductionPlannerSubsystem* ProductionPlanner = GetWorld()->GetSubsystem<UProductionPlannerSubsystem>();
+	TMap<FName, int32> Produced = {};
+	for(FMachineJob& Job : FinishedJobs)
+	{
+		RecipeSubsystem->CancelMachineTimer(Job.TimerHandle);
+
+		// Intermediate products of an order are kept by the planner, like an emitted output
+		const bool bIsKeptByPlanner = Job.OrderTaskId != INDEX_NONE && ProductionPlanner && ProductionPlanner->CompleteTask(Job.OrderTaskId);
+		if(!bIsKeptByPlanner)
+		{
+			++Produced.FindOrAdd(Job.OutputShape);
+		}
+		RecipeSubsystem->OnRecipeConverted.Broadcast(*this, Job.RecipeName, Job.Inputs);
+	}
+
+	for(const TPair<FName, float>& SupplyRate : SupplyRates)
+	{
+		if(NearbyShapes.Contains(SupplyRate.Key))
+		{
+			StoredShapes.FindOrAdd(SupplyRate.Key) += FMath::FloorToInt(SupplyRate.Value * ElapsedSeconds);
+		}
+	}
+	for(const TPair<FName, int32>& SuppliedShape : SuppliedShapes)
+	{
+		if(NearbyShapes.Contains(SuppliedShape.Key))
+		{
+			StoredShapes.FindOrAdd(SuppliedShape.Key) += SuppliedShape.Value;
+		}
+	}
+
+	// Each pass converts every batch the allocation grants at once, further passes only handle cascaded outputs
+	int32 NumConversions = 0;
+	float SlotSeconds = ParallelSlots * ElapsedSeconds;
+	const int32 MaxCascadePasses = GetDefault<URecipeSettings>()->MaxCascadePasses;
+	for(int32 Pass = 0; Pass < MaxCascadePasses; ++Pass)
+	{
+		for(TPair<FName, int32>& Pair : Produced)
+		{
+			if(Pair.Value > 0 && IsConsumedByRecipes(Pair.Key))
+			{
+				StoredShapes.FindOrAdd(Pair.Key) += Pair.Value;
+				Pair.Value = 0;
+			}
+		}
+
+		FRecipeScratchArena::FScope Scratch(RecipeSubsystem->GetRecipeScratch());
+		BuildAllocation(*Scratch);
+
+		int32 NumPassConversions = 0;
+		for(int32 RecipeIndex = 0; RecipeIndex < Scratch->CandidateRecipes.Num(); ++RecipeIndex)
+		{
+			const URecipeDataItem& Recipe = *Scratch->CandidateRecipes[RecipeIndex];
+			int32 NumBatches = Scratch->Batches[RecipeIndex];
+			if(Recipe.Duration > 0.f)
+			{
+				NumBatches = FMath::Min(NumBatches, FMath::FloorToInt(SlotSeconds / Recipe.Duration));
+			}
+			NumBatches = ConsumeStoredInputs(Recipe, NumBatches);
+			if(NumBatches <= 0)
+			{
+				continue;
+			}
+
+			SlotSeconds -= NumBatches * Recipe.Duration;
+			Produced.FindOrAdd(Recipe.OutputKey) += NumBatches;
+			NumPassConversions += NumBatches;
+		}
+
+		NumConversions += NumPassConversions;
+		if(NumPassConversions == 0)
+		{
+			break;
+		}
+	}
+
+	AMachineActor* DownstreamMachine = GetDownstreamMachine();
+	for(const TPair<FName, int32>& Product : Produced)
+	{
+		if(Product.Value <= 0)
+		{
+			continue;
+		}
+
+		if(DownstreamMachine)
+		{
+			OutProducts.FindOrAdd(Product.Key) += Product.Value;
+		}
+		else if(OutputTarget == EMachineOutputTarget::Sink)
+		{
+			RecipeSubsystem->AddToSink(Product.Key, Product.Value);
+		}
+		else
+		{
+			StoredShapes.FindOrAdd(Product.Key) += Product.Value;
+		}
+	}
+
+	MarkInventoryChanged();
+
+	// A player may be watching the machine
+	if(SimulationLod == EMachineSimulationLod::Full)
+	{
+		MaterializeProducts();
+	}
+	return NumConversions;
+}
+
+AMachineActor* AMachineActor::GetDownstreamMachine() const
+{
+	switch(OutputTarget)
+	{
+	case EMachineOutputTarget::Machine:
+		return OutputMachine.Get() != this ? OutputMachine.Get() : nullptr;
+	case EMachineOutputTarget::Conveyor:
+		return OutputConveyor.IsValid() ? OutputConveyor->GetDestinationMachine() : nullptr;
+	default:
+		return nullptr;
+	}
+}
+
+void AMachineActor::ResetPipeline()
+{
+	// Ordered conversions are dropped with their inputs
+	if(UProductionPlannerSubsystem* ProductionPlanner = GetWorld() ? GetWorld()->GetSubsystem<UProductionPlannerSubsystem>() : nullptr)
+	{
+		for(const FMachineJob& Job : Jobs)
+		{
+			if(Job.OrderTaskId != INDEX_NONE)
+			{
+				ProductionPlanner->AbortTask(Job.OrderTaskId);
+			}
+		}
+		for(const FMachineJob& Job : OutputBuffer)
+		{
+			if(Job.OrderTaskId != INDEX_NONE)
+			{
+				ProductionPlanner->AbortTask(Job.OrderTaskId);
+			}
+		}
+	}
+
+	if(RecipeSubsystem.IsValid())
+	{
+		for(FMachineJob& Job : Jobs)
+		{
+			RecipeSubsystem->CancelMachineTimer(Job.TimerHandle);
+		}
+		RecipeSubsystem->CancelMachineTimer(EmitTimerHandle);
+		RecipeSubsystem->CancelMachineTimer(DwellTimerHandle);
+	}
+
+	for(const TWeakObjectPtr<AShapeActor>& Shape : WaitingShapes)
+	{
+		if(Shape.IsValid())
+		{
+			Shape->SetWaiting(false);
+		}
+	}
+
+	Jobs.Reset();
+	OutputBuffer.Reset();
+	WaitingShapes.Reset();
+	ShapeCandidates.Reset();
+	EmitTimerHandle.Invalidate();
+	DwellTimerHandle.Invalidate();
+}
+
+void AMachineActor::GetPipelineShapes(TMap<FName, int32>& OutShapes) const
+{
+	// Finished jobs too, the journal only records their inputs as consumed once the output is emitted
+	for(const TArray<FMachineJob>* JobList : {&Jobs, &OutputBuffer})
+	{
+		for(const FMachineJob& Job : *JobList)
+		{
+			for(const FName& InputName : Job.Inputs)
+			{
+				++OutShapes.FindOrAdd(InputName);
+			}
+		}
+	}
+}
+
+bool AMachineActor::IsConsumedByRecipes(const FName& ShapeName) const
+{
+	for(const TPair<FName, URecipeDataItem*>& Pair : RecipeDataEntries)
+	{
+		if(!Pair.Value->bIsActivated)
+		{
+			continue;
+		}
+
+		if(Pair.Value->InputKeys.Contains(ShapeName))
+		{
+			return true;
+		}
+
+		for(const int32 QueryIndex : Pair.Value->InputQueries)
+		{
+			if(RecipeSubsystem.IsValid() && RecipeSubsystem->DoesShapeMatchIngredient(ShapeName, QueryIndex))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+int32 AMachineActor::AddShapes(const FName& ShapeName, int32 Count)
+{
+	if(!HasAuthority() || !NearbyShapes.Contains(ShapeName))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("AMachineActor::AddShapes - Can't add shape %s to machine %s"), *ShapeName.ToString(), *GetMachineName());
+		return 0;
+	}
+
+	int32 NumAdded = 0;
+	for(; NumAdded < Count && !IsInputBufferFull(); ++NumAdded)
+	{
+		++StoredShapes.FindChecked(ShapeName);
+		RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Arrive, ShapeName);
+	}
+
+	if(NumAdded > 0)
+	{
+		MarkInventoryChanged(ShapeName, NumAdded);
+		ProcessValidRecipes();
+	}
+	return NumAdded;
+}
+
+int32 AMachineActor::TakeShapes(const FName& ShapeName, int32 Count)
+{
+	if(!HasAuthority())
+	{
+		return 0;
+	}
+
+	int32 NumTaken = 0;
+	for(; NumTaken < Count && GetShapeCount(ShapeName) > 0; ++NumTaken)
+	{
+		DestroyShapeByName(ShapeName);
+		RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Leave, ShapeName);
+	}
+
+	// Room was made for the shapes waiting outside
+	if(NumTaken > 0 && !WaitingShapes.IsEmpty())
+	{
+		ProcessValidRecipes();
+	}
+	return NumTaken;
+}
+
+int32 AMachineActor::MaterializeShapes(const FName& ShapeName, int32 Count)
+{
+	int32* StoredCount = StoredShapes.Find(ShapeName);
+	if(!HasAuthority() || !StoredCount)
+	{
+		return 0;
+	}
+
+	int32 NumMaterialized = 0;
+	for(; NumMaterialized < Count && *StoredCount > 0; ++NumMaterialized)
+	{
+		// Decremented first, the spawned actor overlaps the collider and is counted again
+		--(*StoredCount);
+		if(!RecipeSubsystem->SpawnShapeByName(ShapeName, *this))
+		{
+			++(*StoredCount);
+			break;
+		}
+		RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Leave, ShapeName);
+		StoredCount = StoredShapes.Find(ShapeName);
+	}
+
+	if(NumMaterialized > 0)
+	{
+		MarkInventoryChanged(ShapeName, -NumMaterialized);
+	}
+	return NumMaterialized;
+}
+
+bool AMachineActor::StackOutput(const FName& ShapeName)
+{
+	const TWeakObjectPtr<AShapeActor>* OutputStackPtr = OutputStacks.Find(ShapeName);
+	AShapeActor* OutputStack = OutputStackPtr ? OutputStackPtr->Get() : nullptr;
+	if(!HasAuthority() || !OutputStack || !OutputStack->CanStack() || OutputStack->GetStackCount() >= GetDefault<URecipeSettings>()->MaxStackSize)
+	{
+		return false;
+	}
+
+	// Held by this machine, the new unit is part of the inventory right away
+	if(OutputStack->IsInInventory())
+	{
+		const FShapeCollection* ShapeCollection = NearbyShapes.Find(ShapeName);
+		if(!ShapeCollection || !ShapeCollection->Shapes.Contains(OutputStack) || IsInputBufferFull())
+		{
+			return false;
+		}
+
+		OutputStack->AddToStack(1);
+		MarkInventoryChanged(ShapeName, 1);
+		RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Arrive, ShapeName);
+		if(IsConsumedByRecipes(ShapeName))
+		{
+			ProcessValidRecipes();
+		}
+		return true;
+	}
+
+	// A stack which rolled away or was pushed elsewhere gets no more outputs
+	const float StackMergeRadius = GetDefault<URecipeSettings>()->StackMergeRadius;
+	if(FVector::DistSquared(OutputStack->GetActorLocation(), GetActorLocation()) > FMath::Square(StackMergeRadius))
+	{
+		return false;
+	}
+
+	OutputStack->AddToStack(1);
+	RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Drop, ShapeName);
+	return true;
+}
+
+void AMachineActor::SetOutputStack(AShapeActor& Shape)
+{
+	OutputStacks.Add(Shape.GetShapeKey(), &Shape);
+}
+
+bool AMachineActor::AddToInventory(AShapeActor& Shape)
+{
+	FShapeCollection* ShapeCollection = NearbyShapes.Find(Shape.GetShapeKey());
+	if(!ensure(ShapeCollection))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("AMachineActor::AddToInventory - Unknown shape : %s. It's likely that the shape was forgotten to be added in the data table."), *Shape.GetShapeName().ToString());
+		return false;
+	}
+
+	// Colliders of several machines may overlap, only the machine owning the shape can consume it
+	FShapeClaimTable& ShapeClaims = RecipeSubsystem->GetShapeClaims();
+	if(!ShapeClaims.TryClaim(Shape.GetClaimHandle(ShapeClaims), GetClaimOwnerId()))
+	{
+		return false;
+	}
+
+	// The shape no longer lies loose in the world, its units are held by the machine
+	RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::PickUp, Shape.GetShapeKey(), Shape.GetStackCount());
+	RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Arrive, Shape.GetShapeKey(), Shape.GetStackCount());
+
+	// No player is close enough to see the shape, it is only a count
+	if(SimulationLod != EMachineSimulationLod::Full)
+	{
+		TGuardValue<bool> OverlapGuard(bIsOverlapProcessingEnabled, false);
+		StoredShapes.FindOrAdd(Shape.GetShapeKey()) += Shape.GetStackCount();
+		MarkInventoryChanged(Shape.GetShapeKey(), Shape.GetStackCount());
+		RecipeSubsystem->DestroyShape(Shape);
+		return true;
+	}
+
+	MarkInventoryChanged(Shape.GetShapeKey(), Shape.GetStackCount());
+
+	// Piled onto the stack already held, the inventory keeps one actor per shape as long as the stack has room
+	AShapeActor* HeldStack = ShapeCollection->Shapes.IsEmpty() ? nullptr : ShapeCollection->Shapes.Last().Get();
+	if(HeldStack && HeldStack != &Shape && HeldStack->CanStack() && HeldStack->GetStackCount() + Shape.GetStackCount() <= GetDefault<URecipeSettings>()->MaxStackSize)
+	{
+		TGuardValue<bool> OverlapGuard(bIsOverlapProcessingEnabled, false);
+		HeldStack->AddToStack(Shape.GetStackCount());
+		RecipeSubsystem->DestroyShape(Shape);
+		return true;
+	}
+
+	// Add the Detected Shape in the NearbyShapes
+	ShapeCollection->Shapes.Add(&Shape);
+	Shape.EnterInventory(*this);
+	return true;
+}
+
+void AMachineActor::MarkInventoryChanged()
+{
+	if(RecipeSubsystem.IsValid())
+	{
+		RecipeSubsystem->MarkReadinessDirty(*this);
+	}
+}
+
+void AMachineActor::MarkInventoryChanged(const FName& ShapeName, int32 Delta)
+{
+	if(RecipeSubsystem.IsValid())
+	{
+		RecipeSubsystem->UpdateReadinessCount(*this, ShapeName, Delta);
+	}
+}
+
+void AMachineActor::MarkRecipesChanged()
+{
+	if(RecipeSubsystem.IsValid())
+	{
+		RecipeSubsystem->MarkReadinessRecipesDirty(*this);
+	}
+}
+
+void AMachineActor::ReleaseClaim(AShapeActor& Shape)
+{
+	FShapeClaimTable& ShapeClaims = RecipeSubsystem->GetShapeClaims();
+	ShapeClaims.Release(Shape.GetClaimHandle(ShapeClaims), GetClaimOwnerId());
+}
+
+int32 AMachineActor::AdmitWaitingShapes()
+{
+	int32 NumAdmitted = 0;
+	for(int32 ShapeIndex = 0; ShapeIndex < WaitingShapes.Num() && !IsInputBufferFull(); ++ShapeIndex)
+	{
+		// Shapes claimed by another machine keep waiting, shapes merged into another stack are gone
+		const TWeakObjectPtr<AShapeActor> Shape = WaitingShapes[ShapeIndex];
+		if(!Shape.IsValid())
+		{
+			WaitingShapes.RemoveAt(ShapeIndex--);
+		}
+		else if(Shape->IsRetired())
+		{
+			Shape->SetWaiting(false);
+			WaitingShapes.RemoveAt(ShapeIndex--);
+		}
+		else if(AddToInventory(*Shape))
+		{
+			Shape->SetWaiting(false);
+			WaitingShapes.RemoveAt(ShapeIndex--);
+			++NumAdmitted;
+		}
+	}
+	return NumAdmitted;
+}
+
+bool AMachineActor::IsInputBufferFull() const
+{
+	if(InputBufferCapacity <= 0)
+	{
+		return false;
+	}
+
+	int32 NumShapes = 0;
+	for(const TPair<FName, FShapeCollection>& Pair : NearbyShapes)
+	{
+		NumShapes += Pair.Value.Num();
+	}
+	for(const TPair<FName, int32>& StoredShape : StoredShapes)
+	{
+		NumShapes += StoredShape.Value;
+	}
+	return NumShapes >= InputBufferCapacity;
+}
+
+bool AMachineActor::DoesRecipeHaveAllInputShapes(const URecipeDataItem& RecipeData) const
+{
+	if(!ensure(RecipeData.HasInputs()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("AMachineActor::AreAllShapesInRecipe - No InputShape provided for recipe : %s"), *(RecipeData.Name.ToString()));
+		return false;
+	}
+	
+	// Count each input, a recipe may need several shapes of the same kind. Recipes have a few inputs, counting them again is cheaper than a map
+	for (const FName& ShapeName : RecipeData.InputKeys)
+	{
+		if(!ensure(NearbyShapes.Contains(ShapeName)))
+		{
+			UE_LOG(LogTemp, Error, TEXT("AMachineActor::AreAllShapesInRecipe - Unknown shape : %s"), *ShapeName.ToString());
+			return false;
+		}
+
+		// We return as soon as we notice that we are missing a shape for the recipe
+		if(GetShapeCount(ShapeName) < Algo::Count(RecipeData.InputKeys, ShapeName))
+		{
+			return false;
+		}
+	}
+
+	// Wildcard ingredients take what the exact inputs leave
+	if(RecipeData.InputQueries.IsEmpty())
+	{
+		return true;
+	}
+	FRecipeInputs PickedInputs = {};
+	return ResolveInputQueries(RecipeData, RecipeData.InputKeys, PickedInputs);
+}
+
+bool AMachineActor::ResolveInputQueries(const URecipeDataItem& Recipe, FRecipeInputs& InOutInputs) const
+{
+	if(Recipe.InputQueries.IsEmpty())
+	{
+		return true;
+	}
+
+	FRecipeInputs PickedInputs = {};
+	if(!ResolveInputQueries(Recipe, InOutInputs, PickedInputs))
+	{
+		return false;
+	}
+	InOutInputs.Append(PickedInputs);
+	return true;
+}
+
+bool AMachineActor::ResolveInputQueries(const URecipeDataItem& Recipe, TConstArrayView<FName> ReservedInputs, FRecipeInputs& OutPickedInputs) const
+{
+	if(!RecipeSubsystem.IsValid())
+	{
+		return false;
+	}
+
+	for(const int32 QueryIndex : Recipe.InputQueries)
+	{
+		FName BestShape = NAME_None;
+		int32 BestCount = 0;
+		for(const TPair<FName, FShapeCollection>& Pair : NearbyShapes)
+		{
+			if(!RecipeSubsystem->DoesShapeMatchIngredient(Pair.Key, QueryIndex))
+			{
+				continue;
+			}
+
+			const int32 NumLeft = GetShapeCount(Pair.Key) - Algo::Count(ReservedInputs, Pair.Key) - Algo::Count(OutPickedInputs, Pair.Key);
+			if(NumLeft > BestCount)
+			{
+				BestShape = Pair.Key;
+				BestCount = NumLeft;
+			}
+		}
+
+		if(BestShape.IsNone())
+		{
+			return false;
+		}
+		OutPickedInputs.Add(BestShape);
+	}
+	return true;
+}
+
+bool AMachineActor::GetRecipeInputs(const URecipeDataItem& Recipe, FRecipeInputs& OutInputs) const
+{
+	OutInputs = Recipe.InputKeys;
+	return ResolveInputQueries(Recipe, OutInputs);
+}
+
+int32 AMachineActor::ConsumeStoredInputs(const URecipeDataItem& Recipe, int32 NumBatches)
+{
+	if(NumBatches <= 0)
+	{
+		return 0;
+	}
+
+	if(Recipe.InputQueries.IsEmpty())
+	{
+		for(const FName& InputName : Recipe.InputKeys)
+		{
+			StoredShapes.FindOrAdd(InputName) -= NumBatches;
+		}
+		return NumBatches;
+	}
+
+	// Wildcard ingredients are resolved batch by batch, the most available matching shape changes as it is consumed
+	FRecipeInputs Inputs = {};
+	for(int32 Batch = 0; Batch < NumBatches; ++Batch)
+	{
+		if(!GetRecipeInputs(Recipe, Inputs))
+		{
+			return Batch;
+		}
+		for(const FName& InputName : Inputs)
+		{
+			--StoredShapes.FindOrAdd(InputName);
+		}
+	}
+	return NumBatches;
+}
+
+void AMachineActor::InitializeRecipeEntry(URecipeDataItem& RecipeItem, const FRecipeData& RecipeData) const
+{
+	RecipeItem.Initialize(RecipeData.Name, RecipeData.InputShape, RecipeData.OutputShape, RecipeData.Priority, RecipeData.Weight, RecipeData.Duration);
+
+	RecipeItem.InputQueries.Reset();
+	RecipeItem.InputQueryNames.Reset();
+	if(RecipeSubsystem.IsValid())
+	{
+		RecipeItem.InputQueries.Append(RecipeSubsystem->GetIngredientQueries(RecipeItem.NameKey));
+		for(const int32 QueryIndex : RecipeItem.InputQueries)
+		{
+			RecipeItem.InputQueryNames.Add(FText::FromName(RecipeSubsystem->GetIngredientCatalog().GetQueryName(QueryIndex)));
+		}
+	}
+}
+
+int32 AMachineActor::GetShapeCount(const FName& ShapeName) const
+{
+	const FShapeCollection* ShapeCollection = NearbyShapes.Find(ShapeName);
+	const int32* StoredCount = StoredShapes.Find(ShapeName);
+
+	return (ShapeCollection ? ShapeCollection->Num() : 0) + (StoredCount ? *StoredCount : 0);
+}
+
+void AMachineActor::GetInventoryShapes(TArray<AShapeActor*>& OutShapes) const
+{
+	for(const TPair<FName, FShapeCollection>& Pair : NearbyShapes)
+	{
+		for(const TSoftObjectPtr<AShapeActor>& Shape : Pair.Value.Shapes)
+		{
+			if(Shape.IsValid())
+			{
+				OutShapes.Add(Shape.Get());
+			}
+		}
+	}
+}
+
+TBitArray<> AMachineActor::GetRecipeActivations() const
+{
+	TBitArray<> RecipeActivations(false, AffectedRecipes.Num());
+	for(int32 RecipeIndex = 0; RecipeIndex < AffectedRecipes.Num(); ++RecipeIndex)
+	{
+		URecipeDataItem* const* RecipeDataEntry = RecipeDataEntries.Find(UHelperClass::ConvertToName(AffectedRecipes[RecipeIndex]));
+		RecipeActivations[RecipeIndex] = RecipeDataEntry && *RecipeDataEntry && (*RecipeDataEntry)->bIsActivated;
+	}
+	return RecipeActivations;
+}
+
+void AMachineActor::RestoreState(const TMap<FName, int32>& InStoredShapes, const TBitArray<>& InRecipeActivations)
+{
+	// Pipeline shapes were saved as stored shapes, see GetPipelineShapes()
+	ResetPipeline();
+
+	// The previous shape actors are expected to be destroyed by the caller
+	for(TPair<FName, FShapeCollection>& Pair : NearbyShapes)
+	{
+		Pair.Value.Shapes.Reset();
+	}
+
+	// Keys are kept, only the counts are replaced
+	for(TPair<FName, int32>& StoredShape : StoredShapes)
+	{
+		StoredShape.Value = 0;
+	}
+	for(const TPair<FName, int32>& StoredShape : InStoredShapes)
+	{
+		int32* StoredCount = StoredShapes.Find(StoredShape.Key);
+		if(StoredCount && StoredShape.Value > 0)
+		{
+			*StoredCount = StoredShape.Value;
+		}
+	}
+	MarkInventoryChanged();
+
+	const int32 NumRecipes = FMath::Min(InRecipeActivations.Num(), AffectedRecipes.Num());
+	for(int32 RecipeIndex = 0; RecipeIndex < NumRecipes; ++RecipeIndex)
+	{
+		SetRecipeAvailability(AffectedRecipes[RecipeIndex], InRecipeActivations[RecipeIndex]);
+	}
+}
+
+void AMachineActor::RefreshRecipes(const TSet<FName>& ChangedRecipes)
+{
+	if(!RecipeSubsystem.IsValid())
+	{
+		return;
+	}
+
+	for(const FText& AffectedRecipe : AffectedRecipes)
+	{
+		const FName RecipeKey = UHelperClass::ConvertToName(AffectedRecipe);
+		if(!ChangedRecipes.Contains(RecipeKey))
+		{
+			continue;
+		}
+
+		const FRecipeData* RecipeData = RecipeSubsystem->FindRecipeData(RecipeKey);
+		URecipeDataItem** RecipeDataEntry = RecipeDataEntries.Find(RecipeKey);
+
+		// Removed from the DataTable
+		if(!RecipeData)
+		{
+			RecipeDataEntries.Remove(RecipeKey);
+			RecipeStates.RemoveAll([&RecipeKey](const FMachineRecipeState& State)
+			{
+				return State.RecipeName == RecipeKey;
+			});
+			continue;
+		}
+
+		// Modified, the same item is kept so the UI and the activation state stay untouched
+		if(RecipeDataEntry && *RecipeDataEntry)
+		{
+			const bool bWasActivated = (*RecipeDataEntry)->bIsActivated;
+			InitializeRecipeEntry(**RecipeDataEntry, *RecipeData);
+			(*RecipeDataEntry)->bIsActivated = bWasActivated;
+			continue;
+		}
+
+		// Added to the DataTable
+		URecipeDataItem* RecipeItem = NewObject<URecipeDataItem>(this);
+		InitializeRecipeEntry(*RecipeItem, *RecipeData);
+		RecipeDataEntries.Add(RecipeKey, RecipeItem);
+		if(HasAuthority())
+		{
+			RecipeStates.Emplace(RecipeKey, RecipeItem->bIsActivated);
+		}
+	}
+
+	// Removed and added recipes leave the map out of order, see BeginPlay()
+	RecipeDataEntries.KeySort(FNameLexicalLess());
+
+	// New inputs may already be waiting in the machine
+	ProcessValidRecipes();
+}
+
+void AMachineActor::RefreshShapeKeys(const TArray<FName>& ShapeNames)
+{
+	for(const FName& ShapeName : ShapeNames)
+	{
+		NearbyShapes.FindOrAdd(ShapeName);
+		StoredShapes.FindOrAdd(ShapeName);
+	}
+}
+
+void AMachineActor::OnColliderBeginOverlap(
+	UPrimitiveComponent* OverlappedComponent,
+	AActor* OtherActor,
+	UPrimitiveComponent* OtherComp,
+	int32 OtherBodyIndex,
+	bool bFromSweep,
+	const FHitResult& SweepResult)
+{
+	if(OtherActor == nullptr || !bIsOverlapProcessingEnabled)
+	{
+		return;
+	}
+	
+	AShapeActor* Shape = Cast<AShapeActor>(OtherActor);
+	if(!Shape)
+	{
+		return;
+	}
+	
+	// Counted once it settled inside the capture radius, shapes bouncing on the collider edge cost no evaluation
+	if(!ShapeCandidates.ContainsByPredicate([Shape](const FShapeCandidate& Candidate) { return Candidate.Shape == Shape; }))
+	{
+		ShapeCandidates.Add({Shape, -1.f});
+	}
+	UpdateShapeCandidates();
+}
+
+void AMachineActor::UpdateShapeCandidates()
+{
+	const float CurrentTime = GetWorld()->GetTimeSeconds();
+	const FVector CaptureCenter = Collider->GetComponentLocation();
+	const float ColliderRadius = Collider->GetScaledSphereRadius();
+	const float CaptureRadiusSquared = FMath::Square(FMath::Min(CaptureRadius, ColliderRadius));
+	const float ReleaseRadiusSquared = FMath::Square(FMath::Clamp(ReleaseRadius, FMath::Min(CaptureRadius, ColliderRadius), ColliderRadius));
+
+	bool bHasCapturedShapes = false;
+	for(int32 CandidateIndex = 0; CandidateIndex < ShapeCandidates.Num(); ++CandidateIndex)
+	{
+		FShapeCandidate& Candidate = ShapeCandidates[CandidateIndex];
+		// Merged into another stack meanwhile
+		AShapeActor* Shape = Candidate.Shape.Get();
+		if(!Shape || Shape->IsRetired())
+		{
+			ShapeCandidates.RemoveAtSwap(CandidateIndex--);
+			continue;
+		}
+
+		if(Candidate.bIsParked)
+		{
+			continue;
+		}
+
+		const float DistanceSquared = FVector::DistSquared(Shape->GetActorLocation(), CaptureCenter);
+		if(DistanceSquared > CaptureRadiusSquared)
+		{
+			// Leaving the release radius starts the dwell over
+			if(DistanceSquared > ReleaseRadiusSquared)
+			{
+				Candidate.CaptureTime = -1.f;
+			}
+
+			// Resting outside the capture radius, the shape is polled again when it wakes up
+			if(Shape->IsAsleep())
+			{
+				Candidate.bIsParked = true;
+				continue;
+			}
+			if(Candidate.CaptureTime < 0.f)
+			{
+				continue;
+			}
+		}
+		else if(Candidate.CaptureTime < 0.f)
+		{
+			Candidate.CaptureTime = CurrentTime;
+		}
+		if(CurrentTime - Candidate.CaptureTime < MinDwellTime)
+		{
+			continue;
+		}
+
+		ShapeCandidates.RemoveAtSwap(CandidateIndex--);
+
+		// Back-pressure, the shape stays outside until the machine consumes its inventory or its owner releases it
+		if(IsInputBufferFull() || !AddToInventory(*Shape))
+		{
+			if(!WaitingShapes.Contains(Shape))
+			{
+				WaitingShapes.Add(Shape);
+				Shape->SetWaiting(true);
+			}
+			continue;
+		}
+		bHasCapturedShapes = true;
+	}
+
+	const bool bHasPolledCandidates = ShapeCandidates.ContainsByPredicate([](const FShapeCandidate& Candidate) { return !Candidate.bIsParked; });
+	if(bHasPolledCandidates && !DwellTimerHandle.IsValid())
+	{
+		DwellTimerHandle = RecipeSubsystem->ScheduleMachineTimer(*this, DwellTimerId, FMath::Max(DwellCheckInterval, MinDwellTime));
+	}
+
+	// Look up if there is enough ingredients for a valid recipe, once for every captured shape
+	if(bHasCapturedShapes)
+	{
+		ProcessValidRecipes();
+	}
+}
+
+void AMachineActor::WakeShapeCandidate(AShapeActor& Shape)
+{
+	FShapeCandidate* Candidate = ShapeCandidates.FindByPredicate([&Shape](const FShapeCandidate& Item) { return Item.Shape == &Shape; });
+	if(!HasAuthority() || !Candidate || !Candidate->bIsParked)
+	{
+		return;
+	}
+
+	Candidate->bIsParked = false;
+	if(!DwellTimerHandle.IsValid())
+	{
+		DwellTimerHandle = RecipeSubsystem->ScheduleMachineTimer(*this, DwellTimerId, FMath::Max(DwellCheckInterval, MinDwellTime));
+	}
+}
+
+void AMachineActor::OnColliderEndOverlap(
+	UPrimitiveComponent* OverlappedComponent,
+	AActor* OtherActor,
+	UPrimitiveComponent* OtherComp,
+	int32 OtherBodyIndex)
+{
+	if(OtherActor == nullptr || !bIsOverlapProcessingEnabled)
+	{
+		return;
+	}
+	
+	AShapeActor* Shape = Cast<AShapeActor>(OtherActor);
+	if(!Shape)
+	{
+		return;
+	}
+
+	// Released before being captured
+	if(ShapeCandidates.RemoveAllSwap([Shape](const FShapeCandidate& Candidate) { return Candidate.Shape == Shape; }) > 0)
+	{
+		return;
+	}
+
+	if(WaitingShapes.Remove(Shape) > 0)
+	{
+		Shape->SetWaiting(false);
+		return;
+	}
+
+	FShapeCollection* ShapeCollection = NearbyShapes.Find(Shape->GetShapeKey());
+	if(!ensure(ShapeCollection))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("AMachineActor::OnColliderEndOverlap - Unknown shape : %s. It's likely that the shape was forgotten to be added in the data table."), *Shape->GetShapeName().ToString());
+		return;
+	}
+	
+	// Remove the previously Detected Shape in the NearbyShapes
+	if(ShapeCollection->Shapes.RemoveSingle(Shape) > 0)
+	{
+		Shape->LeaveInventory(*this);
+		ReleaseClaim(*Shape);
+		MarkInventoryChanged(Shape->GetShapeKey(), -Shape->GetStackCount());
+		RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Leave, Shape->GetShapeKey(), Shape->GetStackCount());
+		RecipeSubsystem->NotifyShapeEvent(*this, EMachineShapeEvent::Drop, Shape->GetShapeKey(), Shape->GetStackCount());
+
+		// Another machine may be waiting for the shape
+		TArray<AActor*> OverlappingMachines = {};
+		Shape->GetOverlappingActors(OverlappingMachines, AMachineActor::StaticClass());
+		for(AActor* OverlappingMachine : OverlappingMachines)
+		{
+			if(OverlappingMachine != this)
+			{
+				CastChecked<AMachineActor>(OverlappingMachine)->ProcessValidRecipes();
+			}
+		}
+	}
 }
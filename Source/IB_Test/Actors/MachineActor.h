@@ -5,12 +5,17 @@
 #include "CoreMinimal.h"
 #include "Components/SphereComponent.h"
 #include "GameFramework/Actor.h"
+#include "IB_Test/Simulation/RecipeAllocator.h"
+#include "IB_Test/Simulation/TimerWheel.h"
 #include "IB_Test/UI/RecipeDataEntry.h"
 #include "MachineActor.generated.h"
 
 class URecipeSubsystem;
+class AConveyorActor;
 class AShapeActor;
+class APlayerState;
 struct FRecipeData;
+struct FRecipeScratchFrame;
 
 /**
  * Simple Structure used as a value in our NearbyActor TMap since we can't have a direct TArray
@@ -22,9 +27,117 @@ struct FShapeCollection
 	
 	FShapeCollection() = default;
 	
+	/**
+	 * @return The number of shapes in the collection, each stack counts as its units.
+	 */
+	int32 Num() const;
+
 	TArray<TSoftObjectPtr<AShapeActor>> Shapes;
 };
 
+/**
+ * Server-authoritative activation state of a recipe, replicated to clients
+ */
+USTRUCT()
+struct FMachineRecipeState
+{
+	GENERATED_BODY()
+
+	FMachineRecipeState() = default;
+
+	FMachineRecipeState(const FName& InRecipeName, bool bInIsActivated) :
+	RecipeName(InRecipeName), bIsActivated(bInIsActivated)
+	{
+	}
+
+	UPROPERTY()
+	FName RecipeName = NAME_None;
+
+	UPROPERTY()
+	bool bIsActivated = true;
+};
+
+/**
+ * Shape inside the collider, not counted in the inventory until it settles inside the capture radius
+ */
+USTRUCT()
+struct FShapeCandidate
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TWeakObjectPtr<AShapeActor> Shape;
+
+	/* World time the shape entered the capture radius, negative while it is outside */
+	UPROPERTY()
+	float CaptureTime = -1.f;
+
+	/* True while the shape rests outside the capture radius, it isn't polled until it wakes up */
+	UPROPERTY()
+	bool bIsParked = false;
+};
+
+/**
+ * Where a machine sends the outputs of its conversions
+ */
+UENUM(BlueprintType)
+enum class EMachineOutputTarget : uint8
+{
+	// Outputs are spawned as shape actors at the machine location
+	World,
+	// Outputs are added to the inventory of the output machine as counts
+	Machine,
+	// Outputs are pushed on the output conveyor
+	Conveyor,
+	// Outputs are only counted by the recipe subsystem
+	Sink
+};
+
+/**
+ * How closely a machine is simulated, decided by its distance to the players
+ */
+UENUM(BlueprintType)
+enum class EMachineSimulationLod : uint8
+{
+	// Shapes are actors, outputs are spawned with their VFX
+	Full,
+	// The inventory is kept as counts, outputs are never spawned
+	CountOnly,
+	// Count only, recipes are evaluated in coarse steps converting the whole step at once
+	Analytical
+};
+
+/**
+ * Timed conversion occupying a machine slot, inputs are consumed when it starts
+ */
+USTRUCT()
+struct FMachineJob
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	int32 JobId = INDEX_NONE;
+
+	UPROPERTY()
+	FName RecipeName = NAME_None;
+
+	UPROPERTY()
+	FName OutputShape = NAME_None;
+
+	/* Shapes consumed when the job started, wildcard ingredients resolved. Inline so starting a job doesn't allocate */
+	FRecipeInputs Inputs;
+
+	/* True once the conversion is done, the job keeps its slot until the output buffer has room */
+	UPROPERTY()
+	bool bIsFinished = false;
+
+	/* Task of a production order, INDEX_NONE for conversions started by the machine itself */
+	UPROPERTY()
+	int32 OrderTaskId = INDEX_NONE;
+
+	FTimerWheelHandle TimerHandle;
+};
+
 /**
  * Actor representing a conversion machine
  */
@@ -36,6 +149,16 @@ class IB_TEST_API AMachineActor : public AActor
 public:
 	AMachineActor();
 
+	/**
+	 * Timer id of the shape candidates checks, see OnMachineTimerExpired()
+	 */
+	static constexpr int32 DwellTimerId = INDEX_NONE - 1;
+
+	/**
+	 * Time between two checks of the shape candidates
+	 */
+	static constexpr float DwellCheckInterval = 0.05f;
+
 	/**
 	 * @brief Gets the machine name as a string.
 	 *
@@ -56,6 +179,26 @@ public:
 		return AffectedRecipes;
 	}
 
+	/**
+	 * @brief Configures a machine spawned at runtime, must be called before BeginPlay, e.g. on a deferred spawn.
+	 *
+	 * @param InMachineName The unique name of the machine.
+	 * @param InAffectedRecipes The recipes of the machine.
+	 * @param InOutputTarget Where the outputs go.
+	 */
+	void SetupMachine(const FText& InMachineName, const TArray<FText>& InAffectedRecipes, EMachineOutputTarget InOutputTarget);
+
+	/**
+	 * @brief Configures the pipeline of a machine spawned at runtime, must be called before BeginPlay.
+	 *
+	 * @param InAllocationMode How competing recipes share the inputs.
+	 * @param InParallelSlots The number of timed conversions running at the same time.
+	 * @param InInputBufferCapacity The maximum number of shapes in the inventory, 0 for no limit.
+	 * @param InOutputBufferCapacity The maximum number of finished outputs waiting to be emitted, 0 for no limit.
+	 * @param InOutputInterval The minimum time between two emitted outputs.
+	 */
+	void SetupPipeline(ERecipeAllocationMode InAllocationMode, int32 InParallelSlots, int32 InInputBufferCapacity, int32 InOutputBufferCapacity, float InOutputInterval);
+
 	/**
 	 * @brief Gets the recipe entries associated with the machine.
 	 *
@@ -63,6 +206,26 @@ public:
 	 */
 	TArray<URecipeDataItem*> GetRecipeEntries() const;
 
+	/**
+	 * @brief Same as GetRecipeEntries() without copying, for the paths running every frame.
+	 *
+	 * @return The recipe entries by recipe name.
+	 */
+	const TMap<FName, URecipeDataItem*>& GetRecipeEntryMap() const
+	{
+		return RecipeDataEntries;
+	}
+
+	/**
+	 * @param RecipeName The name of the recipe.
+	 * @return The recipe entry, nullptr if the machine doesn't have the recipe.
+	 */
+	const URecipeDataItem* GetRecipeEntry(const FName& RecipeName) const
+	{
+		URecipeDataItem* const* RecipeDataEntry = RecipeDataEntries.Find(RecipeName);
+		return RecipeDataEntry ? *RecipeDataEntry : nullptr;
+	}
+
 	/**
 	 * @brief Sets the availability of a recipe.
 	 *
@@ -72,8 +235,29 @@ public:
 	 */
 	bool SetRecipeAvailability(const FText& RecipeName, bool bIsActivated);
 
+	/**
+	 * @brief Resets the activation state of every recipe to the last state replicated by the server.
+	 *
+	 * Used on clients to roll back predicted toggles before re-applying the ones still pending.
+	 */
+	void ApplyAuthoritativeRecipeStates();
+
+	/**
+	 * @brief Notifies every client that the server performed a conversion on this machine.
+	 *
+	 * @param ConversionId Server-side id of the conversion.
+	 * @param PredictingPlayer Player who predicted the conversion, nullptr if it wasn't predicted.
+	 * @param PredictionKey Key of the client prediction, INDEX_NONE if it wasn't predicted.
+	 * @param bIsOutputStacked True if the output only added a unit to a shape already replicated, no new shape will follow.
+	 */
+	UFUNCTION(NetMulticast, Reliable)
+	void MulticastConversionPerformed(int32 ConversionId, APlayerState* PredictingPlayer, int32 PredictionKey, bool bIsOutputStacked);
+
 	/**
 	 * Process all valid recipes for the machine, destroying input shapes and spawning output shapes as needed.
+	 * Recipes competing for the same inputs are arbitrated by the AllocationMode.
+	 * Outputs consumed by another recipe of the machine are kept as counts and converted again in the same call,
+	 * only the final products are spawned.
 	 */
 	void ProcessValidRecipes();
 	
@@ -84,16 +268,281 @@ public:
 	 */
 	void ProceedValidRecipe(const URecipeDataItem& Recipe);
 
+	/**
+	 * @brief Gets the number of shapes of a kind available to the machine, actors and stored counts included.
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @return The number of available shapes.
+	 */
+	int32 GetShapeCount(const FName& ShapeName) const;
+
+	/**
+	 * @brief Adds shapes to the inventory as stored counts, without any actor (server only).
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @param Count The number of shapes to add.
+	 * @return The number of shapes accepted, less than Count once the input buffer is full.
+	 */
+	int32 AddShapes(const FName& ShapeName, int32 Count);
+
+	/**
+	 * @brief Removes shapes from the inventory, stored counts first then shape actors (server only).
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @param Count The number of shapes to remove.
+	 * @return The number of shapes removed, less than Count if the inventory didn't have enough.
+	 */
+	int32 TakeShapes(const FName& ShapeName, int32 Count);
+
+	/**
+	 * @brief Turns stored counts into shape actors, for when the shapes must be seen or pushed around.
+	 *
+	 * The spawned actors enter the inventory again through the collider, they pile up as a stack.
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @param Count The maximum number of shapes to materialize.
+	 * @return The number of shapes materialized.
+	 */
+	int32 MaterializeShapes(const FName& ShapeName, int32 Count);
+
+	/**
+	 * @param ShapeName The name of the shape.
+	 * @return True if an activated recipe of the machine needs this shape as input.
+	 */
+	bool IsConsumedByRecipes(const FName& ShapeName) const;
+
+	/**
+	 * @brief Adds an output to the stack the machine spawned last for this shape instead of spawning another actor (server only).
+	 *
+	 * The stack must still be loose within the stack merge radius, or in this machine's inventory.
+	 *
+	 * @param ShapeName The output shape.
+	 * @return False if the output must be spawned.
+	 */
+	bool StackOutput(const FName& ShapeName);
+
+	/**
+	 * @brief Remembers a spawned output as the stack the next outputs of its shape pile onto.
+	 */
+	void SetOutputStack(AShapeActor& Shape);
+
+	/**
+	 * @brief Gets the shapes held by the conversion pipeline, as the inputs of every job not emitted yet.
+	 *
+	 * A conversion only consumes its inputs once its output is emitted, see OnRecipeConverted, so a restored job starts over.
+	 *
+	 * @param OutShapes Map incremented with the shape counts by shape name.
+	 */
+	void GetPipelineShapes(TMap<FName, int32>& OutShapes) const;
+
+	/**
+	 * @brief Called by the recipe subsystem timer wheel when a timer of this machine expires.
+	 *
+	 * @param JobId The finished job, INDEX_NONE when the output emission cooldown is over, DwellTimerId to check the shape candidates.
+	 */
+	void OnMachineTimerExpired(int32 JobId);
+
+	/**
+	 * @brief Polls a shape candidate again once its physics body wakes up (server only).
+	 *
+	 * @param Shape The shape which woke up, ignored if it isn't a candidate of the machine.
+	 */
+	void WakeShapeCandidate(AShapeActor& Shape);
+
+	/**
+	 * @brief Changes how closely the machine is simulated (server only).
+	 *
+	 * Leaving Full turns the inventory shape actors into counts, going back to Full materializes the stored products.
+	 *
+	 * @param InSimulationLod The new simulation level of detail.
+	 */
+	void SetSimulationLod(EMachineSimulationLod InSimulationLod);
+
+	/**
+	 * @return How closely the machine is simulated.
+	 */
+	EMachineSimulationLod GetSimulationLod() const
+	{
+		return SimulationLod;
+	}
+
+	/**
+	 * @brief Runs the conversions of a coarse step at once, only while the simulation LOD is Analytical.
+	 *
+	 * Timed recipes share ParallelSlots * DeltaSeconds of slot time, the output buffer and interval are ignored.
+	 *
+	 * @param DeltaSeconds The simulated time since the previous step.
+	 */
+	void AdvanceAnalytically(float DeltaSeconds);
+
+	/**
+	 * @brief Advances the machine by a long period at once on counts, see URecipeSubsystem::FastForward() (server only).
+	 *
+	 * Running jobs are completed, ordered ones through the production planner, and the shapes resting in the collider or
+	 * waiting outside are admitted. Then the inventory and the supplied shapes are shared between the activated recipes in
+	 * batches, timed recipes sharing ParallelSlots * ElapsedSeconds of slot time. Outputs consumed by the machine are
+	 * converted again. Input and output buffers are ignored. Sink products are counted by the recipe subsystem, World ones
+	 * are stored in the machine.
+	 *
+	 * @param ElapsedSeconds The time to advance.
+	 * @param SupplyRates Shapes per second delivered to the machine during that time, by shape name.
+	 * @param SuppliedShapes Shapes delivered to the machine during that time, e.g. the products of the upstream machines, by shape name.
+	 * @param OutProducts Incremented with the products for the downstream machine, by shape name.
+	 * @return The number of conversions.
+	 */
+	int32 FastForward(float ElapsedSeconds, const TMap<FName, float>& SupplyRates, const TMap<FName, int32>& SuppliedShapes, TMap<FName, int32>& OutProducts);
+
+	/**
+	 * @return The machine receiving the outputs, directly or at the end of the output conveyor, nullptr if there is none.
+	 */
+	AMachineActor* GetDownstreamMachine() const;
+
+	/**
+	 * @return True if a timed conversion can start right away.
+	 */
+	bool HasIdleSlot() const
+	{
+		return Jobs.Num() < ParallelSlots;
+	}
+
+	/**
+	 * @return The number of timed conversions running at the same time.
+	 */
+	int32 GetParallelSlots() const
+	{
+		return ParallelSlots;
+	}
+
+	/**
+	 * @return How competing recipes share the inputs.
+	 */
+	ERecipeAllocationMode GetAllocationMode() const
+	{
+		return AllocationMode;
+	}
+
+	/**
+	 * @return The maximum number of shapes in the inventory, 0 for no limit.
+	 */
+	int32 GetInputBufferCapacity() const
+	{
+		return InputBufferCapacity;
+	}
+
+	/**
+	 * @return The maximum number of finished outputs waiting to be emitted, 0 for no limit.
+	 */
+	int32 GetOutputBufferCapacity() const
+	{
+		return OutputBufferCapacity;
+	}
+
+	/**
+	 * @return The minimum time between two emitted outputs.
+	 */
+	float GetOutputInterval() const
+	{
+		return OutputInterval;
+	}
+
+	/**
+	 * @brief Starts a conversion for a production order, its output goes to the production planner first.
+	 *
+	 * @param RecipeName The recipe to convert, it must be enabled.
+	 * @param InventoryInputs The inputs taken from the inventory, the others were produced by the order.
+	 * @param OrderTaskId The task of the order, see UProductionPlannerSubsystem::CompleteTask().
+	 * @return False if the recipe is disabled, an input is missing or no slot is idle.
+	 */
+	bool StartOrderedJob(const FName& RecipeName, TConstArrayView<FName> InventoryInputs, int32 OrderTaskId);
+
+	/**
+	 * @brief Picks an inventory shape for every wildcard ingredient of a recipe.
+	 *
+	 * Greedy: each ingredient takes the matching shape with the most units left, so an ingredient resolved first may
+	 * take the only shape a later one could use.
+	 *
+	 * @param Recipe The recipe whose ingredient queries are resolved.
+	 * @param InOutInputs Shapes already reserved, the picked shapes are appended.
+	 * @return False if an ingredient has no matching shape left.
+	 */
+	bool ResolveInputQueries(const URecipeDataItem& Recipe, FRecipeInputs& InOutInputs) const;
+
+	/**
+	 * @brief Gets the shape actors currently in the machine inventory.
+	 *
+	 * @param OutShapes Array filled with the shape actors.
+	 */
+	void GetInventoryShapes(TArray<AShapeActor*>& OutShapes) const;
+
+	/**
+	 * @brief Gets the shapes stored as counts only, without any actor.
+	 *
+	 * @return Map of shape counts by shape name.
+	 */
+	const TMap<FName, int32>& GetStoredShapes() const
+	{
+		return StoredShapes;
+	}
+
+	/**
+	 * @brief Gets the activation state of every recipe, indexed like AffectedRecipes.
+	 *
+	 * @return One bit per affected recipe.
+	 */
+	TBitArray<> GetRecipeActivations() const;
+
+	/**
+	 * @brief Enables or disables the handling of collider overlaps, used to skip overlap churn during bulk operations.
+	 *
+	 * @param bIsEnabled False to ignore every overlap event.
+	 */
+	void SetOverlapProcessingEnabled(bool bIsEnabled)
+	{
+		bIsOverlapProcessingEnabled = bIsEnabled;
+	}
+
+	/**
+	 * @brief Replaces the whole machine state at once, shape actors of the inventory are forgotten.
+	 *
+	 * @param InStoredShapes Shape counts to store in the machine.
+	 * @param InRecipeActivations Activation state of every recipe, indexed like AffectedRecipes.
+	 */
+	void RestoreState(const TMap<FName, int32>& InStoredShapes, const TBitArray<>& InRecipeActivations);
+
+	/**
+	 * @brief Updates the cached data of recipes changed in the recipe DataTable, keeping their activation state.
+	 *
+	 * @param ChangedRecipes Names of the recipes added, modified or removed.
+	 */
+	void RefreshRecipes(const TSet<FName>& ChangedRecipes);
+
+	/**
+	 * @brief Adds the inventory keys of shapes added to the shape DataTable. Keys are never removed so shapes in progress are kept.
+	 *
+	 * @param ShapeNames Names of every known shape.
+	 */
+	void RefreshShapeKeys(const TArray<FName>& ShapeNames);
+
 protected:
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	/**
+	 * Called on clients when the server-authoritative recipe states changed
+	 */
+	UFUNCTION()
+	void OnRep_RecipeStates();
+
 	/**
 	 * Destroy colliding shapes by their names.
 	 *
 	 * @param ShapeNames The array of shape names to be destroyed.
 	 * @return True if all shapes were successfully destroyed, false otherwise.
 	 */
-	bool DestroyShapesByName(const TArray<FName>& ShapeNames);
+	bool DestroyShapesByName(TConstArrayView<FName> ShapeNames);
 
 	/**
 	 * Destroy a shape by its name.
@@ -142,6 +591,74 @@ protected:
 	 */
 	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Config")
 	FText MachineName = FText();
+
+	/**
+	 * How the inventory is shared between recipes competing for the same inputs.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Config")
+	ERecipeAllocationMode AllocationMode = ERecipeAllocationMode::Priority;
+
+	/**
+	 * Number of timed conversions running at the same time.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Pipeline", meta = (ClampMin = "1"))
+	int32 ParallelSlots = 1;
+
+	/**
+	 * Shapes accepted in the inventory, further shapes wait outside the machine. 0 for no limit.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Pipeline", meta = (ClampMin = "0"))
+	int32 InputBufferCapacity = 0;
+
+	/**
+	 * Outputs waiting to be emitted, finished jobs keep their slot while it is full. 0 for no limit.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Pipeline", meta = (ClampMin = "0"))
+	int32 OutputBufferCapacity = 0;
+
+	/**
+	 * Minimum time between two emitted outputs of timed conversions, 0 to emit them as soon as they are done.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Pipeline", meta = (ClampMin = "0", Units = "s"))
+	float OutputInterval = 0.f;
+
+	/**
+	 * Shapes are captured once inside this radius and released once outside the collider, so shapes jittering on an edge
+	 * don't enter and leave the inventory over and over. Clamped to the collider radius.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Overlap", meta = (ClampMin = "0", Units = "cm"))
+	float CaptureRadius = 150.f;
+
+	/**
+	 * Candidates moving beyond this radius start their dwell over, the ones going back and forth around the capture radius
+	 * keep it. Clamped between the capture radius and the collider radius.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Overlap", meta = (ClampMin = "0", Units = "cm"))
+	float ReleaseRadius = 175.f;
+
+	/**
+	 * Time a shape must stay inside the capture radius before it is counted in the inventory.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Overlap", meta = (ClampMin = "0", Units = "s"))
+	float MinDwellTime = 0.1f;
+
+	/**
+	 * Where the outputs go. Outputs refused by their target are spawned in the world.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Pipeline")
+	EMachineOutputTarget OutputTarget = EMachineOutputTarget::World;
+
+	/**
+	 * Machine receiving the outputs when OutputTarget is Machine.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Pipeline", meta = (EditCondition = "OutputTarget == EMachineOutputTarget::Machine"))
+	TSoftObjectPtr<AMachineActor> OutputMachine;
+
+	/**
+	 * Conveyor receiving the outputs when OutputTarget is Conveyor.
+	 */
+	UPROPERTY(EditInstanceOnly, BlueprintReadWrite, Category = "Pipeline", meta = (EditCondition = "OutputTarget == EMachineOutputTarget::Conveyor"))
+	TSoftObjectPtr<AConveyorActor> OutputConveyor;
 	
 private:
 
@@ -152,6 +669,161 @@ private:
 	 * @return True if all required shapes are present, false otherwise.
 	 */
 	bool DoesRecipeHaveAllInputShapes(const URecipeDataItem& RecipeData) const;
+
+	/**
+	 * Gets the shapes a conversion of the recipe would consume now.
+	 *
+	 * @param Recipe The recipe to convert.
+	 * @param OutInputs The exact inputs followed by the shapes picked for the wildcard ingredients.
+	 * @return False if a wildcard ingredient has no matching shape, the exact inputs aren't checked.
+	 */
+	bool GetRecipeInputs(const URecipeDataItem& Recipe, FRecipeInputs& OutInputs) const;
+
+	/**
+	 * Same as the public ResolveInputQueries(), the reserved shapes are read in place instead of copied.
+	 *
+	 * @param Recipe The recipe whose ingredient queries are resolved.
+	 * @param ReservedInputs Shapes already reserved.
+	 * @param OutPickedInputs Appended with the picked shapes.
+	 * @return False if an ingredient has no matching shape left.
+	 */
+	bool ResolveInputQueries(const URecipeDataItem& Recipe, TConstArrayView<FName> ReservedInputs, FRecipeInputs& OutPickedInputs) const;
+
+	/**
+	 * Takes the inputs of several conversions from the stored counts, for fast-forwards.
+	 *
+	 * @return The number of conversions whose inputs were taken, lower than NumBatches if a wildcard ingredient ran out.
+	 */
+	int32 ConsumeStoredInputs(const URecipeDataItem& Recipe, int32 NumBatches);
+
+	/**
+	 * Copies a recipe of the DataTable to a recipe entry of the machine, with its ingredient queries.
+	 */
+	void InitializeRecipeEntry(URecipeDataItem& RecipeItem, const FRecipeData& RecipeData) const;
+
+	/**
+	 * Allocates the inventory between the activated recipes and converts it once.
+	 */
+	void ProcessAllocationPass();
+
+	/**
+	 * Same as ProcessAllocationPass() for analytical steps, timed recipes are converted at once within the slot time left.
+	 */
+	void ProcessAnalyticalPass();
+
+	/**
+	 * Shares the inventory between the activated recipes according to the AllocationMode.
+	 *
+	 * @param Scratch Frame of the Recipe Subsystem scratch arena, filled with the candidate recipes and their batches.
+	 */
+	void BuildAllocation(FRecipeScratchFrame& Scratch);
+
+	/**
+	 * Consumes the inputs of a recipe and delivers its output right away.
+	 */
+	void ConvertRecipe(const URecipeDataItem& Recipe);
+
+	/**
+	 * Turns the shape actors of the inventory into stored counts.
+	 */
+	void DematerializeInventory();
+
+	/**
+	 * Spawns back part of the stored shapes no recipe of the machine consumes.
+	 */
+	void MaterializeProducts();
+
+	/**
+	 * Consumes the inputs of a timed recipe and schedules its completion on a free slot.
+	 *
+	 * @return False if every slot is busy.
+	 */
+	bool StartJob(const URecipeDataItem& Recipe);
+
+	/**
+	 * Moves finished jobs to the output buffer, emits what can be emitted, then refills the freed slots.
+	 */
+	void AdvancePipeline();
+
+	/**
+	 * @return The number of finished jobs moved to the output buffer.
+	 */
+	int32 FlushFinishedJobs();
+
+	/**
+	 * @return The number of outputs emitted.
+	 */
+	int32 EmitOutputs();
+
+	/**
+	 * Sends the output of a timed conversion to its target.
+	 */
+	void EmitOutput(const FMachineJob& Job);
+
+	/**
+	 * Sends a conversion output to the OutputTarget.
+	 *
+	 * @return True if the output was delivered or spawned.
+	 */
+	bool DeliverOutput(const FName& OutputShape);
+
+	/**
+	 * Cancels every job and forgets the buffered outputs and waiting shapes.
+	 */
+	void ResetPipeline();
+
+	/**
+	 * Claims a shape actor and adds it to the inventory.
+	 *
+	 * @return False if the shape is owned by another machine.
+	 */
+	bool AddToInventory(AShapeActor& Shape);
+
+	/**
+	 * Captures the candidates which settled inside the capture radius, then evaluates the recipes once for all of them.
+	 */
+	void UpdateShapeCandidates();
+
+	/**
+	 * Tells the recipe subsystem the whole inventory changed, e.g. after a fast-forward.
+	 */
+	void MarkInventoryChanged();
+
+	/**
+	 * Tells the recipe subsystem the count of a shape changed.
+	 */
+	void MarkInventoryChanged(const FName& ShapeName, int32 Delta);
+
+	/**
+	 * Tells the recipe subsystem the activated recipes changed.
+	 */
+	void MarkRecipesChanged();
+
+	/**
+	 * Releases the claim of the machine on a shape actor.
+	 */
+	void ReleaseClaim(AShapeActor& Shape);
+
+	/**
+	 * @return The id identifying the machine in the shape claim table.
+	 */
+	uint32 GetClaimOwnerId() const
+	{
+		// Offset so no machine uses the id of unclaimed shapes
+		return GetUniqueID() + 1;
+	}
+
+	/**
+	 * Moves the shapes waiting outside the machine into the inventory while there is room.
+	 *
+	 * @return The number of admitted shapes.
+	 */
+	int32 AdmitWaitingShapes();
+
+	/**
+	 * @return True if the input buffer can't accept any more shape.
+	 */
+	bool IsInputBufferFull() const;
 	
 	/*
 	* Using a TMap<FString, FShapeCollection> instead of TMap<FString, TSoftObjectPtr<AShapeActor>>
@@ -162,6 +834,90 @@ private:
 	UPROPERTY(Transient)
 	TMap<FName, FShapeCollection> NearbyShapes;
 
+	/*
+	* Shapes owned by the machine without any actor, e.g. restored from a snapshot.
+	* They are consumed before the shape actors since they cost nothing to remove.
+	*/
+	UPROPERTY(Transient)
+	TMap<FName, int32> StoredShapes;
+
+	/*
+	* False while overlap events must be ignored
+	*/
+	UPROPERTY(Transient)
+	bool bIsOverlapProcessingEnabled = true;
+
+	/*
+	* Recipe the next weighted round-robin allocation starts with
+	*/
+	UPROPERTY(Transient)
+	int32 RoundRobinCursor = 0;
+
+	/*
+	* Timed conversions running or finished but waiting for room in the output buffer, in start order
+	*/
+	UPROPERTY(Transient)
+	TArray<FMachineJob> Jobs;
+
+	/*
+	* Finished conversions whose output isn't emitted yet, in completion order
+	*/
+	UPROPERTY(Transient)
+	TArray<FMachineJob> OutputBuffer;
+
+	/*
+	* Shapes which reached the machine while the input buffer was full
+	*/
+	UPROPERTY(Transient)
+	TArray<TWeakObjectPtr<AShapeActor>> WaitingShapes;
+
+	/*
+	* Last output stack spawned for each shape, see StackOutput()
+	*/
+	TMap<FName, TWeakObjectPtr<AShapeActor>> OutputStacks;
+
+	/*
+	* Shapes inside the collider not captured yet
+	*/
+	UPROPERTY(Transient)
+	TArray<FShapeCandidate> ShapeCandidates;
+
+	/*
+	* Next check of the shape candidates, valid while there are candidates
+	*/
+	FTimerWheelHandle DwellTimerHandle;
+
+	/*
+	* Outputs kept in the inventory as counts to be converted again, see ProcessValidRecipes()
+	*/
+	int32 NumCascadedOutputs = 0;
+
+	/*
+	* How closely the machine is simulated, see USimulationLodSubsystem
+	*/
+	UPROPERTY(Transient)
+	EMachineSimulationLod SimulationLod = EMachineSimulationLod::Full;
+
+	/*
+	* True while an analytical machine has conversions to evaluate at its next step
+	*/
+	bool bHasPendingEvaluation = false;
+
+	/*
+	* Slot time left for the timed recipes of an analytical machine
+	*/
+	float AnalyticalSlotSeconds = 0.f;
+
+	/*
+	* Id given to the next job
+	*/
+	int32 NextJobId = 0;
+
+	/*
+	* Cooldown between two emitted outputs, valid while running
+	*/
+	FTimerWheelHandle EmitTimerHandle;
+
 	/*
 	* Recipe subsystem simply stored in BeginPlay() to be easily accessed
 	*/
@@ -182,4 +938,11 @@ private:
 	*/
 	UPROPERTY(Transient)
 	TMap<FName, URecipeDataItem*> RecipeDataEntries = {};
+
+	/*
+	* Activation state of each recipe as decided by the server.
+	* RecipeDataEntries may temporarily differ on clients while a predicted toggle waits for confirmation.
+	*/
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_RecipeStates)
+	TArray<FMachineRecipeState> RecipeStates = {};
 };
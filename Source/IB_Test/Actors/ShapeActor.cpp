@@ -3,12 +3,93 @@
 
 #include "ShapeActor.h"
 
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Replication/IB_TestReplicationGraph.h"
+#include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "Engine/NetDriver.h"
+#include "Net/UnrealNetwork.h"
+
 AShapeActor::AShapeActor()
 {
 	PrimaryActorTick.bCanEverTick = true;
+
+	// Shapes are spawned and consumed by the server, clients only mirror them
+	bReplicates = true;
+	SetReplicateMovement(true);
 	
 	ShapeMesh = CreateDefaultSubobject<UStaticMeshComponent>(FName("ShapeMesh"));
 	SetRootComponent(ShapeMesh);
+
+	// Needed to know when a shape settles and can go dormant
+	ShapeMesh->BodyInstance.bGenerateWakeEvents = true;
+}
+
+void AShapeActor::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AShapeActor, StackCount);
+	DOREPLIFETIME_CONDITION(AShapeActor, ConversionId, COND_InitialOnly);
+}
+
+void AShapeActor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if(HasAuthority())
+	{
+		ShapeMesh->OnComponentSleep.AddDynamic(this, &AShapeActor::OnShapeMeshSleep);
+		ShapeMesh->OnComponentWake.AddDynamic(this, &AShapeActor::OnShapeMeshWake);
+	}
+
+	// The yaw rotation is cosmetic, a server rotating the shapes would replicate their movement every frame
+	if(HasAuthority() && (GetNetMode() == NM_DedicatedServer || GetNetMode() == NM_ListenServer))
+	{
+		SetActorTickEnabled(false);
+	}
+
+	// Provisional shapes have local authority on their client, only the shapes of the server make the population
+	Touch();
+	URecipeSubsystem* RecipeSubsystem = GetWorld()->GetSubsystem<URecipeSubsystem>();
+	if(RecipeSubsystem && HasAuthority() && GetNetMode() != NM_Client && !bIsProvisional)
+	{
+		RecipeSubsystem->GetShapePopulation().Add(*this);
+	}
+
+	// The replicated output of a predicted conversion takes over from the provisional shape
+	if(RecipeSubsystem && !HasAuthority() && ConversionId != INDEX_NONE)
+	{
+		if(AMachineActor* Machine = Cast<AMachineActor>(GetOwner()))
+		{
+			RecipeSubsystem->HandleConversionOutputReplicated(*Machine, ConversionId);
+		}
+	}
+}
+
+void AShapeActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Frees the slot, claims still held on this shape become stale
+	const UWorld* World = GetWorld();
+	URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr;
+	if(ClaimHandle.IsValid() && RecipeSubsystem)
+	{
+		RecipeSubsystem->GetShapeClaims().Free(ClaimHandle);
+	}
+	if(RecipeSubsystem)
+	{
+		RecipeSubsystem->GetShapePopulation().Remove(*this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+const FShapeClaimHandle& AShapeActor::GetClaimHandle(FShapeClaimTable& ShapeClaims)
+{
+	if(!ClaimHandle.IsValid())
+	{
+		ClaimHandle = ShapeClaims.Allocate();
+	}
+	return ClaimHandle;
 }
 
 void AShapeActor::Tick(float DeltaTime)
@@ -18,6 +99,162 @@ void AShapeActor::Tick(float DeltaTime)
 	RotateActor(DeltaTime);
 }
 
+FName AShapeActor::GetShapeKey() const
+{
+	if(ShapeKey.IsNone())
+	{
+		ShapeKey = FName(*ShapeName.ToString());
+	}
+	return ShapeKey;
+}
+
+void AShapeActor::SetIsProvisional(bool bInIsProvisional)
+{
+	bIsProvisional = bInIsProvisional;
+
+	// A provisional shape must never be detected by a machine collider, nor fall through the floor
+	SetActorEnableCollision(!bIsProvisional);
+	if(bIsProvisional)
+	{
+		ShapeMesh->SetSimulatePhysics(false);
+	}
+}
+
+void AShapeActor::Retire()
+{
+	bIsRetired = true;
+
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	SetActorTickEnabled(false);
+	ShapeMesh->SetSimulatePhysics(false);
+}
+
+void AShapeActor::AddToStack(int32 Count)
+{
+	if(!ensure(HasAuthority()))
+	{
+		return;
+	}
+
+	StackCount = FMath::Max(StackCount + Count, 1);
+	Touch();
+
+	// A stack idle in an inventory is dormant, the new count must still reach the clients
+	if(NetDormancy > DORM_Awake)
+	{
+		FlushNetDormancy();
+	}
+}
+
+bool AShapeActor::CanStack() const
+{
+	return HasAuthority() && !bIsProvisional && !bIsRetired;
+}
+
+void AShapeActor::EnterInventory(AMachineActor& Machine)
+{
+	++InventoryCount;
+	Touch();
+	UpdateNetDormancy();
+
+	if(!HoldingMachine.IsValid())
+	{
+		HoldingMachine = &Machine;
+		UpdateReplicationHome();
+	}
+}
+
+void AShapeActor::LeaveInventory(AMachineActor& Machine)
+{
+	InventoryCount = FMath::Max(InventoryCount - 1, 0);
+	Touch();
+	UpdateNetDormancy();
+
+	if(HoldingMachine.Get() == &Machine || InventoryCount == 0)
+	{
+		HoldingMachine = nullptr;
+		UpdateReplicationHome();
+	}
+}
+
+void AShapeActor::OnShapeMeshSleep(UPrimitiveComponent* SleepingComponent, FName BoneName)
+{
+	// Settling ends a move, the shape is idle from now on
+	Touch();
+	UpdateNetDormancy();
+}
+
+void AShapeActor::OnShapeMeshWake(UPrimitiveComponent* WakingComponent, FName BoneName)
+{
+	Touch();
+	UpdateNetDormancy();
+
+	// Machines stop polling the candidates resting outside their capture radius
+	TArray<AActor*> OverlappingMachines = {};
+	GetOverlappingActors(OverlappingMachines, AMachineActor::StaticClass());
+	for(AActor* OverlappingMachine : OverlappingMachines)
+	{
+		CastChecked<AMachineActor>(OverlappingMachine)->WakeShapeCandidate(*this);
+	}
+}
+
+bool AShapeActor::IsAsleep() const
+{
+	return !ShapeMesh->IsSimulatingPhysics() || !ShapeMesh->RigidBodyIsAwake();
+}
+
+void AShapeActor::SetWaiting(bool bIsWaiting)
+{
+	WaitingCount = FMath::Max(WaitingCount + (bIsWaiting ? 1 : -1), 0);
+	Touch();
+}
+
+bool AShapeActor::IsClaimed(const FShapeClaimTable& ShapeClaims) const
+{
+	return ClaimHandle.IsValid() && ShapeClaims.GetOwner(ClaimHandle) != FShapeClaimTable::NoOwner;
+}
+
+void AShapeActor::UpdateReplicationHome()
+{
+	const UNetDriver* NetDriver = GetNetDriver();
+	if(UIB_TestReplicationGraph* ReplicationGraph = NetDriver ? Cast<UIB_TestReplicationGraph>(NetDriver->GetReplicationDriver()) : nullptr)
+	{
+		ReplicationGraph->UpdateShapeHome(*this);
+	}
+}
+
+void AShapeActor::Touch()
+{
+	UWorld* World = GetWorld();
+	LastTouchedTime = World ? World->GetTimeSeconds() : 0.;
+
+	// Also moves the shape in or out of the eviction order, whether it is held or waiting may have changed
+	URecipeSubsystem* RecipeSubsystem = World && PopulationIndex != INDEX_NONE ? World->GetSubsystem<URecipeSubsystem>() : nullptr;
+	if(RecipeSubsystem)
+	{
+		RecipeSubsystem->GetShapePopulation().Touch(*this);
+	}
+}
+
+void AShapeActor::UpdateNetDormancy()
+{
+	if(!HasAuthority())
+	{
+		return;
+	}
+
+	if(InventoryCount > 0 && IsAsleep())
+	{
+		// Only physics moves the shape on the server, the cosmetic yaw rotation runs on clients, see BeginPlay()
+		SetNetDormancy(DORM_DormantAll);
+	}
+	else if(NetDormancy != DORM_Awake)
+	{
+		SetNetDormancy(DORM_Awake);
+	}
+}
+
 void AShapeActor::RotateActor(float DeltaTime)
 {
 	FRotator NewRotation = GetActorRotation();
@@ -4,8 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "IB_Test/Simulation/ShapeClaimTable.h"
 #include "ShapeActor.generated.h"
 
+class AMachineActor;
+
 /**
  * Actor representing a Shape
  */
@@ -25,16 +28,244 @@ public:
 	 */
 	FText GetShapeName() const { return ShapeName;}
 
+	/**
+	 * @return The name of the shape as a key, converted once.
+	 */
+	FName GetShapeKey() const;
+
+	/**
+	 * @brief Flags this shape as a client-side prediction waiting for server confirmation.
+	 *
+	 * Provisional shapes are local-only: they have no collision so they can't be ingested by a machine
+	 * and are destroyed once the replicated output of their conversion begins play, or when the server rejects it.
+	 *
+	 * @param bInIsProvisional True to turn the shape into a provisional one.
+	 */
+	void SetIsProvisional(bool bInIsProvisional);
+
+	/**
+	 * @return True if the shape is a client-side prediction.
+	 */
+	bool IsProvisional() const { return bIsProvisional; }
+
+	/**
+	 * @brief Tags the shape with the conversion which spawned it (server only), before it is first replicated.
+	 *
+	 * Clients match it against their predictions to replace the provisional shape without a blink.
+	 *
+	 * @param InConversionId Server-side id of the conversion.
+	 */
+	void SetConversionId(int32 InConversionId) { ConversionId = InConversionId; }
+
+	/**
+	 * @return Server-side id of the conversion which spawned the shape, INDEX_NONE if it wasn't spawned by one.
+	 */
+	int32 GetConversionId() const { return ConversionId; }
+
+	/**
+	 * @return The static mesh component representing the shape.
+	 */
+	const UStaticMeshComponent* GetShapeMesh() const { return ShapeMesh; }
+
+	/**
+	 * @brief Called on the server when the shape enters a machine inventory.
+	 *
+	 * Idle shapes sitting in an inventory go dormant so they stop costing replication until they move or leave,
+	 * and are replicated along with the machine holding them.
+	 *
+	 * @param Machine The machine holding the shape.
+	 */
+	void EnterInventory(AMachineActor& Machine);
+
+	/**
+	 * @brief Called on the server when the shape leaves a machine inventory.
+	 *
+	 * @param Machine The machine which held the shape.
+	 */
+	void LeaveInventory(AMachineActor& Machine);
+
+	/**
+	 * @brief Called on the server when a full machine makes the shape wait outside, or stops doing so.
+	 *
+	 * @param bIsWaiting True when the shape starts waiting at a machine, false when it stops.
+	 */
+	void SetWaiting(bool bIsWaiting);
+
+	/**
+	 * @brief Gets the handle of the shape in the claim table, allocated the first time a machine needs it.
+	 *
+	 * @param ShapeClaims The claim table of the world.
+	 * @return The claim handle of the shape.
+	 */
+	const FShapeClaimHandle& GetClaimHandle(FShapeClaimTable& ShapeClaims);
+
+	/**
+	 * @param ShapeClaims The claim table of the world.
+	 * @return True if a machine owns the shape.
+	 */
+	bool IsClaimed(const FShapeClaimTable& ShapeClaims) const;
+
+	/**
+	 * @brief Hides the shape and removes its collision and physics while it waits for its destruction.
+	 *
+	 * Its claim is kept until the shape is destroyed, see FShapeActorQueue.
+	 */
+	void Retire();
+
+	/**
+	 * @return True if the shape was consumed and waits for its destruction.
+	 */
+	bool IsRetired() const { return bIsRetired; }
+
+	/**
+	 * @return The number of identical shapes this actor stands for.
+	 */
+	int32 GetStackCount() const { return StackCount; }
+
+	/**
+	 * @brief Adds units to the stack (server only).
+	 *
+	 * @param Count Number of units added, negative to take units. The stack never goes below one unit, destroy it instead.
+	 */
+	void AddToStack(int32 Count);
+
+	/**
+	 * @return True if other units may be merged into this stack: a server shape neither provisional nor retired.
+	 */
+	bool CanStack() const;
+
+	/**
+	 * @return True while a machine holds the shape in its inventory.
+	 */
+	bool IsInInventory() const { return InventoryCount > 0; }
+
+	/**
+	 * @return True while the shape waits outside a full machine.
+	 */
+	bool IsWaiting() const { return WaitingCount > 0; }
+
+	/**
+	 * @return True if physics doesn't move the shape, it stays where it is until its body wakes up.
+	 */
+	bool IsAsleep() const;
+
+	/**
+	 * @return The machine holding the shape in its inventory, nullptr for a loose shape.
+	 */
+	AMachineActor* GetHoldingMachine() const { return HoldingMachine.Get(); }
+
+	/**
+	 * @return World time the shape was last spawned, moved, restacked or passed between inventories, for the population policies.
+	 */
+	double GetLastTouchedTime() const { return LastTouchedTime; }
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/**
+	 * Called when the physics body of the shape falls asleep
+	 */
+	UFUNCTION()
+	void OnShapeMeshSleep(UPrimitiveComponent* SleepingComponent, FName BoneName);
+
+	/**
+	 * Called when the physics body of the shape wakes up
+	 */
+	UFUNCTION()
+	void OnShapeMeshWake(UPrimitiveComponent* WakingComponent, FName BoneName);
+
 	/**
 	 * The name of the shape.
 	 */
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Shape")
 	FText ShapeName = FText();
 
+	/**
+	 * Number of identical shapes this actor stands for, machines consume the units one by one.
+	 */
+	UPROPERTY(Transient, Replicated, VisibleInstanceOnly, BlueprintReadOnly, Category = "Shape")
+	int32 StackCount = 1;
+
+	/**
+	 * See GetConversionId(), only sent with the initial replication of the shape.
+	 */
+	UPROPERTY(Transient, Replicated, VisibleInstanceOnly, Category = "Shape")
+	int32 ConversionId = INDEX_NONE;
+
 	/**
 	 * The static mesh component representing the shape.
 	 */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Shape")
 	UStaticMeshComponent* ShapeMesh;
+
+private:
+	friend class FShapePopulation;
+
+	/**
+	 * Puts the shape to net dormancy if it is idle in an inventory, wakes it up otherwise.
+	 */
+	void UpdateNetDormancy();
+
+	/**
+	 * Moves the shape to the replication node matching its holding machine.
+	 */
+	void UpdateReplicationHome();
+
+	/**
+	 * Marks the shape as used now, see GetLastTouchedTime().
+	 */
+	void Touch();
+
+	/**
+	 * True while the shape only exists as a client-side prediction.
+	 */
+	UPROPERTY(Transient)
+	bool bIsProvisional = false;
+
+	/**
+	 * True once the shape was consumed, until it is destroyed.
+	 */
+	UPROPERTY(Transient)
+	bool bIsRetired = false;
+
+	/**
+	 * ShapeName as a key, set on the first GetShapeKey().
+	 */
+	mutable FName ShapeKey = NAME_None;
+
+	/**
+	 * See GetLastTouchedTime().
+	 */
+	double LastTouchedTime = 0.;
+
+	/**
+	 * Index of the shape in the population of the Recipe Subsystem, INDEX_NONE while it isn't registered.
+	 */
+	int32 PopulationIndex = INDEX_NONE;
+
+	/**
+	 * Number of machine inventories containing the shape, at most one since machines claim the shapes they hold.
+	 */
+	UPROPERTY(Transient)
+	int32 InventoryCount = 0;
+
+	/**
+	 * Number of machines the shape waits at.
+	 */
+	int32 WaitingCount = 0;
+
+	/**
+	 * See GetHoldingMachine().
+	 */
+	UPROPERTY(Transient)
+	TWeakObjectPtr<AMachineActor> HoldingMachine = nullptr;
+
+	/**
+	 * Slot of the shape in the claim table, invalid until a machine claims it.
+	 */
+	FShapeClaimHandle ClaimHandle;
 };
@@ -0,0 +1,74 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "MachineControlComponent.h"
+
+#include "GameFramework/Pawn.h"
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "IB_Test/UI/RecipeDataEntry.h"
+#include "IB_Test/Utilities/HelperClass.h"
+
+UMachineControlComponent::UMachineControlComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	SetIsReplicatedByDefault(true);
+}
+
+void UMachineControlComponent::ServerToggleRecipe_Implementation(AMachineActor* Machine, const FText& RecipeName, bool bIsActivated, int32 PredictionKey)
+{
+	URecipeSubsystem* RecipeSubsystem = GetRecipeSubsystem();
+	const bool bAccepted = Machine && RecipeSubsystem && RecipeSubsystem->ToggleRecipe(*Machine, RecipeName, bIsActivated);
+	if(!bAccepted)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UMachineControlComponent::ServerToggleRecipe - Refused toggle of recipe %s"), *RecipeName.ToString());
+	}
+
+	ClientAckToggle(PredictionKey, bAccepted);
+}
+
+void UMachineControlComponent::ServerSpawnRecipe_Implementation(AMachineActor* Machine, const FText& RecipeName, int32 PredictionKey)
+{
+	// Only the activated recipes of the machine can be spawned, the request may name any recipe of the DataTable
+	URecipeSubsystem* RecipeSubsystem = GetRecipeSubsystem();
+	const URecipeDataItem* Recipe = Machine ? Machine->GetRecipeEntry(UHelperClass::ConvertToName(RecipeName)) : nullptr;
+	if(!Recipe || !Recipe->bIsActivated || !RecipeSubsystem)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UMachineControlComponent::ServerSpawnRecipe - Refused spawn of recipe %s"), *RecipeName.ToString());
+		ClientConfirmConversion(PredictionKey, INDEX_NONE);
+		return;
+	}
+
+	const APawn* OwnerPawn = Cast<APawn>(GetOwner());
+	const int32 ConversionId = RecipeSubsystem->SpawnRecipe(*Machine, RecipeName, OwnerPawn ? OwnerPawn->GetPlayerState() : nullptr, PredictionKey);
+
+	ClientConfirmConversion(PredictionKey, ConversionId);
+}
+
+void UMachineControlComponent::ClientAckToggle_Implementation(int32 PredictionKey, bool bAccepted)
+{
+	if(URecipeSubsystem* RecipeSubsystem = GetRecipeSubsystem())
+	{
+		RecipeSubsystem->AcknowledgePredictedToggle(PredictionKey, bAccepted);
+	}
+}
+
+void UMachineControlComponent::ClientConfirmConversion_Implementation(int32 PredictionKey, int32 ConversionId)
+{
+	if(URecipeSubsystem* RecipeSubsystem = GetRecipeSubsystem())
+	{
+		RecipeSubsystem->ConfirmPredictedConversion(PredictionKey, ConversionId);
+	}
+}
+
+URecipeSubsystem* UMachineControlComponent::GetRecipeSubsystem() const
+{
+	const UWorld* World = GetWorld();
+	if(!ensure(World))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UMachineControlComponent::GetRecipeSubsystem - World is nullptr"));
+		return nullptr;
+	}
+
+	return World->GetSubsystem<URecipeSubsystem>();
+}
@@ -0,0 +1,72 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "MachineControlComponent.generated.h"
+
+class AMachineActor;
+class URecipeSubsystem;
+
+/**
+ * Component owned by the player pawn, used as the network channel between the machine UI and the server.
+ *
+ * The UI lives on the client while machines are server-authoritative, so every request goes through
+ * a Server RPC on this component and every answer comes back through a Client RPC tagged with the
+ * prediction key the client generated when it predicted the result locally.
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class IB_TEST_API UMachineControlComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UMachineControlComponent();
+
+	/**
+	 * @brief Asks the server to toggle a recipe on a machine.
+	 *
+	 * @param Machine The machine owning the recipe.
+	 * @param RecipeName The name of the recipe to toggle.
+	 * @param bIsActivated The requested activation state.
+	 * @param PredictionKey Key of the matching client prediction.
+	 */
+	UFUNCTION(Server, Reliable)
+	void ServerToggleRecipe(AMachineActor* Machine, const FText& RecipeName, bool bIsActivated, int32 PredictionKey);
+
+	/**
+	 * @brief Asks the server to spawn the output of a recipe on a machine.
+	 *
+	 * @param Machine The machine on which the output is spawned.
+	 * @param RecipeName The name of the recipe to spawn.
+	 * @param PredictionKey Key of the matching client prediction.
+	 */
+	UFUNCTION(Server, Reliable)
+	void ServerSpawnRecipe(AMachineActor* Machine, const FText& RecipeName, int32 PredictionKey);
+
+protected:
+	/**
+	 * @brief Server answer to a ServerToggleRecipe request.
+	 *
+	 * @param PredictionKey Key of the client prediction being acknowledged.
+	 * @param bAccepted False if the server refused the toggle and the prediction must be rolled back.
+	 */
+	UFUNCTION(Client, Reliable)
+	void ClientAckToggle(int32 PredictionKey, bool bAccepted);
+
+	/**
+	 * @brief Server answer to a ServerSpawnRecipe request.
+	 *
+	 * @param PredictionKey Key of the client prediction being confirmed.
+	 * @param ConversionId Server-side id of the conversion, INDEX_NONE if it was refused.
+	 */
+	UFUNCTION(Client, Reliable)
+	void ClientConfirmConversion(int32 PredictionKey, int32 ConversionId);
+
+private:
+	/**
+	 * @return The recipe subsystem of the owning world.
+	 */
+	URecipeSubsystem* GetRecipeSubsystem() const;
+};
@@ -0,0 +1,146 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "FactorySnapshot.h"
+
+namespace FactorySnapshot
+{
+	constexpr uint32 SnapshotMagic = 0x53464249; // "IBFS"
+	constexpr uint32 JournalMagic = 0x4A464249; // "IBFJ"
+	/** 2: loose shapes are stacks carrying a count */
+	constexpr uint32 Version = 2;
+
+	/**
+	 * Serializes a signed value as a packed unsigned one, values are never negative in the snapshot.
+	 */
+	void SerializePacked(FArchive& Ar, int32& Value)
+	{
+		uint32 PackedValue = static_cast<uint32>(FMath::Max(Value, 0));
+		Ar.SerializeIntPacked(PackedValue);
+		Value = static_cast<int32>(PackedValue);
+	}
+
+	/**
+	 * Serializes the number of elements of an array, then resizes it when loading.
+	 * A count larger than the bytes left can't come from a valid file, the archive is flagged as failed instead of allocating it.
+	 */
+	template<typename ElementType>
+	bool SerializeNum(FArchive& Ar, TArray<ElementType>& Array)
+	{
+		int32 Num = Array.Num();
+		SerializePacked(Ar, Num);
+		if(Ar.IsLoading())
+		{
+			// Every element takes at least one byte
+			const int64 NumBytesLeft = Ar.TotalSize() - Ar.Tell();
+			if(Ar.IsError() || Num < 0 || Num > NumBytesLeft)
+			{
+				Ar.SetError();
+				return false;
+			}
+			Array.SetNum(Num);
+		}
+		return !Ar.IsError();
+	}
+
+	/**
+	 * Serializes names as plain strings, memory archives have no name table.
+	 */
+	bool SerializeNames(FArchive& Ar, TArray<FName>& Names)
+	{
+		if(!SerializeNum(Ar, Names))
+		{
+			return false;
+		}
+
+		for(FName& Name : Names)
+		{
+			FString NameString = Name.ToString();
+			Ar << NameString;
+			Name = FName(*NameString);
+		}
+		return !Ar.IsError();
+	}
+
+	/**
+	 * @param OutFileVersion Version of the data, older versions are still read.
+	 */
+	bool SerializeHeader(FArchive& Ar, uint32 ExpectedMagic, uint32& OutFileVersion)
+	{
+		uint32 Magic = ExpectedMagic;
+		OutFileVersion = Version;
+		Ar << Magic;
+		Ar << OutFileVersion;
+		return !Ar.IsError() && Magic == ExpectedMagic && OutFileVersion >= 1 && OutFileVersion <= Version;
+	}
+}
+
+bool FFactorySnapshot::Serialize(FArchive& Ar)
+{
+	uint32 FileVersion = 0;
+	if(!FactorySnapshot::SerializeHeader(Ar, FactorySnapshot::SnapshotMagic, FileVersion))
+	{
+		return false;
+	}
+
+	Ar << SnapshotId;
+	if(!FactorySnapshot::SerializeNames(Ar, ShapeNames) || !FactorySnapshot::SerializeNum(Ar, Machines))
+	{
+		return false;
+	}
+
+	for(FMachineSnapshot& Machine : Machines)
+	{
+		Ar << Machine.MachineName;
+		Ar << Machine.RecipeActivations;
+
+		if(!FactorySnapshot::SerializeNum(Ar, Machine.Inventory))
+		{
+			return false;
+		}
+
+		for(FShapeCountSnapshot& Entry : Machine.Inventory)
+		{
+			FactorySnapshot::SerializePacked(Ar, Entry.ShapeId);
+			FactorySnapshot::SerializePacked(Ar, Entry.Count);
+		}
+	}
+
+	if(!FactorySnapshot::SerializeNum(Ar, LooseShapes))
+	{
+		return false;
+	}
+
+	for(FLooseShapeSnapshot& LooseShape : LooseShapes)
+	{
+		FactorySnapshot::SerializePacked(Ar, LooseShape.ShapeId);
+		if(FileVersion >= 2)
+		{
+			FactorySnapshot::SerializePacked(Ar, LooseShape.Count);
+		}
+		Ar << LooseShape.Location;
+		Ar << LooseShape.Rotation;
+	}
+
+	return !Ar.IsError();
+}
+
+bool FFactoryJournalHeader::Serialize(FArchive& Ar)
+{
+	uint32 FileVersion = 0;
+	if(!FactorySnapshot::SerializeHeader(Ar, FactorySnapshot::JournalMagic, FileVersion))
+	{
+		return false;
+	}
+
+	Ar << SnapshotId;
+	if(!FactorySnapshot::SerializeNum(Ar, MachineNames))
+	{
+		return false;
+	}
+	for(FString& MachineName : MachineNames)
+	{
+		Ar << MachineName;
+	}
+
+	return FactorySnapshot::SerializeNames(Ar, ShapeNames) && FactorySnapshot::SerializeNames(Ar, RecipeNames);
+}
@@ -0,0 +1,123 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Number of shapes of a kind, identified by its compact shape id.
+ */
+struct IB_TEST_API FShapeCountSnapshot
+{
+	int32 ShapeId = INDEX_NONE;
+	int32 Count = 0;
+};
+
+/**
+ * Saved state of a machine: recipe activations and inventory counts.
+ */
+struct IB_TEST_API FMachineSnapshot
+{
+	/** Name of the machine, machines are matched by name on restore */
+	FString MachineName;
+
+	/** One bit per recipe, indexed like AMachineActor::AffectedRecipes */
+	TBitArray<> RecipeActivations;
+
+	/** Inventory of the machine, only as counts */
+	TArray<FShapeCountSnapshot> Inventory;
+};
+
+/**
+ * Saved state of a shape lying outside of any machine.
+ */
+struct IB_TEST_API FLooseShapeSnapshot
+{
+	int32 ShapeId = INDEX_NONE;
+	/** Units of the shape stack */
+	int32 Count = 1;
+	FVector3f Location = FVector3f::ZeroVector;
+	FQuat4f Rotation = FQuat4f::Identity;
+};
+
+/**
+ * Compact binary snapshot of the whole factory.
+ *
+ * Shapes are referenced by compact ids, the snapshot embeds its own id-to-name table so it stays valid
+ * if shapes are added to the DataTable afterward.
+ */
+struct IB_TEST_API FFactorySnapshot
+{
+	/** Identifies the snapshot, the journal written after it carries the same id */
+	FGuid SnapshotId;
+
+	/** Shape names indexed by the ids used in this snapshot */
+	TArray<FName> ShapeNames;
+
+	TArray<FMachineSnapshot> Machines;
+
+	TArray<FLooseShapeSnapshot> LooseShapes;
+
+	/**
+	 * Serializes the snapshot in both directions.
+	 *
+	 * @param Ar The archive to read from or write to.
+	 * @return False if the data isn't a snapshot or uses an unknown version.
+	 */
+	bool Serialize(FArchive& Ar);
+};
+
+/**
+ * Kind of change appended to the journal
+ */
+enum class EFactoryJournalEventType : uint8
+{
+	ShapeArrive,	// Units entered a machine inventory
+	ShapeLeave,		// Units left a machine inventory, consumed inputs included
+	ShapePickUp,	// A loose shape was taken by a machine, it no longer lies in the world
+	ShapeDrop,		// Units were released as a loose shape next to a machine
+	Conversion		// A machine converted a recipe, its inputs are journaled as departures just before
+};
+
+/**
+ * Header of the append-only journal written between two snapshots.
+ * Entries only store indices into the tables of the header.
+ */
+struct IB_TEST_API FFactoryJournalHeader
+{
+	/** Id of the snapshot the journal applies to */
+	FGuid SnapshotId;
+
+	TArray<FString> MachineNames;
+
+	TArray<FName> ShapeNames;
+
+	TArray<FName> RecipeNames;
+
+	/**
+	 * Serializes the header in both directions.
+	 *
+	 * @param Ar The archive to read from or write to.
+	 * @return False if the data isn't a journal or uses an unknown version.
+	 */
+	bool Serialize(FArchive& Ar);
+};
+
+/**
+ * A single change of the journal, fixed size so the journal can be appended and read back without framing.
+ */
+struct IB_TEST_API FFactoryJournalEntry
+{
+	uint16 MachineIndex = 0;
+
+	/** Index of the shape in FFactoryJournalHeader::ShapeNames, or of the recipe for conversions */
+	uint16 Argument = 0;
+
+	/** Number of units, larger stacks are split over several entries */
+	uint16 Count = 1;
+
+	EFactoryJournalEventType Type = EFactoryJournalEventType::ShapeArrive;
+
+	uint8 Padding = 0;
+};
+static_assert(sizeof(FFactoryJournalEntry) == 8, "Journal entries are written as raw bytes");
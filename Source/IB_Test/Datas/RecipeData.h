@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "Engine/DataTable.h"
+#include "GameplayTagContainer.h"
 #include "RecipeData.generated.h"
 
 /**
@@ -21,6 +22,30 @@ struct IB_TEST_API FRecipeData : public FTableRowBase
 	{
 	}
 
+	/**
+	 * @brief Compares every field of two recipes.
+	 *
+	 * @param Other The recipe to compare with.
+	 * @return True if both recipes have the same name, inputs, ingredients, output, allocation settings and duration.
+	 */
+	bool IsSameRecipe(const FRecipeData& Other) const
+	{
+		if(!Name.EqualTo(Other.Name) || !OutputShape.EqualTo(Other.OutputShape) || InputShape.Num() != Other.InputShape.Num()
+			|| InputQueries != Other.InputQueries || Priority != Other.Priority || Weight != Other.Weight || Duration != Other.Duration)
+		{
+			return false;
+		}
+
+		for(int32 InputIndex = 0; InputIndex < InputShape.Num(); ++InputIndex)
+		{
+			if(!InputShape[InputIndex].EqualTo(Other.InputShape[InputIndex]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
 	/**
 	 * Name of the Recipe
 	 */
@@ -33,9 +58,33 @@ struct IB_TEST_API FRecipeData : public FTableRowBase
 	UPROPERTY(EditAnywhere)
 	TArray<FText> InputShape;
 
+	/**
+	 * Wildcard ingredients, each one consumes a single shape whose tags match the query.
+	 */
+	UPROPERTY(EditAnywhere)
+	TArray<FGameplayTagQuery> InputQueries;
+
 	/**
 	 * Shapes produced by the recipe.
 	 */
 	UPROPERTY(EditAnywhere)
 	FText OutputShape;
+
+	/**
+	 * Recipes with a higher priority are served first when competing for the same inputs.
+	 */
+	UPROPERTY(EditAnywhere)
+	int32 Priority = 0;
+
+	/**
+	 * Conversions per turn when a machine shares its inputs in weighted round-robin.
+	 */
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "1"))
+	int32 Weight = 1;
+
+	/**
+	 * Time a machine slot is busy converting the inputs, 0 for an instant conversion.
+	 */
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0", Units = "s"))
+	float Duration = 0.f;
 };
\ No newline at end of file
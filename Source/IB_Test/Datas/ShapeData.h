@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "Engine/DataTable.h"
+#include "GameplayTagContainer.h"
 #include "ShapeData.generated.h"
 
 class AShapeActor;
@@ -18,7 +19,7 @@ struct IB_TEST_API FShapeData : public FTableRowBase
 
 	FShapeData() = default;
 
-	FShapeData(const FText& InName,const FText& InDescription, const TSubclassOf<AShapeActor> InShapeActorClass) :
+	FShapeData(const FText& InName,const FText& InDescription, const TSoftClassPtr<AShapeActor>& InShapeActorClass) :
 	Name(InName), Description(InDescription), ShapeActorClass(InShapeActorClass)
 	{
 	}
@@ -36,8 +37,20 @@ struct IB_TEST_API FShapeData : public FTableRowBase
 	FText Description;
 
 	/**
-	 * Class of the shape
+	 * Class of the shape, streamed when first needed
 	 */
 	UPROPERTY(EditAnywhere)
-	TSubclassOf<AShapeActor> ShapeActorClass;
+	TSoftClassPtr<AShapeActor> ShapeActorClass;
+
+	/**
+	 * Value of the shape, maximized by machines allocating their inputs by value
+	 */
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "0"))
+	float Value = 1.f;
+
+	/**
+	 * Tags of the shape, matched against the ingredient queries of the recipes (e.g. Shape.Triangle.Red)
+	 */
+	UPROPERTY(EditAnywhere)
+	FGameplayTagContainer Tags;
 };
\ No newline at end of file
@@ -0,0 +1,421 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "FactoryBenchmarkCommandlet.h"
+
+#include "Dom/JsonObject.h"
+#include "Engine/DataTable.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/PlatformMemory.h"
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Actors/ShapeActor.h"
+#include "IB_Test/Datas/RecipeData.h"
+#include "IB_Test/Datas/ShapeData.h"
+#include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "IB_Test/Subsystems/SimulationLodSubsystem.h"
+#include "IB_Test/Utilities/HelperClass.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "UObject/Package.h"
+
+namespace FactoryBenchmark
+{
+	/**
+	 * Shapes added to a machine every frame
+	 */
+	struct FMachineFeed
+	{
+		TWeakObjectPtr<AMachineActor> Machine;
+		TArray<FName, TInlineAllocator<8>> Inputs;
+		float Accumulator = 0.f;
+	};
+
+	double GetPercentile(const TArray<double>& SortedValues, double Percentile)
+	{
+		if(SortedValues.IsEmpty())
+		{
+			return 0.;
+		}
+		const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * SortedValues.Num()) - 1, 0, SortedValues.Num() - 1);
+		return SortedValues[Index];
+	}
+
+	FText GetShapeName(int32 ShapeIndex)
+	{
+		return FText::FromString(FString::Printf(TEXT("BenchShape_%d"), ShapeIndex));
+	}
+
+	FText GetRecipeName(int32 RecipeIndex)
+	{
+		return FText::FromString(FString::Printf(TEXT("BenchRecipe_%d"), RecipeIndex));
+	}
+}
+
+void FFactoryBenchmarkOptions::Parse(const FString& Params)
+{
+	FParse::Value(*Params, TEXT("Map="), MapName);
+	FParse::Value(*Params, TEXT("Machines="), NumMachines);
+	FParse::Value(*Params, TEXT("Recipes="), NumRecipes);
+	FParse::Value(*Params, TEXT("Shapes="), NumShapes);
+	FParse::Value(*Params, TEXT("RecipesPerMachine="), RecipesPerMachine);
+	FParse::Value(*Params, TEXT("RecipeDuration="), RecipeDuration);
+	FParse::Value(*Params, TEXT("Output="), OutputTarget);
+	FParse::Value(*Params, TEXT("FeedRate="), FeedRate);
+	FParse::Value(*Params, TEXT("Duration="), Duration);
+	FParse::Value(*Params, TEXT("Lod="), Lod);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("Report="), ReportPath);
+
+	float TickRate = 1.f / DeltaSeconds;
+	FParse::Value(*Params, TEXT("TickRate="), TickRate);
+	DeltaSeconds = 1.f / FMath::Max(TickRate, 1.f);
+
+	NumMachines = FMath::Max(NumMachines, 1);
+	NumRecipes = FMath::Max(NumRecipes, 1);
+	// A recipe needs at least one shape to consume and another one to produce
+	NumShapes = FMath::Max(NumShapes, 2);
+	RecipesPerMachine = FMath::Clamp(RecipesPerMachine, 1, NumRecipes);
+	Duration = FMath::Max(Duration, DeltaSeconds);
+
+	if(ReportPath.IsEmpty())
+	{
+		ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("FactoryBenchmark.json");
+	}
+}
+
+UFactoryBenchmarkCommandlet::UFactoryBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = true;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UFactoryBenchmarkCommandlet::Main(const FString& Params)
+{
+	using namespace FactoryBenchmark;
+
+	FFactoryBenchmarkOptions Options;
+	Options.Parse(Params);
+	const bool bIsLoadedMap = !Options.MapName.IsEmpty();
+
+	UWorld* World = CreateBenchmarkWorld(Options);
+	if(!World)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryBenchmarkCommandlet::Main - Couldn't load map %s"), *Options.MapName);
+		return 1;
+	}
+
+	URecipeSubsystem* RecipeSubsystem = World->GetSubsystem<URecipeSubsystem>();
+	if(!ensure(RecipeSubsystem))
+	{
+		DestroyBenchmarkWorld(*World, bIsLoadedMap);
+		return 1;
+	}
+
+	if(!bIsLoadedMap)
+	{
+		GenerateDataTables(Options);
+		RecipeSubsystem->OverrideDataTables(RecipeDataTable, ShapeDataTable);
+	}
+
+	FURL URL;
+	World->SetGameMode(URL);
+	World->InitializeActorsForPlay(URL);
+	if(!bIsLoadedMap)
+	{
+		SpawnSyntheticMachines(*World, Options);
+	}
+	World->BeginPlay();
+
+	// Streaming is a hitch of its own, every shape class is loaded before measuring
+	for(const FName& ShapeName : RecipeSubsystem->GetAllShapeNames())
+	{
+		RecipeSubsystem->LoadShapeActorClass(ShapeName);
+	}
+
+	if(USimulationLodSubsystem* SimulationLodSubsystem = World->GetSubsystem<USimulationLodSubsystem>())
+	{
+		const int64 LodValue = StaticEnum<EMachineSimulationLod>()->GetValueByNameString(Options.Lod);
+		if(LodValue != INDEX_NONE)
+		{
+			SimulationLodSubsystem->SetForcedLod(static_cast<EMachineSimulationLod>(LodValue));
+		}
+	}
+
+	// Every input of the activated recipes is fed, intermediate shapes included
+	TArray<FMachineFeed> Feeds = {};
+	for(const TPair<FString, AMachineActor*>& Pair : RecipeSubsystem->GetMachinesData())
+	{
+		if(!Pair.Value)
+		{
+			continue;
+		}
+
+		FMachineFeed& Feed = Feeds.AddDefaulted_GetRef();
+		Feed.Machine = Pair.Value;
+		for(const URecipeDataItem* Recipe : Pair.Value->GetRecipeEntries())
+		{
+			for(const FText& InputName : Recipe->InputNames)
+			{
+				Feed.Inputs.AddUnique(UHelperClass::ConvertToName(InputName));
+			}
+			for(const int32 QueryIndex : Recipe->InputQueries)
+			{
+				for(const FName& ShapeName : RecipeSubsystem->GetShapeNamesById())
+				{
+					if(RecipeSubsystem->DoesShapeMatchIngredient(ShapeName, QueryIndex))
+					{
+						Feed.Inputs.AddUnique(ShapeName);
+					}
+				}
+			}
+		}
+	}
+
+	int64 NumConversions = 0;
+	const FDelegateHandle RecipeConvertedHandle = RecipeSubsystem->OnRecipeConverted.AddLambda([&NumConversions](AMachineActor&, const FName&, TConstArrayView<FName>)
+	{
+		++NumConversions;
+	});
+
+	int32 NumGarbageCollections = 0;
+	double GarbageCollectionStartTime = 0.;
+	double GarbageCollectionSeconds = 0.;
+	double MaxGarbageCollectionSeconds = 0.;
+	const FDelegateHandle PreGarbageCollectHandle = FCoreUObjectDelegates::GetPreGarbageCollectDelegate().AddLambda([&GarbageCollectionStartTime]()
+	{
+		GarbageCollectionStartTime = FPlatformTime::Seconds();
+	});
+	const FDelegateHandle PostGarbageCollectHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddLambda([&]()
+	{
+		const double Seconds = FPlatformTime::Seconds() - GarbageCollectionStartTime;
+		++NumGarbageCollections;
+		GarbageCollectionSeconds += Seconds;
+		MaxGarbageCollectionSeconds = FMath::Max(MaxGarbageCollectionSeconds, Seconds);
+	});
+
+	const int32 NumFrames = FMath::CeilToInt(Options.Duration / Options.DeltaSeconds);
+	TArray<double> FrameTimes = {};
+	FrameTimes.Reserve(NumFrames);
+
+	UE_LOG(LogTemp, Display, TEXT("UFactoryBenchmarkCommandlet::Main - Simulating %d machines for %d frames"), Feeds.Num(), NumFrames);
+
+	// The scratch memory of the evaluations is sized during the first tenth of the run, it must not grow afterward
+	const int32 NumWarmupFrames = NumFrames / 10;
+	int64 NumWarmupScratchGrowths = 0;
+
+	const double StartTime = FPlatformTime::Seconds();
+	for(int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		if(Frame == NumWarmupFrames)
+		{
+			NumWarmupScratchGrowths = RecipeSubsystem->GetRecipeScratch().GetStats().NumGrowths;
+		}
+
+		const uint64 FrameStartCycles = FPlatformTime::Cycles64();
+
+		FApp::SetDeltaTime(Options.DeltaSeconds);
+		FApp::SetCurrentTime(FApp::GetCurrentTime() + Options.DeltaSeconds);
+		++GFrameCounter;
+
+		for(FMachineFeed& Feed : Feeds)
+		{
+			Feed.Accumulator += Options.FeedRate * Options.DeltaSeconds;
+			const int32 NumShapes = FMath::FloorToInt(Feed.Accumulator);
+			if(NumShapes == 0 || !Feed.Machine.IsValid())
+			{
+				continue;
+			}
+
+			Feed.Accumulator -= NumShapes;
+			for(const FName& Input : Feed.Inputs)
+			{
+				Feed.Machine->AddShapes(Input, NumShapes);
+			}
+		}
+
+		World->Tick(LEVELTICK_All, Options.DeltaSeconds);
+		GEngine->ConditionalCollectGarbage();
+
+		FrameTimes.Add(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - FrameStartCycles));
+	}
+	const double WallSeconds = FPlatformTime::Seconds() - StartTime;
+	const double SimulatedSeconds = NumFrames * Options.DeltaSeconds;
+
+	RecipeSubsystem->OnRecipeConverted.Remove(RecipeConvertedHandle);
+	FCoreUObjectDelegates::GetPreGarbageCollectDelegate().Remove(PreGarbageCollectHandle);
+	FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGarbageCollectHandle);
+
+	double FrameTimeSum = 0.;
+	for(const double FrameTime : FrameTimes)
+	{
+		FrameTimeSum += FrameTime;
+	}
+	FrameTimes.Sort();
+
+	const TSharedRef<FJsonObject> FrameTimesObject = MakeShared<FJsonObject>();
+	FrameTimesObject->SetNumberField(TEXT("mean"), FrameTimes.IsEmpty() ? 0. : FrameTimeSum / FrameTimes.Num());
+	FrameTimesObject->SetNumberField(TEXT("p50"), GetPercentile(FrameTimes, 0.50));
+	FrameTimesObject->SetNumberField(TEXT("p90"), GetPercentile(FrameTimes, 0.90));
+	FrameTimesObject->SetNumberField(TEXT("p95"), GetPercentile(FrameTimes, 0.95));
+	FrameTimesObject->SetNumberField(TEXT("p99"), GetPercentile(FrameTimes, 0.99));
+	FrameTimesObject->SetNumberField(TEXT("max"), FrameTimes.IsEmpty() ? 0. : FrameTimes.Last());
+
+	const TSharedRef<FJsonObject> GarbageCollectionObject = MakeShared<FJsonObject>();
+	GarbageCollectionObject->SetNumberField(TEXT("count"), NumGarbageCollections);
+	GarbageCollectionObject->SetNumberField(TEXT("total_ms"), GarbageCollectionSeconds * 1000.);
+	GarbageCollectionObject->SetNumberField(TEXT("max_ms"), MaxGarbageCollectionSeconds * 1000.);
+
+	const FRecipeScratchStats ScratchStats = RecipeSubsystem->GetRecipeScratch().GetStats();
+	const int64 NumSteadyScratchGrowths = ScratchStats.NumGrowths - NumWarmupScratchGrowths;
+	if(NumSteadyScratchGrowths > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UFactoryBenchmarkCommandlet::Main - The recipe evaluations allocated %lld times after the warm-up: %s"), NumSteadyScratchGrowths, *ScratchStats.ToString());
+	}
+
+	const TSharedRef<FJsonObject> ScratchObject = MakeShared<FJsonObject>();
+	ScratchObject->SetNumberField(TEXT("frames"), ScratchStats.NumFrames);
+	ScratchObject->SetNumberField(TEXT("bytes"), ScratchStats.AllocatedBytes);
+	ScratchObject->SetNumberField(TEXT("growths"), ScratchStats.NumGrowths);
+	ScratchObject->SetNumberField(TEXT("growths_after_warmup"), NumSteadyScratchGrowths);
+
+	const FPlatformMemoryStats MemoryStats = FPlatformMemory::GetStats();
+
+	const TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("map"), bIsLoadedMap ? Options.MapName : TEXT("synthetic"));
+	Report->SetNumberField(TEXT("machines"), Feeds.Num());
+	Report->SetNumberField(TEXT("recipes"), RecipeSubsystem->GetAllRecipeNames().Num());
+	Report->SetNumberField(TEXT("shapes"), RecipeSubsystem->GetAllShapeNames().Num());
+	Report->SetStringField(TEXT("lod"), Options.Lod);
+	Report->SetNumberField(TEXT("frames"), NumFrames);
+	Report->SetNumberField(TEXT("delta_seconds"), Options.DeltaSeconds);
+	Report->SetNumberField(TEXT("simulated_seconds"), SimulatedSeconds);
+	Report->SetNumberField(TEXT("wall_seconds"), WallSeconds);
+	Report->SetNumberField(TEXT("conversions"), NumConversions);
+	Report->SetNumberField(TEXT("conversions_per_simulated_second"), NumConversions / SimulatedSeconds);
+	Report->SetNumberField(TEXT("conversions_per_wall_second"), WallSeconds > 0. ? NumConversions / WallSeconds : 0.);
+	Report->SetObjectField(TEXT("frame_time_ms"), FrameTimesObject);
+	Report->SetNumberField(TEXT("peak_used_physical_mb"), MemoryStats.PeakUsedPhysical / (1024. * 1024.));
+	Report->SetObjectField(TEXT("gc"), GarbageCollectionObject);
+	Report->SetObjectField(TEXT("scratch"), ScratchObject);
+
+	FString ReportString;
+	const TSharedRef<TJsonWriter<>> JsonWriter = TJsonWriterFactory<>::Create(&ReportString);
+	FJsonSerializer::Serialize(Report, JsonWriter);
+
+	UE_LOG(LogTemp, Display, TEXT("UFactoryBenchmarkCommandlet::Main - %s"), *ReportString);
+	if(!FFileHelper::SaveStringToFile(ReportString, *Options.ReportPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryBenchmarkCommandlet::Main - Couldn't write the report to %s"), *Options.ReportPath);
+	}
+
+	DestroyBenchmarkWorld(*World, bIsLoadedMap);
+	return 0;
+}
+
+UWorld* UFactoryBenchmarkCommandlet::CreateBenchmarkWorld(const FFactoryBenchmarkOptions& Options) const
+{
+	UWorld* World = nullptr;
+	if(Options.MapName.IsEmpty())
+	{
+		World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("FactoryBenchmark"));
+	}
+	else
+	{
+		UPackage* MapPackage = LoadPackage(nullptr, *Options.MapName, LOAD_None);
+		World = MapPackage ? UWorld::FindWorldInPackage(MapPackage) : nullptr;
+		if(!World)
+		{
+			return nullptr;
+		}
+
+		World->WorldType = EWorldType::Game;
+		World->AddToRoot();
+		World->InitWorld();
+	}
+
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	return World;
+}
+
+void UFactoryBenchmarkCommandlet::GenerateDataTables(const FFactoryBenchmarkOptions& Options)
+{
+	using namespace FactoryBenchmark;
+
+	ShapeDataTable = NewObject<UDataTable>(GetTransientPackage());
+	ShapeDataTable->RowStruct = FShapeData::StaticStruct();
+	for(int32 ShapeIndex = 0; ShapeIndex < Options.NumShapes; ++ShapeIndex)
+	{
+		const FText ShapeName = GetShapeName(ShapeIndex);
+		FShapeData ShapeData(ShapeName, FText::GetEmpty(), AShapeActor::StaticClass());
+		ShapeData.Value = ShapeIndex + 1.f;
+		ShapeDataTable->AddRow(UHelperClass::ConvertToName(ShapeName), ShapeData);
+	}
+
+	// Inputs always have a lower index than the output, the recipe graph has no cycle
+	FRandomStream RandomStream(Options.Seed);
+	RecipeDataTable = NewObject<UDataTable>(GetTransientPackage());
+	RecipeDataTable->RowStruct = FRecipeData::StaticStruct();
+	for(int32 RecipeIndex = 0; RecipeIndex < Options.NumRecipes; ++RecipeIndex)
+	{
+		const int32 OutputIndex = 1 + RecipeIndex % (Options.NumShapes - 1);
+		const TArray<FText> Inputs = {
+			GetShapeName(RandomStream.RandRange(0, OutputIndex - 1)),
+			GetShapeName(RandomStream.RandRange(0, OutputIndex - 1))
+		};
+
+		const FText RecipeName = GetRecipeName(RecipeIndex);
+		FRecipeData RecipeData(RecipeName, Inputs, GetShapeName(OutputIndex));
+		RecipeData.Duration = Options.RecipeDuration;
+		RecipeDataTable->AddRow(UHelperClass::ConvertToName(RecipeName), RecipeData);
+	}
+}
+
+void UFactoryBenchmarkCommandlet::SpawnSyntheticMachines(UWorld& World, const FFactoryBenchmarkOptions& Options) const
+{
+	using namespace FactoryBenchmark;
+
+	EMachineOutputTarget OutputTarget = EMachineOutputTarget::Sink;
+	const int64 OutputTargetValue = StaticEnum<EMachineOutputTarget>()->GetValueByNameString(Options.OutputTarget);
+	if(OutputTargetValue != INDEX_NONE)
+	{
+		OutputTarget = static_cast<EMachineOutputTarget>(OutputTargetValue);
+	}
+
+	// Far enough apart for the colliders to never overlap
+	constexpr float MachineSpacing = 1000.f;
+	const int32 GridSize = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(Options.NumMachines)));
+	for(int32 MachineIndex = 0; MachineIndex < Options.NumMachines; ++MachineIndex)
+	{
+		TArray<FText> AffectedRecipes = {};
+		for(int32 RecipeOffset = 0; RecipeOffset < Options.RecipesPerMachine; ++RecipeOffset)
+		{
+			AffectedRecipes.Add(GetRecipeName((MachineIndex + RecipeOffset) % Options.NumRecipes));
+		}
+
+		const FTransform Transform(FVector(MachineIndex % GridSize, MachineIndex / GridSize, 0.f) * MachineSpacing);
+		AMachineActor* Machine = World.SpawnActorDeferred<AMachineActor>(AMachineActor::StaticClass(), Transform);
+		if(!ensure(Machine))
+		{
+			continue;
+		}
+
+		Machine->SetupMachine(FText::FromString(FString::Printf(TEXT("BenchMachine_%d"), MachineIndex)), AffectedRecipes, OutputTarget);
+		Machine->FinishSpawning(Transform);
+	}
+}
+
+void UFactoryBenchmarkCommandlet::DestroyBenchmarkWorld(UWorld& World, bool bIsLoadedMap) const
+{
+	World.BeginTearingDown();
+	GEngine->DestroyWorldContext(&World);
+	World.DestroyWorld(false);
+
+	if(bIsLoadedMap)
+	{
+		World.RemoveFromRoot();
+	}
+}
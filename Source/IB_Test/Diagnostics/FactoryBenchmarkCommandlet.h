@@ -0,0 +1,102 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FactoryBenchmarkCommandlet.generated.h"
+
+class UDataTable;
+
+/**
+ * Options of a benchmark, parsed from the command line
+ */
+struct FFactoryBenchmarkOptions
+{
+	/** Map to load, a synthetic layout is generated when empty */
+	FString MapName;
+
+	/** Synthetic layout: number of machines, recipes and shapes */
+	int32 NumMachines = 100;
+	int32 NumRecipes = 8;
+	int32 NumShapes = 6;
+
+	/** Synthetic layout: recipes of each machine */
+	int32 RecipesPerMachine = 2;
+
+	/** Synthetic layout: duration of every recipe, 0 for instant conversions */
+	float RecipeDuration = 0.f;
+
+	/** Synthetic layout: where the machines send their outputs */
+	FString OutputTarget = TEXT("Sink");
+
+	/** Shapes of each recipe input added to every machine per simulated second */
+	float FeedRate = 20.f;
+
+	/** Simulated time, in seconds */
+	float Duration = 60.f;
+
+	/** Simulated time of a frame, frames run back to back without waiting */
+	float DeltaSeconds = 1.f / 60.f;
+
+	/** Simulation level of detail of every machine, Auto to keep the distance-based one */
+	FString Lod = TEXT("Full");
+
+	int32 Seed = 0;
+
+	/** File the JSON report is written to */
+	FString ReportPath;
+
+	void Parse(const FString& Params);
+};
+
+/**
+ * Runs the machines of a map, or of a generated layout, for a fixed simulated duration without rendering nor player
+ * and reports the conversion throughput, frame times, peak memory and garbage collection time as JSON.
+ *
+ * Usage: UnrealEditor-Cmd <Project> -run=FactoryBenchmark -nullrhi [-Map=/Game/Maps/Factory] [-Machines=100]
+ *        [-Recipes=8] [-Shapes=6] [-RecipesPerMachine=2] [-RecipeDuration=0] [-Output=Sink] [-FeedRate=20]
+ *        [-Duration=60] [-TickRate=60] [-Lod=Full] [-Seed=0] [-Report=<Path>]
+ */
+UCLASS()
+class IB_TEST_API UFactoryBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UFactoryBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	/**
+	 * Loads the map or creates an empty world, registered as the game world.
+	 *
+	 * @return The world, nullptr if the map couldn't be loaded.
+	 */
+	UWorld* CreateBenchmarkWorld(const FFactoryBenchmarkOptions& Options) const;
+
+	/**
+	 * Generates the recipe and shape DataTables of the synthetic layout, recipes only consume shapes of a lower index.
+	 */
+	void GenerateDataTables(const FFactoryBenchmarkOptions& Options);
+
+	/**
+	 * Spawns the machines of the synthetic layout on a grid, before the world begins play.
+	 */
+	void SpawnSyntheticMachines(UWorld& World, const FFactoryBenchmarkOptions& Options) const;
+
+	/**
+	 * Destroys the world and forgets its world context.
+	 */
+	void DestroyBenchmarkWorld(UWorld& World, bool bIsLoadedMap) const;
+
+	/*
+	* Generated DataTables of the synthetic layout
+	*/
+	UPROPERTY(Transient)
+	TObjectPtr<UDataTable> RecipeDataTable = nullptr;
+
+	UPROPERTY(Transient)
+	TObjectPtr<UDataTable> ShapeDataTable = nullptr;
+};
@@ -0,0 +1,161 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "MachineEventRecorder.h"
+
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "IB_Test/UI/RecipeDataEntry.h"
+#include "IB_Test/Utilities/HelperClass.h"
+
+void FMachineEventRecorder::Start(const URecipeSubsystem& RecipeSubsystem)
+{
+	Recording = FMachineEventRecording();
+	MachineIndices.Reset();
+	ShapeIndices.Reset();
+	RecipeIndices.Reset();
+
+	// Shape indices are the compact shape ids
+	Recording.ShapeNames = RecipeSubsystem.GetShapeNamesById();
+	for(int32 ShapeId = 0; ShapeId < Recording.ShapeNames.Num(); ++ShapeId)
+	{
+		ShapeIndices.Add(Recording.ShapeNames[ShapeId], ShapeId);
+	}
+
+	TArray<AMachineActor*> Machines = {};
+	RecipeSubsystem.GetMachinesData().GenerateValueArray(Machines);
+	Machines.RemoveAll([](const AMachineActor* Machine) { return Machine == nullptr; });
+	Machines.Sort([](const AMachineActor& A, const AMachineActor& B)
+	{
+		return A.GetMachineName() < B.GetMachineName();
+	});
+
+	for(const AMachineActor* Machine : Machines)
+	{
+		MachineIndices.Add(Machine, Recording.Machines.Num());
+		TMap<FName, int32>& MachineRecipeIndices = RecipeIndices.AddDefaulted_GetRef();
+
+		FRecordedMachine& RecordedMachine = Recording.Machines.AddDefaulted_GetRef();
+		RecordedMachine.Name = Machine->GetMachineName();
+		RecordedMachine.AllocationMode = Machine->GetAllocationMode();
+		RecordedMachine.ParallelSlots = Machine->GetParallelSlots();
+		RecordedMachine.InputBufferCapacity = Machine->GetInputBufferCapacity();
+		RecordedMachine.OutputBufferCapacity = Machine->GetOutputBufferCapacity();
+		RecordedMachine.OutputInterval = Machine->GetOutputInterval();
+		for(const FName& ShapeName : Recording.ShapeNames)
+		{
+			RecordedMachine.InitialCounts.Add(Machine->GetShapeCount(ShapeName));
+		}
+
+		// Recipes are recorded in the order the machine evaluates them
+		for(const URecipeDataItem* RecipeItem : Machine->GetRecipeEntries())
+		{
+			FRecordedRecipe& RecordedRecipe = RecordedMachine.Recipes.AddDefaulted_GetRef();
+			RecordedRecipe.Name = UHelperClass::ConvertToName(RecipeItem->Name);
+			RecordedRecipe.Output = static_cast<uint16>(ShapeIndices.FindRef(UHelperClass::ConvertToName(RecipeItem->OutputShape)));
+			RecordedRecipe.bIsActivated = RecipeItem->bIsActivated;
+			RecordedRecipe.Priority = RecipeItem->Priority;
+			RecordedRecipe.Weight = RecipeItem->Weight;
+			RecordedRecipe.Duration = RecipeItem->Duration;
+			RecordedRecipe.Value = RecipeSubsystem.GetShapeValue(UHelperClass::ConvertToName(RecipeItem->OutputShape));
+			for(const FText& InputName : RecipeItem->InputNames)
+			{
+				RecordedRecipe.Inputs.Add(static_cast<uint16>(ShapeIndices.FindRef(UHelperClass::ConvertToName(InputName))));
+			}
+
+			// Recordings have no tags, the replay ignores the wildcard ingredients
+			if(!RecipeItem->InputQueries.IsEmpty())
+			{
+				UE_LOG(LogTemp, Warning, TEXT("FMachineEventRecorder::Start - Wildcard ingredients of recipe %s on machine %s aren't recorded"),
+					*RecordedRecipe.Name.ToString(), *Machine->GetMachineName());
+			}
+
+			MachineRecipeIndices.Add(RecordedRecipe.Name, RecordedMachine.Recipes.Num() - 1);
+		}
+	}
+
+	StartTime = FPlatformTime::Seconds();
+	bIsRecording = true;
+}
+
+bool FMachineEventRecorder::Stop(const FString& FilePath)
+{
+	if(!bIsRecording)
+	{
+		return false;
+	}
+	bIsRecording = false;
+
+	if(!Recording.SaveToFile(FilePath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("FMachineEventRecorder::Stop - Failed to write %s"), *FilePath);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("FMachineEventRecorder::Stop - Recorded %d events on %d machines in %s"), Recording.Events.Num(), Recording.Machines.Num(), *FilePath);
+	return true;
+}
+
+FString FMachineEventRecorder::GetDefaultRecordingPath()
+{
+	return FPaths::ProjectSavedDir() / TEXT("Factory") / TEXT("MachineEvents.rec");
+}
+
+void FMachineEventRecorder::RecordShapeArrive(const AMachineActor& Machine, const FName& ShapeName, int32 Count)
+{
+	RecordShapeEvent(Machine, EMachineEventType::ShapeArrive, ShapeName, Count);
+}
+
+void FMachineEventRecorder::RecordShapeLeave(const AMachineActor& Machine, const FName& ShapeName, int32 Count)
+{
+	RecordShapeEvent(Machine, EMachineEventType::ShapeLeave, ShapeName, Count);
+}
+
+void FMachineEventRecorder::RecordToggle(const AMachineActor& Machine, const FName& RecipeName, bool bIsActivated)
+{
+	RecordRecipeEvent(Machine, EMachineEventType::Toggle, RecipeName, bIsActivated);
+}
+
+void FMachineEventRecorder::RecordSpawnClick(const AMachineActor& Machine, const FName& RecipeName)
+{
+	RecordRecipeEvent(Machine, EMachineEventType::SpawnClick, RecipeName, false);
+}
+
+void FMachineEventRecorder::RecordShapeEvent(const AMachineActor& Machine, EMachineEventType Type, const FName& ShapeName, int32 Count)
+{
+	if(!bIsRecording)
+	{
+		return;
+	}
+
+	const int32* MachineIndex = MachineIndices.Find(&Machine);
+	const int32* ShapeIndex = ShapeIndices.Find(ShapeName);
+	for(int32 Unit = 0; MachineIndex && ShapeIndex && Unit < Count; ++Unit)
+	{
+		Record(*MachineIndex, Type, *ShapeIndex, false);
+	}
+}
+
+void FMachineEventRecorder::RecordRecipeEvent(const AMachineActor& Machine, EMachineEventType Type, const FName& RecipeName, bool bValue)
+{
+	if(!bIsRecording)
+	{
+		return;
+	}
+
+	const int32* MachineIndex = MachineIndices.Find(&Machine);
+	const int32* RecipeIndex = MachineIndex ? RecipeIndices[*MachineIndex].Find(RecipeName) : nullptr;
+	if(RecipeIndex)
+	{
+		Record(*MachineIndex, Type, *RecipeIndex, bValue);
+	}
+}
+
+void FMachineEventRecorder::Record(int32 MachineIndex, EMachineEventType Type, int32 Argument, bool bValue)
+{
+	FMachineEvent& Event = Recording.Events.AddDefaulted_GetRef();
+	Event.Time = static_cast<float>(FPlatformTime::Seconds() - StartTime);
+	Event.MachineIndex = static_cast<uint16>(MachineIndex);
+	Event.Type = Type;
+	Event.Argument = static_cast<uint16>(Argument);
+	Event.bValue = bValue;
+}
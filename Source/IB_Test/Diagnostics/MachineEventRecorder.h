@@ -0,0 +1,70 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MachineEventRecording.h"
+
+class AMachineActor;
+class URecipeSubsystem;
+
+/**
+ * Records the ordered stream of events fed to every machine, so a production session can be replayed
+ * later as a benchmark with FMachineEventReplayer.
+ *
+ * Only events changing what the machine logic sees are recorded: shapes added to or removed from an inventory
+ * (consumed shapes are not "leaving"), toggles and spawn clicks.
+ */
+class IB_TEST_API FMachineEventRecorder
+{
+public:
+	/**
+	 * @brief Starts a recording, capturing the current state of every machine as its starting point.
+	 *
+	 * @param RecipeSubsystem The subsystem giving access to the machines and shapes.
+	 */
+	void Start(const URecipeSubsystem& RecipeSubsystem);
+
+	/**
+	 * @brief Stops the recording and writes it to a file.
+	 *
+	 * @param FilePath Path of the file to write.
+	 * @return True if the file was written.
+	 */
+	bool Stop(const FString& FilePath);
+
+	/**
+	 * @return True while a recording is in progress.
+	 */
+	bool IsRecording() const
+	{
+		return bIsRecording;
+	}
+
+	/** Count is the number of units of a shape stack, recorded as one event each */
+	void RecordShapeArrive(const AMachineActor& Machine, const FName& ShapeName, int32 Count = 1);
+	void RecordShapeLeave(const AMachineActor& Machine, const FName& ShapeName, int32 Count = 1);
+	void RecordToggle(const AMachineActor& Machine, const FName& RecipeName, bool bIsActivated);
+	void RecordSpawnClick(const AMachineActor& Machine, const FName& RecipeName);
+
+	/**
+	 * @return Path of the recording used when none is provided.
+	 */
+	static FString GetDefaultRecordingPath();
+
+private:
+	void RecordShapeEvent(const AMachineActor& Machine, EMachineEventType Type, const FName& ShapeName, int32 Count);
+	void RecordRecipeEvent(const AMachineActor& Machine, EMachineEventType Type, const FName& RecipeName, bool bValue);
+	void Record(int32 MachineIndex, EMachineEventType Type, int32 Argument, bool bValue);
+
+	bool bIsRecording = false;
+
+	double StartTime = 0.;
+
+	FMachineEventRecording Recording;
+
+	/** Lookups from live objects to the indices of the recording */
+	TMap<const AMachineActor*, int32> MachineIndices;
+	TMap<FName, int32> ShapeIndices;
+	TArray<TMap<FName, int32>> RecipeIndices;
+};
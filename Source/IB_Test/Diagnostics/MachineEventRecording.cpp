@@ -0,0 +1,111 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "MachineEventRecording.h"
+
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace MachineEventRecording
+{
+	constexpr uint32 Magic = 0x52454249; // "IBER"
+	constexpr uint32 Version = 3;
+
+	template<typename ElementType, typename FunctionType>
+	void SerializeArray(FArchive& Ar, TArray<ElementType>& Array, FunctionType SerializeElement)
+	{
+		int32 Num = Array.Num();
+		Ar << Num;
+		if(Ar.IsLoading())
+		{
+			Array.SetNum(FMath::Max(Num, 0));
+		}
+
+		for(ElementType& Element : Array)
+		{
+			SerializeElement(Element);
+		}
+	}
+
+	void SerializeName(FArchive& Ar, FName& Name)
+	{
+		FString NameString = Name.ToString();
+		Ar << NameString;
+		Name = FName(*NameString);
+	}
+}
+
+bool FMachineEventRecording::Serialize(FArchive& Ar)
+{
+	uint32 FileMagic = MachineEventRecording::Magic;
+	uint32 FileVersion = MachineEventRecording::Version;
+	Ar << FileMagic;
+	Ar << FileVersion;
+	if(Ar.IsError() || FileMagic != MachineEventRecording::Magic || FileVersion != MachineEventRecording::Version)
+	{
+		return false;
+	}
+
+	MachineEventRecording::SerializeArray(Ar, ShapeNames, [&Ar](FName& ShapeName)
+	{
+		MachineEventRecording::SerializeName(Ar, ShapeName);
+	});
+
+	MachineEventRecording::SerializeArray(Ar, Machines, [&Ar](FRecordedMachine& Machine)
+	{
+		uint8 AllocationMode = static_cast<uint8>(Machine.AllocationMode);
+		Ar << Machine.Name;
+		Ar << AllocationMode;
+		Ar << Machine.ParallelSlots;
+		Ar << Machine.InputBufferCapacity;
+		Ar << Machine.OutputBufferCapacity;
+		Ar << Machine.OutputInterval;
+		Ar << Machine.InitialCounts;
+		Machine.AllocationMode = static_cast<ERecipeAllocationMode>(AllocationMode);
+		MachineEventRecording::SerializeArray(Ar, Machine.Recipes, [&Ar](FRecordedRecipe& Recipe)
+		{
+			MachineEventRecording::SerializeName(Ar, Recipe.Name);
+			Ar << Recipe.Inputs;
+			Ar << Recipe.Output;
+			Ar << Recipe.bIsActivated;
+			Ar << Recipe.Priority;
+			Ar << Recipe.Weight;
+			Ar << Recipe.Duration;
+			Ar << Recipe.Value;
+		});
+	});
+
+	MachineEventRecording::SerializeArray(Ar, Events, [&Ar](FMachineEvent& Event)
+	{
+		uint8 Type = static_cast<uint8>(Event.Type);
+		Ar << Event.Time;
+		Ar << Event.MachineIndex;
+		Ar << Type;
+		Ar << Event.Argument;
+		Ar << Event.bValue;
+		Event.Type = static_cast<EMachineEventType>(Type);
+	});
+
+	return !Ar.IsError();
+}
+
+bool FMachineEventRecording::SaveToFile(const FString& FilePath)
+{
+	TArray<uint8> Bytes = {};
+	FMemoryWriter Writer(Bytes);
+	Serialize(Writer);
+
+	return FFileHelper::SaveArrayToFile(Bytes, *FilePath);
+}
+
+bool FMachineEventRecording::LoadFromFile(const FString& FilePath)
+{
+	TArray<uint8> Bytes = {};
+	if(!FFileHelper::LoadFileToArray(Bytes, *FilePath))
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(Bytes);
+	return Serialize(Reader);
+}
@@ -0,0 +1,118 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "IB_Test/Simulation/RecipeAllocator.h"
+
+/**
+ * Kind of event fed to a machine
+ */
+enum class EMachineEventType : uint8
+{
+	ShapeArrive,	// A shape entered the machine collider
+	ShapeLeave,		// A shape left the machine collider without being consumed
+	Toggle,			// A recipe was enabled or disabled
+	SpawnClick		// The "Spawn" button of a recipe was clicked
+};
+
+/**
+ * A single recorded event
+ */
+struct IB_TEST_API FMachineEvent
+{
+	/** Time of the event since the recording started, in seconds */
+	float Time = 0.f;
+
+	/** Index of the machine in FMachineEventRecording::Machines */
+	uint16 MachineIndex = 0;
+
+	EMachineEventType Type = EMachineEventType::ShapeArrive;
+
+	/** Index of the shape in FMachineEventRecording::ShapeNames, or of the recipe in the machine recipes */
+	uint16 Argument = 0;
+
+	/** New activation state for toggles */
+	bool bValue = false;
+};
+
+/**
+ * Recipe of a recorded machine
+ */
+struct IB_TEST_API FRecordedRecipe
+{
+	FName Name = NAME_None;
+
+	/** Shape indices of the inputs, a shape needed twice appears twice */
+	TArray<uint16> Inputs;
+
+	/** Shape index of the output */
+	uint16 Output = 0;
+
+	/** Activation state when the recording started */
+	bool bIsActivated = true;
+
+	int32 Priority = 0;
+
+	int32 Weight = 1;
+
+	/** Time a slot is busy converting, 0 for an instant conversion */
+	float Duration = 0.f;
+
+	/** Value of the output */
+	float Value = 1.f;
+};
+
+/**
+ * State of a machine when the recording started
+ */
+struct IB_TEST_API FRecordedMachine
+{
+	FString Name;
+
+	ERecipeAllocationMode AllocationMode = ERecipeAllocationMode::Priority;
+
+	/** Pipeline settings, see AMachineActor::SetupPipeline() */
+	int32 ParallelSlots = 1;
+	int32 InputBufferCapacity = 0;
+	int32 OutputBufferCapacity = 0;
+	float OutputInterval = 0.f;
+
+	/** Recipes in the order the machine evaluates them */
+	TArray<FRecordedRecipe> Recipes;
+
+	/** Number of available shapes, indexed like FMachineEventRecording::ShapeNames */
+	TArray<int32> InitialCounts;
+};
+
+/**
+ * Ordered stream of events fed to machines, with everything needed to rebuild the machines and replay it in an empty world.
+ */
+struct IB_TEST_API FMachineEventRecording
+{
+	TArray<FName> ShapeNames;
+
+	TArray<FRecordedMachine> Machines;
+
+	TArray<FMachineEvent> Events;
+
+	/**
+	 * Serializes the recording in both directions.
+	 *
+	 * @param Ar The archive to read from or write to.
+	 * @return False if the data isn't a recording or uses an unknown version.
+	 */
+	bool Serialize(FArchive& Ar);
+
+	/**
+	 * @param FilePath Path of the file to write.
+	 * @return True if the file was written.
+	 */
+	bool SaveToFile(const FString& FilePath);
+
+	/**
+	 * @param FilePath Path of the file to read.
+	 * @return True if the file was read and is a valid recording.
+	 */
+	bool LoadFromFile(const FString& FilePath);
+};
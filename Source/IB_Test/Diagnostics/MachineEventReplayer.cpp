@@ -0,0 +1,326 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "MachineEventReplayer.h"
+
+#include "Engine/DataTable.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "MachineEventRecorder.h"
+#include "MachineEventRecording.h"
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Actors/ShapeActor.h"
+#include "IB_Test/Datas/RecipeData.h"
+#include "IB_Test/Datas/ShapeData.h"
+#include "IB_Test/Simulation/RecipeScratch.h"
+#include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "IB_Test/Subsystems/SimulationLodSubsystem.h"
+#include "UObject/Package.h"
+
+namespace MachineEventReplayer
+{
+	/** Simulated time of a world tick */
+	constexpr float DeltaSeconds = 1.f / 60.f;
+
+	/** Far enough apart for the colliders to never overlap */
+	constexpr float MachineSpacing = 1000.f;
+
+	/**
+	 * Turns the recipes and shapes of the recording into DataTables, a recipe shared by several machines is added once.
+	 */
+	void GenerateDataTables(const FMachineEventRecording& Recording, UDataTable& RecipeDataTable, UDataTable& ShapeDataTable)
+	{
+		TMap<FName, float> ShapeValues = {};
+		for(const FRecordedMachine& Machine : Recording.Machines)
+		{
+			for(const FRecordedRecipe& Recipe : Machine.Recipes)
+			{
+				if(RecipeDataTable.FindRowUnchecked(Recipe.Name) || !Recording.ShapeNames.IsValidIndex(Recipe.Output))
+				{
+					continue;
+				}
+
+				TArray<FText> Inputs = {};
+				for(const uint16 Input : Recipe.Inputs)
+				{
+					if(Recording.ShapeNames.IsValidIndex(Input))
+					{
+						Inputs.Add(FText::FromName(Recording.ShapeNames[Input]));
+					}
+				}
+
+				FRecipeData RecipeData(FText::FromName(Recipe.Name), Inputs, FText::FromName(Recording.ShapeNames[Recipe.Output]));
+				RecipeData.Priority = Recipe.Priority;
+				RecipeData.Weight = Recipe.Weight;
+				RecipeData.Duration = Recipe.Duration;
+				RecipeDataTable.AddRow(Recipe.Name, RecipeData);
+
+				ShapeValues.Add(Recording.ShapeNames[Recipe.Output], Recipe.Value);
+			}
+		}
+
+		for(const FName& ShapeName : Recording.ShapeNames)
+		{
+			FShapeData ShapeData(FText::FromName(ShapeName), FText::GetEmpty(), AShapeActor::StaticClass());
+			const float* Value = ShapeValues.Find(ShapeName);
+			ShapeData.Value = Value ? *Value : 1.f;
+			ShapeDataTable.AddRow(ShapeName, ShapeData);
+		}
+	}
+
+	/**
+	 * Spawns the recorded machines in their starting state, indexed like FMachineEventRecording::Machines.
+	 */
+	void SpawnMachines(UWorld& World, const FMachineEventRecording& Recording, TArray<AMachineActor*>& OutMachines)
+	{
+		OutMachines.Reset();
+		for(int32 MachineIndex = 0; MachineIndex < Recording.Machines.Num(); ++MachineIndex)
+		{
+			const FRecordedMachine& RecordedMachine = Recording.Machines[MachineIndex];
+
+			TArray<FText> AffectedRecipes = {};
+			for(const FRecordedRecipe& Recipe : RecordedMachine.Recipes)
+			{
+				AffectedRecipes.Add(FText::FromName(Recipe.Name));
+			}
+
+			const FTransform Transform(FVector(MachineIndex * MachineSpacing, 0.f, 0.f));
+			AMachineActor* Machine = World.SpawnActorDeferred<AMachineActor>(AMachineActor::StaticClass(), Transform);
+			OutMachines.Add(Machine);
+			if(!ensure(Machine))
+			{
+				continue;
+			}
+
+			Machine->SetupMachine(FText::FromString(RecordedMachine.Name), AffectedRecipes, EMachineOutputTarget::Sink);
+			Machine->SetupPipeline(RecordedMachine.AllocationMode, RecordedMachine.ParallelSlots, RecordedMachine.InputBufferCapacity,
+				RecordedMachine.OutputBufferCapacity, RecordedMachine.OutputInterval);
+			Machine->FinishSpawning(Transform);
+
+			// Activations first, the added shapes run the conversions the machine was able to do when the recording started
+			for(int32 RecipeIndex = 0; RecipeIndex < RecordedMachine.Recipes.Num(); ++RecipeIndex)
+			{
+				Machine->SetRecipeAvailability(AffectedRecipes[RecipeIndex], RecordedMachine.Recipes[RecipeIndex].bIsActivated);
+			}
+			for(int32 ShapeIndex = 0; ShapeIndex < RecordedMachine.InitialCounts.Num() && ShapeIndex < Recording.ShapeNames.Num(); ++ShapeIndex)
+			{
+				if(RecordedMachine.InitialCounts[ShapeIndex] > 0)
+				{
+					Machine->AddShapes(Recording.ShapeNames[ShapeIndex], RecordedMachine.InitialCounts[ShapeIndex]);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Unregisters the world from the engine and destroys it.
+	 */
+	void DestroyReplayWorld(UWorld& World)
+	{
+		World.BeginTearingDown();
+		GEngine->DestroyWorldContext(&World);
+		World.DestroyWorld(false);
+	}
+
+	/**
+	 * Ticks the world until the simulated time reaches the target time.
+	 */
+	void TickWorld(UWorld& World, float& InOutSimulatedTime, float TargetTime)
+	{
+		while(InOutSimulatedTime + DeltaSeconds <= TargetTime)
+		{
+			FApp::SetDeltaTime(DeltaSeconds);
+			FApp::SetCurrentTime(FApp::GetCurrentTime() + DeltaSeconds);
+			++GFrameCounter;
+
+			World.Tick(LEVELTICK_All, DeltaSeconds);
+			InOutSimulatedTime += DeltaSeconds;
+		}
+	}
+
+	double GetPercentile(const TArray<double>& SortedValues, double Percentile)
+	{
+		if(SortedValues.IsEmpty())
+		{
+			return 0.;
+		}
+		const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * SortedValues.Num()) - 1, 0, SortedValues.Num() - 1);
+		return SortedValues[Index];
+	}
+}
+
+FString FMachineReplayReport::ToString() const
+{
+	return FString::Printf(TEXT("%d events, %d conversions, %d spawn clicks in %.3f s (%.0f events/s) - latency us p50 %.3f p95 %.3f p99 %.3f max %.3f - %lld scratch growths after the warm-up, %lld requirement spills"),
+		NumEvents, NumConversions, NumSpawnClicks, TotalSeconds, EventsPerSecond, LatencyP50, LatencyP95, LatencyP99, LatencyMax, NumScratchGrowths, NumRequirementSpills);
+}
+
+FMachineReplayReport FMachineEventReplayer::Replay(const FMachineEventRecording& Recording, int32 NumIterations)
+{
+	using namespace MachineEventReplayer;
+
+	FMachineReplayReport Report;
+	NumIterations = FMath::Max(NumIterations, 1);
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("MachineEventReplay"));
+	if(!ensure(World))
+	{
+		return Report;
+	}
+
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	URecipeSubsystem* RecipeSubsystem = World->GetSubsystem<URecipeSubsystem>();
+	if(!ensure(RecipeSubsystem))
+	{
+		DestroyReplayWorld(*World);
+		return Report;
+	}
+
+	UDataTable* RecipeDataTable = NewObject<UDataTable>(GetTransientPackage());
+	RecipeDataTable->RowStruct = FRecipeData::StaticStruct();
+	UDataTable* ShapeDataTable = NewObject<UDataTable>(GetTransientPackage());
+	ShapeDataTable->RowStruct = FShapeData::StaticStruct();
+	GenerateDataTables(Recording, *RecipeDataTable, *ShapeDataTable);
+	RecipeSubsystem->OverrideDataTables(RecipeDataTable, ShapeDataTable);
+
+	FURL URL;
+	World->SetGameMode(URL);
+	World->InitializeActorsForPlay(URL);
+	World->BeginPlay();
+
+	// Nobody watches the machines, the distance-based level of detail would turn them into counts
+	if(USimulationLodSubsystem* SimulationLodSubsystem = World->GetSubsystem<USimulationLodSubsystem>())
+	{
+		SimulationLodSubsystem->SetForcedLod(EMachineSimulationLod::Full);
+	}
+
+	const FDelegateHandle RecipeConvertedHandle = RecipeSubsystem->OnRecipeConverted.AddLambda([&Report](AMachineActor&, const FName&, TConstArrayView<FName>)
+	{
+		++Report.NumConversions;
+	});
+
+	TArray<double> Latencies = {};
+	Latencies.Reserve(Recording.Events.Num() * NumIterations);
+
+	TArray<AMachineActor*> Machines = {};
+	int64 NumWarmupScratchGrowths = 0;
+
+	const double StartTime = FPlatformTime::Seconds();
+	for(int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+	{
+		SpawnMachines(*World, Recording, Machines);
+
+		float SimulatedTime = 0.f;
+		for(const FMachineEvent& Event : Recording.Events)
+		{
+			AMachineActor* Machine = Machines.IsValidIndex(Event.MachineIndex) ? Machines[Event.MachineIndex] : nullptr;
+			if(!Machine)
+			{
+				continue;
+			}
+
+			TickWorld(*World, SimulatedTime, Event.Time);
+
+			const TArray<FRecordedRecipe>& Recipes = Recording.Machines[Event.MachineIndex].Recipes;
+			const uint64 EventStartCycles = FPlatformTime::Cycles64();
+			switch(Event.Type)
+			{
+			case EMachineEventType::ShapeArrive:
+				if(Recording.ShapeNames.IsValidIndex(Event.Argument))
+				{
+					Machine->AddShapes(Recording.ShapeNames[Event.Argument], 1);
+				}
+				break;
+			case EMachineEventType::ShapeLeave:
+				if(Recording.ShapeNames.IsValidIndex(Event.Argument))
+				{
+					Machine->TakeShapes(Recording.ShapeNames[Event.Argument], 1);
+				}
+				break;
+			case EMachineEventType::Toggle:
+				if(Recipes.IsValidIndex(Event.Argument))
+				{
+					RecipeSubsystem->ToggleRecipe(*Machine, FText::FromName(Recipes[Event.Argument].Name), Event.bValue);
+				}
+				break;
+			case EMachineEventType::SpawnClick:
+				++Report.NumSpawnClicks;
+				break;
+			}
+			Latencies.Add(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - EventStartCycles) * 1000000.);
+		}
+
+		for(AMachineActor* Machine : Machines)
+		{
+			if(Machine)
+			{
+				World->DestroyActor(Machine);
+			}
+		}
+
+		if(Iteration == 0)
+		{
+			NumWarmupScratchGrowths = RecipeSubsystem->GetRecipeScratch().GetStats().NumGrowths;
+		}
+	}
+
+	Report.TotalSeconds = FPlatformTime::Seconds() - StartTime;
+
+	const FRecipeScratchStats ScratchStats = RecipeSubsystem->GetRecipeScratch().GetStats();
+	Report.NumScratchGrowths = ScratchStats.NumGrowths - NumWarmupScratchGrowths;
+	Report.NumRequirementSpills = ScratchStats.NumRequirementSpills;
+	Report.NumEvents = Latencies.Num();
+	Report.EventsPerSecond = Report.TotalSeconds > 0. ? Report.NumEvents / Report.TotalSeconds : 0.;
+
+	Latencies.Sort();
+	Report.LatencyP50 = GetPercentile(Latencies, 0.50);
+	Report.LatencyP95 = GetPercentile(Latencies, 0.95);
+	Report.LatencyP99 = GetPercentile(Latencies, 0.99);
+	Report.LatencyMax = Latencies.IsEmpty() ? 0. : Latencies.Last();
+
+	RecipeSubsystem->OnRecipeConverted.Remove(RecipeConvertedHandle);
+	DestroyReplayWorld(*World);
+
+	return Report;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs StartRecordingCommand(
+	TEXT("IB.Machines.StartRecording"),
+	TEXT("Starts recording the events fed to every machine"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if(URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr)
+		{
+			RecipeSubsystem->GetEventRecorder().Start(*RecipeSubsystem);
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs StopRecordingCommand(
+	TEXT("IB.Machines.StopRecording"),
+	TEXT("Stops recording machine events and writes them to a file. Usage: IB.Machines.StopRecording [FilePath]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if(URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr)
+		{
+			RecipeSubsystem->GetEventRecorder().Stop(Args.Num() > 0 ? Args[0] : FMachineEventRecorder::GetDefaultRecordingPath());
+		}
+	}));
+
+static FAutoConsoleCommand ReplayRecordingCommand(
+	TEXT("IB.Machines.Replay"),
+	TEXT("Replays a machine event recording on machines spawned in an empty world and logs throughput and latency. Usage: IB.Machines.Replay [FilePath] [Iterations]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const FString FilePath = Args.Num() > 0 ? Args[0] : FMachineEventRecorder::GetDefaultRecordingPath();
+		const int32 NumIterations = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 1;
+
+		FMachineEventRecording Recording;
+		if(!Recording.LoadFromFile(FilePath))
+		{
+			UE_LOG(LogTemp, Error, TEXT("IB.Machines.Replay - %s is not a valid recording"), *FilePath);
+			return;
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("IB.Machines.Replay - %s"), *FMachineEventReplayer::Replay(Recording, NumIterations).ToString());
+	}));
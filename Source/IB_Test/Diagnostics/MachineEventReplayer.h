@@ -0,0 +1,64 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FMachineEventRecording;
+
+/**
+ * Results of a replay
+ */
+struct IB_TEST_API FMachineReplayReport
+{
+	int32 NumEvents = 0;
+	int32 NumConversions = 0;
+	int32 NumSpawnClicks = 0;
+
+	/** Wall time of the whole replay, world ticks included, in seconds */
+	double TotalSeconds = 0.;
+
+	double EventsPerSecond = 0.;
+
+	/** Time spent handling a single event, in microseconds */
+	double LatencyP50 = 0.;
+	double LatencyP95 = 0.;
+	double LatencyP99 = 0.;
+	double LatencyMax = 0.;
+
+	/** Allocation passes which had to allocate scratch memory after the first iteration warmed the frames up, see FRecipeScratchStats */
+	int64 NumScratchGrowths = 0;
+
+	/** Recipes with more distinct inputs than held inline, counted over every iteration */
+	int64 NumRequirementSpills = 0;
+
+	/**
+	 * @return A single line summary of the report.
+	 */
+	FString ToString() const;
+};
+
+/**
+ * Replays a recording against real machines spawned in an empty world, without rendering, player nor physics.
+ *
+ * The recipes and shapes of the recording are turned into DataTables and every recorded machine is spawned with its
+ * recipes and pipeline settings, so the replay goes through the same code as a production session: arrivals and
+ * departures are fed with AMachineActor::AddShapes() and TakeShapes(), toggles with URecipeSubsystem::ToggleRecipe(),
+ * and the world is ticked up to the time of each event for the timed recipes to finish.
+ *
+ * Machines send their outputs to a sink, the recording already holds the arrival events of the outputs. Spawn clicks
+ * are only counted for the same reason, and wildcard ingredients aren't recorded.
+ */
+class IB_TEST_API FMachineEventReplayer
+{
+public:
+	/**
+	 * @brief Replays a recording at full speed.
+	 *
+	 * @param Recording The recording to replay.
+	 * @param NumIterations Number of times the whole recording is replayed in the same world, the machines are spawned again
+	 *                      for each one. The first iteration warms the scratch memory up.
+	 * @return The throughput and latency measured during the replay.
+	 */
+	static FMachineReplayReport Replay(const FMachineEventRecording& Recording, int32 NumIterations = 1);
+};
@@ -0,0 +1,188 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ThroughputSolverCommandlet.h"
+
+#include "Dom/JsonObject.h"
+#include "Engine/DataTable.h"
+#include "IB_Test/Datas/RecipeData.h"
+#include "IB_Test/Datas/ShapeData.h"
+#include "IB_Test/Settings/RecipeSettings.h"
+#include "IB_Test/Simulation/IngredientCatalog.h"
+#include "IB_Test/Simulation/ThroughputSolver.h"
+#include "IB_Test/Utilities/HelperClass.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace ThroughputSolverCommandlet
+{
+	/**
+	 * Parses a list of Name:Value pairs separated by commas.
+	 */
+	TMap<FName, float> ParseNamedValues(const FString& Params, const TCHAR* Key)
+	{
+		FString List;
+		TMap<FName, float> Values = {};
+		if(!FParse::Value(*Params, Key, List, false))
+		{
+			return Values;
+		}
+
+		TArray<FString> Pairs = {};
+		List.ParseIntoArray(Pairs, TEXT(","));
+		for(const FString& Pair : Pairs)
+		{
+			FString Name;
+			FString Value;
+			if(Pair.Split(TEXT(":"), &Name, &Value))
+			{
+				Values.Add(FName(*Name.TrimStartAndEnd()), FCString::Atof(*Value));
+			}
+		}
+		return Values;
+	}
+
+	/**
+	 * Compiles the ingredient queries of the recipes against the tags of the shapes, ids ordered by shape name.
+	 */
+	void CompileIngredients(const TArray<FRecipeData*>& RecipesData, const UDataTable* ShapeDataTable, FIngredientCatalog& OutCatalog, TArray<FName>& OutShapeNames)
+	{
+		for(const FRecipeData* RecipeData : RecipesData)
+		{
+			for(const FGameplayTagQuery& InputQuery : RecipeData->InputQueries)
+			{
+				OutCatalog.AddQuery(InputQuery);
+			}
+		}
+
+		TMap<FName, FGameplayTagContainer> TagsByShape = {};
+		if(ShapeDataTable)
+		{
+			ShapeDataTable->ForeachRow<FShapeData>(TEXT(""), [&TagsByShape](const FName&, const FShapeData& ShapeData)
+			{
+				TagsByShape.Add(UHelperClass::ConvertToName(ShapeData.Name), ShapeData.Tags);
+			});
+		}
+		TagsByShape.KeySort(FNameLexicalLess());
+
+		TArray<FGameplayTagContainer> ShapeTags = {};
+		for(const TPair<FName, FGameplayTagContainer>& Pair : TagsByShape)
+		{
+			OutShapeNames.Add(Pair.Key);
+			ShapeTags.Add(Pair.Value);
+		}
+		OutCatalog.Compile(ShapeTags);
+	}
+}
+
+UThroughputSolverCommandlet::UThroughputSolverCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UThroughputSolverCommandlet::Main(const FString& Params)
+{
+	using namespace ThroughputSolverCommandlet;
+
+	FString RecipeTablePath;
+	UDataTable* RecipeDataTable = FParse::Value(*Params, TEXT("RecipeTable="), RecipeTablePath)
+		? LoadObject<UDataTable>(nullptr, *RecipeTablePath)
+		: GetDefault<URecipeSettings>()->RecipeDataTable.LoadSynchronous();
+	if(!RecipeDataTable)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UThroughputSolverCommandlet::Main - Couldn't load the recipe DataTable %s"), *RecipeTablePath);
+		return 1;
+	}
+
+	int32 NumSlots = 1;
+	FParse::Value(*Params, TEXT("Slots="), NumSlots);
+	const TMap<FName, float> MachineCounts = ParseNamedValues(Params, TEXT("Machines="));
+
+	FThroughputProblem Problem;
+	Problem.SupplyRates = ParseNamedValues(Params, TEXT("Supply="));
+
+	TArray<FRecipeData*> RecipesData = {};
+	RecipeDataTable->GetAllRows<FRecipeData>("", RecipesData);
+
+	// Wildcard ingredients need the shape tags, without shapes they match nothing
+	FString ShapeTablePath;
+	const UDataTable* ShapeDataTable = FParse::Value(*Params, TEXT("ShapeTable="), ShapeTablePath)
+		? LoadObject<UDataTable>(nullptr, *ShapeTablePath)
+		: GetDefault<URecipeSettings>()->ShapeDataTable.LoadSynchronous();
+	FIngredientCatalog IngredientCatalog;
+	TArray<FName> ShapeNames = {};
+	CompileIngredients(RecipesData, ShapeDataTable, IngredientCatalog, ShapeNames);
+	Problem.AddIngredients(IngredientCatalog, ShapeNames);
+
+	for(const FRecipeData* RecipeData : RecipesData)
+	{
+		TArray<FName> IngredientNames = {};
+		for(const FGameplayTagQuery& InputQuery : RecipeData->InputQueries)
+		{
+			const int32 QueryIndex = IngredientCatalog.AddQuery(InputQuery);
+			if(QueryIndex != INDEX_NONE)
+			{
+				IngredientNames.Add(IngredientCatalog.GetQueryName(QueryIndex));
+			}
+		}
+
+		const int32 RecipeIndex = Problem.AddRecipe(*RecipeData, IngredientNames);
+		const FName RecipeName = Problem.Recipes[RecipeIndex].Name;
+		const float* MachineCount = MachineCounts.Find(RecipeName);
+		for(int32 Index = 0; Index < FMath::RoundToInt(MachineCount ? *MachineCount : 1.f); ++Index)
+		{
+			FThroughputMachine& Machine = Problem.Machines.AddDefaulted_GetRef();
+			Machine.Name = FString::Printf(TEXT("%s_%d"), *RecipeName.ToString(), Index);
+			Machine.Slots = FMath::Max(NumSlots, 1);
+			Machine.Recipes.Add(RecipeIndex);
+		}
+	}
+
+	FString TargetShape;
+	TArray<FName> TargetShapes = {};
+	if(FParse::Value(*Params, TEXT("Target="), TargetShape))
+	{
+		TargetShapes.Add(FName(*TargetShape));
+	}
+	else
+	{
+		for(const FThroughputRecipe& Recipe : Problem.Recipes)
+		{
+			TargetShapes.AddUnique(Recipe.Output);
+		}
+		TargetShapes.Sort(FNameLexicalLess());
+	}
+
+	TArray<TSharedPtr<FJsonValue>> ReportValues = {};
+	for(const FName& Target : TargetShapes)
+	{
+		Problem.TargetShape = Target;
+		const FThroughputReport Report = FThroughputSolver::Solve(Problem);
+		UE_LOG(LogTemp, Display, TEXT("UThroughputSolverCommandlet::Main - %s"), *Report.ToString());
+		ReportValues.Add(MakeShared<FJsonValueObject>(Report.ToJson()));
+	}
+
+	const TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("recipe_table"), RecipeDataTable->GetPathName());
+	Report->SetNumberField(TEXT("machines"), Problem.Machines.Num());
+	Report->SetArrayField(TEXT("targets"), ReportValues);
+
+	FString ReportPath;
+	if(!FParse::Value(*Params, TEXT("Report="), ReportPath))
+	{
+		ReportPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("Throughput.json");
+	}
+
+	FString ReportString;
+	const TSharedRef<TJsonWriter<>> JsonWriter = TJsonWriterFactory<>::Create(&ReportString);
+	FJsonSerializer::Serialize(Report, JsonWriter);
+	if(!FFileHelper::SaveStringToFile(ReportString, *ReportPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UThroughputSolverCommandlet::Main - Couldn't write the report to %s"), *ReportPath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,26 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "ThroughputSolverCommandlet.generated.h"
+
+/**
+ * Computes the maximum steady-state output rate of shapes from the recipe DataTable, without any world, and reports
+ * the bottleneck machines and supplies, the cycles and the unreachable shapes as JSON.
+ * Each recipe runs on its own machines, one by default. Every shape produced by a recipe is solved when no target is given.
+ *
+ * Usage: UnrealEditor-Cmd <Project> -run=ThroughputSolver [-Target=Shape] [-Supply=ShapeA:2,ShapeB:0.5]
+ *        [-Machines=RecipeA:3,RecipeB:1] [-Slots=1] [-RecipeTable=/Game/Data/DT_Recipes] [-ShapeTable=/Game/Data/DT_Shapes] [-Report=<Path>]
+ */
+UCLASS()
+class IB_TEST_API UThroughputSolverCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UThroughputSolverCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -19,7 +19,11 @@ public class IB_Test : ModuleRules
 			"DeveloperSettings",
 			"UMG",
 			"SlateCore",
-			"Niagara"
+			"Niagara",
+			"ReplicationGraph",
+			"SignificanceManager",
+			"Json",
+			"GameplayTags"
 		});
 	}
 }
@@ -1,7 +1,35 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "IB_Test.h"
+#include "Engine/NetDriver.h"
+#include "Engine/ReplicationDriver.h"
 #include "Modules/ModuleManager.h"
+#include "Replication/IB_TestReplicationGraph.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, IB_Test, "IB_Test" );
- 
\ No newline at end of file
+/**
+ * Game module, installs the project replication graph on the game net driver
+ */
+class FIB_TestModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		UReplicationDriver::CreateReplicationDriverDelegate().BindLambda(
+			[](UNetDriver* ForNetDriver, const FURL& URL, UWorld* World) -> UReplicationDriver*
+			{
+				// Demo and beacon drivers keep the default relevancy path
+				if(!ForNetDriver || ForNetDriver->NetDriverName != NAME_GameNetDriver)
+				{
+					return nullptr;
+				}
+				return NewObject<UIB_TestReplicationGraph>(GetTransientPackage());
+			});
+	}
+
+	virtual void ShutdownModule() override
+	{
+		UReplicationDriver::CreateReplicationDriverDelegate().Unbind();
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FIB_TestModule, IB_Test, "IB_Test" );
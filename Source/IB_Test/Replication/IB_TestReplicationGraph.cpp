@@ -0,0 +1,295 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "IB_TestReplicationGraph.h"
+
+#include "Engine/LevelScriptActor.h"
+#include "GameFramework/Info.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "IB_Test/Actors/ConveyorActor.h"
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Actors/ShapeActor.h"
+
+void UIB_TestReplicationGraphNode_MachineShapes::NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo)
+{
+	const AShapeActor* Shape = Cast<AShapeActor>(ActorInfo.Actor);
+	AActor* Machine = Shape ? Shape->GetHoldingMachine() : nullptr;
+	if(ensure(Machine))
+	{
+		AddShape(ActorInfo.Actor, Machine);
+	}
+}
+
+bool UIB_TestReplicationGraphNode_MachineShapes::NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound)
+{
+	// Without the key of the machine every group is searched
+	for(TPair<FObjectKey, FMachineShapeGroup>& Pair : Groups)
+	{
+		if(Pair.Value.Shapes.RemoveFast(ActorInfo.Actor))
+		{
+			return true;
+		}
+	}
+
+	if(bWarnIfNotFound)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UIB_TestReplicationGraphNode_MachineShapes::NotifyRemoveNetworkActor - Shape %s not found"), *GetNameSafe(ActorInfo.Actor));
+	}
+	return false;
+}
+
+void UIB_TestReplicationGraphNode_MachineShapes::AddShape(AActor* Shape, AActor* Machine)
+{
+	FMachineShapeGroup& Group = Groups.FindOrAdd(FObjectKey(Machine));
+	Group.Machine = Machine;
+	Group.Shapes.Add(Shape);
+}
+
+bool UIB_TestReplicationGraphNode_MachineShapes::RemoveShape(AActor* Shape, const FObjectKey& MachineKey)
+{
+	FMachineShapeGroup* Group = Groups.Find(MachineKey);
+	if(!Group || !Group->Shapes.RemoveFast(Shape))
+	{
+		return NotifyRemoveNetworkActor(FNewReplicatedActorInfo(Shape));
+	}
+
+	if(Group->Shapes.Num() == 0 && !Group->Machine.IsValid())
+	{
+		Groups.Remove(MachineKey);
+	}
+	return true;
+}
+
+void UIB_TestReplicationGraphNode_MachineShapes::NotifyResetAllNetworkActors()
+{
+	Groups.Reset();
+	Super::NotifyResetAllNetworkActors();
+}
+
+void UIB_TestReplicationGraphNode_MachineShapes::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	for(auto It = Groups.CreateIterator(); It; ++It)
+	{
+		// Machines release their shapes in EndPlay, the group of a destroyed machine is emptied before it goes
+		FMachineShapeGroup& Group = It.Value();
+		if(!Group.Machine.IsValid())
+		{
+			if(Group.Shapes.Num() == 0)
+			{
+				It.RemoveCurrent();
+			}
+			continue;
+		}
+
+		if(Group.Shapes.Num() == 0)
+		{
+			continue;
+		}
+
+		// One distance check per machine instead of one per shape
+		const FVector MachineLocation = Group.Machine->GetActorLocation();
+		for(const FNetViewer& Viewer : Params.Viewers)
+		{
+			if(FVector::DistSquared(Viewer.ViewLocation, MachineLocation) <= CullDistanceSquared)
+			{
+				Params.OutGatheredReplicationLists.AddReplicationActorList(Group.Shapes);
+				break;
+			}
+		}
+	}
+}
+
+void UIB_TestReplicationGraphNode_AlwaysRelevant_ForConnection::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	ReplicationActorList.Reset();
+
+	// The controller and pawn of the connection can change at any time, they are gathered each frame
+	if(const UNetConnection* NetConnection = Params.ConnectionManager.NetConnection)
+	{
+		if(APlayerController* PlayerController = NetConnection->PlayerController)
+		{
+			ReplicationActorList.Add(PlayerController);
+			if(APawn* Pawn = PlayerController->GetPawn())
+			{
+				ReplicationActorList.Add(Pawn);
+			}
+		}
+	}
+
+	Super::GatherActorListsForConnection(Params);
+}
+
+UIB_TestReplicationGraph::UIB_TestReplicationGraph()
+{
+	ReplicationConnectionManagerClass = UNetReplicationGraphConnection::StaticClass();
+}
+
+void UIB_TestReplicationGraph::ResetGameWorldState()
+{
+	Super::ResetGameWorldState();
+	ShapeHomes.Reset();
+}
+
+void UIB_TestReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	ClassRepNodePolicies.Set(AActor::StaticClass(), EClassRepNodeMapping::Spatialize_Dynamic);
+	ClassRepNodePolicies.Set(AInfo::StaticClass(), EClassRepNodeMapping::RelevantAllConnections);
+	ClassRepNodePolicies.Set(ALevelScriptActor::StaticClass(), EClassRepNodeMapping::NotRouted);
+	ClassRepNodePolicies.Set(APlayerController::StaticClass(), EClassRepNodeMapping::NotRouted);
+	ClassRepNodePolicies.Set(AMachineActor::StaticClass(), EClassRepNodeMapping::Spatialize_Static);
+	ClassRepNodePolicies.Set(AConveyorActor::StaticClass(), EClassRepNodeMapping::Spatialize_Static);
+	ClassRepNodePolicies.Set(AShapeActor::StaticClass(), EClassRepNodeMapping::Spatialize_Dormancy);
+
+	FClassReplicationInfo MachineInfo;
+	MachineInfo.SetCullDistanceSquared(FMath::Square(MachineCullDistance));
+	GlobalActorReplicationInfoMap.SetClassInfo(AMachineActor::StaticClass(), MachineInfo);
+
+	FClassReplicationInfo ShapeInfo;
+	ShapeInfo.SetCullDistanceSquared(FMath::Square(ShapeCullDistance));
+	GlobalActorReplicationInfoMap.SetClassInfo(AShapeActor::StaticClass(), ShapeInfo);
+}
+
+void UIB_TestReplicationGraph::InitGlobalGraphNodes()
+{
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = GridCellSize;
+	GridNode->SpatialBias = SpatialBias;
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+
+	MachineShapesNode = CreateNewNode<UIB_TestReplicationGraphNode_MachineShapes>();
+	MachineShapesNode->CullDistanceSquared = FMath::Square(ShapeCullDistance);
+	AddGlobalGraphNode(MachineShapesNode);
+}
+
+void UIB_TestReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection)
+{
+	Super::InitConnectionGraphNodes(RepGraphConnection);
+
+	UIB_TestReplicationGraphNode_AlwaysRelevant_ForConnection* AlwaysRelevantForConnectionNode = CreateNewNode<UIB_TestReplicationGraphNode_AlwaysRelevant_ForConnection>();
+	AddConnectionGraphNode(AlwaysRelevantForConnectionNode, RepGraphConnection);
+}
+
+void UIB_TestReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	if(const AShapeActor* Shape = Cast<AShapeActor>(ActorInfo.Actor))
+	{
+		AddShapeToHome(ActorInfo, GlobalInfo, Shape->GetHoldingMachine());
+		return;
+	}
+
+	switch(GetMappingPolicy(ActorInfo.Class))
+	{
+	case EClassRepNodeMapping::RelevantAllConnections:
+		AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+		break;
+	case EClassRepNodeMapping::Spatialize_Static:
+		GridNode->AddActor_Static(ActorInfo, GlobalInfo);
+		break;
+	case EClassRepNodeMapping::Spatialize_Dynamic:
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+		break;
+	case EClassRepNodeMapping::Spatialize_Dormancy:
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+		break;
+	default:
+		break;
+	}
+}
+
+void UIB_TestReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	FObjectKey MachineKey;
+	if(ShapeHomes.RemoveAndCopyValue(FObjectKey(ActorInfo.Actor), MachineKey))
+	{
+		RemoveShapeFromHome(ActorInfo, MachineKey);
+		return;
+	}
+
+	switch(GetMappingPolicy(ActorInfo.Class))
+	{
+	case EClassRepNodeMapping::RelevantAllConnections:
+		AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+		break;
+	case EClassRepNodeMapping::Spatialize_Static:
+		GridNode->RemoveActor_Static(ActorInfo);
+		break;
+	case EClassRepNodeMapping::Spatialize_Dynamic:
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+		break;
+	case EClassRepNodeMapping::Spatialize_Dormancy:
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+		break;
+	default:
+		break;
+	}
+}
+
+EClassRepNodeMapping UIB_TestReplicationGraph::GetMappingPolicy(UClass* Class) const
+{
+	const EClassRepNodeMapping* Policy = ClassRepNodePolicies.Get(Class);
+	return Policy ? *Policy : EClassRepNodeMapping::NotRouted;
+}
+
+void UIB_TestReplicationGraph::UpdateShapeHome(AShapeActor& Shape)
+{
+	// Shapes not routed yet are added to their home when they are
+	const FObjectKey* MachineKey = ShapeHomes.Find(FObjectKey(&Shape));
+	AActor* Machine = Shape.GetHoldingMachine();
+	if(!MachineKey || *MachineKey == FObjectKey(Machine))
+	{
+		return;
+	}
+
+	const FObjectKey PreviousMachineKey = *MachineKey;
+	const FNewReplicatedActorInfo ActorInfo(&Shape);
+	RemoveShapeFromHome(ActorInfo, PreviousMachineKey);
+	AddShapeToHome(ActorInfo, GlobalActorReplicationInfoMap.Get(&Shape), Machine);
+}
+
+void UIB_TestReplicationGraph::AddShapeToHome(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo, AActor* Machine)
+{
+	// Loose shapes roll, get pushed and evicted, only the grid knows where they are
+	ShapeHomes.Add(FObjectKey(ActorInfo.Actor), FObjectKey(Machine));
+	if(Machine)
+	{
+		// The node already checked the distance to the machine, grouped shapes have no cull distance of their own
+		SetCullDistanceSquared(*ActorInfo.Actor, GlobalInfo, 0.f);
+		MachineShapesNode->AddShape(ActorInfo.Actor, Machine);
+	}
+	else
+	{
+		SetCullDistanceSquared(*ActorInfo.Actor, GlobalInfo, FMath::Square(ShapeCullDistance));
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+	}
+}
+
+void UIB_TestReplicationGraph::SetCullDistanceSquared(AActor& Actor, FGlobalActorReplicationInfo& GlobalInfo, float CullDistanceSquared)
+{
+	GlobalInfo.Settings.SetCullDistanceSquared(CullDistanceSquared);
+
+	// Connections copied the setting when they first saw the actor
+	for(UNetReplicationGraphConnection* Connection : Connections)
+	{
+		if(FConnectionReplicationActorInfo* ConnectionInfo = Connection ? Connection->ActorInfoMap.Find(&Actor) : nullptr)
+		{
+			ConnectionInfo->SetCullDistanceSquared(CullDistanceSquared);
+		}
+	}
+}
+
+void UIB_TestReplicationGraph::RemoveShapeFromHome(const FNewReplicatedActorInfo& ActorInfo, const FObjectKey& MachineKey)
+{
+	if(MachineKey != FObjectKey())
+	{
+		MachineShapesNode->RemoveShape(ActorInfo.Actor, MachineKey);
+	}
+	else
+	{
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+	}
+}
@@ -0,0 +1,182 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "IB_TestReplicationGraph.generated.h"
+
+class AMachineActor;
+class AShapeActor;
+
+/**
+ * How actors of a given class are routed into the replication graph
+ */
+UENUM()
+enum class EClassRepNodeMapping : uint32
+{
+	NotRouted,				// Not routed to any node, handled by a custom path (e.g. per connection)
+	RelevantAllConnections,	// Always relevant to every connection
+	Spatialize_Static,		// Spatialized in the grid, never moves
+	Spatialize_Dynamic,		// Spatialized in the grid, moves every frame
+	Spatialize_Dormancy,	// Spatialized in the grid, static while dormant and dynamic while awake
+};
+
+/**
+ * Node grouping the shapes held in a machine inventory so they are gathered with a single distance check
+ * against the machine instead of one check per shape.
+ */
+UCLASS()
+class UIB_TestReplicationGraphNode_MachineShapes : public UReplicationGraphNode
+{
+	GENERATED_BODY()
+
+public:
+	virtual void NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual bool NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound = true) override;
+	virtual void NotifyResetAllNetworkActors() override;
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+
+	/**
+	 * @brief Adds a shape to the group of a machine.
+	 *
+	 * @param Shape The shape held by the machine.
+	 * @param Machine The machine holding the shape.
+	 */
+	void AddShape(AActor* Shape, AActor* Machine);
+
+	/**
+	 * @brief Removes a shape from the group of a machine, the machine may already be destroyed.
+	 *
+	 * @param Shape The shape to remove.
+	 * @param MachineKey Key of the machine the shape was added with.
+	 * @return True if the shape was found.
+	 */
+	bool RemoveShape(AActor* Shape, const FObjectKey& MachineKey);
+
+	/**
+	 * Squared distance from the holding machine beyond which its shapes are not gathered
+	 */
+	float CullDistanceSquared = 0.f;
+
+private:
+	/**
+	 * Shapes held by a same machine
+	 */
+	struct FMachineShapeGroup
+	{
+		TWeakObjectPtr<AActor> Machine = nullptr;
+		FActorRepListRefView Shapes;
+	};
+
+	/**
+	 * Groups of shapes mapped by their holding machine
+	 */
+	TMap<FObjectKey, FMachineShapeGroup> Groups;
+};
+
+/**
+ * Node making the connection's own controller and pawn always relevant to it
+ */
+UCLASS()
+class UIB_TestReplicationGraphNode_AlwaysRelevant_ForConnection : public UReplicationGraphNode_AlwaysRelevant_ForConnection
+{
+	GENERATED_BODY()
+
+public:
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+};
+
+/**
+ * Replication graph of the project.
+ *
+ * Loose shapes are bucketed in a spatial grid, shapes held in a machine inventory are grouped under that machine
+ * and dormant while idle (see AShapeActor::EnterInventory), so the server cost scales with what each client can
+ * see rather than with the total number of shapes in the world.
+ */
+UCLASS(Transient, Config=Engine)
+class IB_TEST_API UIB_TestReplicationGraph : public UReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+	UIB_TestReplicationGraph();
+
+	virtual void ResetGameWorldState() override;
+	virtual void InitGlobalActorClassSettings() override;
+	virtual void InitGlobalGraphNodes() override;
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection) override;
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+
+	/**
+	 * @brief Moves a shape between the grid and the group of its holding machine, when it enters or leaves an inventory.
+	 *
+	 * @param Shape The shape whose holding machine changed.
+	 */
+	void UpdateShapeHome(AShapeActor& Shape);
+
+	/**
+	 * Size of a cell of the spatial grid
+	 */
+	UPROPERTY(Config)
+	float GridCellSize = 10000.f;
+
+	/**
+	 * World coordinates of the grid origin, actors below it are clamped in the first cells
+	 */
+	UPROPERTY(Config)
+	FVector2D SpatialBias = FVector2D(-200000.f, -200000.f);
+
+	/**
+	 * Distance beyond which shapes aren't replicated to a connection
+	 */
+	UPROPERTY(Config)
+	float ShapeCullDistance = 15000.f;
+
+	/**
+	 * Distance beyond which machines aren't replicated to a connection
+	 */
+	UPROPERTY(Config)
+	float MachineCullDistance = 30000.f;
+
+private:
+	/**
+	 * @return The routing policy of a class, walking up its hierarchy.
+	 */
+	EClassRepNodeMapping GetMappingPolicy(UClass* Class) const;
+
+	/**
+	 * @brief Adds a shape to the group of its holding machine, to the grid if it is loose.
+	 */
+	void AddShapeToHome(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo, AActor* Machine);
+
+	/**
+	 * @brief Removes a shape from the node it was added to.
+	 */
+	void RemoveShapeFromHome(const FNewReplicatedActorInfo& ActorInfo, const FObjectKey& MachineKey);
+
+	/**
+	 * @brief Changes the cull distance of a single actor, for every connection.
+	 */
+	void SetCullDistanceSquared(AActor& Actor, FGlobalActorReplicationInfo& GlobalInfo, float CullDistanceSquared);
+
+	/**
+	 * Routing policies mapped by class
+	 */
+	TClassMap<EClassRepNodeMapping> ClassRepNodePolicies;
+
+	UPROPERTY()
+	TObjectPtr<UReplicationGraphNode_GridSpatialization2D> GridNode;
+
+	UPROPERTY()
+	TObjectPtr<UReplicationGraphNode_ActorList> AlwaysRelevantNode;
+
+	UPROPERTY()
+	TObjectPtr<UIB_TestReplicationGraphNode_MachineShapes> MachineShapesNode;
+
+	/**
+	 * Key of the machine group each routed shape is in, a null key for the grid
+	 */
+	TMap<FObjectKey, FObjectKey> ShapeHomes;
+};
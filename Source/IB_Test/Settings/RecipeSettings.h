@@ -8,6 +8,7 @@
 
 class UNiagaraSystem;
 class UDataTable;
+class UStaticMesh;
 /**
  * Custom class settings for recipe-related configurations.
  */
@@ -28,4 +29,136 @@ public:
 	/* VFX used when spawning the recipe output*/
 	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "VFX", AdvancedDisplay)
 	TSoftObjectPtr<UNiagaraSystem> SpawnVfx;
+
+	/* Time in seconds after which a client prediction without server answer is rolled back */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Network", meta = (ClampMin = "0.1", Units = "s"))
+	float PredictionTimeout = 1.f;
+
+	/* Resolution of the timer wheel driving every timed conversion, durations are rounded up to it */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Simulation", meta = (ClampMin = "0.001", Units = "s"))
+	float TimerWheelResolution = 0.01f;
+
+	/* Maximum allocation passes a machine runs to resolve chained conversions, protects against cyclic recipes */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Simulation", meta = (ClampMin = "1"))
+	int32 MaxCascadePasses = 32;
+
+	/* Re-checks every machine for convertible inputs missed by the events, with a single vectorized pass over the whole factory */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Simulation")
+	bool bEnableReadinessSweep = true;
+
+	/* Time between two readiness sweeps, 0 for every frame */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Simulation", meta = (ClampMin = "0", Units = "s", EditCondition = "bEnableReadinessSweep"))
+	float ReadinessSweepInterval = 0.f;
+
+	/* Shape classes of the recipes of a machine are streamed once a player is this close to it */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Streaming", meta = (ClampMin = "0", Units = "cm"))
+	float ShapePreloadRadius = 3000.f;
+
+	/* Time between two checks of the players distance to the machines */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Streaming", meta = (ClampMin = "0.1", Units = "s"))
+	float ShapePreloadInterval = 0.5f;
+
+	/* Machines further than this from every player keep their inventory as counts and stop spawning outputs */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Significance", meta = (ClampMin = "0", Units = "cm"))
+	float CountOnlyDistance = 4000.f;
+
+	/* Machines further than this from every player are only evaluated every AnalyticalStepInterval */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Significance", meta = (ClampMin = "0", Units = "cm"))
+	float AnalyticalDistance = 12000.f;
+
+	/* Extra distance before a machine is demoted again, avoids switching back and forth at the boundaries */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Significance", meta = (ClampMin = "0", Units = "cm"))
+	float SignificanceHysteresis = 500.f;
+
+	/* Time between two updates of the machines significance */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Significance", meta = (ClampMin = "0.05", Units = "s"))
+	float SignificanceUpdateInterval = 0.25f;
+
+	/* Time simulated at once by distant machines */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Significance", meta = (ClampMin = "0.1", Units = "s"))
+	float AnalyticalStepInterval = 1.f;
+
+	/* Stored products turned back into shape actors, per shape, when a player gets close to a machine */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Significance", meta = (ClampMin = "0"))
+	int32 PromotionMaterializeLimit = 16;
+
+	/* Weapons fire into the projectile subsystem instead of spawning one projectile actor per shot */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Projectile")
+	bool bUseProjectileSubsystem = true;
+
+	/* Projectiles simulated at once, the oldest is recycled when a new one is fired */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Projectile", meta = (ClampMin = "1", EditCondition = "bUseProjectileSubsystem"))
+	int32 MaxProjectiles = 512;
+
+	/* Projectiles swept per frame, the others move further on the next frames. 0 for every projectile */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Projectile", meta = (ClampMin = "0", EditCondition = "bUseProjectileSubsystem"))
+	int32 ProjectileSweepBudget = 256;
+
+	/* Mesh instanced for every projectile */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Projectile", meta = (EditCondition = "bUseProjectileSubsystem"))
+	TSoftObjectPtr<UStaticMesh> ProjectileMesh;
+
+	/* Scale of the projectile mesh instances */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Projectile", meta = (EditCondition = "bUseProjectileSubsystem"))
+	FVector ProjectileMeshScale = FVector(0.06f);
+
+	/* Conversions planned at most for a single production order, larger orders are refused */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Orders", meta = (ClampMin = "1"))
+	int32 MaxOrderTasks = 4096;
+
+	/* Time between two dispatches of the production order tasks to the machines */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Orders", meta = (ClampMin = "0", Units = "s"))
+	float OrderDispatchInterval = 0.1f;
+
+	/* Spreads the shapes spawned and destroyed by the conversions across frames instead of handling a burst in one frame */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Spawning")
+	bool bUseShapeActorQueue = true;
+
+	/* Time per frame spent finishing shape spawns and destroying consumed shapes, at least one of them is handled per frame */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Spawning", meta = (ClampMin = "0.01", Units = "ms", EditCondition = "bUseShapeActorQueue"))
+	float ShapeActorQueueBudget = 1.f;
+
+	/* Identical shapes are represented by one actor carrying a count, up to this many units. 1 gives every shape its own actor */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Spawning", meta = (ClampMin = "1"))
+	int32 MaxStackSize = 50;
+
+	/* Loose stacks of the same shape closer than this are merged, and outputs pile onto the last stack of their machine within it */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Spawning", meta = (ClampMin = "1", Units = "cm", EditCondition = "MaxStackSize > 1"))
+	float StackMergeRadius = 100.f;
+
+	/* Time between two sweeps merging the loose stacks */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Spawning", meta = (ClampMin = "0.1", Units = "s", EditCondition = "MaxStackSize > 1"))
+	float StackMergeInterval = 1.f;
+
+	/* Caps the number of loose shape actors and evicts the idle ones, evicted shapes become counts in a nearby machine or the sink */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Population")
+	bool bEnablePopulationPolicies = true;
+
+	/* Shape actors alive in the world above which the least recently touched loose ones are evicted, 0 for no cap */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Population", meta = (ClampMin = "0", EditCondition = "bEnablePopulationPolicies"))
+	int32 MaxShapeActors = 2000;
+
+	/* Same cap for each shape, 0 for no cap */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Population", meta = (ClampMin = "0", EditCondition = "bEnablePopulationPolicies"))
+	int32 MaxShapeActorsPerShape = 0;
+
+	/* Cap of specific shapes, overriding MaxShapeActorsPerShape */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Population", meta = (EditCondition = "bEnablePopulationPolicies"))
+	TMap<FName, int32> ShapeActorLimits;
+
+	/* Loose shapes nothing spawned, moved or restacked for this long are evicted, 0 to keep them forever */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Population", meta = (ClampMin = "0", Units = "s", EditCondition = "bEnablePopulationPolicies"))
+	float ShapeIdleLifetime = 300.f;
+
+	/* Time between two sweeps applying the population policies */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Population", meta = (ClampMin = "0.1", Units = "s", EditCondition = "bEnablePopulationPolicies"))
+	float PopulationSweepInterval = 1.f;
+
+	/* Evicted shapes are stored in the closest machine consuming them within this distance, in the sink otherwise */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Population", meta = (ClampMin = "0", Units = "cm", EditCondition = "bEnablePopulationPolicies"))
+	float EvictionRadius = 2000.f;
+
+	/* Time between two snapshots of the factory once one was saved or restored, each one starts a new journal so it stays short. 0 to only save on demand */
+	UPROPERTY(Config, EditAnywhere, BlueprintReadOnly, Category = "Persistence", meta = (ClampMin = "0", Units = "s"))
+	float SnapshotAutoSaveInterval = 600.f;
 };
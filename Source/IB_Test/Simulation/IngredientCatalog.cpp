@@ -0,0 +1,53 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "IngredientCatalog.h"
+
+void FIngredientCatalog::Reset()
+{
+	Queries.Reset();
+	Masks.Reset();
+	NumWords = 0;
+	NumShapes = 0;
+}
+
+int32 FIngredientCatalog::AddQuery(const FGameplayTagQuery& Query)
+{
+	if(Query.IsEmpty())
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 QueryIndex = Queries.Find(Query);
+	return QueryIndex != INDEX_NONE ? QueryIndex : Queries.Add(Query);
+}
+
+void FIngredientCatalog::Compile(TConstArrayView<FGameplayTagContainer> ShapeTags)
+{
+	NumShapes = ShapeTags.Num();
+	NumWords = FMath::DivideAndRoundUp(Queries.Num(), 64);
+	Masks.Init(0, NumShapes * NumWords);
+
+	for(int32 ShapeId = 0; ShapeId < NumShapes; ++ShapeId)
+	{
+		uint64* ShapeMask = Masks.GetData() + ShapeId * NumWords;
+		for(int32 QueryIndex = 0; QueryIndex < Queries.Num(); ++QueryIndex)
+		{
+			if(Queries[QueryIndex].Matches(ShapeTags[ShapeId]))
+			{
+				ShapeMask[QueryIndex / 64] |= uint64(1) << (QueryIndex % 64);
+			}
+		}
+	}
+}
+
+FName FIngredientCatalog::GetQueryName(int32 QueryIndex) const
+{
+	if(!Queries.IsValidIndex(QueryIndex))
+	{
+		return NAME_None;
+	}
+
+	// Brackets keep ingredients apart from shape names
+	const FString& Description = Queries[QueryIndex].GetDescription();
+	return FName(Description.IsEmpty() ? FString::Printf(TEXT("[Ingredient %d]"), QueryIndex) : FString::Printf(TEXT("[%s]"), *Description));
+}
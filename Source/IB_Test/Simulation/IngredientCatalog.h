@@ -0,0 +1,70 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameplayTagContainer.h"
+
+/**
+ * Wildcard ingredients of the recipes, compiled into one bitset per shape.
+ *
+ * Every distinct tag query gets a bit, and the bitset of a shape holds the bits of every query its tags match. Queries
+ * are evaluated once against the tag hierarchy when compiling, matching an ingredient at runtime is a single AND.
+ */
+class IB_TEST_API FIngredientCatalog
+{
+public:
+	/**
+	 * @brief Forgets every query and shape.
+	 */
+	void Reset();
+
+	/**
+	 * @brief Registers a query, equal queries share the same index. Indices stay valid until Reset().
+	 *
+	 * @param Query The tag query of an ingredient.
+	 * @return The index of the query, INDEX_NONE for an empty query.
+	 */
+	int32 AddQuery(const FGameplayTagQuery& Query);
+
+	/**
+	 * @brief Evaluates every query against the tags of every shape.
+	 *
+	 * @param ShapeTags Tags of the shapes, indexed by shape id.
+	 */
+	void Compile(TConstArrayView<FGameplayTagContainer> ShapeTags);
+
+	/**
+	 * @param ShapeId Id of the shape, see URecipeSubsystem::GetShapeId().
+	 * @param QueryIndex Index returned by AddQuery().
+	 * @return True if the shape can be used as this ingredient, false for unknown shapes or queries.
+	 */
+	bool Matches(int32 ShapeId, int32 QueryIndex) const
+	{
+		if(ShapeId < 0 || ShapeId >= NumShapes || QueryIndex < 0 || QueryIndex >= Queries.Num())
+		{
+			return false;
+		}
+		return (Masks[ShapeId * NumWords + QueryIndex / 64] & (uint64(1) << (QueryIndex % 64))) != 0;
+	}
+
+	/**
+	 * @return Name of the ingredient in logs and reports, the query description when it has one.
+	 */
+	FName GetQueryName(int32 QueryIndex) const;
+
+	int32 GetNumQueries() const
+	{
+		return Queries.Num();
+	}
+
+private:
+	TArray<FGameplayTagQuery> Queries;
+
+	/** NumWords words of bits per shape, shape after shape */
+	TArray<uint64> Masks;
+
+	int32 NumWords = 0;
+
+	int32 NumShapes = 0;
+};
@@ -0,0 +1,114 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ReadinessEvaluator.h"
+
+namespace ReadinessEvaluator
+{
+	/**
+	 * Batches of a shape the recipe doesn't need, larger than any count
+	 */
+	constexpr float UnusedShapeBatches = 1.e30f;
+
+	constexpr int32 VectorWidth = 4;
+}
+
+void FReadinessEvaluator::Reset(int32 InNumShapes)
+{
+	using namespace ReadinessEvaluator;
+
+	NumShapes = FMath::Max(InNumShapes, 0);
+	Stride = FMath::Max(Align(NumShapes, VectorWidth), VectorWidth);
+	Counts.Reset();
+	InverseRequirements.Reset();
+	Offsets.Reset();
+	MachineRecipes.Reset();
+}
+
+int32 FReadinessEvaluator::AddRecipe(TConstArrayView<TPair<int32, int32>> Requirements)
+{
+	using namespace ReadinessEvaluator;
+
+	TArray<int32, TInlineAllocator<16>> RequiredCounts = {};
+	RequiredCounts.SetNumZeroed(Stride);
+	bool bHasRequirement = false;
+	for(const TPair<int32, int32>& Requirement : Requirements)
+	{
+		if(Requirement.Key >= 0 && Requirement.Key < NumShapes && Requirement.Value > 0)
+		{
+			RequiredCounts[Requirement.Key] += Requirement.Value;
+			bHasRequirement = true;
+		}
+	}
+
+	// Without any requirement the recipe would always be ready
+	if(!bHasRequirement)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 RecipeIndex = GetNumRecipes();
+	for(int32 ShapeId = 0; ShapeId < Stride; ++ShapeId)
+	{
+		const float InverseRequirement = RequiredCounts[ShapeId] > 0 ? 1.f / RequiredCounts[ShapeId] : 0.f;
+		InverseRequirements.Add(InverseRequirement);
+		Offsets.Add(RequiredCounts[ShapeId] > 0 ? 0.5f * InverseRequirement : UnusedShapeBatches);
+	}
+	return RecipeIndex;
+}
+
+int32 FReadinessEvaluator::AddMachine()
+{
+	Counts.AddZeroed(Stride);
+	MachineRecipes.AddDefaulted();
+	return MachineRecipes.Num() - 1;
+}
+
+void FReadinessEvaluator::SetMachineRecipes(int32 MachineIndex, TConstArrayView<int32> RecipeIndices)
+{
+	TArray<int32, TInlineAllocator<8>>& Recipes = MachineRecipes[MachineIndex];
+	Recipes.Reset();
+	for(const int32 RecipeIndex : RecipeIndices)
+	{
+		if(RecipeIndex >= 0 && RecipeIndex < GetNumRecipes())
+		{
+			Recipes.Add(RecipeIndex);
+		}
+	}
+}
+
+void FReadinessEvaluator::Evaluate(TArray<FReadyRecipe>& OutReadyRecipes) const
+{
+	using namespace ReadinessEvaluator;
+
+	OutReadyRecipes.Reset();
+
+	const float* CountData = Counts.GetData();
+	const float* InverseRequirementData = InverseRequirements.GetData();
+	const float* OffsetData = Offsets.GetData();
+	for(int32 MachineIndex = 0; MachineIndex < MachineRecipes.Num(); ++MachineIndex)
+	{
+		const float* MachineCounts = CountData + MachineIndex * Stride;
+		for(const int32 RecipeIndex : MachineRecipes[MachineIndex])
+		{
+			const float* RecipeInverseRequirements = InverseRequirementData + RecipeIndex * Stride;
+			const float* RecipeOffsets = OffsetData + RecipeIndex * Stride;
+
+			// Count / Requirement for every needed shape, four shapes at a time, keeping the minimum
+			VectorRegister4Float MinBatches = VectorSetFloat1(UnusedShapeBatches);
+			for(int32 ShapeId = 0; ShapeId < Stride; ShapeId += VectorWidth)
+			{
+				const VectorRegister4Float Batches = VectorMultiplyAdd(VectorLoadAligned(MachineCounts + ShapeId),
+					VectorLoadAligned(RecipeInverseRequirements + ShapeId), VectorLoadAligned(RecipeOffsets + ShapeId));
+				MinBatches = VectorMin(MinBatches, Batches);
+			}
+
+			float Lanes[VectorWidth];
+			VectorStore(MinBatches, Lanes);
+			const int32 MaxBatches = FMath::FloorToInt(FMath::Min(FMath::Min(Lanes[0], Lanes[1]), FMath::Min(Lanes[2], Lanes[3])));
+			if(MaxBatches > 0)
+			{
+				OutReadyRecipes.Add({MachineIndex, RecipeIndex, MaxBatches});
+			}
+		}
+	}
+}
@@ -0,0 +1,110 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Recipe of a machine holding the inputs of at least one conversion
+ */
+struct FReadyRecipe
+{
+	int32 MachineIndex = INDEX_NONE;
+	int32 RecipeIndex = INDEX_NONE;
+
+	/** Conversions the machine inventory allows, ignoring the other recipes of the machine */
+	int32 MaxBatches = 0;
+};
+
+/**
+ * Decides which recipes every machine can convert, for the whole factory at once.
+ *
+ * Inventories are rows of a dense matrix of counts (machines x shape ids) and recipes are dense vectors of inverse
+ * requirements, so the number of batches of a recipe is the minimum of an element-wise multiply, four shapes at a time.
+ * Shapes a recipe doesn't need have an offset large enough to never be the minimum.
+ */
+class IB_TEST_API FReadinessEvaluator
+{
+public:
+	/**
+	 * @brief Forgets every machine and recipe.
+	 *
+	 * @param InNumShapes Number of shape ids, the width of the matrix.
+	 */
+	void Reset(int32 InNumShapes);
+
+	/**
+	 * @param Requirements Pairs of (shape id, required count).
+	 * @return The index of the recipe, INDEX_NONE if it has no valid requirement.
+	 */
+	int32 AddRecipe(TConstArrayView<TPair<int32, int32>> Requirements);
+
+	/**
+	 * @return The index of the new machine row, every count starts at 0.
+	 */
+	int32 AddMachine();
+
+	/**
+	 * @brief Sets the recipes evaluated for a machine, usually its activated ones.
+	 *
+	 * @param MachineIndex The machine row.
+	 * @param RecipeIndices Indices returned by AddRecipe().
+	 */
+	void SetMachineRecipes(int32 MachineIndex, TConstArrayView<int32> RecipeIndices);
+
+	/**
+	 * @param MachineIndex The machine row.
+	 * @param ShapeId The shape column.
+	 * @param Count The number of shapes available to the machine.
+	 */
+	void SetCount(int32 MachineIndex, int32 ShapeId, int32 Count)
+	{
+		Counts[MachineIndex * Stride + ShapeId] = static_cast<float>(Count);
+	}
+
+	/**
+	 * @param MachineIndex The machine row.
+	 * @param ShapeId The shape column.
+	 * @param Delta The number of shapes the machine gained, negative if it lost some.
+	 */
+	void AddCount(int32 MachineIndex, int32 ShapeId, int32 Delta)
+	{
+		Counts[MachineIndex * Stride + ShapeId] += static_cast<float>(Delta);
+	}
+
+	/**
+	 * @brief Computes the batches of every recipe of every machine in one pass.
+	 *
+	 * @param OutReadyRecipes Filled with the recipes having at least one batch, by machine then recipe order.
+	 */
+	void Evaluate(TArray<FReadyRecipe>& OutReadyRecipes) const;
+
+	int32 GetNumMachines() const
+	{
+		return MachineRecipes.Num();
+	}
+
+	int32 GetNumRecipes() const
+	{
+		return Stride > 0 ? InverseRequirements.Num() / Stride : 0;
+	}
+
+private:
+	/* Number of shape ids */
+	int32 NumShapes = 0;
+
+	/* Row width, the number of shapes rounded up to a whole vector */
+	int32 Stride = 0;
+
+	/* Machines x Stride shape counts */
+	TArray<float, TAlignedHeapAllocator<16>> Counts;
+
+	/* Recipes x Stride inverse of the required counts, 0 for shapes the recipe doesn't need */
+	TArray<float, TAlignedHeapAllocator<16>> InverseRequirements;
+
+	/* Recipes x Stride half of the inverse requirement against float rounding, a large value for shapes the recipe doesn't need */
+	TArray<float, TAlignedHeapAllocator<16>> Offsets;
+
+	/* Recipes evaluated for each machine */
+	TArray<TArray<int32, TInlineAllocator<8>>> MachineRecipes;
+};
@@ -0,0 +1,210 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "RecipeAllocator.h"
+
+#include "Algo/StableSort.h"
+
+namespace RecipeAllocator
+{
+	int32 GetMaxBatches(const FAllocationRecipe& Recipe, TConstArrayView<int32> Counts)
+	{
+		if(Recipe.Requirements.IsEmpty())
+		{
+			return 0;
+		}
+
+		int32 MaxBatches = MAX_int32;
+		for(const TPair<int32, int32>& Requirement : Recipe.Requirements)
+		{
+			MaxBatches = FMath::Min(MaxBatches, Counts[Requirement.Key] / FMath::Max(Requirement.Value, 1));
+		}
+		return MaxBatches;
+	}
+
+	void Consume(const FAllocationRecipe& Recipe, TArrayView<int32> Counts, int32 Batches)
+	{
+		for(const TPair<int32, int32>& Requirement : Recipe.Requirements)
+		{
+			Counts[Requirement.Key] -= Requirement.Value * Batches;
+		}
+	}
+
+	/**
+	 * Depth-first branch and bound over the number of batches of each recipe, recipes ordered by value.
+	 */
+	struct FValueSearch
+	{
+		TConstArrayView<FAllocationRecipe> Recipes;
+		TArray<int32, TInlineAllocator<16>> Order;
+		TArrayView<int32> Counts;
+		TArray<int32, TInlineAllocator<16>> Current;
+		TArray<int32, TInlineAllocator<16>> Best;
+		double BestValue = 0.;
+		int32 NodesLeft = FRecipeAllocator::MaxSearchNodes;
+
+		FValueSearch(TConstArrayView<FAllocationRecipe> InRecipes, TArrayView<int32> InCounts) :
+		Recipes(InRecipes), Counts(InCounts)
+		{
+		}
+
+		/**
+		 * Optimistic value of the remaining recipes: each one alone takes everything it can.
+		 */
+		double GetUpperBound(int32 Depth) const
+		{
+			double Bound = 0.;
+			for(int32 OrderIndex = Depth; OrderIndex < Order.Num(); ++OrderIndex)
+			{
+				const FAllocationRecipe& Recipe = Recipes[Order[OrderIndex]];
+				Bound += GetMaxBatches(Recipe, Counts) * static_cast<double>(Recipe.Value);
+			}
+			return Bound;
+		}
+
+		void Search(int32 Depth, double Value)
+		{
+			if(--NodesLeft < 0)
+			{
+				return;
+			}
+
+			if(Depth == Order.Num())
+			{
+				if(Value > BestValue)
+				{
+					BestValue = Value;
+					Best = Current;
+				}
+				return;
+			}
+
+			if(Value + GetUpperBound(Depth) <= BestValue)
+			{
+				return;
+			}
+
+			const int32 RecipeIndex = Order[Depth];
+			const FAllocationRecipe& Recipe = Recipes[RecipeIndex];
+			for(int32 Batches = GetMaxBatches(Recipe, Counts); Batches >= 0; --Batches)
+			{
+				Consume(Recipe, Counts, Batches);
+				Current[RecipeIndex] = Batches;
+				Search(Depth + 1, Value + Batches * static_cast<double>(Recipe.Value));
+				Consume(Recipe, Counts, -Batches);
+			}
+			Current[RecipeIndex] = 0;
+		}
+	};
+}
+
+void FRecipeAllocator::Allocate(ERecipeAllocationMode Mode, TConstArrayView<FAllocationRecipe> Recipes, TConstArrayView<int32> Counts, int32& RoundRobinCursor, TArray<int32>& OutBatches)
+{
+	OutBatches.Reset();
+	OutBatches.SetNumZeroed(Recipes.Num());
+
+	// Inline so a machine evaluating its recipes doesn't allocate
+	TArray<int32, TInlineAllocator<16>> RemainingCounts(Counts.GetData(), Counts.Num());
+	switch(Mode)
+	{
+	case ERecipeAllocationMode::Priority:
+		AllocateByPriority(Recipes, RemainingCounts, OutBatches);
+		break;
+	case ERecipeAllocationMode::WeightedRoundRobin:
+		AllocateRoundRobin(Recipes, RemainingCounts, RoundRobinCursor, OutBatches);
+		break;
+	case ERecipeAllocationMode::MaximizeValue:
+		AllocateMaximizeValue(Recipes, RemainingCounts, OutBatches);
+		break;
+	}
+}
+
+void FRecipeAllocator::AllocateByPriority(TConstArrayView<FAllocationRecipe> Recipes, TArrayView<int32> Counts, TArrayView<int32> OutBatches)
+{
+	TArray<int32, TInlineAllocator<16>> Order = {};
+	for(int32 RecipeIndex = 0; RecipeIndex < Recipes.Num(); ++RecipeIndex)
+	{
+		Order.Add(RecipeIndex);
+	}
+
+	// Stable so recipes of equal priority keep their deterministic order
+	Algo::StableSort(Order, [&Recipes](int32 A, int32 B)
+	{
+		return Recipes[A].Priority > Recipes[B].Priority;
+	});
+
+	for(const int32 RecipeIndex : Order)
+	{
+		const int32 Batches = RecipeAllocator::GetMaxBatches(Recipes[RecipeIndex], Counts);
+		RecipeAllocator::Consume(Recipes[RecipeIndex], Counts, Batches);
+		OutBatches[RecipeIndex] += Batches;
+	}
+}
+
+void FRecipeAllocator::AllocateRoundRobin(TConstArrayView<FAllocationRecipe> Recipes, TArrayView<int32> Counts, int32& RoundRobinCursor, TArrayView<int32> OutBatches)
+{
+	if(Recipes.IsEmpty())
+	{
+		return;
+	}
+
+	RoundRobinCursor = FMath::Clamp(RoundRobinCursor, 0, Recipes.Num() - 1);
+
+	bool bHasConverted = true;
+	while(bHasConverted)
+	{
+		bHasConverted = false;
+		for(int32 Turn = 0; Turn < Recipes.Num(); ++Turn)
+		{
+			const int32 RecipeIndex = (RoundRobinCursor + Turn) % Recipes.Num();
+			const FAllocationRecipe& Recipe = Recipes[RecipeIndex];
+
+			const int32 Batches = FMath::Min(FMath::Max(Recipe.Weight, 1), RecipeAllocator::GetMaxBatches(Recipe, Counts));
+			if(Batches > 0)
+			{
+				RecipeAllocator::Consume(Recipe, Counts, Batches);
+				OutBatches[RecipeIndex] += Batches;
+				bHasConverted = true;
+			}
+		}
+	}
+
+	// The next call starts with the recipe following the one which started this call
+	RoundRobinCursor = (RoundRobinCursor + 1) % Recipes.Num();
+}
+
+void FRecipeAllocator::AllocateMaximizeValue(TConstArrayView<FAllocationRecipe> Recipes, TArrayView<int32> Counts, TArrayView<int32> OutBatches)
+{
+	RecipeAllocator::FValueSearch ValueSearch(Recipes, Counts);
+	for(int32 RecipeIndex = 0; RecipeIndex < Recipes.Num(); ++RecipeIndex)
+	{
+		// Recipes without value can only compete for inputs, they are filled afterward
+		if(Recipes[RecipeIndex].Value > 0.f)
+		{
+			ValueSearch.Order.Add(RecipeIndex);
+		}
+	}
+
+	// Most valuable recipes first so good solutions are found early and prune the rest
+	Algo::StableSort(ValueSearch.Order, [&Recipes](int32 A, int32 B)
+	{
+		return Recipes[A].Value > Recipes[B].Value;
+	});
+
+	ValueSearch.Current.SetNumZeroed(Recipes.Num());
+	ValueSearch.Best.SetNumZeroed(Recipes.Num());
+	ValueSearch.Search(0, 0.);
+
+	if(ValueSearch.NodesLeft < 0)
+	{
+		UE_LOG(LogTemp, Verbose, TEXT("FRecipeAllocator::AllocateMaximizeValue - Search budget exhausted, using the best allocation found"));
+	}
+
+	for(int32 RecipeIndex = 0; RecipeIndex < Recipes.Num(); ++RecipeIndex)
+	{
+		RecipeAllocator::Consume(Recipes[RecipeIndex], Counts, ValueSearch.Best[RecipeIndex]);
+		OutBatches[RecipeIndex] = ValueSearch.Best[RecipeIndex];
+	}
+
+	// Leftovers can't raise the total value anymore, they still feed whatever recipe can use them
+	AllocateByPriority(Recipes, Counts, OutBatches);
+}
@@ -0,0 +1,69 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RecipeAllocator.generated.h"
+
+/**
+ * How a machine shares its inventory between recipes competing for the same inputs
+ */
+UENUM(BlueprintType)
+enum class ERecipeAllocationMode : uint8
+{
+	// Recipes are served by descending priority, ties broken by name
+	Priority,
+	// Recipes take turns, each one converting up to its weight per turn
+	WeightedRoundRobin,
+	// Conversions maximizing the total value of the outputs
+	MaximizeValue
+};
+
+/**
+ * A recipe as seen by the allocator: requirements on local shape indices, no names involved
+ */
+struct IB_TEST_API FAllocationRecipe
+{
+	/** Distinct inputs held without any heap allocation */
+	static constexpr int32 NumInlineRequirements = 4;
+
+	/** Pairs of (shape index, required count) */
+	TArray<TPair<int32, int32>, TInlineAllocator<NumInlineRequirements>> Requirements;
+
+	int32 Priority = 0;
+
+	int32 Weight = 1;
+
+	/** Value of the output produced by one conversion */
+	float Value = 1.f;
+};
+
+/**
+ * Decides how many times each recipe converts, given the shape counts currently available.
+ */
+class IB_TEST_API FRecipeAllocator
+{
+public:
+	/**
+	 * @brief Allocates the available shapes between recipes.
+	 *
+	 * Recipes are expected in a deterministic order (e.g. by name), it is used to break ties.
+	 *
+	 * @param Mode The allocation policy.
+	 * @param Recipes The recipes competing for the shapes.
+	 * @param Counts Available count of each shape index, left untouched.
+	 * @param RoundRobinCursor Recipe the next round-robin turn starts with, updated so turns stay fair between calls.
+	 * @param OutBatches Number of conversions of each recipe, its memory is reused.
+	 */
+	static void Allocate(ERecipeAllocationMode Mode, TConstArrayView<FAllocationRecipe> Recipes, TConstArrayView<int32> Counts, int32& RoundRobinCursor, TArray<int32>& OutBatches);
+
+	/**
+	 * @brief Maximum number of branch and bound nodes explored in MaximizeValue mode, the best allocation found so far is used past it.
+	 */
+	static constexpr int32 MaxSearchNodes = 20000;
+
+private:
+	static void AllocateByPriority(TConstArrayView<FAllocationRecipe> Recipes, TArrayView<int32> Counts, TArrayView<int32> OutBatches);
+	static void AllocateRoundRobin(TConstArrayView<FAllocationRecipe> Recipes, TArrayView<int32> Counts, int32& RoundRobinCursor, TArrayView<int32> OutBatches);
+	static void AllocateMaximizeValue(TConstArrayView<FAllocationRecipe> Recipes, TArrayView<int32> Counts, TArrayView<int32> OutBatches);
+};
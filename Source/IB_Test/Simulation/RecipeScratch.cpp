@@ -0,0 +1,85 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "RecipeScratch.h"
+
+#include "Algo/Count.h"
+
+void FRecipeScratchFrame::Reset()
+{
+	AllocationRecipes.Reset();
+	CandidateRecipes.Reset();
+	LocalShapeNames.Reset();
+	ShapeCounts.Reset();
+	Batches.Reset();
+}
+
+SIZE_T FRecipeScratchFrame::GetAllocatedSize() const
+{
+	return AllocationRecipes.GetAllocatedSize() + CandidateRecipes.GetAllocatedSize() + LocalShapeNames.GetAllocatedSize()
+		+ ShapeCounts.GetAllocatedSize() + Batches.GetAllocatedSize();
+}
+
+int32 FRecipeScratchFrame::GetNumSpilledRequirements() const
+{
+	return Algo::CountIf(AllocationRecipes, [](const FAllocationRecipe& Recipe)
+	{
+		return Recipe.Requirements.Max() > FAllocationRecipe::NumInlineRequirements;
+	});
+}
+
+FString FRecipeScratchStats::ToString() const
+{
+	return FString::Printf(TEXT("%d frames (%lld bytes) - %lld passes, %lld growths (%d last tick), %lld requirement spills"),
+		NumFrames, AllocatedBytes, NumAcquires, NumGrowths, NumGrowthsLastTick, NumRequirementSpills);
+}
+
+FRecipeScratchArena::FScope::FScope(FRecipeScratchArena& InArena) :
+Arena(InArena)
+{
+	if(Arena.Depth == Arena.Frames.Num())
+	{
+		Arena.Frames.Add(MakeUnique<FRecipeScratchFrame>());
+	}
+
+	Frame = Arena.Frames[Arena.Depth++].Get();
+	AcquiredSize = Frame->GetAllocatedSize();
+	++Arena.Stats.NumAcquires;
+}
+
+FRecipeScratchArena::FScope::~FScope()
+{
+	// Spilled requirements belong to the recipes, they are freed by the reset below and allocated again by the next pass
+	const SIZE_T ReleasedSize = Frame->GetAllocatedSize();
+	const int32 NumSpilledRequirements = Frame->GetNumSpilledRequirements();
+	if(ReleasedSize > AcquiredSize || NumSpilledRequirements > 0)
+	{
+		++Arena.Stats.NumGrowths;
+		Arena.Stats.AllocatedBytes += ReleasedSize > AcquiredSize ? ReleasedSize - AcquiredSize : 0;
+		Arena.Stats.NumRequirementSpills += NumSpilledRequirements;
+	}
+
+	Frame->Reset();
+	check(Arena.Depth > 0 && Arena.Frames[Arena.Depth - 1].Get() == Frame);
+	--Arena.Depth;
+}
+
+void FRecipeScratchArena::EndTick()
+{
+	Stats.NumGrowthsLastTick = static_cast<int32>(Stats.NumGrowths - NumGrowthsBeforeTick);
+	NumGrowthsBeforeTick = Stats.NumGrowths;
+}
+
+void FRecipeScratchArena::Reset()
+{
+	check(Depth == 0);
+	Frames.Reset();
+	NumGrowthsBeforeTick = 0;
+	Stats = FRecipeScratchStats();
+}
+
+FRecipeScratchStats FRecipeScratchArena::GetStats() const
+{
+	FRecipeScratchStats CurrentStats = Stats;
+	CurrentStats.NumFrames = Frames.Num();
+	return CurrentStats;
+}
@@ -0,0 +1,127 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RecipeAllocator.h"
+
+class URecipeDataItem;
+
+/**
+ * Buffers of one allocation pass, emptied between passes but never freed
+ */
+struct IB_TEST_API FRecipeScratchFrame
+{
+	TArray<FAllocationRecipe> AllocationRecipes;
+
+	/** Recipes competing in the pass, indexed like AllocationRecipes */
+	TArray<const URecipeDataItem*> CandidateRecipes;
+
+	/** Shapes used by the pass, indexed like ShapeCounts */
+	TArray<FName> LocalShapeNames;
+
+	TArray<int32> ShapeCounts;
+
+	/** Number of conversions of each candidate recipe */
+	TArray<int32> Batches;
+
+	/**
+	 * Empties the buffers, their memory is kept for the next pass.
+	 */
+	void Reset();
+
+	SIZE_T GetAllocatedSize() const;
+
+	/**
+	 * @return The number of recipes whose requirements spilled to the heap, they are freed with the pass.
+	 */
+	int32 GetNumSpilledRequirements() const;
+};
+
+/**
+ * Counters of the scratch arena, the growths stop once every frame is warm
+ */
+struct IB_TEST_API FRecipeScratchStats
+{
+	/** Frames created, the deepest cascade between machines seen so far */
+	int32 NumFrames = 0;
+
+	int64 AllocatedBytes = 0;
+
+	int64 NumAcquires = 0;
+
+	/** Passes which had to grow a frame or spill requirements, each one is a heap allocation of the evaluation path */
+	int64 NumGrowths = 0;
+
+	/** Recipes with more distinct inputs than FAllocationRecipe holds inline, they allocate on every pass */
+	int64 NumRequirementSpills = 0;
+
+	int32 NumGrowthsLastTick = 0;
+
+	FString ToString() const;
+};
+
+/**
+ * Scratch memory of the recipe evaluations, owned by the Recipe Subsystem.
+ *
+ * Frames are handed out as a stack: a conversion delivering its output to another machine starts a nested pass, which gets
+ * the next frame while the outer one is still in use. Frames are reused by later passes, so the steady state allocates nothing.
+ */
+class IB_TEST_API FRecipeScratchArena
+{
+public:
+	/**
+	 * Frame in use for the lifetime of the scope, released empty.
+	 */
+	class IB_TEST_API FScope : public FNoncopyable
+	{
+	public:
+		explicit FScope(FRecipeScratchArena& InArena);
+
+		~FScope();
+
+		FRecipeScratchFrame& operator*() const
+		{
+			return *Frame;
+		}
+
+		FRecipeScratchFrame* operator->() const
+		{
+			return Frame;
+		}
+
+	private:
+		FRecipeScratchArena& Arena;
+
+		FRecipeScratchFrame* Frame = nullptr;
+
+		/* Size of the frame when it was acquired, to detect growths */
+		SIZE_T AcquiredSize = 0;
+	};
+
+	/**
+	 * @brief Closes the counters of the current tick.
+	 */
+	void EndTick();
+
+	/**
+	 * @brief Frees every frame, none may be in use.
+	 */
+	void Reset();
+
+	/**
+	 * @return The counters of the arena.
+	 */
+	FRecipeScratchStats GetStats() const;
+
+private:
+	/* Frames by depth, pointers stay valid while the array grows */
+	TArray<TUniquePtr<FRecipeScratchFrame>> Frames;
+
+	/* Number of frames in use */
+	int32 Depth = 0;
+
+	int64 NumGrowthsBeforeTick = 0;
+
+	FRecipeScratchStats Stats;
+};
@@ -0,0 +1,129 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ShapeActorQueue.h"
+
+#include "Engine/World.h"
+#include "IB_Test/Actors/ShapeActor.h"
+
+FString FShapeActorQueueStats::ToString() const
+{
+	return FString::Printf(TEXT("%d spawns and %d destructions pending (oldest %.3f s, peak %d) - last frame %d in %.3f ms - %lld spawned, %lld destroyed"),
+		NumPendingSpawns, NumPendingDestroys, OldestPendingSeconds, PeakBacklog, NumProcessedLastFrame, LastFrameMilliseconds, NumSpawned, NumDestroyed);
+}
+
+AShapeActor* FShapeActorQueue::EnqueueSpawn(UWorld& World, TSubclassOf<AShapeActor> ShapeClass, const FTransform& Transform, AActor* Owner, APawn* Instigator)
+{
+	AShapeActor* Shape = World.SpawnActorDeferred<AShapeActor>(ShapeClass, Transform, Owner, Instigator, ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn);
+	if(!Shape)
+	{
+		return nullptr;
+	}
+
+	Operations.Add({Shape, Transform, World.GetTimeSeconds(), true});
+	Stats.PeakBacklog = FMath::Max(Stats.PeakBacklog, Num());
+	return Shape;
+}
+
+void FShapeActorQueue::EnqueueDestroy(AShapeActor& Shape)
+{
+	if(Shape.IsRetired())
+	{
+		return;
+	}
+
+	Shape.Retire();
+	Operations.Add({&Shape, FTransform::Identity, Shape.GetWorld() ? Shape.GetWorld()->GetTimeSeconds() : 0., false});
+	Stats.PeakBacklog = FMath::Max(Stats.PeakBacklog, Num());
+}
+
+void FShapeActorQueue::Process(double BudgetSeconds)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Operations may enqueue others through overlaps, those wait for the next frame. The operation is copied, an
+	// enqueue may grow the array
+	const int32 NumOperations = Operations.Num();
+	int32 NumProcessed = 0;
+	while(Head < NumOperations && (NumProcessed == 0 || FPlatformTime::Seconds() - StartTime < BudgetSeconds))
+	{
+		FOperation Operation = Operations[Head++];
+		Execute(Operation);
+		++NumProcessed;
+	}
+	Compact();
+
+	Stats.NumProcessedLastFrame = NumProcessed;
+	Stats.LastFrameMilliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.;
+}
+
+void FShapeActorQueue::Flush()
+{
+	// Finishing a spawn may enqueue a destruction, the queue is drained until empty
+	while(Head < Operations.Num())
+	{
+		FOperation Operation = Operations[Head++];
+		Execute(Operation);
+	}
+	Compact();
+}
+
+void FShapeActorQueue::Reset()
+{
+	// A deferred spawn never finished would leak a half constructed actor, both kinds are destroyed instead of run
+	for(int32 Index = Head; Index < Operations.Num(); ++Index)
+	{
+		if(AShapeActor* Shape = Operations[Index].Shape.Get())
+		{
+			Shape->Destroy();
+		}
+	}
+
+	Operations.Reset();
+	Head = 0;
+	Stats = FShapeActorQueueStats();
+}
+
+void FShapeActorQueue::Compact()
+{
+	if(Head == Operations.Num())
+	{
+		Operations.Reset();
+		Head = 0;
+	}
+	else if(Head > Operations.Num() / 2)
+	{
+		Operations.RemoveAt(0, Head, false);
+		Head = 0;
+	}
+}
+
+FShapeActorQueueStats FShapeActorQueue::GetStats(double CurrentTime) const
+{
+	FShapeActorQueueStats CurrentStats = Stats;
+	for(int32 Index = Head; Index < Operations.Num(); ++Index)
+	{
+		++(Operations[Index].bIsSpawn ? CurrentStats.NumPendingSpawns : CurrentStats.NumPendingDestroys);
+	}
+	CurrentStats.OldestPendingSeconds = Head < Operations.Num() ? CurrentTime - Operations[Head].EnqueueTime : 0.;
+	return CurrentStats;
+}
+
+void FShapeActorQueue::Execute(FOperation& Operation)
+{
+	AShapeActor* Shape = Operation.Shape.Get();
+	if(!Shape)
+	{
+		return;
+	}
+
+	if(Operation.bIsSpawn)
+	{
+		Shape->FinishSpawning(Operation.Transform);
+		++Stats.NumSpawned;
+	}
+	else
+	{
+		Shape->Destroy();
+		++Stats.NumDestroyed;
+	}
+}
@@ -0,0 +1,118 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AShapeActor;
+
+/**
+ * Backlog of the shape actor queue
+ */
+struct IB_TEST_API FShapeActorQueueStats
+{
+	int32 NumPendingSpawns = 0;
+
+	int32 NumPendingDestroys = 0;
+
+	/** Time the oldest pending operation has been waiting */
+	double OldestPendingSeconds = 0.;
+
+	/** Operations processed during the last frame, and the time they took */
+	int32 NumProcessedLastFrame = 0;
+
+	double LastFrameMilliseconds = 0.;
+
+	/** Largest number of pending operations since the queue was reset */
+	int32 PeakBacklog = 0;
+
+	int64 NumSpawned = 0;
+
+	int64 NumDestroyed = 0;
+
+	FString ToString() const;
+};
+
+/**
+ * Spreads the shape actors spawned and destroyed by the conversions across frames.
+ *
+ * Spawns are started deferred right away and their FinishSpawning() waits for its turn. Destroyed shapes are retired at
+ * once, hidden without collision and still claimed so no machine counts them again, then destroyed when their turn comes.
+ * Each frame processes the oldest operations within a time budget, always at least one so the backlog drains.
+ */
+class IB_TEST_API FShapeActorQueue
+{
+public:
+	/**
+	 * @brief Starts spawning a shape, the actor is fully constructed by a later Process().
+	 *
+	 * @return The deferred actor, nullptr if it couldn't be spawned.
+	 */
+	AShapeActor* EnqueueSpawn(UWorld& World, TSubclassOf<AShapeActor> ShapeClass, const FTransform& Transform, AActor* Owner, APawn* Instigator);
+
+	/**
+	 * @brief Retires a shape now and destroys it during a later Process().
+	 */
+	void EnqueueDestroy(AShapeActor& Shape);
+
+	/**
+	 * @brief Runs the pending operations in order until the budget is spent.
+	 *
+	 * @param BudgetSeconds Time allowed this frame, the first operation always runs.
+	 */
+	void Process(double BudgetSeconds);
+
+	/**
+	 * @brief Runs every pending operation, before the world state is read or replaced at once.
+	 */
+	void Flush();
+
+	/**
+	 * @brief Drops the pending operations when the world is torn down, the deferred and retired shapes are destroyed.
+	 */
+	void Reset();
+
+	/**
+	 * @param CurrentTime World time, used to age the oldest operation.
+	 * @return The backlog and the cost of the last frame.
+	 */
+	FShapeActorQueueStats GetStats(double CurrentTime) const;
+
+	/**
+	 * @return The number of pending operations.
+	 */
+	int32 Num() const
+	{
+		return Operations.Num() - Head;
+	}
+
+private:
+	struct FOperation
+	{
+		TWeakObjectPtr<AShapeActor> Shape;
+
+		/** Spawn transform, unused by destructions */
+		FTransform Transform;
+
+		double EnqueueTime = 0.;
+
+		bool bIsSpawn = true;
+	};
+
+	/**
+	 * Finishes the spawn or destroys the shape, nothing happens if the shape was destroyed meanwhile.
+	 */
+	void Execute(FOperation& Operation);
+
+	/**
+	 * Drops the operations before Head once they are the larger part of the array, so each one is moved once on average.
+	 */
+	void Compact();
+
+	/** Operations, oldest first, the pending ones start at Head */
+	TArray<FOperation> Operations;
+
+	int32 Head = 0;
+
+	FShapeActorQueueStats Stats;
+};
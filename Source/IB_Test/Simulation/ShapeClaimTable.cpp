@@ -0,0 +1,100 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ShapeClaimTable.h"
+
+FShapeClaimHandle FShapeClaimTable::Allocate()
+{
+	check(IsInGameThread());
+
+	int32 Index = INDEX_NONE;
+	if(!FreeIndices.IsEmpty())
+	{
+		Index = FreeIndices.Pop(false);
+	}
+	else
+	{
+		const int32 ChunkIndex = NumSlots / ChunkSize;
+		if(!ensureMsgf(ChunkIndex < MaxChunks, TEXT("FShapeClaimTable::Allocate - More than %d shapes alive"), MaxChunks * ChunkSize))
+		{
+			return FShapeClaimHandle();
+		}
+
+		if(!Chunks[ChunkIndex])
+		{
+			Chunks[ChunkIndex] = MakeUnique<FChunk>();
+			for(std::atomic<uint64>& Slot : Chunks[ChunkIndex]->Slots)
+			{
+				Slot.store(Pack(0, NoOwner), std::memory_order_relaxed);
+			}
+		}
+		Index = NumSlots++;
+	}
+
+	// The slot keeps the generation it was freed with
+	const uint64 Slot = Chunks[Index / ChunkSize]->Slots[Index % ChunkSize].load(std::memory_order_acquire);
+	return FShapeClaimHandle{Index, static_cast<uint32>(Slot >> 32)};
+}
+
+void FShapeClaimTable::Free(FShapeClaimHandle& Handle)
+{
+	check(IsInGameThread());
+
+	if(std::atomic<uint64>* Slot = GetSlot(Handle))
+	{
+		// A new generation makes every handle and claim on the previous shape stale
+		Slot->store(Pack(Handle.Generation + 1, NoOwner), std::memory_order_release);
+		FreeIndices.Add(Handle.Index);
+	}
+	Handle = FShapeClaimHandle();
+}
+
+bool FShapeClaimTable::TryClaim(const FShapeClaimHandle& Handle, uint32 OwnerId)
+{
+	std::atomic<uint64>* Slot = GetSlot(Handle);
+	if(!Slot || OwnerId == NoOwner)
+	{
+		return false;
+	}
+
+	uint64 Expected = Pack(Handle.Generation, NoOwner);
+	if(Slot->compare_exchange_strong(Expected, Pack(Handle.Generation, OwnerId), std::memory_order_acq_rel))
+	{
+		return true;
+	}
+	return Expected == Pack(Handle.Generation, OwnerId);
+}
+
+bool FShapeClaimTable::Release(const FShapeClaimHandle& Handle, uint32 OwnerId)
+{
+	std::atomic<uint64>* Slot = GetSlot(Handle);
+	if(!Slot)
+	{
+		return false;
+	}
+
+	uint64 Expected = Pack(Handle.Generation, OwnerId);
+	return Slot->compare_exchange_strong(Expected, Pack(Handle.Generation, NoOwner), std::memory_order_acq_rel);
+}
+
+uint32 FShapeClaimTable::GetOwner(const FShapeClaimHandle& Handle) const
+{
+	const std::atomic<uint64>* Slot = GetSlot(Handle);
+	if(!Slot)
+	{
+		return NoOwner;
+	}
+
+	const uint64 Value = Slot->load(std::memory_order_acquire);
+	return static_cast<uint32>(Value >> 32) == Handle.Generation ? static_cast<uint32>(Value) : NoOwner;
+}
+
+std::atomic<uint64>* FShapeClaimTable::GetSlot(const FShapeClaimHandle& Handle) const
+{
+	if(Handle.Index < 0 || Handle.Index >= MaxChunks * ChunkSize)
+	{
+		return nullptr;
+	}
+
+	FChunk* Chunk = Chunks[Handle.Index / ChunkSize].Get();
+	return Chunk ? &Chunk->Slots[Handle.Index % ChunkSize] : nullptr;
+}
@@ -0,0 +1,98 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * Handle of a shape in the claim table, stale once the shape is freed
+ */
+struct FShapeClaimHandle
+{
+	int32 Index = INDEX_NONE;
+
+	uint32 Generation = 0;
+
+	bool IsValid() const
+	{
+		return Index != INDEX_NONE;
+	}
+};
+
+/**
+ * Ownership table making sure a shape belongs to at most one machine at a time.
+ *
+ * Claims and releases are a single compare-and-swap on the slot of the shape, so they can be issued from several
+ * threads at once. Slots are allocated and freed on the game thread only, in chunks which never move.
+ */
+class IB_TEST_API FShapeClaimTable
+{
+public:
+	/** Owner of a slot nobody claimed */
+	static constexpr uint32 NoOwner = 0;
+
+	FShapeClaimTable() = default;
+	FShapeClaimTable(const FShapeClaimTable&) = delete;
+	FShapeClaimTable& operator=(const FShapeClaimTable&) = delete;
+
+	/**
+	 * @brief Allocates the slot of a new shape (game thread only).
+	 */
+	FShapeClaimHandle Allocate();
+
+	/**
+	 * @brief Frees the slot of a destroyed shape, every claim on it is dropped (game thread only).
+	 */
+	void Free(FShapeClaimHandle& Handle);
+
+	/**
+	 * @brief Claims a shape for an owner.
+	 *
+	 * @return True if the shape was free or already owned by this owner.
+	 */
+	bool TryClaim(const FShapeClaimHandle& Handle, uint32 OwnerId);
+
+	/**
+	 * @brief Releases a shape, nothing happens if the owner doesn't own it.
+	 *
+	 * @return True if the claim was released.
+	 */
+	bool Release(const FShapeClaimHandle& Handle, uint32 OwnerId);
+
+	/**
+	 * @return The owner of a shape, NoOwner if unclaimed or stale.
+	 */
+	uint32 GetOwner(const FShapeClaimHandle& Handle) const;
+
+	/**
+	 * @return The number of allocated slots.
+	 */
+	int32 Num() const
+	{
+		return NumSlots - FreeIndices.Num();
+	}
+
+private:
+	static constexpr int32 ChunkSize = 1024;
+	static constexpr int32 MaxChunks = 1024;
+
+	/** Generation in the high bits, owner in the low bits */
+	struct FChunk
+	{
+		std::atomic<uint64> Slots[ChunkSize];
+	};
+
+	static uint64 Pack(uint32 Generation, uint32 OwnerId)
+	{
+		return (static_cast<uint64>(Generation) << 32) | OwnerId;
+	}
+
+	std::atomic<uint64>* GetSlot(const FShapeClaimHandle& Handle) const;
+
+	TUniquePtr<FChunk> Chunks[MaxChunks];
+
+	int32 NumSlots = 0;
+
+	TArray<int32> FreeIndices;
+};
@@ -0,0 +1,216 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ShapePopulation.h"
+
+#include "IB_Test/Actors/ShapeActor.h"
+
+FString FShapePopulationStats::ToString() const
+{
+	return FString::Printf(TEXT("%d shapes (peak %d) - %lld expired, %lld evicted - %lld units sent to machines, %lld to sinks"),
+		NumShapes, PeakShapes, NumExpired, NumEvicted, NumUnitsToMachines, NumUnitsToSinks);
+}
+
+void FShapePopulation::Add(AShapeActor& Shape)
+{
+	if(Shape.PopulationIndex != INDEX_NONE)
+	{
+		return;
+	}
+
+	const int32 Index = FreeEntries.IsEmpty() ? Entries.AddDefaulted() : FreeEntries.Pop(false);
+	FEntry& Entry = Entries[Index];
+	Entry = FEntry();
+	Entry.Shape = &Shape;
+	Entry.ShapeName = Shape.GetShapeKey();
+	Shape.PopulationIndex = Index;
+
+	++ShapeLists.FindOrAdd(Entry.ShapeName).NumRegistered;
+	++Stats.NumShapes;
+	Stats.PeakShapes = FMath::Max(Stats.PeakShapes, Stats.NumShapes);
+
+	Touch(Shape);
+}
+
+void FShapePopulation::Remove(AShapeActor& Shape)
+{
+	const int32 Index = Shape.PopulationIndex;
+	Shape.PopulationIndex = INDEX_NONE;
+	if(!Entries.IsValidIndex(Index) || Entries[Index].Shape.Get() != &Shape)
+	{
+		return;
+	}
+
+	Unlink(Index);
+	FShapeList& ShapeList = ShapeLists.FindChecked(Entries[Index].ShapeName);
+	ShapeList.NumRegistered = FMath::Max(ShapeList.NumRegistered - 1, 0);
+	--Stats.NumShapes;
+
+	Entries[Index] = FEntry();
+	FreeEntries.Add(Index);
+}
+
+void FShapePopulation::Touch(AShapeActor& Shape)
+{
+	const int32 Index = Shape.PopulationIndex;
+	if(!Entries.IsValidIndex(Index))
+	{
+		return;
+	}
+
+	// Touches happen at the current time, appending keeps both orders sorted by last touch
+	Unlink(Index);
+	if(IsEvictable(Shape))
+	{
+		Link(Index);
+	}
+}
+
+void FShapePopulation::Reset()
+{
+	for(const FEntry& Entry : Entries)
+	{
+		if(Entry.Shape.IsValid())
+		{
+			Entry.Shape->PopulationIndex = INDEX_NONE;
+		}
+	}
+
+	Entries.Reset();
+	FreeEntries.Reset();
+	AllShapesOrder = FOrder();
+	ShapeLists.Reset();
+	Stats = FShapePopulationStats();
+}
+
+TMap<FName, int32> FShapePopulation::GetNumByShape() const
+{
+	TMap<FName, int32> NumByShape = {};
+	for(const TPair<FName, FShapeList>& Pair : ShapeLists)
+	{
+		NumByShape.Add(Pair.Key, Pair.Value.NumRegistered);
+	}
+	return NumByShape;
+}
+
+void FShapePopulation::GetEvictionCandidates(double ExpireTime, int32 MaxShapes, TFunctionRef<int32(const FName&)> GetShapeLimit, const FShapeClaimTable& ShapeClaims, TArray<FShapeEvictionCandidate>& OutCandidates)
+{
+	OutCandidates.Reset();
+
+	// Idle shapes and the oldest ones over the global cap, the walk stops at the first shape that is neither
+	int32 NumOverCap = MaxShapes > 0 ? Stats.NumShapes - MaxShapes : 0;
+	for(int32 Index = AllShapesOrder.Head; Index != INDEX_NONE; Index = Entries[Index].Links[AllShapes].Next)
+	{
+		FEntry& Entry = Entries[Index];
+		const AShapeActor* Shape = Entry.Shape.Get();
+		const bool bIsExpired = Shape && Shape->GetLastTouchedTime() < ExpireTime;
+		if(!bIsExpired && NumOverCap <= 0)
+		{
+			break;
+		}
+		if(!Shape || Shape->IsClaimed(ShapeClaims))
+		{
+			continue;
+		}
+
+		Entry.bIsPicked = true;
+		OutCandidates.Add({Entry.Shape, bIsExpired});
+		--NumOverCap;
+	}
+
+	// The oldest ones of each shape over its own cap, the shapes already picked are the first ones evicted
+	for(TPair<FName, FShapeList>& Pair : ShapeLists)
+	{
+		const int32 Limit = GetShapeLimit(Pair.Key);
+		int32 NumOverShapeCap = Limit > 0 ? Pair.Value.NumRegistered - Limit : 0;
+		for(int32 Index = Pair.Value.Order.Head; Index != INDEX_NONE && NumOverShapeCap > 0; Index = Entries[Index].Links[SameShape].Next)
+		{
+			FEntry& Entry = Entries[Index];
+			if(Entry.bIsPicked)
+			{
+				--NumOverShapeCap;
+				continue;
+			}
+
+			const AShapeActor* Shape = Entry.Shape.Get();
+			if(!Shape || Shape->IsClaimed(ShapeClaims))
+			{
+				continue;
+			}
+
+			Entry.bIsPicked = true;
+			OutCandidates.Add({Entry.Shape, false});
+			--NumOverShapeCap;
+		}
+	}
+
+	for(const FShapeEvictionCandidate& Candidate : OutCandidates)
+	{
+		Entries[Candidate.Shape->PopulationIndex].bIsPicked = false;
+	}
+}
+
+bool FShapePopulation::IsEvictable(const AShapeActor& Shape)
+{
+	return !Shape.IsInInventory() && !Shape.IsWaiting() && !Shape.IsRetired();
+}
+
+void FShapePopulation::Link(int32 Index)
+{
+	FEntry& Entry = Entries[Index];
+	if(!Entry.bIsLinked)
+	{
+		LinkLast(AllShapesOrder, AllShapes, Index);
+		LinkLast(ShapeLists.FindChecked(Entry.ShapeName).Order, SameShape, Index);
+		Entry.bIsLinked = true;
+	}
+}
+
+void FShapePopulation::Unlink(int32 Index)
+{
+	FEntry& Entry = Entries[Index];
+	if(Entry.bIsLinked)
+	{
+		UnlinkFrom(AllShapesOrder, AllShapes, Index);
+		UnlinkFrom(ShapeLists.FindChecked(Entry.ShapeName).Order, SameShape, Index);
+		Entry.bIsLinked = false;
+	}
+}
+
+void FShapePopulation::LinkLast(FOrder& Order, EOrder OrderType, int32 Index)
+{
+	FLink& Link = Entries[Index].Links[OrderType];
+	Link.Prev = Order.Tail;
+	Link.Next = INDEX_NONE;
+	if(Order.Tail != INDEX_NONE)
+	{
+		Entries[Order.Tail].Links[OrderType].Next = Index;
+	}
+	else
+	{
+		Order.Head = Index;
+	}
+	Order.Tail = Index;
+}
+
+void FShapePopulation::UnlinkFrom(FOrder& Order, EOrder OrderType, int32 Index)
+{
+	FLink& Link = Entries[Index].Links[OrderType];
+	if(Link.Prev != INDEX_NONE)
+	{
+		Entries[Link.Prev].Links[OrderType].Next = Link.Next;
+	}
+	else
+	{
+		Order.Head = Link.Next;
+	}
+
+	if(Link.Next != INDEX_NONE)
+	{
+		Entries[Link.Next].Links[OrderType].Prev = Link.Prev;
+	}
+	else
+	{
+		Order.Tail = Link.Prev;
+	}
+	Link = FLink();
+}
@@ -0,0 +1,188 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AShapeActor;
+class FShapeClaimTable;
+
+/**
+ * Counters of the shape population
+ */
+struct IB_TEST_API FShapePopulationStats
+{
+	/** Shape actors alive, stacks count once */
+	int32 NumShapes = 0;
+
+	/** Largest number of shape actors alive since the population was reset */
+	int32 PeakShapes = 0;
+
+	/** Shapes evicted because nothing touched them for the idle lifetime */
+	int64 NumExpired = 0;
+
+	/** Shapes evicted because the population was over a cap */
+	int64 NumEvicted = 0;
+
+	/** Units of the evicted shapes, by where they went */
+	int64 NumUnitsToMachines = 0;
+
+	int64 NumUnitsToSinks = 0;
+
+	FString ToString() const;
+};
+
+/**
+ * A shape picked for eviction
+ */
+struct IB_TEST_API FShapeEvictionCandidate
+{
+	TWeakObjectPtr<AShapeActor> Shape = nullptr;
+
+	/** True if the shape is evicted for being idle, false for a population cap */
+	bool bIsExpired = false;
+};
+
+/**
+ * Registry of the shape actors alive on the server, by shape.
+ *
+ * Shapes register when they begin play and leave once they are retired or end play. Every registered shape counts
+ * against the caps, but only the evictable ones (loose, neither waiting at a machine nor retired) are kept in the
+ * least recently touched order, once overall and once per shape. Touching a shape moves it to the recent end, so
+ * picking the shapes to evict only visits the oldest ones.
+ */
+class IB_TEST_API FShapePopulation
+{
+public:
+	/**
+	 * @brief Registers a shape, nothing happens if it already is.
+	 */
+	void Add(AShapeActor& Shape);
+
+	/**
+	 * @brief Unregisters a shape, nothing happens if it isn't registered.
+	 */
+	void Remove(AShapeActor& Shape);
+
+	/**
+	 * @brief Moves a shape to the recent end of the eviction order, or out of it if it can't be evicted anymore.
+	 */
+	void Touch(AShapeActor& Shape);
+
+	/**
+	 * @brief Forgets every shape and the counters, when the world is torn down.
+	 */
+	void Reset();
+
+	/**
+	 * @return The number of registered shapes.
+	 */
+	int32 Num() const
+	{
+		return Stats.NumShapes;
+	}
+
+	/**
+	 * @param ShapeName The name of the shape.
+	 * @return The number of registered shapes of this kind.
+	 */
+	int32 Num(const FName& ShapeName) const
+	{
+		const FShapeList* ShapeList = ShapeLists.Find(ShapeName);
+		return ShapeList ? ShapeList->NumRegistered : 0;
+	}
+
+	/**
+	 * @return The number of registered shapes of each kind.
+	 */
+	TMap<FName, int32> GetNumByShape() const;
+
+	/**
+	 * @brief Picks the shapes to evict, the ones untouched for the longest time first.
+	 *
+	 * Shapes idle since before ExpireTime are picked, then the oldest ones as long as the population stays over a cap.
+	 * Claimed shapes are skipped, a machine is about to take them.
+	 *
+	 * @param ExpireTime World time before which an untouched shape is idle for too long.
+	 * @param MaxShapes Maximum number of shapes, 0 for no cap.
+	 * @param GetShapeLimit Maximum number of shapes of a kind, 0 for no cap.
+	 * @param ShapeClaims The claim table of the world.
+	 * @param OutCandidates Array filled with the shapes to evict, oldest first.
+	 */
+	void GetEvictionCandidates(double ExpireTime, int32 MaxShapes, TFunctionRef<int32(const FName&)> GetShapeLimit, const FShapeClaimTable& ShapeClaims, TArray<FShapeEvictionCandidate>& OutCandidates);
+
+	FShapePopulationStats& GetStats()
+	{
+		return Stats;
+	}
+
+	const FShapePopulationStats& GetStats() const
+	{
+		return Stats;
+	}
+
+private:
+	/** The eviction order a link belongs to */
+	enum EOrder : uint8
+	{
+		AllShapes,
+		SameShape,
+		NumOrders
+	};
+
+	struct FLink
+	{
+		int32 Prev = INDEX_NONE;
+		int32 Next = INDEX_NONE;
+	};
+
+	/** Eviction order of some shapes, oldest at the head */
+	struct FOrder
+	{
+		int32 Head = INDEX_NONE;
+		int32 Tail = INDEX_NONE;
+	};
+
+	struct FShapeList
+	{
+		FOrder Order;
+
+		/** Registered shapes of the kind, evictable or not */
+		int32 NumRegistered = 0;
+	};
+
+	struct FEntry
+	{
+		TWeakObjectPtr<AShapeActor> Shape = nullptr;
+		FName ShapeName = NAME_None;
+		FLink Links[NumOrders];
+		bool bIsLinked = false;
+
+		/* Already picked by the current GetEvictionCandidates() */
+		bool bIsPicked = false;
+	};
+
+	/**
+	 * @return True if the shape may be evicted: loose, not waiting at a machine and not retired.
+	 */
+	static bool IsEvictable(const AShapeActor& Shape);
+
+	void Link(int32 Index);
+
+	void Unlink(int32 Index);
+
+	void LinkLast(FOrder& Order, EOrder OrderType, int32 Index);
+
+	void UnlinkFrom(FOrder& Order, EOrder OrderType, int32 Index);
+
+	/** Slots of the registered shapes, freed slots are reused so indices stay stable */
+	TArray<FEntry> Entries;
+
+	TArray<int32> FreeEntries;
+
+	FOrder AllShapesOrder;
+
+	TMap<FName, FShapeList> ShapeLists;
+
+	FShapePopulationStats Stats;
+};
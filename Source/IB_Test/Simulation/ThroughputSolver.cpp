@@ -0,0 +1,606 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ThroughputSolver.h"
+
+#include "Algo/AllOf.h"
+#include "Algo/BinarySearch.h"
+#include "IB_Test/Datas/RecipeData.h"
+#include "IB_Test/Simulation/IngredientCatalog.h"
+#include "IB_Test/Utilities/HelperClass.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace ThroughputSolver
+{
+	constexpr double Epsilon = 1e-9;
+
+	enum class ESimplexResult : uint8
+	{
+		Optimal,
+		Unbounded,
+		PivotLimit
+	};
+
+	/**
+	 * Maximizes Objective . X subject to Constraints X <= Bounds and X >= 0, every bound being non-negative so X = 0 is feasible.
+	 * Bland's rule picks the pivots, it can't cycle on the degenerate programs of balanced recipes.
+	 *
+	 * @param Constraints Row-major, NumRows x Objective.Num().
+	 * @param OutDuals Dual value of each row, positive for the rows limiting the objective.
+	 */
+	ESimplexResult Maximize(TConstArrayView<double> Objective, TConstArrayView<double> Constraints, TConstArrayView<double> Bounds,
+		TArray<double>& OutX, TArray<double>& OutDuals, double& OutValue)
+	{
+		const int32 NumVariables = Objective.Num();
+		const int32 NumRows = Bounds.Num();
+		const int32 NumColumns = NumVariables + NumRows + 1;
+		const int32 RhsColumn = NumColumns - 1;
+
+		// Rows of constraints with their slack, then the objective row
+		TArray<double> Tableau = {};
+		Tableau.SetNumZeroed((NumRows + 1) * NumColumns);
+		auto At = [&Tableau, NumColumns](int32 Row, int32 Column) -> double& { return Tableau[Row * NumColumns + Column]; };
+
+		TArray<int32> Basis = {};
+		Basis.SetNumUninitialized(NumRows);
+		for(int32 Row = 0; Row < NumRows; ++Row)
+		{
+			for(int32 Column = 0; Column < NumVariables; ++Column)
+			{
+				At(Row, Column) = Constraints[Row * NumVariables + Column];
+			}
+			At(Row, NumVariables + Row) = 1.;
+			At(Row, RhsColumn) = Bounds[Row];
+			Basis[Row] = NumVariables + Row;
+		}
+		for(int32 Column = 0; Column < NumVariables; ++Column)
+		{
+			At(NumRows, Column) = -Objective[Column];
+		}
+
+		ESimplexResult Result = ESimplexResult::PivotLimit;
+		for(int32 Pivot = 0; Pivot < FThroughputSolver::MaxPivots; ++Pivot)
+		{
+			int32 EnteringColumn = INDEX_NONE;
+			for(int32 Column = 0; Column < RhsColumn; ++Column)
+			{
+				if(At(NumRows, Column) < -Epsilon)
+				{
+					EnteringColumn = Column;
+					break;
+				}
+			}
+			if(EnteringColumn == INDEX_NONE)
+			{
+				Result = ESimplexResult::Optimal;
+				break;
+			}
+
+			int32 LeavingRow = INDEX_NONE;
+			double BestRatio = TNumericLimits<double>::Max();
+			for(int32 Row = 0; Row < NumRows; ++Row)
+			{
+				const double Coefficient = At(Row, EnteringColumn);
+				if(Coefficient <= Epsilon)
+				{
+					continue;
+				}
+
+				const double Ratio = At(Row, RhsColumn) / Coefficient;
+				if(Ratio < BestRatio - Epsilon || (Ratio < BestRatio + Epsilon && LeavingRow != INDEX_NONE && Basis[Row] < Basis[LeavingRow]))
+				{
+					BestRatio = Ratio;
+					LeavingRow = Row;
+				}
+			}
+			if(LeavingRow == INDEX_NONE)
+			{
+				Result = ESimplexResult::Unbounded;
+				break;
+			}
+
+			const double PivotValue = At(LeavingRow, EnteringColumn);
+			for(int32 Column = 0; Column < NumColumns; ++Column)
+			{
+				At(LeavingRow, Column) /= PivotValue;
+			}
+			for(int32 Row = 0; Row <= NumRows; ++Row)
+			{
+				const double Factor = At(Row, EnteringColumn);
+				if(Row == LeavingRow || FMath::Abs(Factor) <= Epsilon)
+				{
+					continue;
+				}
+				for(int32 Column = 0; Column < NumColumns; ++Column)
+				{
+					At(Row, Column) -= Factor * At(LeavingRow, Column);
+				}
+			}
+			Basis[LeavingRow] = EnteringColumn;
+		}
+
+		OutX.SetNumZeroed(NumVariables);
+		for(int32 Row = 0; Row < NumRows; ++Row)
+		{
+			if(Basis[Row] < NumVariables)
+			{
+				OutX[Basis[Row]] = At(Row, RhsColumn);
+			}
+		}
+		OutDuals.SetNumUninitialized(NumRows);
+		for(int32 Row = 0; Row < NumRows; ++Row)
+		{
+			OutDuals[Row] = At(NumRows, NumVariables + Row);
+		}
+		OutValue = At(NumRows, RhsColumn);
+		return Result;
+	}
+
+	/**
+	 * Tarjan's strongly connected components, shapes are nodes and each enabled recipe links its inputs to its output.
+	 */
+	struct FCycleFinder
+	{
+		const TArray<TArray<int32>>& Edges;
+		TArray<int32> Indices;
+		TArray<int32> LowLinks;
+		TArray<bool> IsOnStack;
+		TArray<int32> Stack;
+		TArray<TArray<int32>> Components;
+		int32 NextIndex = 0;
+
+		explicit FCycleFinder(const TArray<TArray<int32>>& InEdges)
+			: Edges(InEdges)
+		{
+			Indices.Init(INDEX_NONE, Edges.Num());
+			LowLinks.Init(0, Edges.Num());
+			IsOnStack.Init(false, Edges.Num());
+		}
+
+		void Visit(int32 Node)
+		{
+			Indices[Node] = LowLinks[Node] = NextIndex++;
+			Stack.Push(Node);
+			IsOnStack[Node] = true;
+
+			for(const int32 Next : Edges[Node])
+			{
+				if(Indices[Next] == INDEX_NONE)
+				{
+					Visit(Next);
+					LowLinks[Node] = FMath::Min(LowLinks[Node], LowLinks[Next]);
+				}
+				else if(IsOnStack[Next])
+				{
+					LowLinks[Node] = FMath::Min(LowLinks[Node], Indices[Next]);
+				}
+			}
+
+			if(LowLinks[Node] != Indices[Node])
+			{
+				return;
+			}
+
+			TArray<int32>& Component = Components.AddDefaulted_GetRef();
+			int32 Member = INDEX_NONE;
+			do
+			{
+				Member = Stack.Pop();
+				IsOnStack[Member] = false;
+				Component.Add(Member);
+			}
+			while(Member != Node);
+
+			// A single shape is a cycle only if a recipe turns it into itself
+			if(Component.Num() == 1 && !Edges[Node].Contains(Node))
+			{
+				Components.Pop();
+			}
+		}
+	};
+
+	/**
+	 * @return Every shape of the problem, sorted by name.
+	 */
+	TArray<FName> GatherShapes(const FThroughputProblem& Problem)
+	{
+		TSet<FName> Shapes = {};
+		for(const FThroughputRecipe& Recipe : Problem.Recipes)
+		{
+			Shapes.Append(Recipe.Inputs);
+			Shapes.Add(Recipe.Output);
+		}
+		for(const TPair<FName, float>& SupplyRate : Problem.SupplyRates)
+		{
+			Shapes.Add(SupplyRate.Key);
+		}
+		Shapes.Add(Problem.TargetShape);
+
+		TArray<FName> SortedShapes = Shapes.Array();
+		SortedShapes.Sort(FNameLexicalLess());
+		return SortedShapes;
+	}
+
+	/**
+	 * @return The problem with a substitution recipe from each matching shape to its ingredient, all enabled on one more machine.
+	 */
+	FThroughputProblem ExpandIngredients(const FThroughputProblem& Problem)
+	{
+		FThroughputProblem ExpandedProblem = Problem;
+		if(Problem.Ingredients.IsEmpty())
+		{
+			return ExpandedProblem;
+		}
+
+		FThroughputMachine& Substitutions = ExpandedProblem.Machines.AddDefaulted_GetRef();
+		Substitutions.Name = TEXT("Substitutions");
+		for(const TPair<FName, TArray<FName>>& Ingredient : Problem.Ingredients)
+		{
+			for(const FName& ShapeName : Ingredient.Value)
+			{
+				FThroughputRecipe& Recipe = ExpandedProblem.Recipes.AddDefaulted_GetRef();
+				Recipe.Name = FName(*FString::Printf(TEXT("%s as %s"), *ShapeName.ToString(), *Ingredient.Key.ToString()));
+				Recipe.Inputs.Add(ShapeName);
+				Recipe.Output = Ingredient.Key;
+				Substitutions.Recipes.Add(ExpandedProblem.Recipes.Num() - 1);
+			}
+		}
+		return ExpandedProblem;
+	}
+}
+
+int32 FThroughputProblem::AddRecipe(const FRecipeData& RecipeData, TConstArrayView<FName> IngredientNames)
+{
+	FThroughputRecipe& Recipe = Recipes.AddDefaulted_GetRef();
+	Recipe.Name = UHelperClass::ConvertToName(RecipeData.Name);
+	Recipe.Inputs = UHelperClass::ConvertToNames(RecipeData.InputShape);
+	Recipe.Inputs.Append(IngredientNames.GetData(), IngredientNames.Num());
+	Recipe.Output = UHelperClass::ConvertToName(RecipeData.OutputShape);
+	Recipe.Duration = RecipeData.Duration;
+	return Recipes.Num() - 1;
+}
+
+int32 FThroughputProblem::FindRecipe(const FName& RecipeName) const
+{
+	return Recipes.IndexOfByPredicate([&RecipeName](const FThroughputRecipe& Recipe) { return Recipe.Name == RecipeName; });
+}
+
+void FThroughputProblem::AddIngredients(const FIngredientCatalog& Catalog, TConstArrayView<FName> ShapeNamesById)
+{
+	for(int32 QueryIndex = 0; QueryIndex < Catalog.GetNumQueries(); ++QueryIndex)
+	{
+		TArray<FName>& MatchingShapes = Ingredients.FindOrAdd(Catalog.GetQueryName(QueryIndex));
+		for(int32 ShapeId = 0; ShapeId < ShapeNamesById.Num(); ++ShapeId)
+		{
+			if(Catalog.Matches(ShapeId, QueryIndex))
+			{
+				MatchingShapes.AddUnique(ShapeNamesById[ShapeId]);
+			}
+		}
+	}
+}
+
+FThroughputReport FThroughputSolver::Solve(const FThroughputProblem& InProblem)
+{
+	using namespace ThroughputSolver;
+
+	const FThroughputProblem Problem = ExpandIngredients(InProblem);
+	FThroughputReport Report;
+	Report.TargetShape = Problem.TargetShape;
+
+	const TArray<FName> Shapes = GatherShapes(Problem);
+	TMap<FName, int32> ShapeRows = {};
+	for(int32 ShapeIndex = 0; ShapeIndex < Shapes.Num(); ++ShapeIndex)
+	{
+		ShapeRows.Add(Shapes[ShapeIndex], ShapeIndex);
+	}
+
+	// One variable per timed recipe of each machine, instant recipes run anywhere they are enabled at no slot cost
+	struct FRateVariable
+	{
+		int32 RecipeIndex = INDEX_NONE;
+		int32 MachineIndex = INDEX_NONE;
+	};
+	TArray<FRateVariable> Variables = {};
+	TArray<bool> EnabledRecipes = {};
+	EnabledRecipes.Init(false, Problem.Recipes.Num());
+	for(int32 MachineIndex = 0; MachineIndex < Problem.Machines.Num(); ++MachineIndex)
+	{
+		for(const int32 RecipeIndex : Problem.Machines[MachineIndex].Recipes)
+		{
+			if(!Problem.Recipes.IsValidIndex(RecipeIndex))
+			{
+				continue;
+			}
+
+			const bool bIsInstant = Problem.Recipes[RecipeIndex].Duration <= 0.f;
+			if(!bIsInstant || !EnabledRecipes[RecipeIndex])
+			{
+				Variables.Add({RecipeIndex, bIsInstant ? INDEX_NONE : MachineIndex});
+			}
+			EnabledRecipes[RecipeIndex] = true;
+		}
+	}
+
+	FindCycles(Problem, EnabledRecipes, Report);
+	FindUnreachableShapes(Problem, EnabledRecipes, Report);
+
+	// Shape rows first: consumed - produced <= supplied, then a slot time row per machine with timed recipes
+	TArray<int32> MachineRows = {};
+	MachineRows.Init(INDEX_NONE, Problem.Machines.Num());
+	int32 NumRows = Shapes.Num();
+	for(const FRateVariable& Variable : Variables)
+	{
+		if(Variable.MachineIndex != INDEX_NONE && MachineRows[Variable.MachineIndex] == INDEX_NONE)
+		{
+			MachineRows[Variable.MachineIndex] = NumRows++;
+		}
+	}
+
+	TArray<double> Objective = {};
+	TArray<double> Constraints = {};
+	TArray<double> Bounds = {};
+	Objective.SetNumZeroed(Variables.Num());
+	Constraints.SetNumZeroed(NumRows * Variables.Num());
+	Bounds.SetNumZeroed(NumRows);
+	for(int32 ShapeIndex = 0; ShapeIndex < Shapes.Num(); ++ShapeIndex)
+	{
+		const float* SupplyRate = Problem.SupplyRates.Find(Shapes[ShapeIndex]);
+		Bounds[ShapeIndex] = SupplyRate ? FMath::Max(*SupplyRate, 0.f) : 0.;
+	}
+	for(int32 MachineIndex = 0; MachineIndex < Problem.Machines.Num(); ++MachineIndex)
+	{
+		if(MachineRows[MachineIndex] != INDEX_NONE)
+		{
+			Bounds[MachineRows[MachineIndex]] = FMath::Max(Problem.Machines[MachineIndex].Slots, 0);
+		}
+	}
+
+	for(int32 VariableIndex = 0; VariableIndex < Variables.Num(); ++VariableIndex)
+	{
+		const FThroughputRecipe& Recipe = Problem.Recipes[Variables[VariableIndex].RecipeIndex];
+		auto Coefficient = [&Constraints, &Variables, VariableIndex](int32 Row) -> double& { return Constraints[Row * Variables.Num() + VariableIndex]; };
+
+		for(const FName& Input : Recipe.Inputs)
+		{
+			Coefficient(ShapeRows[Input]) += 1.;
+			Objective[VariableIndex] -= Input == Problem.TargetShape ? 1. : 0.;
+		}
+		Coefficient(ShapeRows[Recipe.Output]) -= 1.;
+		Objective[VariableIndex] += Recipe.Output == Problem.TargetShape ? 1. : 0.;
+
+		if(Variables[VariableIndex].MachineIndex != INDEX_NONE)
+		{
+			Coefficient(MachineRows[Variables[VariableIndex].MachineIndex]) = Recipe.Duration;
+		}
+	}
+
+	TArray<double> Rates = {};
+	TArray<double> Duals = {};
+	const ESimplexResult Result = Maximize(Objective, Constraints, Bounds, Rates, Duals, Report.MaxRate);
+	Report.bIsUnbounded = Result == ESimplexResult::Unbounded;
+	if(Result == ESimplexResult::PivotLimit)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("FThroughputSolver::Solve - No optimum after %d pivots, the rate of %s is a lower bound"), MaxPivots, *Problem.TargetShape.ToString());
+	}
+
+	for(int32 VariableIndex = 0; VariableIndex < Variables.Num(); ++VariableIndex)
+	{
+		const FRateVariable& Variable = Variables[VariableIndex];
+		const FThroughputRecipe& Recipe = Problem.Recipes[Variable.RecipeIndex];
+		Report.RecipeRates.FindOrAdd(Recipe.Name) += Rates[VariableIndex];
+		if(Variable.MachineIndex != INDEX_NONE)
+		{
+			const FThroughputMachine& Machine = Problem.Machines[Variable.MachineIndex];
+			Report.MachineUtilizations.FindOrAdd(Machine.Name) += Machine.Slots > 0 ? Rates[VariableIndex] * Recipe.Duration / Machine.Slots : 0.;
+		}
+	}
+
+	// Only the saturated capacities with a positive dual value limit the target, the others are slack or don't matter
+	for(int32 ShapeIndex = 0; ShapeIndex < Shapes.Num(); ++ShapeIndex)
+	{
+		if(Duals[ShapeIndex] <= Epsilon || Bounds[ShapeIndex] <= 0.)
+		{
+			continue;
+		}
+
+		FThroughputBottleneck& Bottleneck = Report.Bottlenecks.AddDefaulted_GetRef();
+		Bottleneck.Type = EThroughputBottleneckType::Supply;
+		Bottleneck.Name = Shapes[ShapeIndex].ToString();
+		Bottleneck.ShadowPrice = Duals[ShapeIndex];
+		for(const FThroughputRecipe& Recipe : Problem.Recipes)
+		{
+			if(Recipe.Inputs.Contains(Shapes[ShapeIndex]) && Report.RecipeRates.FindRef(Recipe.Name) > Epsilon)
+			{
+				Bottleneck.Recipes.AddUnique(Recipe.Name);
+			}
+		}
+	}
+	for(int32 MachineIndex = 0; MachineIndex < Problem.Machines.Num(); ++MachineIndex)
+	{
+		const int32 Row = MachineRows[MachineIndex];
+		if(Row == INDEX_NONE || Duals[Row] <= Epsilon)
+		{
+			continue;
+		}
+
+		FThroughputBottleneck& Bottleneck = Report.Bottlenecks.AddDefaulted_GetRef();
+		Bottleneck.Type = EThroughputBottleneckType::Machine;
+		Bottleneck.Name = Problem.Machines[MachineIndex].Name;
+		Bottleneck.ShadowPrice = Duals[Row];
+		for(int32 VariableIndex = 0; VariableIndex < Variables.Num(); ++VariableIndex)
+		{
+			if(Variables[VariableIndex].MachineIndex == MachineIndex && Rates[VariableIndex] > Epsilon)
+			{
+				Bottleneck.Recipes.AddUnique(Problem.Recipes[Variables[VariableIndex].RecipeIndex].Name);
+			}
+		}
+	}
+	Report.Bottlenecks.Sort([](const FThroughputBottleneck& BottleneckA, const FThroughputBottleneck& BottleneckB)
+	{
+		return BottleneckA.ShadowPrice > BottleneckB.ShadowPrice;
+	});
+
+	return Report;
+}
+
+void FThroughputSolver::FindCycles(const FThroughputProblem& Problem, const TArray<bool>& EnabledRecipes, FThroughputReport& OutReport)
+{
+	using namespace ThroughputSolver;
+
+	const TArray<FName> Shapes = GatherShapes(Problem);
+	TArray<TArray<int32>> Edges = {};
+	Edges.SetNum(Shapes.Num());
+	for(int32 RecipeIndex = 0; RecipeIndex < Problem.Recipes.Num(); ++RecipeIndex)
+	{
+		if(!EnabledRecipes[RecipeIndex])
+		{
+			continue;
+		}
+
+		const FThroughputRecipe& Recipe = Problem.Recipes[RecipeIndex];
+		const int32 OutputIndex = Algo::BinarySearch(Shapes, Recipe.Output, FNameLexicalLess());
+		for(const FName& Input : Recipe.Inputs)
+		{
+			Edges[Algo::BinarySearch(Shapes, Input, FNameLexicalLess())].AddUnique(OutputIndex);
+		}
+	}
+
+	FCycleFinder CycleFinder(Edges);
+	for(int32 ShapeIndex = 0; ShapeIndex < Shapes.Num(); ++ShapeIndex)
+	{
+		if(CycleFinder.Indices[ShapeIndex] == INDEX_NONE)
+		{
+			CycleFinder.Visit(ShapeIndex);
+		}
+	}
+
+	for(const TArray<int32>& Component : CycleFinder.Components)
+	{
+		TArray<FName>& Cycle = OutReport.Cycles.AddDefaulted_GetRef();
+		for(const int32 ShapeIndex : Component)
+		{
+			Cycle.Add(Shapes[ShapeIndex]);
+		}
+		Cycle.Sort(FNameLexicalLess());
+	}
+}
+
+void FThroughputSolver::FindUnreachableShapes(const FThroughputProblem& Problem, const TArray<bool>& EnabledRecipes, FThroughputReport& OutReport)
+{
+	TSet<FName> ReachableShapes = {};
+	for(const TPair<FName, float>& SupplyRate : Problem.SupplyRates)
+	{
+		if(SupplyRate.Value > 0.f)
+		{
+			ReachableShapes.Add(SupplyRate.Key);
+		}
+	}
+
+	// Recipes fire once all their inputs are reachable, until nothing changes
+	TArray<bool> FiredRecipes = {};
+	FiredRecipes.Init(false, Problem.Recipes.Num());
+	bool bHasChanged = true;
+	while(bHasChanged)
+	{
+		bHasChanged = false;
+		for(int32 RecipeIndex = 0; RecipeIndex < Problem.Recipes.Num(); ++RecipeIndex)
+		{
+			const FThroughputRecipe& Recipe = Problem.Recipes[RecipeIndex];
+			if(FiredRecipes[RecipeIndex] || !EnabledRecipes[RecipeIndex])
+			{
+				continue;
+			}
+
+			if(Algo::AllOf(Recipe.Inputs, [&ReachableShapes](const FName& Input) { return ReachableShapes.Contains(Input); }))
+			{
+				FiredRecipes[RecipeIndex] = true;
+				ReachableShapes.Add(Recipe.Output);
+				bHasChanged = true;
+			}
+		}
+	}
+
+	for(const FName& ShapeName : ThroughputSolver::GatherShapes(Problem))
+	{
+		if(!ReachableShapes.Contains(ShapeName))
+		{
+			OutReport.UnreachableShapes.Add(ShapeName);
+		}
+	}
+}
+
+FString FThroughputReport::ToString() const
+{
+	FString String = bIsUnbounded
+		? FString::Printf(TEXT("%s: unbounded rate"), *TargetShape.ToString())
+		: FString::Printf(TEXT("%s: %.3f/s"), *TargetShape.ToString(), MaxRate);
+
+	for(const FThroughputBottleneck& Bottleneck : Bottlenecks)
+	{
+		String += FString::Printf(TEXT("\n  bottleneck %s %s (+%.3f/s per unit) - %s"),
+			Bottleneck.Type == EThroughputBottleneckType::Machine ? TEXT("machine") : TEXT("supply"), *Bottleneck.Name, Bottleneck.ShadowPrice,
+			*FString::JoinBy(Bottleneck.Recipes, TEXT(", "), [](const FName& Recipe) { return Recipe.ToString(); }));
+	}
+	for(const TArray<FName>& Cycle : Cycles)
+	{
+		String += FString::Printf(TEXT("\n  cycle %s"), *FString::JoinBy(Cycle, TEXT(" <-> "), [](const FName& Shape) { return Shape.ToString(); }));
+	}
+	if(!UnreachableShapes.IsEmpty())
+	{
+		String += FString::Printf(TEXT("\n  unreachable %s"), *FString::JoinBy(UnreachableShapes, TEXT(", "), [](const FName& Shape) { return Shape.ToString(); }));
+	}
+	return String;
+}
+
+TSharedRef<FJsonObject> FThroughputReport::ToJson() const
+{
+	auto ToJsonNames = [](const TArray<FName>& Names)
+	{
+		TArray<TSharedPtr<FJsonValue>> Values = {};
+		for(const FName& Name : Names)
+		{
+			Values.Add(MakeShared<FJsonValueString>(Name.ToString()));
+		}
+		return Values;
+	};
+
+	const TSharedRef<FJsonObject> RecipeRatesObject = MakeShared<FJsonObject>();
+	for(const TPair<FName, double>& RecipeRate : RecipeRates)
+	{
+		RecipeRatesObject->SetNumberField(RecipeRate.Key.ToString(), RecipeRate.Value);
+	}
+
+	const TSharedRef<FJsonObject> UtilizationsObject = MakeShared<FJsonObject>();
+	for(const TPair<FString, double>& Utilization : MachineUtilizations)
+	{
+		UtilizationsObject->SetNumberField(Utilization.Key, Utilization.Value);
+	}
+
+	TArray<TSharedPtr<FJsonValue>> BottleneckValues = {};
+	for(const FThroughputBottleneck& Bottleneck : Bottlenecks)
+	{
+		const TSharedRef<FJsonObject> BottleneckObject = MakeShared<FJsonObject>();
+		BottleneckObject->SetStringField(TEXT("type"), Bottleneck.Type == EThroughputBottleneckType::Machine ? TEXT("machine") : TEXT("supply"));
+		BottleneckObject->SetStringField(TEXT("name"), Bottleneck.Name);
+		BottleneckObject->SetNumberField(TEXT("shadow_price"), Bottleneck.ShadowPrice);
+		BottleneckObject->SetArrayField(TEXT("recipes"), ToJsonNames(Bottleneck.Recipes));
+		BottleneckValues.Add(MakeShared<FJsonValueObject>(BottleneckObject));
+	}
+
+	TArray<TSharedPtr<FJsonValue>> CycleValues = {};
+	for(const TArray<FName>& Cycle : Cycles)
+	{
+		CycleValues.Add(MakeShared<FJsonValueArray>(ToJsonNames(Cycle)));
+	}
+
+	const TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("target"), TargetShape.ToString());
+	Report->SetBoolField(TEXT("unbounded"), bIsUnbounded);
+	Report->SetNumberField(TEXT("max_rate"), MaxRate);
+	Report->SetObjectField(TEXT("recipe_rates"), RecipeRatesObject);
+	Report->SetObjectField(TEXT("machine_utilizations"), UtilizationsObject);
+	Report->SetArrayField(TEXT("bottlenecks"), BottleneckValues);
+	Report->SetArrayField(TEXT("cycles"), CycleValues);
+	Report->SetArrayField(TEXT("unreachable_shapes"), ToJsonNames(UnreachableShapes));
+	return Report;
+}
@@ -0,0 +1,172 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Dom/JsonObject.h"
+
+struct FRecipeData;
+class FIngredientCatalog;
+
+/**
+ * Recipe as seen by the solver, a hyperedge from its inputs to its output
+ */
+struct FThroughputRecipe
+{
+	FName Name = NAME_None;
+
+	/** Input shapes, a shape needed twice appears twice */
+	TArray<FName> Inputs;
+
+	FName Output = NAME_None;
+
+	/** Time of a conversion, 0 for instant recipes which aren't limited by the machines */
+	float Duration = 0.f;
+};
+
+/**
+ * Machine as seen by the solver
+ */
+struct FThroughputMachine
+{
+	FString Name;
+
+	/** Conversions running at the same time */
+	int32 Slots = 1;
+
+	/** Indices of the recipes the machine has enabled */
+	TArray<int32> Recipes;
+};
+
+/**
+ * Production graph and capacities to solve
+ */
+struct IB_TEST_API FThroughputProblem
+{
+	TArray<FThroughputRecipe> Recipes;
+
+	TArray<FThroughputMachine> Machines;
+
+	/** Shapes per second delivered from outside the factory */
+	TMap<FName, float> SupplyRates;
+
+	/** Shape whose output rate is maximized */
+	FName TargetShape = NAME_None;
+
+	/** Wildcard ingredients mapped to the shapes matching them, an ingredient is a shape any matching shape can stand for */
+	TMap<FName, TArray<FName>> Ingredients;
+
+	/**
+	 * @param RecipeData A row of the recipe DataTable.
+	 * @param IngredientNames Names of its wildcard ingredients, consumed like input shapes.
+	 * @return The index of the recipe.
+	 */
+	int32 AddRecipe(const FRecipeData& RecipeData, TConstArrayView<FName> IngredientNames = {});
+
+	/**
+	 * @brief Adds every query of the catalog to the Ingredients, named after FIngredientCatalog::GetQueryName().
+	 *
+	 * @param Catalog The compiled ingredient queries.
+	 * @param ShapeNamesById Names of the shapes the catalog was compiled with.
+	 */
+	void AddIngredients(const FIngredientCatalog& Catalog, TConstArrayView<FName> ShapeNamesById);
+
+	/**
+	 * @param RecipeName The name of the recipe.
+	 * @return The index of the recipe, INDEX_NONE if unknown.
+	 */
+	int32 FindRecipe(const FName& RecipeName) const;
+};
+
+/**
+ * What limits the output rate
+ */
+enum class EThroughputBottleneckType : uint8
+{
+	// Every slot of the machine is busy
+	Machine,
+	// Every shape delivered from outside the factory is consumed
+	Supply
+};
+
+/**
+ * Saturated capacity, one more unit of it would raise the output rate by its shadow price
+ */
+struct FThroughputBottleneck
+{
+	EThroughputBottleneckType Type = EThroughputBottleneckType::Machine;
+
+	/** Machine or shape name */
+	FString Name;
+
+	/** Output rate gained per extra slot or per extra supplied shape per second */
+	double ShadowPrice = 0.;
+
+	/** Recipes running on the machine, or consuming the shape */
+	TArray<FName> Recipes;
+};
+
+/**
+ * Steady state maximizing the output rate of the target shape
+ */
+struct IB_TEST_API FThroughputReport
+{
+	FName TargetShape = NAME_None;
+
+	/** Target shapes per second left after the recipes consuming it */
+	double MaxRate = 0.;
+
+	/** True if a recipe without input nor duration makes the rate infinite */
+	bool bIsUnbounded = false;
+
+	/** Conversions per second of each recipe */
+	TMap<FName, double> RecipeRates;
+
+	/** Busy fraction of the slots of each machine with timed recipes */
+	TMap<FString, double> MachineUtilizations;
+
+	/** Most limiting first */
+	TArray<FThroughputBottleneck> Bottlenecks;
+
+	/** Shapes feeding each other through the recipes, each cycle is a strongly connected set of shapes */
+	TArray<TArray<FName>> Cycles;
+
+	/** Shapes no enabled recipe can make from the supplied shapes */
+	TArray<FName> UnreachableShapes;
+
+	FString ToString() const;
+
+	TSharedRef<FJsonObject> ToJson() const;
+};
+
+/**
+ * Computes the maximum steady-state output rate of a shape through the recipe graph.
+ *
+ * Each (recipe, machine) pair is a rate variable of a linear program: machines share their slot time between their timed
+ * recipes, and every shape must be produced or supplied at least as fast as it is consumed. The program is solved with a
+ * dense simplex, its dual values point to the saturated machines and supplies actually limiting the target.
+ */
+class IB_TEST_API FThroughputSolver
+{
+public:
+	/**
+	 * @brief Solves the problem, each matching shape feeds an ingredient through an instant substitution recipe named "Shape as Ingredient".
+	 */
+	static FThroughputReport Solve(const FThroughputProblem& Problem);
+
+	/**
+	 * @brief Maximum simplex pivots, the best solution found so far is reported past it.
+	 */
+	static constexpr int32 MaxPivots = 50000;
+
+private:
+	/**
+	 * Fills the strongly connected shapes of the graph of the enabled recipes.
+	 */
+	static void FindCycles(const FThroughputProblem& Problem, const TArray<bool>& EnabledRecipes, FThroughputReport& OutReport);
+
+	/**
+	 * Fills the shapes the enabled recipes can't make from the supplied ones.
+	 */
+	static void FindUnreachableShapes(const FThroughputProblem& Problem, const TArray<bool>& EnabledRecipes, FThroughputReport& OutReport);
+};
@@ -0,0 +1,255 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Handle of a timer scheduled in a TTimerWheel
+ */
+struct FTimerWheelHandle
+{
+	int32 Index = INDEX_NONE;
+
+	uint32 Serial = 0;
+
+	bool IsValid() const
+	{
+		return Index != INDEX_NONE;
+	}
+
+	void Invalidate()
+	{
+		Index = INDEX_NONE;
+	}
+};
+
+/**
+ * Hierarchical timer wheel: scheduling, cancelling and expiring a timer are O(1) whatever the number of timers in flight.
+ *
+ * Timers are bucketed by expiration tick over NumLevels wheels of SlotsPerLevel slots, each level covering
+ * SlotsPerLevel times the range of the previous one. When the first wheel wraps, the matching slot of the next
+ * level is cascaded down. Timers are stored in a pooled array linked by indices so nothing is allocated once warm.
+ */
+template<typename PayloadType>
+class TTimerWheel
+{
+public:
+	static constexpr int32 SlotBits = 6;
+	static constexpr int32 SlotsPerLevel = 1 << SlotBits;
+	static constexpr int32 NumLevels = 4;
+	static constexpr uint64 MaxDelayTicks = (uint64(1) << (SlotBits * NumLevels)) - 1;
+
+	explicit TTimerWheel(float InTickSeconds = 0.01f)
+	{
+		SetTickSeconds(InTickSeconds);
+		Heads.Init(INDEX_NONE, SlotsPerLevel * NumLevels);
+	}
+
+	/**
+	 * @brief Changes the resolution of the wheel, only meant to be called while it is empty.
+	 */
+	void SetTickSeconds(float InTickSeconds)
+	{
+		ensure(NumTimers == 0);
+		TickSeconds = FMath::Max(InTickSeconds, UE_KINDA_SMALL_NUMBER);
+	}
+
+	/**
+	 * @brief Schedules a payload to expire after a delay, rounded up to the next tick.
+	 */
+	FTimerWheelHandle Schedule(const PayloadType& Payload, float DelaySeconds)
+	{
+		// At least one tick, a timer scheduled while its slot expires would wait a whole turn otherwise
+		const uint64 DelayTicks = FMath::Clamp<uint64>(FMath::CeilToInt64(FMath::Max(DelaySeconds, 0.f) / TickSeconds), 1, MaxDelayTicks);
+
+		int32 Index = FreeHead;
+		if(Index != INDEX_NONE)
+		{
+			FreeHead = Entries[Index].Next;
+		}
+		else
+		{
+			Index = Entries.AddDefaulted();
+		}
+
+		FEntry& Entry = Entries[Index];
+		Entry.Payload = Payload;
+		Entry.ExpireTick = CurrentTick + DelayTicks;
+		Entry.bIsScheduled = true;
+		++Entry.Serial;
+		Link(Index);
+		++NumTimers;
+
+		return FTimerWheelHandle{Index, Entry.Serial};
+	}
+
+	/**
+	 * @brief Cancels a timer, nothing happens if it already expired.
+	 */
+	void Cancel(FTimerWheelHandle& Handle)
+	{
+		if(Entries.IsValidIndex(Handle.Index) && Entries[Handle.Index].Serial == Handle.Serial && Entries[Handle.Index].bIsScheduled)
+		{
+			Unlink(Handle.Index);
+			Release(Handle.Index);
+		}
+		Handle.Invalidate();
+	}
+
+	/**
+	 * @brief Advances the wheel, calling OnExpired for every timer reaching its expiration.
+	 *
+	 * OnExpired may schedule or cancel timers.
+	 */
+	template<typename FunctionType>
+	void Advance(float DeltaSeconds, FunctionType&& OnExpired)
+	{
+		PendingSeconds += DeltaSeconds;
+		const int64 NumTicks = FMath::FloorToInt64(PendingSeconds / TickSeconds);
+		PendingSeconds -= NumTicks * TickSeconds;
+
+		for(int64 Tick = 0; Tick < NumTicks; ++Tick)
+		{
+			// Nothing to expire, jump straight to the end of the elapsed time
+			if(NumTimers == 0)
+			{
+				CurrentTick += NumTicks - Tick;
+				break;
+			}
+
+			// Refill the first wheel from the upper levels each time it wraps
+			for(int32 Level = 1; Level < NumLevels && GetSlot(CurrentTick, Level - 1) == 0; ++Level)
+			{
+				Cascade(Level, GetSlot(CurrentTick, Level));
+			}
+
+			// Entries are popped one by one so OnExpired may cancel the other timers of the slot
+			const int32 HeadIndex = GetSlot(CurrentTick, 0);
+			int32 Index = Heads[HeadIndex];
+			while(Index != INDEX_NONE)
+			{
+				FEntry& Entry = Entries[Index];
+				Heads[HeadIndex] = Entry.Next;
+				if(Entry.Next != INDEX_NONE)
+				{
+					Entries[Entry.Next].Prev = INDEX_NONE;
+				}
+
+				const PayloadType Payload = Entry.Payload;
+				Release(Index);
+				OnExpired(Payload);
+
+				Index = Heads[HeadIndex];
+			}
+			++CurrentTick;
+		}
+	}
+
+	int32 Num() const
+	{
+		return NumTimers;
+	}
+
+	void Reset()
+	{
+		Entries.Reset();
+		Heads.Init(INDEX_NONE, SlotsPerLevel * NumLevels);
+		FreeHead = INDEX_NONE;
+		NumTimers = 0;
+		PendingSeconds = 0.f;
+	}
+
+private:
+	struct FEntry
+	{
+		PayloadType Payload;
+		uint64 ExpireTick = 0;
+		int32 Prev = INDEX_NONE;
+		int32 Next = INDEX_NONE;
+		int32 HeadIndex = INDEX_NONE;
+		uint32 Serial = 0;
+		bool bIsScheduled = false;
+	};
+
+	static int32 GetSlot(uint64 Tick, int32 Level)
+	{
+		return static_cast<int32>((Tick >> (SlotBits * Level)) & (SlotsPerLevel - 1));
+	}
+
+	void Link(int32 Index)
+	{
+		FEntry& Entry = Entries[Index];
+		const uint64 DelayTicks = Entry.ExpireTick > CurrentTick ? Entry.ExpireTick - CurrentTick : 0;
+
+		int32 Level = 0;
+		while(Level < NumLevels - 1 && DelayTicks >= (uint64(1) << (SlotBits * (Level + 1))))
+		{
+			++Level;
+		}
+
+		Entry.HeadIndex = Level * SlotsPerLevel + GetSlot(Entry.ExpireTick, Level);
+		Entry.Prev = INDEX_NONE;
+		Entry.Next = Heads[Entry.HeadIndex];
+		if(Entry.Next != INDEX_NONE)
+		{
+			Entries[Entry.Next].Prev = Index;
+		}
+		Heads[Entry.HeadIndex] = Index;
+	}
+
+	void Unlink(int32 Index)
+	{
+		FEntry& Entry = Entries[Index];
+		if(Entry.Prev != INDEX_NONE)
+		{
+			Entries[Entry.Prev].Next = Entry.Next;
+		}
+		else
+		{
+			Heads[Entry.HeadIndex] = Entry.Next;
+		}
+		if(Entry.Next != INDEX_NONE)
+		{
+			Entries[Entry.Next].Prev = Entry.Prev;
+		}
+	}
+
+	void Release(int32 Index)
+	{
+		FEntry& Entry = Entries[Index];
+		Entry.bIsScheduled = false;
+		Entry.Payload = PayloadType();
+		Entry.Next = FreeHead;
+		FreeHead = Index;
+		--NumTimers;
+	}
+
+	void Cascade(int32 Level, int32 Slot)
+	{
+		const int32 HeadIndex = Level * SlotsPerLevel + Slot;
+		int32 Index = Heads[HeadIndex];
+		Heads[HeadIndex] = INDEX_NONE;
+		while(Index != INDEX_NONE)
+		{
+			const int32 NextIndex = Entries[Index].Next;
+			Link(Index);
+			Index = NextIndex;
+		}
+	}
+
+	TArray<FEntry> Entries;
+
+	/** First entry of every slot of every level, INDEX_NONE if empty */
+	TArray<int32> Heads;
+
+	int32 FreeHead = INDEX_NONE;
+
+	int32 NumTimers = 0;
+
+	uint64 CurrentTick = 0;
+
+	float TickSeconds = 0.01f;
+
+	float PendingSeconds = 0.f;
+};
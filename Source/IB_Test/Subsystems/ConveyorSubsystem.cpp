@@ -0,0 +1,57 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ConveyorSubsystem.h"
+
+#include "IB_Test/Actors/ConveyorActor.h"
+
+void UConveyorSubsystem::RegisterConveyor(AConveyorActor& Conveyor)
+{
+	Conveyors.AddUnique(&Conveyor);
+}
+
+void UConveyorSubsystem::UnregisterConveyor(AConveyorActor& Conveyor)
+{
+	Conveyors.RemoveSingleSwap(&Conveyor);
+}
+
+int32 UConveyorSubsystem::GetNumItems() const
+{
+	int32 NumItems = 0;
+	for(const AConveyorActor* Conveyor : Conveyors)
+	{
+		NumItems += Conveyor ? Conveyor->GetNumItems() : 0;
+	}
+	return NumItems;
+}
+
+void UConveyorSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// Simulation first, a handed off item may start a conversion spawning onto another belt
+	for(int32 ConveyorIndex = 0; ConveyorIndex < Conveyors.Num(); ++ConveyorIndex)
+	{
+		if(AConveyorActor* Conveyor = Conveyors[ConveyorIndex])
+		{
+			Conveyor->AdvanceItems(DeltaTime);
+		}
+	}
+
+	if(GetWorld() && GetWorld()->GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
+	for(AConveyorActor* Conveyor : Conveyors)
+	{
+		if(Conveyor)
+		{
+			Conveyor->UpdateInstances();
+		}
+	}
+}
+
+TStatId UConveyorSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UConveyorSubsystem, STATGROUP_Tickables);
+}
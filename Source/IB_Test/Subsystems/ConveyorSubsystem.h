@@ -0,0 +1,48 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ConveyorSubsystem.generated.h"
+
+class AConveyorActor;
+
+/**
+ * Subsystem advancing every conveyor of the world in a single pass per frame.
+ */
+UCLASS()
+class IB_TEST_API UConveyorSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Adds a conveyor to the ones advanced every frame.
+	 *
+	 * @param Conveyor The conveyor to add.
+	 */
+	void RegisterConveyor(AConveyorActor& Conveyor);
+
+	/**
+	 * @brief Removes a conveyor from the ones advanced every frame.
+	 *
+	 * @param Conveyor The conveyor to remove.
+	 */
+	void UnregisterConveyor(AConveyorActor& Conveyor);
+
+	/**
+	 * @return The number of items on every conveyor.
+	 */
+	int32 GetNumItems() const;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+private:
+	/*
+	* Every conveyor of the world
+	*/
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<AConveyorActor>> Conveyors;
+};
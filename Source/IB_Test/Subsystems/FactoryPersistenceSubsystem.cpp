@@ -0,0 +1,653 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "FactoryPersistenceSubsystem.h"
+
+#include "EngineUtils.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Actors/ShapeActor.h"
+#include "IB_Test/Settings/RecipeSettings.h"
+#include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "IB_Test/Utilities/HelperClass.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+void UFactoryPersistenceSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	RecipeSubsystem = Collection.InitializeDependency<URecipeSubsystem>();
+	if(!ensure(RecipeSubsystem))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryPersistenceSubsystem::Initialize - RecipeSubsystem nullptr"));
+		return;
+	}
+
+	RecipeConvertedHandle = RecipeSubsystem->OnRecipeConverted.AddUObject(this, &UFactoryPersistenceSubsystem::OnRecipeConverted);
+	MachineShapeEventHandle = RecipeSubsystem->OnMachineShapeEvent.AddUObject(this, &UFactoryPersistenceSubsystem::OnMachineShapeEvent);
+	FactoryFastForwardedHandle = RecipeSubsystem->OnFactoryFastForwarded.AddUObject(this, &UFactoryPersistenceSubsystem::OnFactoryFastForwarded);
+}
+
+void UFactoryPersistenceSubsystem::Deinitialize()
+{
+	if(RecipeSubsystem)
+	{
+		RecipeSubsystem->OnRecipeConverted.Remove(RecipeConvertedHandle);
+		RecipeSubsystem->OnMachineShapeEvent.Remove(MachineShapeEventHandle);
+		RecipeSubsystem->OnFactoryFastForwarded.Remove(FactoryFastForwardedHandle);
+	}
+
+	if(const UWorld* World = GetWorld())
+	{
+		World->GetTimerManager().ClearTimer(AutoSaveHandle);
+	}
+
+	if(JournalHandle)
+	{
+		JournalHandle->Flush();
+		JournalHandle.Reset();
+	}
+
+	Super::Deinitialize();
+}
+
+FString UFactoryPersistenceSubsystem::GetDefaultSnapshotPath()
+{
+	return FPaths::ProjectSavedDir() / TEXT("Factory") / TEXT("Factory.snapshot");
+}
+
+bool UFactoryPersistenceSubsystem::SaveSnapshot(const FString& SnapshotPath)
+{
+	if(!ensure(RecipeSubsystem) || GetWorld()->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryPersistenceSubsystem::SaveSnapshot - Snapshots can only be saved by the server"));
+		return false;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Shapes waiting for their spawn or destruction are saved as they will be
+	RecipeSubsystem->GetShapeActorQueue().Flush();
+
+	FFactorySnapshot Snapshot;
+	Snapshot.SnapshotId = FGuid::NewGuid();
+	CaptureSnapshot(Snapshot);
+
+	TArray<uint8> Bytes = {};
+	FMemoryWriter Writer(Bytes);
+	Snapshot.Serialize(Writer);
+	
+	// The previous snapshot is only replaced once the new one is complete
+	const FString TempPath = SnapshotPath + TEXT(".tmp");
+	if(!FFileHelper::SaveArrayToFile(Bytes, *TempPath) || !IFileManager::Get().Move(*SnapshotPath, *TempPath, true))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryPersistenceSubsystem::SaveSnapshot - Failed to write %s"), *SnapshotPath);
+		IFileManager::Get().Delete(*TempPath, false, false, true);
+		return false;
+	}
+
+	// Changes made from now on are relative to this snapshot
+	OpenJournal(GetJournalPath(SnapshotPath), Snapshot.SnapshotId, false);
+	SetCurrentSnapshot(SnapshotPath);
+
+	UE_LOG(LogTemp, Log, TEXT("UFactoryPersistenceSubsystem::SaveSnapshot - Saved %d machines and %d loose shapes (%d bytes) in %.2f ms"),
+		Snapshot.Machines.Num(), Snapshot.LooseShapes.Num(), Bytes.Num(), (FPlatformTime::Seconds() - StartTime) * 1000.);
+	return true;
+}
+
+bool UFactoryPersistenceSubsystem::RestoreSnapshot(const FString& SnapshotPath)
+{
+	if(!ensure(RecipeSubsystem) || GetWorld()->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryPersistenceSubsystem::RestoreSnapshot - Snapshots can only be restored by the server"));
+		return false;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	TArray<uint8> Bytes = {};
+	if(!FFileHelper::LoadFileToArray(Bytes, *SnapshotPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryPersistenceSubsystem::RestoreSnapshot - Failed to read %s"), *SnapshotPath);
+		return false;
+	}
+
+	FFactorySnapshot Snapshot;
+	FMemoryReader Reader(Bytes);
+	if(!Snapshot.Serialize(Reader))
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryPersistenceSubsystem::RestoreSnapshot - %s is not a valid snapshot"), *SnapshotPath);
+		return false;
+	}
+
+	const FString JournalPath = GetJournalPath(SnapshotPath);
+	const int32 NumReplayed = ReplayJournal(JournalPath, Snapshot);
+
+	// Nothing done while applying belongs to the journal currently written
+	JournalHandle.Reset();
+
+	const TArray<AMachineActor*> SortedMachines = GetSortedMachines();
+	for(AMachineActor* Machine : SortedMachines)
+	{
+		Machine->SetOverlapProcessingEnabled(false);
+	}
+
+	ApplySnapshot(Snapshot);
+
+	// The factory is now the snapshot plus its journal, what happens next is appended to it
+	OpenJournal(JournalPath, Snapshot.SnapshotId, true);
+
+	// Machines may hold enough inputs for new conversions once everything is restored
+	for(AMachineActor* Machine : SortedMachines)
+	{
+		Machine->SetOverlapProcessingEnabled(true);
+		Machine->ProcessValidRecipes();
+	}
+
+	SetCurrentSnapshot(SnapshotPath);
+
+	UE_LOG(LogTemp, Log, TEXT("UFactoryPersistenceSubsystem::RestoreSnapshot - Restored snapshot %s: %d machines, %d loose shapes and %d journal entries in %.2f ms"),
+		*Snapshot.SnapshotId.ToString(), Snapshot.Machines.Num(), Snapshot.LooseShapes.Num(), NumReplayed, (FPlatformTime::Seconds() - StartTime) * 1000.);
+	return true;
+}
+
+void UFactoryPersistenceSubsystem::CaptureSnapshot(FFactorySnapshot& OutSnapshot) const
+{
+	const TArray<FName>& ShapeNames = RecipeSubsystem->GetShapeNamesById();
+	OutSnapshot.ShapeNames = ShapeNames;
+
+	// Machines claim the shapes they hold, a shape is still only saved once should two inventories list it
+	TSet<const AShapeActor*> SavedShapes = {};
+	TArray<AShapeActor*> InventoryShapes = {};
+	TArray<int32> Counts = {};
+
+	for(const AMachineActor* Machine : GetSortedMachines())
+	{
+		Counts.Reset();
+		Counts.SetNumZeroed(ShapeNames.Num());
+
+		TMap<FName, int32> MachineShapes = Machine->GetStoredShapes();
+		Machine->GetPipelineShapes(MachineShapes);
+		for(const TPair<FName, int32>& StoredShape : MachineShapes)
+		{
+			const int32 ShapeId = RecipeSubsystem->GetShapeId(StoredShape.Key);
+			if(ShapeId != INDEX_NONE)
+			{
+				Counts[ShapeId] += StoredShape.Value;
+			}
+		}
+
+		InventoryShapes.Reset();
+		Machine->GetInventoryShapes(InventoryShapes);
+		for(const AShapeActor* Shape : InventoryShapes)
+		{
+			bool bIsAlreadySaved = false;
+			SavedShapes.Add(Shape, &bIsAlreadySaved);
+
+			const int32 ShapeId = RecipeSubsystem->GetShapeId(Shape->GetShapeKey());
+			if(!bIsAlreadySaved && ShapeId != INDEX_NONE)
+			{
+				Counts[ShapeId] += Shape->GetStackCount();
+			}
+		}
+
+		FMachineSnapshot& MachineSnapshot = OutSnapshot.Machines.AddDefaulted_GetRef();
+		MachineSnapshot.MachineName = Machine->GetMachineName();
+		MachineSnapshot.RecipeActivations = Machine->GetRecipeActivations();
+		for(int32 ShapeId = 0; ShapeId < Counts.Num(); ++ShapeId)
+		{
+			if(Counts[ShapeId] > 0)
+			{
+				MachineSnapshot.Inventory.Add({ShapeId, Counts[ShapeId]});
+			}
+		}
+	}
+
+	for(TActorIterator<AShapeActor> ShapeItr(GetWorld()); ShapeItr; ++ShapeItr)
+	{
+		const AShapeActor* Shape = *ShapeItr;
+		if(SavedShapes.Contains(Shape) || Shape->IsProvisional() || Shape->IsRetired())
+		{
+			continue;
+		}
+
+		const int32 ShapeId = RecipeSubsystem->GetShapeId(Shape->GetShapeKey());
+		if(ShapeId == INDEX_NONE)
+		{
+			continue;
+		}
+
+		FLooseShapeSnapshot& LooseShape = OutSnapshot.LooseShapes.AddDefaulted_GetRef();
+		LooseShape.ShapeId = ShapeId;
+		LooseShape.Count = Shape->GetStackCount();
+		LooseShape.Location = FVector3f(Shape->GetActorLocation());
+		LooseShape.Rotation = FQuat4f(Shape->GetActorQuat());
+	}
+}
+
+void UFactoryPersistenceSubsystem::ApplySnapshot(const FFactorySnapshot& Snapshot)
+{
+	UWorld* World = GetWorld();
+
+	// The restored factory replaces every existing shape, the queued ones included
+	RecipeSubsystem->GetShapeActorQueue().Flush();
+	for(TActorIterator<AShapeActor> ShapeItr(World); ShapeItr; ++ShapeItr)
+	{
+		ShapeItr->Destroy();
+	}
+
+	const TMap<FString, AMachineActor*>& Machines = RecipeSubsystem->GetMachinesData();
+	TMap<FName, int32> StoredShapes = {};
+	for(const FMachineSnapshot& MachineSnapshot : Snapshot.Machines)
+	{
+		AMachineActor* const* Machine = Machines.Find(MachineSnapshot.MachineName);
+		if(!Machine || !*Machine)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("UFactoryPersistenceSubsystem::ApplySnapshot - Unknown machine %s, its state is dropped"), *MachineSnapshot.MachineName);
+			continue;
+		}
+
+		StoredShapes.Reset();
+		for(const FShapeCountSnapshot& Entry : MachineSnapshot.Inventory)
+		{
+			if(Snapshot.ShapeNames.IsValidIndex(Entry.ShapeId))
+			{
+				StoredShapes.Add(Snapshot.ShapeNames[Entry.ShapeId], Entry.Count);
+			}
+		}
+
+		(*Machine)->RestoreState(StoredShapes, MachineSnapshot.RecipeActivations);
+	}
+
+	// Restoring is a loading step, each shape class is loaded synchronously once
+	TArray<TSubclassOf<AShapeActor>> ShapeClasses = {};
+	ShapeClasses.SetNum(Snapshot.ShapeNames.Num());
+	for(int32 ShapeId = 0; ShapeId < Snapshot.ShapeNames.Num(); ++ShapeId)
+	{
+		if(RecipeSubsystem->GetShapeId(Snapshot.ShapeNames[ShapeId]) != INDEX_NONE)
+		{
+			ShapeClasses[ShapeId] = RecipeSubsystem->LoadShapeActorClass(Snapshot.ShapeNames[ShapeId]);
+		}
+	}
+
+	// The spawns are finished by the queue within its frame budget, a large factory doesn't stall the restore
+	FShapeActorQueue& ShapeActorQueue = RecipeSubsystem->GetShapeActorQueue();
+	for(const FLooseShapeSnapshot& LooseShape : Snapshot.LooseShapes)
+	{
+		const TSubclassOf<AShapeActor> ShapeClass = ShapeClasses.IsValidIndex(LooseShape.ShapeId) ? ShapeClasses[LooseShape.ShapeId] : nullptr;
+		if(!ShapeClass)
+		{
+			continue;
+		}
+
+		const FTransform Transform(FQuat(LooseShape.Rotation), FVector(LooseShape.Location));
+		if(AShapeActor* Shape = ShapeActorQueue.EnqueueSpawn(*World, ShapeClass, Transform, nullptr, nullptr))
+		{
+			Shape->AddToStack(LooseShape.Count - 1);
+		}
+	}
+}
+
+bool UFactoryPersistenceSubsystem::OpenJournal(const FString& JournalPath, const FGuid& SnapshotId, bool bAppend)
+{
+	if(JournalHandle)
+	{
+		JournalHandle->Flush();
+		JournalHandle.Reset();
+	}
+
+	JournalHeader = FFactoryJournalHeader();
+	JournalHeader.SnapshotId = SnapshotId;
+	JournalMachineIndices.Reset();
+	JournalShapeIndices.Reset();
+	JournalRecipeIndices.Reset();
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if(bAppend && PlatformFile.FileExists(*JournalPath))
+	{
+		// Keep the tables of the existing journal, appended entries must use the same indices
+		TArray<uint8> Bytes = {};
+		FFileHelper::LoadFileToArray(Bytes, *JournalPath);
+		FMemoryReader Reader(Bytes);
+		if(!JournalHeader.Serialize(Reader) || JournalHeader.SnapshotId != SnapshotId)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("UFactoryPersistenceSubsystem::OpenJournal - %s doesn't match the snapshot, starting a new one"), *JournalPath);
+			return OpenJournal(JournalPath, SnapshotId, false);
+		}
+
+		// Entries must start on an entry boundary, a trailing partial entry comes from an interrupted write
+		const int64 EntriesSize = (Bytes.Num() - Reader.Tell()) / sizeof(FFactoryJournalEntry) * sizeof(FFactoryJournalEntry);
+		if(Reader.Tell() + EntriesSize != Bytes.Num())
+		{
+			Bytes.SetNum(Reader.Tell() + EntriesSize);
+			FFileHelper::SaveArrayToFile(Bytes, *JournalPath);
+		}
+	}
+	else
+	{
+		for(const AMachineActor* Machine : GetSortedMachines())
+		{
+			JournalHeader.MachineNames.Add(Machine->GetMachineName());
+		}
+		JournalHeader.ShapeNames = RecipeSubsystem->GetShapeNamesById();
+		JournalHeader.RecipeNames = RecipeSubsystem->GetAllRecipeNames();
+		JournalHeader.RecipeNames.Sort(FNameLexicalLess());
+
+		TArray<uint8> Bytes = {};
+		FMemoryWriter Writer(Bytes);
+		JournalHeader.Serialize(Writer);
+		if(!FFileHelper::SaveArrayToFile(Bytes, *JournalPath))
+		{
+			UE_LOG(LogTemp, Error, TEXT("UFactoryPersistenceSubsystem::OpenJournal - Failed to create %s"), *JournalPath);
+			return false;
+		}
+	}
+
+	const TMap<FString, AMachineActor*>& Machines = RecipeSubsystem->GetMachinesData();
+	for(int32 MachineIndex = 0; MachineIndex < JournalHeader.MachineNames.Num() && MachineIndex <= MAX_uint16; ++MachineIndex)
+	{
+		if(AMachineActor* const* Machine = Machines.Find(JournalHeader.MachineNames[MachineIndex]))
+		{
+			JournalMachineIndices.Add(*Machine, MachineIndex);
+		}
+	}
+	for(int32 ShapeIndex = 0; ShapeIndex < JournalHeader.ShapeNames.Num() && ShapeIndex <= MAX_uint16; ++ShapeIndex)
+	{
+		JournalShapeIndices.Add(JournalHeader.ShapeNames[ShapeIndex], ShapeIndex);
+	}
+	for(int32 RecipeIndex = 0; RecipeIndex < JournalHeader.RecipeNames.Num() && RecipeIndex <= MAX_uint16; ++RecipeIndex)
+	{
+		JournalRecipeIndices.Add(JournalHeader.RecipeNames[RecipeIndex], RecipeIndex);
+	}
+
+	JournalHandle.Reset(PlatformFile.OpenWrite(*JournalPath, true));
+	if(!JournalHandle)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UFactoryPersistenceSubsystem::OpenJournal - Failed to open %s"), *JournalPath);
+		return false;
+	}
+	return true;
+}
+
+int32 UFactoryPersistenceSubsystem::ReplayJournal(const FString& JournalPath, FFactorySnapshot& InOutSnapshot) const
+{
+	TArray<uint8> Bytes = {};
+	if(!FFileHelper::LoadFileToArray(Bytes, *JournalPath, FILEREAD_Silent))
+	{
+		return 0;
+	}
+
+	FFactoryJournalHeader Header;
+	FMemoryReader Reader(Bytes);
+	if(!Header.Serialize(Reader) || Header.SnapshotId != InOutSnapshot.SnapshotId)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UFactoryPersistenceSubsystem::ReplayJournal - %s doesn't match the snapshot, it is ignored"), *JournalPath);
+		return 0;
+	}
+
+	// Journal indices to snapshot indices, shapes unknown to the snapshot are appended to its table
+	TArray<int32> ShapeIds = {};
+	for(const FName& ShapeName : Header.ShapeNames)
+	{
+		const int32 ShapeId = InOutSnapshot.ShapeNames.Find(ShapeName);
+		ShapeIds.Add(ShapeId != INDEX_NONE ? ShapeId : InOutSnapshot.ShapeNames.Add(ShapeName));
+	}
+
+	TArray<int32> MachineIndices = {};
+	for(const FString& MachineName : Header.MachineNames)
+	{
+		MachineIndices.Add(InOutSnapshot.Machines.IndexOfByPredicate([&MachineName](const FMachineSnapshot& Machine)
+		{
+			return Machine.MachineName == MachineName;
+		}));
+	}
+
+	const int32 NumShapes = InOutSnapshot.ShapeNames.Num();
+	TArray<TArray<int32>> Counts = {};
+	Counts.SetNum(InOutSnapshot.Machines.Num());
+	for(int32 MachineIndex = 0; MachineIndex < Counts.Num(); ++MachineIndex)
+	{
+		Counts[MachineIndex].SetNumZeroed(NumShapes);
+		for(const FShapeCountSnapshot& Entry : InOutSnapshot.Machines[MachineIndex].Inventory)
+		{
+			if(Counts[MachineIndex].IsValidIndex(Entry.ShapeId))
+			{
+				Counts[MachineIndex][Entry.ShapeId] += Entry.Count;
+			}
+		}
+	}
+
+	// Loose shapes are only balanced by count, the drops are kept to place the shapes still lying in the world
+	TArray<int32> LooseBalances = {};
+	LooseBalances.SetNumZeroed(NumShapes);
+	TArray<TArray<FFactoryJournalEntry>> Drops = {};
+	Drops.SetNum(NumShapes);
+
+	// A trailing partial entry comes from an interrupted write and is dropped
+	const int64 EntriesOffset = Reader.Tell();
+	const int32 NumEntries = static_cast<int32>((Bytes.Num() - EntriesOffset) / sizeof(FFactoryJournalEntry));
+	int32 NumReplayed = 0;
+	int32 NumUnmatchedUnits = 0;
+	int32 NumConversions = 0;
+	for(int32 EntryIndex = 0; EntryIndex < NumEntries; ++EntryIndex)
+	{
+		FFactoryJournalEntry Entry;
+		FMemory::Memcpy(&Entry, Bytes.GetData() + EntriesOffset + EntryIndex * sizeof(FFactoryJournalEntry), sizeof(FFactoryJournalEntry));
+
+		const int32 MachineIndex = MachineIndices.IsValidIndex(Entry.MachineIndex) ? MachineIndices[Entry.MachineIndex] : INDEX_NONE;
+		if(Entry.Type == EFactoryJournalEventType::Conversion)
+		{
+			NumReplayed += Header.RecipeNames.IsValidIndex(Entry.Argument) ? 1 : 0;
+			NumConversions += Header.RecipeNames.IsValidIndex(Entry.Argument) ? 1 : 0;
+			continue;
+		}
+
+		const int32 ShapeId = ShapeIds.IsValidIndex(Entry.Argument) ? ShapeIds[Entry.Argument] : INDEX_NONE;
+		if(MachineIndex == INDEX_NONE || ShapeId == INDEX_NONE)
+		{
+			continue;
+		}
+
+		int32& Count = Counts[MachineIndex][ShapeId];
+		switch(Entry.Type)
+		{
+		case EFactoryJournalEventType::ShapeArrive:
+			Count += Entry.Count;
+			break;
+		case EFactoryJournalEventType::ShapeLeave:
+			// Ordered jobs also consume the intermediates kept by the production planner, which never arrived at a machine
+			NumUnmatchedUnits += FMath::Max(Entry.Count - Count, 0);
+			Count = FMath::Max(Count - Entry.Count, 0);
+			break;
+		case EFactoryJournalEventType::ShapePickUp:
+			LooseBalances[ShapeId] -= Entry.Count;
+			break;
+		case EFactoryJournalEventType::ShapeDrop:
+			LooseBalances[ShapeId] += Entry.Count;
+			Drops[ShapeId].Add(Entry);
+			break;
+		default:
+			continue;
+		}
+		++NumReplayed;
+	}
+
+	for(int32 MachineIndex = 0; MachineIndex < Counts.Num(); ++MachineIndex)
+	{
+		TArray<FShapeCountSnapshot>& Inventory = InOutSnapshot.Machines[MachineIndex].Inventory;
+		Inventory.Reset();
+		for(int32 ShapeId = 0; ShapeId < NumShapes; ++ShapeId)
+		{
+			if(Counts[MachineIndex][ShapeId] > 0)
+			{
+				Inventory.Add({ShapeId, Counts[MachineIndex][ShapeId]});
+			}
+		}
+	}
+
+	const TMap<FString, AMachineActor*>& Machines = RecipeSubsystem->GetMachinesData();
+	for(int32 ShapeId = 0; ShapeId < NumShapes; ++ShapeId)
+	{
+		// Saved loose shapes were picked up, the last saved ones go first
+		for(int32 LooseIndex = InOutSnapshot.LooseShapes.Num() - 1; LooseIndex >= 0 && LooseBalances[ShapeId] < 0; --LooseIndex)
+		{
+			FLooseShapeSnapshot& LooseShape = InOutSnapshot.LooseShapes[LooseIndex];
+			if(LooseShape.ShapeId == ShapeId)
+			{
+				const int32 NumTaken = FMath::Min(LooseShape.Count, -LooseBalances[ShapeId]);
+				LooseShape.Count -= NumTaken;
+				LooseBalances[ShapeId] += NumTaken;
+				if(LooseShape.Count == 0)
+				{
+					InOutSnapshot.LooseShapes.RemoveAt(LooseIndex);
+				}
+			}
+		}
+
+		// Shapes dropped since the snapshot still lie in the world, next to the machines which dropped them last
+		for(int32 DropIndex = Drops[ShapeId].Num() - 1; DropIndex >= 0 && LooseBalances[ShapeId] > 0; --DropIndex)
+		{
+			const FFactoryJournalEntry& Drop = Drops[ShapeId][DropIndex];
+			AMachineActor* const* Machine = Header.MachineNames.IsValidIndex(Drop.MachineIndex) ? Machines.Find(Header.MachineNames[Drop.MachineIndex]) : nullptr;
+			if(!Machine || !*Machine)
+			{
+				continue;
+			}
+
+			FLooseShapeSnapshot& LooseShape = InOutSnapshot.LooseShapes.AddDefaulted_GetRef();
+			LooseShape.ShapeId = ShapeId;
+			LooseShape.Count = FMath::Min<int32>(Drop.Count, LooseBalances[ShapeId]);
+			LooseShape.Location = FVector3f((*Machine)->GetActorLocation());
+			LooseBalances[ShapeId] -= LooseShape.Count;
+		}
+	}
+
+	if(NumUnmatchedUnits > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UFactoryPersistenceSubsystem::ReplayJournal - %d journaled units left machines which didn't hold them"), NumUnmatchedUnits);
+	}
+	UE_LOG(LogTemp, Log, TEXT("UFactoryPersistenceSubsystem::ReplayJournal - Replayed %d of %d entries, %d conversions"), NumReplayed, NumEntries, NumConversions);
+	return NumReplayed;
+}
+
+void UFactoryPersistenceSubsystem::OnRecipeConverted(AMachineActor& Machine, const FName& RecipeName, TConstArrayView<FName> Inputs)
+{
+	if(!JournalHandle)
+	{
+		return;
+	}
+
+	// The inputs left the machine for good, the output is journaled wherever it lands
+	for(const FName& InputName : Inputs)
+	{
+		if(const int32* ShapeIndex = JournalShapeIndices.Find(InputName))
+		{
+			AppendJournal(Machine, EFactoryJournalEventType::ShapeLeave, *ShapeIndex, 1);
+		}
+	}
+
+	if(const int32* RecipeIndex = JournalRecipeIndices.Find(RecipeName))
+	{
+		AppendJournal(Machine, EFactoryJournalEventType::Conversion, *RecipeIndex, 1);
+	}
+}
+
+void UFactoryPersistenceSubsystem::OnMachineShapeEvent(AMachineActor& Machine, EMachineShapeEvent Event, const FName& ShapeName, int32 Count)
+{
+	const int32* ShapeIndex = JournalHandle ? JournalShapeIndices.Find(ShapeName) : nullptr;
+	if(!ShapeIndex)
+	{
+		return;
+	}
+
+	switch(Event)
+	{
+	case EMachineShapeEvent::Arrive:
+		AppendJournal(Machine, EFactoryJournalEventType::ShapeArrive, *ShapeIndex, Count);
+		break;
+	case EMachineShapeEvent::Leave:
+		AppendJournal(Machine, EFactoryJournalEventType::ShapeLeave, *ShapeIndex, Count);
+		break;
+	case EMachineShapeEvent::PickUp:
+		AppendJournal(Machine, EFactoryJournalEventType::ShapePickUp, *ShapeIndex, Count);
+		break;
+	case EMachineShapeEvent::Drop:
+		AppendJournal(Machine, EFactoryJournalEventType::ShapeDrop, *ShapeIndex, Count);
+		break;
+	}
+}
+
+void UFactoryPersistenceSubsystem::AppendJournal(const AMachineActor& Machine, EFactoryJournalEventType Type, int32 Argument, int32 Count)
+{
+	const int32* MachineIndex = JournalMachineIndices.Find(&Machine);
+	if(!MachineIndex)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UFactoryPersistenceSubsystem::AppendJournal - Machine %s unknown to the journal"), *Machine.GetMachineName());
+		return;
+	}
+
+	FFactoryJournalEntry Entry;
+	Entry.MachineIndex = static_cast<uint16>(*MachineIndex);
+	Entry.Argument = static_cast<uint16>(Argument);
+	Entry.Type = Type;
+	for(int32 NumLeft = Count; NumLeft > 0; NumLeft -= Entry.Count)
+	{
+		Entry.Count = static_cast<uint16>(FMath::Min<int32>(NumLeft, MAX_uint16));
+		JournalHandle->Write(reinterpret_cast<const uint8*>(&Entry), sizeof(FFactoryJournalEntry));
+	}
+}
+
+void UFactoryPersistenceSubsystem::OnFactoryFastForwarded(float ElapsedSeconds)
+{
+	// Without a journal nothing was saved yet
+	if(JournalHandle)
+	{
+		AutoSaveSnapshot();
+	}
+}
+
+void UFactoryPersistenceSubsystem::AutoSaveSnapshot()
+{
+	// Without a current snapshot nothing was saved yet
+	if(!CurrentSnapshotPath.IsEmpty())
+	{
+		SaveSnapshot(CurrentSnapshotPath);
+	}
+}
+
+void UFactoryPersistenceSubsystem::SetCurrentSnapshot(const FString& SnapshotPath)
+{
+	CurrentSnapshotPath = SnapshotPath;
+
+	const float AutoSaveInterval = GetDefault<URecipeSettings>()->SnapshotAutoSaveInterval;
+	FTimerManager& TimerManager = GetWorld()->GetTimerManager();
+	if(AutoSaveInterval > 0.f && !TimerManager.IsTimerActive(AutoSaveHandle))
+	{
+		TimerManager.SetTimer(AutoSaveHandle, this, &UFactoryPersistenceSubsystem::AutoSaveSnapshot, AutoSaveInterval, true);
+	}
+}
+
+TArray<AMachineActor*> UFactoryPersistenceSubsystem::GetSortedMachines() const
+{
+	TArray<AMachineActor*> SortedMachines = {};
+	if(!RecipeSubsystem)
+	{
+		return SortedMachines;
+	}
+
+	for(const TPair<FString, AMachineActor*>& Pair : RecipeSubsystem->GetMachinesData())
+	{
+		if(Pair.Value)
+		{
+			SortedMachines.Add(Pair.Value);
+		}
+	}
+
+	SortedMachines.Sort([](const AMachineActor& A, const AMachineActor& B)
+	{
+		return A.GetMachineName() < B.GetMachineName();
+	});
+	return SortedMachines;
+}
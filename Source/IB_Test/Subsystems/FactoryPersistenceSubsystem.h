@@ -0,0 +1,188 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "IB_Test/Datas/FactorySnapshot.h"
+#include "FactoryPersistenceSubsystem.generated.h"
+
+class AMachineActor;
+class URecipeSubsystem;
+class IFileHandle;
+enum class EMachineShapeEvent : uint8;
+
+/**
+ * Subsystem saving and restoring the whole factory: machine inventories, enabled recipes and loose shapes.
+ *
+ * A snapshot is a compact binary image of the factory. Every shape entering, leaving or released next to a machine and
+ * every conversion performed after it is appended to a journal next to the snapshot, so restoring is loading the snapshot,
+ * replaying the journal on its counts then applying the result once. A new snapshot replaces the journal at the auto-save
+ * interval and after every fast-forward.
+ */
+UCLASS()
+class IB_TEST_API UFactoryPersistenceSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Saves the factory to a snapshot file and starts a new journal next to it, later auto-saves overwrite both (server only).
+	 *
+	 * The file is written next to its destination then moved, an interrupted save leaves the previous snapshot and its journal intact.
+	 *
+	 * @param SnapshotPath Path of the snapshot file.
+	 * @return True if the snapshot was written, false otherwise.
+	 */
+	bool SaveSnapshot(const FString& SnapshotPath);
+
+	/**
+	 * @brief Restores the factory from a snapshot file and its journal, later auto-saves overwrite both (server only).
+	 *
+	 * Machine inventories are restored as counts with overlap processing disabled, so no per-actor overlap event is generated.
+	 * Loose shapes are spawned through the shape actor queue, within its frame budget.
+	 *
+	 * @param SnapshotPath Path of the snapshot file.
+	 * @return True if the snapshot was restored, false otherwise.
+	 */
+	bool RestoreSnapshot(const FString& SnapshotPath);
+
+	/**
+	 * @return Path of the snapshot used when none is provided.
+	 */
+	static FString GetDefaultSnapshotPath();
+
+	/**
+	 * @param SnapshotPath Path of a snapshot file.
+	 * @return Path of the journal written after this snapshot.
+	 */
+	static FString GetJournalPath(const FString& SnapshotPath)
+	{
+		return FPaths::ChangeExtension(SnapshotPath, TEXT("journal"));
+	}
+
+protected:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+private:
+	/**
+	 * @brief Appends the consumed inputs and the conversion to the journal.
+	 *
+	 * @param Machine The machine which performed the conversion.
+	 * @param RecipeName The name of the converted recipe.
+	 * @param Inputs The shapes consumed by the conversion.
+	 */
+	void OnRecipeConverted(AMachineActor& Machine, const FName& RecipeName, TConstArrayView<FName> Inputs);
+
+	/**
+	 * @brief Appends shapes entering, leaving or released next to a machine to the journal.
+	 */
+	void OnMachineShapeEvent(AMachineActor& Machine, EMachineShapeEvent Event, const FName& ShapeName, int32 Count);
+
+	/**
+	 * @brief Appends entries to the journal, a count too large for a single entry is split.
+	 *
+	 * @param Machine The machine the entries apply to.
+	 * @param Type The kind of change.
+	 * @param Argument Index of the shape or of the recipe in the journal tables.
+	 * @param Count The number of units.
+	 */
+	void AppendJournal(const AMachineActor& Machine, EFactoryJournalEventType Type, int32 Argument, int32 Count);
+
+	/**
+	 * @brief Saves a new snapshot, the journal can't describe the conversions of a fast-forward.
+	 *
+	 * @param ElapsedSeconds The fast-forwarded time.
+	 */
+	void OnFactoryFastForwarded(float ElapsedSeconds);
+
+	/**
+	 * @brief Replaces the current snapshot with the state of the factory now.
+	 */
+	void AutoSaveSnapshot();
+
+	/**
+	 * @brief Makes the auto-saves write to a snapshot file.
+	 *
+	 * @param SnapshotPath Path of the snapshot file.
+	 */
+	void SetCurrentSnapshot(const FString& SnapshotPath);
+
+	/**
+	 * @brief Builds the snapshot of the current factory.
+	 *
+	 * @param OutSnapshot The snapshot to fill.
+	 */
+	void CaptureSnapshot(FFactorySnapshot& OutSnapshot) const;
+
+	/**
+	 * @brief Applies a snapshot on the current factory.
+	 *
+	 * @param Snapshot The snapshot to apply.
+	 */
+	void ApplySnapshot(const FFactorySnapshot& Snapshot);
+
+	/**
+	 * @brief Creates a new journal or opens an existing one to append entries.
+	 *
+	 * @param JournalPath Path of the journal file.
+	 * @param SnapshotId Id of the snapshot the journal applies to.
+	 * @param bAppend True to append to an existing journal, false to start a new one.
+	 * @return True if the journal is ready, false otherwise.
+	 */
+	bool OpenJournal(const FString& JournalPath, const FGuid& SnapshotId, bool bAppend);
+
+	/**
+	 * @brief Replays a journal on the counts of a snapshot before it is applied.
+	 *
+	 * Loose shapes are replayed by count: shapes picked up are removed from the saved ones, shapes dropped and not
+	 * picked up again are added next to the machine which dropped them.
+	 *
+	 * @param JournalPath Path of the journal file.
+	 * @param InOutSnapshot The snapshot the journal must apply to, updated in place.
+	 * @return The number of replayed entries.
+	 */
+	int32 ReplayJournal(const FString& JournalPath, FFactorySnapshot& InOutSnapshot) const;
+
+	/**
+	 * @return The machines of the world sorted by name, so indices are stable between runs.
+	 */
+	TArray<AMachineActor*> GetSortedMachines() const;
+
+	/**
+	 * Recipe subsystem simply stored in Initialize() to be easily accessed
+	 */
+	UPROPERTY(Transient)
+	TObjectPtr<URecipeSubsystem> RecipeSubsystem = nullptr;
+
+	/**
+	 * Tables of the journal currently written
+	 */
+	FFactoryJournalHeader JournalHeader;
+
+	/**
+	 * Reverse lookups of the journal tables
+	 */
+	TMap<const AMachineActor*, int32> JournalMachineIndices;
+	TMap<FName, int32> JournalShapeIndices;
+	TMap<FName, int32> JournalRecipeIndices;
+
+	/**
+	 * Handle of the journal currently written, nullptr until a snapshot is saved or restored
+	 */
+	TUniquePtr<IFileHandle> JournalHandle;
+
+	/**
+	 * Path of the snapshot replaced by the auto-saves, empty until a snapshot is saved or restored
+	 */
+	FString CurrentSnapshotPath;
+
+	FTimerHandle AutoSaveHandle;
+
+	FDelegateHandle RecipeConvertedHandle;
+
+	FDelegateHandle MachineShapeEventHandle;
+
+	FDelegateHandle FactoryFastForwardedHandle;
+};
@@ -0,0 +1,513 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ProductionPlannerSubsystem.h"
+
+#include "RecipeSubsystem.h"
+#include "Algo/Count.h"
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Settings/RecipeSettings.h"
+#include "IB_Test/Utilities/HelperClass.h"
+
+void UProductionPlannerSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	const URecipeSettings* RecipeSettings = GetDefault<URecipeSettings>();
+	CachedMaxOrderTasks = RecipeSettings->MaxOrderTasks;
+	CachedDispatchInterval = RecipeSettings->OrderDispatchInterval;
+}
+
+void UProductionPlannerSubsystem::Deinitialize()
+{
+	Orders.Reset();
+	Tasks.Reset();
+	Queues.Reset();
+	RecipesByShape.Reset();
+	MachinesByRecipe.Reset();
+
+	Super::Deinitialize();
+}
+
+int32 UProductionPlannerSubsystem::PlaceOrder(const FName& ShapeName, int32 Quantity, double Deadline)
+{
+	// Conversions are server-authoritative
+	if(!GetWorld() || GetWorld()->GetNetMode() == NM_Client || Quantity <= 0)
+	{
+		return INDEX_NONE;
+	}
+
+	RefreshProducers();
+
+	const int32 OrderId = NextOrderId++;
+	FProductionOrder& Order = Orders.Add(OrderId);
+	Order.ShapeName = ShapeName;
+	Order.Quantity = Quantity;
+	Order.Deadline = Deadline;
+
+	// One task tree per ordered shape, each conversion can then run on a different machine
+	NumExpandedTasks = 0;
+	TArray<int32> RootTaskIds = {};
+	for(int32 Index = 0; Index < Quantity; ++Index)
+	{
+		TArray<FName> ShapePath = {};
+		const int32 RootTaskId = ExpandShape(OrderId, ShapeName, INDEX_NONE, ShapePath);
+		if(RootTaskId == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("UProductionPlannerSubsystem::PlaceOrder - Can't plan %d %s, no enabled recipe produces it or more than %d conversions are needed"),
+				Quantity, *ShapeName.ToString(), CachedMaxOrderTasks);
+			Tasks = Tasks.FilterByPredicate([OrderId](const TPair<int32, FProductionTask>& Pair) { return Pair.Value.OrderId != OrderId; });
+			Orders.Remove(OrderId);
+			return INDEX_NONE;
+		}
+		RootTaskIds.Add(RootTaskId);
+	}
+
+	for(TPair<int32, FProductionTask>& Pair : Tasks)
+	{
+		if(Pair.Value.OrderId == OrderId && !AssignTask(Pair.Key))
+		{
+			// Unreachable, every expanded recipe has a producer
+			ensureMsgf(false, TEXT("Task of recipe %s has no machine"), *Pair.Value.RecipeName.ToString());
+		}
+	}
+
+	// Earliest deadline first, then in order of creation
+	for(FMachineTaskQueue& Queue : Queues)
+	{
+		Queue.TaskIds.Sort([this](int32 TaskA, int32 TaskB)
+		{
+			const double DeadlineA = Orders[Tasks[TaskA].OrderId].Deadline;
+			const double DeadlineB = Orders[Tasks[TaskB].OrderId].Deadline;
+			return DeadlineA != DeadlineB ? DeadlineA < DeadlineB : TaskA < TaskB;
+		});
+	}
+
+	DispatchTasks();
+	return OrderId;
+}
+
+bool UProductionPlannerSubsystem::CancelOrder(int32 OrderId)
+{
+	const FProductionOrder* Order = Orders.Find(OrderId);
+	if(!Order || Order->State != EProductionOrderState::InProgress)
+	{
+		return false;
+	}
+
+	FinishOrder(OrderId, EProductionOrderState::Failed);
+	return true;
+}
+
+int32 UProductionPlannerSubsystem::ExpandShape(int32 OrderId, const FName& ShapeName, int32 ParentTaskId, TArray<FName>& ShapePath)
+{
+	const FName* RecipeName = RecipesByShape.Find(ShapeName);
+	if(!RecipeName || ++NumExpandedTasks > CachedMaxOrderTasks)
+	{
+		return INDEX_NONE;
+	}
+
+	const AMachineActor* Machine = MachinesByRecipe[*RecipeName][0].Get();
+	const URecipeDataItem* Recipe = Machine ? Machine->GetRecipeEntry(*RecipeName) : nullptr;
+	if(!Recipe)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 TaskId = NextTaskId++;
+	FProductionTask& Task = Tasks.Add(TaskId);
+	Task.OrderId = OrderId;
+	Task.RecipeName = *RecipeName;
+	Task.Duration = Recipe->Duration;
+	Task.ParentTaskId = ParentTaskId;
+
+	// Inputs produced by another recipe are planned as child tasks, the others must be in the inventory like the wildcard ingredients
+	const TArray<FName> InputNames = UHelperClass::ConvertToNames(Recipe->InputNames);
+	ShapePath.Push(ShapeName);
+	for(const FName& InputName : InputNames)
+	{
+		if(ShapePath.Contains(InputName) || !RecipesByShape.Contains(InputName))
+		{
+			Tasks[TaskId].InventoryInputs.Add(InputName);
+			continue;
+		}
+
+		if(ExpandShape(OrderId, InputName, TaskId, ShapePath) == INDEX_NONE)
+		{
+			ShapePath.Pop();
+			return INDEX_NONE;
+		}
+		++Tasks[TaskId].NumMissingInputs;
+	}
+	ShapePath.Pop();
+
+	return TaskId;
+}
+
+void UProductionPlannerSubsystem::RefreshProducers()
+{
+	// Recipe names are unique, the recipe with the most machines is kept for each shape
+	MachinesByRecipe.Reset();
+	TMap<FName, FName> OutputsByRecipe = {};
+	const URecipeSubsystem* RecipeSubsystem = GetWorld()->GetSubsystem<URecipeSubsystem>();
+	for(const TPair<FString, AMachineActor*>& Pair : RecipeSubsystem->GetMachinesData())
+	{
+		if(!Pair.Value)
+		{
+			continue;
+		}
+
+		for(const URecipeDataItem* Recipe : Pair.Value->GetRecipeEntries())
+		{
+			if(Recipe && Recipe->bIsActivated && Recipe->HasInputs())
+			{
+				const FName RecipeName = UHelperClass::ConvertToName(Recipe->Name);
+				MachinesByRecipe.FindOrAdd(RecipeName).Add(Pair.Value);
+				OutputsByRecipe.Add(RecipeName, UHelperClass::ConvertToName(Recipe->OutputShape));
+			}
+		}
+	}
+
+	RecipesByShape.Reset();
+	for(const TPair<FName, TArray<TWeakObjectPtr<AMachineActor>>>& Pair : MachinesByRecipe)
+	{
+		FName& RecipeName = RecipesByShape.FindOrAdd(OutputsByRecipe[Pair.Key], Pair.Key);
+		if(MachinesByRecipe[RecipeName].Num() < Pair.Value.Num())
+		{
+			RecipeName = Pair.Key;
+		}
+	}
+}
+
+bool UProductionPlannerSubsystem::IsTaskReady(const AMachineActor& Machine, const FProductionTask& Task) const
+{
+	if(Task.bIsRunning || Task.NumMissingInputs > 0)
+	{
+		return false;
+	}
+
+	const URecipeDataItem* Recipe = Machine.GetRecipeEntry(Task.RecipeName);
+	if(!Recipe || !Recipe->bIsActivated)
+	{
+		return false;
+	}
+
+	FRecipeInputs Inputs(Task.InventoryInputs);
+	if(!Machine.ResolveInputQueries(*Recipe, Inputs))
+	{
+		return false;
+	}
+
+	for(const FName& InputName : Inputs)
+	{
+		const int32 NumNeeded = Algo::Count(Inputs, InputName);
+		if(Machine.GetShapeCount(InputName) < NumNeeded)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool UProductionPlannerSubsystem::AssignTask(int32 TaskId)
+{
+	FProductionTask& Task = Tasks[TaskId];
+	const TArray<TWeakObjectPtr<AMachineActor>>* Machines = MachinesByRecipe.Find(Task.RecipeName);
+	if(!Machines)
+	{
+		return false;
+	}
+
+	// Least queued time per slot, the queue length breaks ties between instant recipes
+	AMachineActor* BestMachine = nullptr;
+	float BestLoad = TNumericLimits<float>::Max();
+	int32 BestNumTasks = MAX_int32;
+	for(const TWeakObjectPtr<AMachineActor>& Machine : *Machines)
+	{
+		if(!Machine.IsValid())
+		{
+			continue;
+		}
+
+		const FMachineTaskQueue& Queue = FindOrAddQueue(*Machine);
+		const float Load = (Queue.QueuedSeconds + Task.Duration) / FMath::Max(Machine->GetParallelSlots(), 1);
+		if(Load < BestLoad || (Load == BestLoad && Queue.TaskIds.Num() < BestNumTasks))
+		{
+			BestMachine = Machine.Get();
+			BestLoad = Load;
+			BestNumTasks = Queue.TaskIds.Num();
+		}
+	}
+
+	if(!BestMachine)
+	{
+		return false;
+	}
+
+	FMachineTaskQueue& Queue = FindOrAddQueue(*BestMachine);
+	Queue.TaskIds.Add(TaskId);
+	Queue.QueuedSeconds += Task.Duration;
+	Task.Machine = BestMachine;
+	return true;
+}
+
+void UProductionPlannerSubsystem::DispatchTasks()
+{
+	// Tasks of a destroyed machine go to another one
+	for(int32 QueueIndex = 0; QueueIndex < Queues.Num(); ++QueueIndex)
+	{
+		if(Queues[QueueIndex].Machine.IsValid())
+		{
+			continue;
+		}
+
+		const TArray<int32> TaskIds = MoveTemp(Queues[QueueIndex].TaskIds);
+		Queues.RemoveAtSwap(QueueIndex--);
+		RefreshProducers();
+		for(const int32 TaskId : TaskIds)
+		{
+			if(Tasks.Contains(TaskId) && !AssignTask(TaskId))
+			{
+				FinishOrder(Tasks[TaskId].OrderId, EProductionOrderState::Failed);
+			}
+		}
+	}
+
+	// Each machine starts its own ready tasks first
+	TArray<int32, TInlineAllocator<16>> IdleQueues = {};
+	for(int32 QueueIndex = 0; QueueIndex < Queues.Num(); ++QueueIndex)
+	{
+		FMachineTaskQueue& Queue = Queues[QueueIndex];
+		for(int32 TaskIndex = 0; TaskIndex < Queue.TaskIds.Num() && Queue.Machine->HasIdleSlot(); ++TaskIndex)
+		{
+			if(IsTaskReady(*Queue.Machine, Tasks[Queue.TaskIds[TaskIndex]]) && StartTask(Queue, TaskIndex))
+			{
+				--TaskIndex;
+			}
+		}
+
+		if(Queue.Machine.IsValid() && Queue.Machine->HasIdleSlot())
+		{
+			IdleQueues.Add(QueueIndex);
+		}
+	}
+
+	// Then idle machines steal what they can start from the tail of the busiest queues
+	for(const int32 ThiefIndex : IdleQueues)
+	{
+		FMachineTaskQueue& Thief = Queues[ThiefIndex];
+		while(Thief.Machine.IsValid() && Thief.Machine->HasIdleSlot())
+		{
+			int32 VictimIndex = INDEX_NONE;
+			int32 StolenIndex = INDEX_NONE;
+			float VictimLoad = 0.f;
+			for(int32 QueueIndex = 0; QueueIndex < Queues.Num(); ++QueueIndex)
+			{
+				const FMachineTaskQueue& Queue = Queues[QueueIndex];
+				if(QueueIndex == ThiefIndex || Queue.QueuedSeconds < VictimLoad || Queue.TaskIds.IsEmpty())
+				{
+					continue;
+				}
+
+				for(int32 TaskIndex = Queue.TaskIds.Num() - 1; TaskIndex >= 0; --TaskIndex)
+				{
+					if(IsTaskReady(*Thief.Machine, Tasks[Queue.TaskIds[TaskIndex]]))
+					{
+						VictimIndex = QueueIndex;
+						StolenIndex = TaskIndex;
+						VictimLoad = Queue.QueuedSeconds;
+						break;
+					}
+				}
+			}
+
+			if(VictimIndex == INDEX_NONE)
+			{
+				break;
+			}
+
+			FMachineTaskQueue& Victim = Queues[VictimIndex];
+			const int32 TaskId = Victim.TaskIds[StolenIndex];
+			FProductionTask& Task = Tasks[TaskId];
+			Victim.TaskIds.RemoveAt(StolenIndex);
+			Victim.QueuedSeconds -= Task.Duration;
+			Thief.TaskIds.Add(TaskId);
+			Thief.QueuedSeconds += Task.Duration;
+			Task.Machine = Thief.Machine;
+			++NumStolenTasks;
+
+			if(!StartTask(Thief, Thief.TaskIds.Num() - 1))
+			{
+				break;
+			}
+		}
+	}
+}
+
+bool UProductionPlannerSubsystem::StartTask(FMachineTaskQueue& Queue, int32 QueueIndex)
+{
+	const int32 TaskId = Queue.TaskIds[QueueIndex];
+	FProductionTask& Task = Tasks[TaskId];
+
+	// Running before the machine is called, an instant recipe completes the task right away
+	Task.bIsRunning = true;
+	Queue.TaskIds.RemoveAt(QueueIndex);
+	Queue.QueuedSeconds -= Task.Duration;
+	const float Duration = Task.Duration;
+	const TArray<FName> InventoryInputs = Task.InventoryInputs;
+	const FName RecipeName = Task.RecipeName;
+
+	if(Queue.Machine->StartOrderedJob(RecipeName, InventoryInputs, TaskId))
+	{
+		return true;
+	}
+
+	Task.bIsRunning = false;
+	Queue.TaskIds.Insert(TaskId, QueueIndex);
+	Queue.QueuedSeconds += Duration;
+	return false;
+}
+
+bool UProductionPlannerSubsystem::CompleteTask(int32 TaskId)
+{
+	FProductionTask Task;
+	if(!Tasks.RemoveAndCopyValue(TaskId, Task))
+	{
+		return false;
+	}
+
+	// Intermediate products wait in the planner for the task consuming them
+	if(FProductionTask* ParentTask = Tasks.Find(Task.ParentTaskId))
+	{
+		--ParentTask->NumMissingInputs;
+		return true;
+	}
+
+	FProductionOrder* Order = Orders.Find(Task.OrderId);
+	if(Order && ++Order->NumProduced >= Order->Quantity)
+	{
+		FinishOrder(Task.OrderId, EProductionOrderState::Completed);
+	}
+	return false;
+}
+
+void UProductionPlannerSubsystem::AbortTask(int32 TaskId)
+{
+	if(const FProductionTask* Task = Tasks.Find(TaskId))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UProductionPlannerSubsystem::AbortTask - Conversion %s was dropped, order %d failed"), *Task->RecipeName.ToString(), Task->OrderId);
+		FinishOrder(Task->OrderId, EProductionOrderState::Failed);
+	}
+}
+
+void UProductionPlannerSubsystem::FinishOrder(int32 OrderId, EProductionOrderState State)
+{
+	FProductionOrder* Order = Orders.Find(OrderId);
+	if(!Order || Order->State != EProductionOrderState::InProgress)
+	{
+		return;
+	}
+	Order->State = State;
+
+	for(auto TaskIt = Tasks.CreateIterator(); TaskIt; ++TaskIt)
+	{
+		if(TaskIt->Value.OrderId != OrderId)
+		{
+			continue;
+		}
+
+		for(FMachineTaskQueue& Queue : Queues)
+		{
+			if(Queue.TaskIds.Remove(TaskIt->Key) > 0)
+			{
+				Queue.QueuedSeconds -= TaskIt->Value.Duration;
+			}
+		}
+		TaskIt.RemoveCurrent();
+	}
+
+	OnProductionOrderFinished.Broadcast(OrderId, State);
+}
+
+FMachineTaskQueue& UProductionPlannerSubsystem::FindOrAddQueue(AMachineActor& Machine)
+{
+	FMachineTaskQueue* Queue = Queues.FindByPredicate([&Machine](const FMachineTaskQueue& Item) { return Item.Machine == &Machine; });
+	if(Queue)
+	{
+		return *Queue;
+	}
+
+	FMachineTaskQueue& NewQueue = Queues.AddDefaulted_GetRef();
+	NewQueue.Machine = &Machine;
+	return NewQueue;
+}
+
+void UProductionPlannerSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if(Tasks.IsEmpty())
+	{
+		return;
+	}
+
+	DispatchCountdown -= DeltaTime;
+	if(DispatchCountdown > 0.f)
+	{
+		return;
+	}
+	DispatchCountdown = CachedDispatchInterval;
+
+	const double CurrentTime = GetWorld()->GetTimeSeconds();
+	for(TPair<int32, FProductionOrder>& Pair : Orders)
+	{
+		FProductionOrder& Order = Pair.Value;
+		if(Order.State == EProductionOrderState::InProgress && !Order.bIsLate && CurrentTime > Order.Deadline)
+		{
+			Order.bIsLate = true;
+			UE_LOG(LogTemp, Warning, TEXT("UProductionPlannerSubsystem::Tick - Order %d is late, %d/%d %s produced"),
+				Pair.Key, Order.NumProduced, Order.Quantity, *Order.ShapeName.ToString());
+		}
+	}
+
+	DispatchTasks();
+}
+
+TStatId UProductionPlannerSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UProductionPlannerSubsystem, STATGROUP_Tickables);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs PlaceOrderCommand(
+	TEXT("IB.Orders.Place"),
+	TEXT("Orders shapes from the machines. Usage: IB.Orders.Place <Shape> <Quantity> [DeadlineSeconds]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UProductionPlannerSubsystem* ProductionPlanner = World ? World->GetSubsystem<UProductionPlannerSubsystem>() : nullptr;
+		if(!ProductionPlanner || Args.Num() < 2)
+		{
+			return;
+		}
+
+		const double Deadline = World->GetTimeSeconds() + (Args.Num() > 2 ? FCString::Atod(*Args[2]) : 60.);
+		const int32 OrderId = ProductionPlanner->PlaceOrder(FName(*Args[0]), FCString::Atoi(*Args[1]), Deadline);
+		UE_LOG(LogTemp, Log, TEXT("IB.Orders.Place - Order %d placed"), OrderId);
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs ListOrdersCommand(
+	TEXT("IB.Orders.List"),
+	TEXT("Logs the progress of every production order"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const UProductionPlannerSubsystem* ProductionPlanner = World ? World->GetSubsystem<UProductionPlannerSubsystem>() : nullptr;
+		if(!ProductionPlanner)
+		{
+			return;
+		}
+
+		for(const TPair<int32, FProductionOrder>& Pair : ProductionPlanner->GetOrders())
+		{
+			UE_LOG(LogTemp, Log, TEXT("IB.Orders.List - Order %d: %d/%d %s, %s%s"), Pair.Key, Pair.Value.NumProduced, Pair.Value.Quantity,
+				*Pair.Value.ShapeName.ToString(), *UEnum::GetValueAsString(Pair.Value.State), Pair.Value.bIsLate ? TEXT(", late") : TEXT(""));
+		}
+		UE_LOG(LogTemp, Log, TEXT("IB.Orders.List - %d tasks stolen by idle machines"), ProductionPlanner->GetNumStolenTasks());
+	}));
@@ -0,0 +1,259 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ProductionPlannerSubsystem.generated.h"
+
+class AMachineActor;
+
+/**
+ * Progress of a production order
+ */
+UENUM(BlueprintType)
+enum class EProductionOrderState : uint8
+{
+	// Sub-jobs are queued or running on the machines
+	InProgress,
+	// Every ordered shape was produced
+	Completed,
+	// Cancelled, or a running sub-job was lost with its machine
+	Failed
+};
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnProductionOrderFinished, int32 /*OrderId*/, EProductionOrderState /*State*/);
+
+/**
+ * Request to produce a quantity of a shape before a deadline
+ */
+struct FProductionOrder
+{
+	FName ShapeName = NAME_None;
+
+	int32 Quantity = 0;
+
+	/** Ordered shapes already produced */
+	int32 NumProduced = 0;
+
+	/** World time by which the shapes are expected, orders are served earliest deadline first */
+	double Deadline = 0.;
+
+	EProductionOrderState State = EProductionOrderState::InProgress;
+
+	/** True once the deadline passed before the order completed */
+	bool bIsLate = false;
+};
+
+/**
+ * Single conversion of an order, queued on a machine having its recipe enabled
+ */
+struct FProductionTask
+{
+	int32 OrderId = INDEX_NONE;
+
+	FName RecipeName = NAME_None;
+
+	/** Estimated time of the conversion, used to balance the machine queues */
+	float Duration = 0.f;
+
+	/** Inputs taken from the inventory of the machine running the task */
+	TArray<FName> InventoryInputs;
+
+	/** Inputs still produced by child tasks, the task is ready once it reaches 0 */
+	int32 NumMissingInputs = 0;
+
+	/** Task consuming the output, INDEX_NONE when the output is an ordered shape */
+	int32 ParentTaskId = INDEX_NONE;
+
+	/** Machine whose queue holds the task, or running it */
+	TWeakObjectPtr<AMachineActor> Machine;
+
+	bool bIsRunning = false;
+};
+
+/**
+ * Tasks waiting on a machine, ordered by deadline
+ */
+struct FMachineTaskQueue
+{
+	TWeakObjectPtr<AMachineActor> Machine;
+
+	TArray<int32> TaskIds;
+
+	/** Sum of the durations of the queued tasks */
+	float QueuedSeconds = 0.f;
+};
+
+/**
+ * Server subsystem turning production orders into conversions across the machines.
+ * An order is expanded through the recipe graph into one task per conversion, intermediate products are kept by the
+ * planner for the task consuming them. Tasks are queued on the least loaded machine able to run them, idle machines
+ * steal the tasks they can start from the busiest queues.
+ */
+UCLASS()
+class IB_TEST_API UProductionPlannerSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Delegate broadcast when an order completed or failed
+	FOnProductionOrderFinished OnProductionOrderFinished;
+
+	/**
+	 * @brief Orders a quantity of a shape, planned right away on the machines having the needed recipes enabled.
+	 *
+	 * @param ShapeName The shape to produce.
+	 * @param Quantity The number of shapes to produce.
+	 * @param Deadline World time by which the shapes are expected.
+	 * @return Id of the order, INDEX_NONE if no enabled recipe produces the shape or the plan is too large.
+	 */
+	int32 PlaceOrder(const FName& ShapeName, int32 Quantity, double Deadline);
+
+	/**
+	 * @brief Cancels an order, its running conversions finish and deliver their output like any other.
+	 *
+	 * @param OrderId The order to cancel.
+	 * @return True if the order was in progress.
+	 */
+	bool CancelOrder(int32 OrderId);
+
+	/**
+	 * @param OrderId The order to find.
+	 * @return The order, nullptr if the id is unknown.
+	 */
+	const FProductionOrder* FindOrder(int32 OrderId) const
+	{
+		return Orders.Find(OrderId);
+	}
+
+	/**
+	 * @return Every order placed in this world, by id.
+	 */
+	const TMap<int32, FProductionOrder>& GetOrders() const
+	{
+		return Orders;
+	}
+
+	/**
+	 * @return The number of tasks moved from a busy machine to an idle one.
+	 */
+	int32 GetNumStolenTasks() const
+	{
+		return NumStolenTasks;
+	}
+
+	/**
+	 * @brief Called by a machine when the conversion of a task is done.
+	 *
+	 * @param TaskId The finished task.
+	 * @return True if the output is kept for another task, false if the machine delivers it.
+	 */
+	bool CompleteTask(int32 TaskId);
+
+	/**
+	 * @brief Called by a machine dropping a running conversion, e.g. when its pipeline is reset. The order fails, the inputs are lost.
+	 *
+	 * @param TaskId The dropped task.
+	 */
+	void AbortTask(int32 TaskId);
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+protected:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+private:
+	/**
+	 * Creates the task producing a shape, then the tasks producing its inputs.
+	 *
+	 * @param OrderId The order of the task.
+	 * @param ShapeName The shape to produce.
+	 * @param ParentTaskId The task consuming the shape.
+	 * @param ShapePath Shapes produced by the parent tasks, an input among them is taken from the inventory to break cycles.
+	 * @return Id of the created task, INDEX_NONE if no enabled recipe produces the shape or the order has too many tasks.
+	 */
+	int32 ExpandShape(int32 OrderId, const FName& ShapeName, int32 ParentTaskId, TArray<FName>& ShapePath);
+
+	/**
+	 * Gathers the enabled recipes of every machine, by output shape.
+	 */
+	void RefreshProducers();
+
+	/**
+	 * @param Machine The machine to check.
+	 * @param Task The task to run.
+	 * @return True if the machine has the recipe enabled and every input of the task.
+	 */
+	bool IsTaskReady(const AMachineActor& Machine, const FProductionTask& Task) const;
+
+	/**
+	 * Queues a task on the least loaded machine having its recipe enabled.
+	 *
+	 * @return False if no machine can run the task.
+	 */
+	bool AssignTask(int32 TaskId);
+
+	/**
+	 * Starts the ready tasks of every queue, then lets the idle machines steal from the busy ones.
+	 */
+	void DispatchTasks();
+
+	/**
+	 * Starts a queued task on the machine of a queue.
+	 *
+	 * @return True if the machine started the conversion.
+	 */
+	bool StartTask(FMachineTaskQueue& Queue, int32 QueueIndex);
+
+	/**
+	 * Removes every task of an order and broadcasts its end.
+	 */
+	void FinishOrder(int32 OrderId, EProductionOrderState State);
+
+	FMachineTaskQueue& FindOrAddQueue(AMachineActor& Machine);
+
+	/*
+	* Every order, kept once finished
+	*/
+	TMap<int32, FProductionOrder> Orders;
+
+	/*
+	* Every task not finished yet
+	*/
+	TMap<int32, FProductionTask> Tasks;
+
+	/*
+	* Queue of every machine having received a task
+	*/
+	TArray<FMachineTaskQueue> Queues;
+
+	/*
+	* Recipe producing each shape, see RefreshProducers()
+	*/
+	TMap<FName, FName> RecipesByShape;
+
+	/*
+	* Machines having each recipe enabled
+	*/
+	TMap<FName, TArray<TWeakObjectPtr<AMachineActor>>> MachinesByRecipe;
+
+	int32 NextOrderId = 0;
+	int32 NextTaskId = 0;
+	int32 NumStolenTasks = 0;
+
+	/*
+	* Tasks created by the order being expanded
+	*/
+	int32 NumExpandedTasks = 0;
+
+	/*
+	* Settings cached at begin play
+	*/
+	int32 CachedMaxOrderTasks = 4096;
+	float CachedDispatchInterval = 0.1f;
+
+	float DispatchCountdown = 0.f;
+};
@@ -0,0 +1,277 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "ProjectileSubsystem.h"
+
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/SphereComponent.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "IB_Test/Settings/RecipeSettings.h"
+#include "IB_Test/Template/IB_TestProjectile.h"
+
+void UProjectileSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	const URecipeSettings* RecipeSettings = GetDefault<URecipeSettings>();
+	CachedMaxProjectiles = RecipeSettings->MaxProjectiles;
+	CachedSweepBudget = RecipeSettings->ProjectileSweepBudget;
+	CachedMeshScale = RecipeSettings->ProjectileMeshScale;
+
+	if(InWorld.GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
+	UStaticMesh* ProjectileMesh = RecipeSettings->ProjectileMesh.LoadSynchronous();
+	if(!ProjectileMesh)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("UProjectileSubsystem::OnWorldBeginPlay - No projectile mesh in the recipe settings, projectiles are invisible"));
+		return;
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.ObjectFlags |= RF_Transient;
+	InstancesOwner = InWorld.SpawnActor<AActor>(SpawnParameters);
+	Instances = NewObject<UInstancedStaticMeshComponent>(InstancesOwner);
+	Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Instances->SetCastShadow(false);
+	Instances->SetStaticMesh(ProjectileMesh);
+	InstancesOwner->SetRootComponent(Instances);
+	Instances->RegisterComponent();
+}
+
+void UProjectileSubsystem::Deinitialize()
+{
+	Projectiles.Reset();
+	Archetypes.Reset();
+	if(InstancesOwner)
+	{
+		InstancesOwner->Destroy();
+	}
+	InstancesOwner = nullptr;
+	Instances = nullptr;
+
+	Super::Deinitialize();
+}
+
+bool UProjectileSubsystem::FireProjectile(TSubclassOf<AIB_TestProjectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, const AActor* Instigator)
+{
+	const int32 ArchetypeIndex = FindOrAddArchetype(ProjectileClass);
+	if(ArchetypeIndex == INDEX_NONE || CachedMaxProjectiles <= 0)
+	{
+		return false;
+	}
+
+	// A muzzle inside geometry fires nothing, a muzzle inside the firing pawn is fine since the pawn is never hit
+	static const FName ProjectileSpawnName = FName("ProjectileSpawn");
+	const FCollisionQueryParams QueryParams(ProjectileSpawnName, false, Instigator);
+	const FProjectileArchetype& Archetype = Archetypes[ArchetypeIndex];
+	if(GetWorld()->OverlapBlockingTestByProfile(Location, FQuat::Identity, Archetype.CollisionProfile, FCollisionShape::MakeSphere(Archetype.Radius), QueryParams))
+	{
+		return false;
+	}
+
+	// The oldest projectile makes room, the cost stays flat whatever the fire rate
+	if(Projectiles.Num() >= CachedMaxProjectiles)
+	{
+		Projectiles.RemoveAt(0, Projectiles.Num() - CachedMaxProjectiles + 1, false);
+		SweepCursor = 0;
+	}
+
+	const UProjectileMovementComponent* ProjectileMovement = ProjectileClass->GetDefaultObject<AIB_TestProjectile>()->GetProjectileMovement();
+	FVector Velocity = ProjectileMovement->Velocity;
+	if(ProjectileMovement->InitialSpeed > 0.f)
+	{
+		Velocity = Velocity.GetSafeNormal() * ProjectileMovement->InitialSpeed;
+	}
+
+	FSimulatedProjectile& Projectile = Projectiles.AddDefaulted_GetRef();
+	Projectile.Location = Location;
+	Projectile.Velocity = Rotation.RotateVector(Velocity);
+	Projectile.LifeSpan = Archetype.LifeSpan;
+	Projectile.ArchetypeIndex = ArchetypeIndex;
+	Projectile.Instigator = Instigator;
+	return true;
+}
+
+int32 UProjectileSubsystem::GetNumProjectiles() const
+{
+	return Projectiles.Num();
+}
+
+int32 UProjectileSubsystem::FindOrAddArchetype(TSubclassOf<AIB_TestProjectile> ProjectileClass)
+{
+	if(!ProjectileClass)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 ArchetypeIndex = Archetypes.IndexOfByPredicate([ProjectileClass](const FProjectileArchetype& Archetype)
+	{
+		return Archetype.ProjectileClass == ProjectileClass;
+	});
+	if(ArchetypeIndex != INDEX_NONE)
+	{
+		return ArchetypeIndex;
+	}
+	if(Archetypes.Num() > MAX_uint16)
+	{
+		UE_LOG(LogTemp, Error, TEXT("UProjectileSubsystem::FindOrAddArchetype - Too many projectile classes, %s is not fired"), *ProjectileClass->GetName());
+		return INDEX_NONE;
+	}
+
+	const AIB_TestProjectile* DefaultProjectile = ProjectileClass->GetDefaultObject<AIB_TestProjectile>();
+	const USphereComponent* CollisionComp = DefaultProjectile->GetCollisionComp();
+	const UProjectileMovementComponent* ProjectileMovement = DefaultProjectile->GetProjectileMovement();
+
+	FProjectileArchetype& Archetype = Archetypes.AddDefaulted_GetRef();
+	Archetype.ProjectileClass = ProjectileClass;
+	Archetype.CollisionProfile = CollisionComp->GetCollisionProfileName();
+	Archetype.Radius = CollisionComp->GetUnscaledSphereRadius();
+	Archetype.MaxSpeed = ProjectileMovement->MaxSpeed;
+	Archetype.GravityScale = ProjectileMovement->ProjectileGravityScale;
+	Archetype.bShouldBounce = ProjectileMovement->bShouldBounce;
+	Archetype.Bounciness = ProjectileMovement->Bounciness;
+	Archetype.Friction = ProjectileMovement->Friction;
+	Archetype.BounceStopSpeed = ProjectileMovement->BounceVelocityStopSimulatingThreshold;
+	Archetype.LifeSpan = DefaultProjectile->InitialLifeSpan > 0.f ? DefaultProjectile->InitialLifeSpan : 3.f;
+	return Archetypes.Num() - 1;
+}
+
+void UProjectileSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if(Projectiles.IsEmpty())
+	{
+		UpdateInstances();
+		return;
+	}
+
+	for(FSimulatedProjectile& Projectile : Projectiles)
+	{
+		Projectile.LifeSpan -= DeltaTime;
+		Projectile.PendingTime += DeltaTime;
+	}
+
+	// At most the sweep budget per frame, the others catch up with a longer step on the next frames
+	const float GravityZ = GetWorld()->GetGravityZ();
+	const int32 NumSweeps = CachedSweepBudget > 0 ? FMath::Min(CachedSweepBudget, Projectiles.Num()) : Projectiles.Num();
+	for(int32 SweepIndex = 0; SweepIndex < NumSweeps; ++SweepIndex)
+	{
+		FSimulatedProjectile& Projectile = Projectiles[(SweepCursor + SweepIndex) % Projectiles.Num()];
+		if(Projectile.LifeSpan > 0.f && !StepProjectile(Projectile, GravityZ))
+		{
+			Projectile.LifeSpan = 0.f;
+		}
+	}
+	SweepCursor = (SweepCursor + NumSweeps) % Projectiles.Num();
+
+	const int32 NumProjectiles = Projectiles.Num();
+	Projectiles.RemoveAll([](const FSimulatedProjectile& Projectile)
+	{
+		return Projectile.LifeSpan <= 0.f;
+	});
+	if(Projectiles.Num() != NumProjectiles)
+	{
+		SweepCursor = Projectiles.IsEmpty() ? 0 : SweepCursor % Projectiles.Num();
+	}
+
+	UpdateInstances();
+}
+
+TStatId UProjectileSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UProjectileSubsystem, STATGROUP_Tickables);
+}
+
+bool UProjectileSubsystem::StepProjectile(FSimulatedProjectile& Projectile, float GravityZ) const
+{
+	float RemainingTime = Projectile.PendingTime;
+	Projectile.PendingTime = 0.f;
+	if(!Projectile.bIsMoving)
+	{
+		return true;
+	}
+
+	const FProjectileArchetype& Archetype = Archetypes[Projectile.ArchetypeIndex];
+	Projectile.Velocity.Z += GravityZ * Archetype.GravityScale * RemainingTime;
+	if(Archetype.MaxSpeed > 0.f)
+	{
+		Projectile.Velocity = Projectile.Velocity.GetClampedToMaxSize(Archetype.MaxSpeed);
+	}
+
+	static const FName ProjectileSweepName = FName("ProjectileSweep");
+	const FCollisionQueryParams QueryParams(ProjectileSweepName, false, Projectile.Instigator.Get());
+	const FCollisionShape Shape = FCollisionShape::MakeSphere(Archetype.Radius);
+
+	// A few bounces per step, like the sub-steps of the projectile movement component
+	constexpr int32 MaxIterations = 4;
+	for(int32 Iteration = 0; Iteration < MaxIterations && RemainingTime > 0.f; ++Iteration)
+	{
+		const FVector End = Projectile.Location + Projectile.Velocity * RemainingTime;
+		FHitResult Hit;
+		if(!GetWorld()->SweepSingleByProfile(Hit, Projectile.Location, End, FQuat::Identity, Archetype.CollisionProfile, Shape, QueryParams))
+		{
+			Projectile.Location = End;
+			return true;
+		}
+
+		// Something moved onto the projectile, the movement component would push it out and it would fall, it is removed instead
+		if(Hit.bStartPenetrating)
+		{
+			return false;
+		}
+
+		Projectile.Location = Hit.Location;
+		RemainingTime *= 1.f - Hit.Time;
+
+		// Same as AIB_TestProjectile::OnHit, only physics pushes and consumes the projectile
+		UPrimitiveComponent* OtherComp = Hit.GetComponent();
+		if(Hit.GetActor() && OtherComp && OtherComp->IsSimulatingPhysics())
+		{
+			OtherComp->AddImpulseAtLocation(Projectile.Velocity * 100.0f, Projectile.Location);
+			return false;
+		}
+
+		if(!Archetype.bShouldBounce)
+		{
+			Projectile.bIsMoving = false;
+			return true;
+		}
+
+		const FVector NormalVelocity = (Projectile.Velocity | Hit.Normal) * Hit.Normal;
+		Projectile.Velocity = (Projectile.Velocity - NormalVelocity) * (1.f - Archetype.Friction) - NormalVelocity * Archetype.Bounciness;
+		if(Projectile.Velocity.SizeSquared() < FMath::Square(Archetype.BounceStopSpeed))
+		{
+			Projectile.bIsMoving = false;
+			return true;
+		}
+	}
+	return true;
+}
+
+void UProjectileSubsystem::UpdateInstances()
+{
+	if(!Instances)
+	{
+		return;
+	}
+
+	InstanceTransforms.Reset();
+	for(const FSimulatedProjectile& Projectile : Projectiles)
+	{
+		InstanceTransforms.Emplace(Projectile.Velocity.ToOrientationQuat(), Projectile.Location, CachedMeshScale);
+	}
+
+	// Instances are only rebuilt when projectiles were fired or removed, moved otherwise
+	if(Instances->GetInstanceCount() != InstanceTransforms.Num())
+	{
+		Instances->ClearInstances();
+		Instances->AddInstances(InstanceTransforms, false, true);
+	}
+	else if(!InstanceTransforms.IsEmpty())
+	{
+		Instances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+	}
+}
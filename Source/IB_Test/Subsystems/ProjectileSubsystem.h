@@ -0,0 +1,145 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ProjectileSubsystem.generated.h"
+
+class AIB_TestProjectile;
+class UInstancedStaticMeshComponent;
+
+/**
+ * Movement and collision parameters shared by every projectile of a class, read from its default object
+ */
+struct FProjectileArchetype
+{
+	TSubclassOf<AIB_TestProjectile> ProjectileClass;
+	FName CollisionProfile = NAME_None;
+	float Radius = 5.f;
+	float MaxSpeed = 0.f;
+	float GravityScale = 1.f;
+	bool bShouldBounce = false;
+	float Bounciness = 0.6f;
+	float Friction = 0.2f;
+	float BounceStopSpeed = 5.f;
+	float LifeSpan = 3.f;
+};
+
+/**
+ * A projectile in flight
+ */
+struct FSimulatedProjectile
+{
+	FVector Location = FVector::ZeroVector;
+	FVector Velocity = FVector::ZeroVector;
+
+	/** Time left before the projectile is removed */
+	float LifeSpan = 0.f;
+
+	/** Time elapsed since the projectile was last moved, it waits for its turn in the sweep budget */
+	float PendingTime = 0.f;
+
+	/** Pawn which fired the projectile, ignored by its sweeps */
+	TWeakObjectPtr<const AActor> Instigator = nullptr;
+
+	/** Index in UProjectileSubsystem::Archetypes */
+	uint16 ArchetypeIndex = 0;
+
+	/** False once the projectile came to rest after bouncing */
+	bool bIsMoving = true;
+};
+
+/**
+ * Subsystem simulating the weapon projectiles as plain structs instead of one actor per shot.
+ * Projectiles behave like AIB_TestProjectile, they push the physics-simulating components they hit, and are drawn with instances.
+ */
+UCLASS()
+class IB_TEST_API UProjectileSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Fires a projectile, the oldest one is recycled when the pool is full.
+	 *
+	 * @param ProjectileClass Class whose movement and collision settings are used.
+	 * @param Location Where the projectile starts.
+	 * @param Rotation Direction of the projectile.
+	 * @param Instigator Pawn firing the projectile, the projectile never collides with it.
+	 * @return False if the projectile would start inside blocking geometry, like a spawn with AdjustIfPossibleButDontSpawnIfColliding.
+	 */
+	bool FireProjectile(TSubclassOf<AIB_TestProjectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, const AActor* Instigator = nullptr);
+
+	/**
+	 * @return The number of projectiles in flight or at rest.
+	 */
+	int32 GetNumProjectiles() const;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+protected:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+private:
+	/**
+	 * @param ProjectileClass Class of the projectile.
+	 * @return Index of the class parameters in Archetypes, INDEX_NONE if there are too many classes.
+	 */
+	int32 FindOrAddArchetype(TSubclassOf<AIB_TestProjectile> ProjectileClass);
+
+	/**
+	 * Moves a projectile by its pending time and resolves what it hits.
+	 *
+	 * @param Projectile The projectile to move.
+	 * @param GravityZ World gravity.
+	 * @return False if the projectile hit a physics-simulating component or got stuck in geometry, and must be removed.
+	 */
+	bool StepProjectile(FSimulatedProjectile& Projectile, float GravityZ) const;
+
+	/**
+	 * Moves the instances to the projectiles locations.
+	 */
+	void UpdateInstances();
+
+	/*
+	* Parameters of every fired projectile class
+	*/
+	TArray<FProjectileArchetype> Archetypes;
+
+	/*
+	* Every projectile, the oldest first
+	*/
+	TArray<FSimulatedProjectile> Projectiles;
+
+	/*
+	* Next projectile to move when there are more than the sweep budget
+	*/
+	int32 SweepCursor = 0;
+
+	/*
+	* Scratch buffer of UpdateInstances()
+	*/
+	TArray<FTransform> InstanceTransforms;
+
+	/*
+	* Actor owning the instances, only outside of dedicated servers
+	*/
+	UPROPERTY(Transient)
+	TObjectPtr<AActor> InstancesOwner;
+
+	/*
+	* One instance per projectile
+	*/
+	UPROPERTY(Transient)
+	TObjectPtr<UInstancedStaticMeshComponent> Instances;
+
+	/*
+	* Settings cached at begin play
+	*/
+	int32 CachedMaxProjectiles = 512;
+	int32 CachedSweepBudget = 256;
+	FVector CachedMeshScale = FVector::OneVector;
+};
@@ -7,8 +7,12 @@
 #include "NiagaraFunctionLibrary.h"
 #include "IB_Test/Actors/MachineActor.h"
 #include "IB_Test/Actors/ShapeActor.h"
+#include "IB_Test/Components/MachineControlComponent.h"
 #include "IB_Test/Settings/RecipeSettings.h"
+#include "Engine/AssetManager.h"
 #include "Engine/DataTable.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
 #include "IB_Test/Utilities/HelperClass.h"
 
 void URecipeSubsystem::Initialize(FSubsystemCollectionBase& Collection)
@@ -22,25 +26,121 @@ void URecipeSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 		return;
 	}
 	
-	CacheRecipeData(RecipeSettings);
-	CacheShapeData(RecipeSettings);
+	CacheRecipeData(RecipeSettings->RecipeDataTable.LoadSynchronous());
+	CacheShapeData(RecipeSettings->ShapeDataTable.LoadSynchronous());
 	CacheVfx(RecipeSettings);
+
+	CachedPredictionTimeout = RecipeSettings->PredictionTimeout;
+	MachineTimers.SetTickSeconds(RecipeSettings->TimerWheelResolution);
+	CachedShapePreloadRadius = RecipeSettings->ShapePreloadRadius;
+	CachedShapePreloadInterval = RecipeSettings->ShapePreloadInterval;
+	bIsReadinessSweepEnabled = RecipeSettings->bEnableReadinessSweep;
+	CachedReadinessSweepInterval = RecipeSettings->ReadinessSweepInterval;
+	bIsShapeActorQueueEnabled = RecipeSettings->bUseShapeActorQueue;
+	CachedShapeActorQueueBudget = RecipeSettings->ShapeActorQueueBudget;
+	CachedMaxStackSize = RecipeSettings->MaxStackSize;
+	CachedStackMergeRadius = RecipeSettings->StackMergeRadius;
+	CachedStackMergeInterval = RecipeSettings->StackMergeInterval;
+	bArePopulationPoliciesEnabled = RecipeSettings->bEnablePopulationPolicies;
+	CachedMaxShapeActors = RecipeSettings->MaxShapeActors;
+	CachedMaxShapeActorsPerShape = RecipeSettings->MaxShapeActorsPerShape;
+	CachedShapeActorLimits = RecipeSettings->ShapeActorLimits;
+	CachedShapeIdleLifetime = RecipeSettings->ShapeIdleLifetime;
+	CachedPopulationSweepInterval = RecipeSettings->PopulationSweepInterval;
+	CachedEvictionRadius = RecipeSettings->EvictionRadius;
+}
+
+void URecipeSubsystem::Deinitialize()
+{
+	MachineTimers.Reset();
+	ShapeActorQueue.Reset();
+	RecipeScratch.Reset();
+	ShapePopulation.Reset();
+	PopulationCandidates.Empty();
+
+	for(const TPair<FName, TSharedPtr<FStreamableHandle>>& Pair : ShapeClassHandles)
+	{
+		if(Pair.Value.IsValid())
+		{
+			Pair.Value->CancelHandle();
+		}
+	}
+	ShapeClassHandles.Reset();
+	PendingShapeSpawns.Reset();
+
+	if(CachedRecipeDataTable)
+	{
+		CachedRecipeDataTable->OnDataTableChanged().RemoveAll(this);
+	}
+	if(CachedShapeDataTable)
+	{
+		CachedShapeDataTable->OnDataTableChanged().RemoveAll(this);
+	}
+
+	Super::Deinitialize();
+}
+
+void URecipeSubsystem::OverrideDataTables(UDataTable* InRecipeDataTable, UDataTable* InShapeDataTable)
+{
+	if(!ensure(!GetWorld() || !GetWorld()->HasBegunPlay()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::OverrideDataTables - The world already began play, machines cached the previous recipes"));
+		return;
+	}
+
+	if(CachedRecipeDataTable)
+	{
+		CachedRecipeDataTable->OnDataTableChanged().RemoveAll(this);
+	}
+	if(CachedShapeDataTable)
+	{
+		CachedShapeDataTable->OnDataTableChanged().RemoveAll(this);
+	}
+
+	CachedRecipesData.Reset();
+	CachedShapesData.Reset();
+	ShapeNamesById.Reset();
+	ShapeIdsByName.Reset();
+	IngredientCatalog.Reset();
+	IngredientQueriesByRecipe.Reset();
+
+	CacheRecipeData(InRecipeDataTable);
+	CacheShapeData(InShapeDataTable);
 }
 
-void URecipeSubsystem::CacheShapeData(const URecipeSettings* RecipeSettings)
+void URecipeSubsystem::CacheShapeData(UDataTable* ShapeDataTable)
 {
-	const TSoftObjectPtr<UDataTable> CachedShapeDataTable = RecipeSettings->ShapeDataTable.LoadSynchronous();
+	CachedShapeDataTable = ShapeDataTable;
 	if(!CachedShapeDataTable)
 	{
 		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::Initialize - CachedShapeDataTable invalid"));
 		return;
 	}
+
+	// Rebuild the cache whenever the DataTable is edited or reimported while the world runs
+	CachedShapeDataTable->OnDataTableChanged().AddUObject(this, &URecipeSubsystem::OnShapeDataTableChanged);
+
+	BuildShapeCache();
+
+	// Dense ids ordered by name so they don't depend on the DataTable row order
+	CachedShapesData.GetKeys(ShapeNamesById);
+	ShapeNamesById.Sort(FNameLexicalLess());
+	for(int32 ShapeId = 0; ShapeId < ShapeNamesById.Num(); ++ShapeId)
+	{
+		ShapeIdsByName.Add(ShapeNamesById[ShapeId], ShapeId);
+	}
+
+	CompileIngredients();
+}
+
+void URecipeSubsystem::BuildShapeCache()
+{
 	TArray<FShapeData*> OutShapesData = {};
 	CachedShapeDataTable->GetAllRows<FShapeData>("",OutShapesData);
 
 	if(!ensure(OutShapesData.Num() > 0))
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::Initialize - OutShapesData empty, check the Shape DataTable"));
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::BuildShapeCache - OutShapesData empty, check the Shape DataTable"));
 		return;
 	}
 
@@ -51,19 +151,29 @@ void URecipeSubsystem::CacheShapeData(const URecipeSettings* RecipeSettings)
 	}
 }
 
-void URecipeSubsystem::CacheRecipeData(const URecipeSettings* RecipeSettings)
+void URecipeSubsystem::CacheRecipeData(UDataTable* RecipeDataTable)
 {
-	const TSoftObjectPtr<UDataTable> CachedRecipeDataTable = RecipeSettings->RecipeDataTable.LoadSynchronous();
+	CachedRecipeDataTable = RecipeDataTable;
 	if(!CachedRecipeDataTable)
 	{
 		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::Initialize - CachedRecipeDataTable invalid"));
+		return;
 	}
+
+	// Rebuild the cache whenever the DataTable is edited or reimported while the world runs
+	CachedRecipeDataTable->OnDataTableChanged().AddUObject(this, &URecipeSubsystem::OnRecipeDataTableChanged);
+
+	BuildRecipeCache();
+}
+
+void URecipeSubsystem::BuildRecipeCache()
+{
 	TArray<FRecipeData*> OutRecipesData = {};
 	CachedRecipeDataTable->GetAllRows<FRecipeData>("",OutRecipesData);
 
 	if(!ensure(OutRecipesData.Num() > 0))
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::Initialize - OutRecipesData empty, check the Recipe DataTable"));
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::BuildRecipeCache - OutRecipesData empty, check the Recipe DataTable"));
 	}
 
 	// Build our map to easily & efficiently retrieve data later
@@ -71,6 +181,117 @@ void URecipeSubsystem::CacheRecipeData(const URecipeSettings* RecipeSettings)
 	{
 		CachedRecipesData.Add(UHelperClass::ConvertToName(RecipeData->Name), *RecipeData);
 	}
+
+	// The catalog is never reset here, machines keep the query indices of the recipes they cached
+	IngredientQueriesByRecipe.Reset();
+	for(const TPair<FName, FRecipeData>& Pair : CachedRecipesData)
+	{
+		for(const FGameplayTagQuery& InputQuery : Pair.Value.InputQueries)
+		{
+			const int32 QueryIndex = IngredientCatalog.AddQuery(InputQuery);
+			if(QueryIndex == INDEX_NONE)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("URecipeSubsystem::BuildRecipeCache - Empty ingredient query ignored in recipe %s"), *Pair.Key.ToString());
+				continue;
+			}
+			IngredientQueriesByRecipe.FindOrAdd(Pair.Key).Add(QueryIndex);
+		}
+	}
+}
+
+void URecipeSubsystem::CompileIngredients()
+{
+	// Removed shapes keep their id and match nothing
+	TArray<FGameplayTagContainer> ShapeTags = {};
+	ShapeTags.SetNum(ShapeNamesById.Num());
+	for(int32 ShapeId = 0; ShapeId < ShapeNamesById.Num(); ++ShapeId)
+	{
+		if(const FShapeData* ShapeData = CachedShapesData.Find(ShapeNamesById[ShapeId]))
+		{
+			ShapeTags[ShapeId] = ShapeData->Tags;
+		}
+	}
+	IngredientCatalog.Compile(ShapeTags);
+}
+
+void URecipeSubsystem::OnRecipeDataTableChanged()
+{
+	TMap<FName, FRecipeData> PreviousRecipesData = MoveTemp(CachedRecipesData);
+	CachedRecipesData.Reset();
+	BuildRecipeCache();
+	CompileIngredients();
+
+	// Only the added, modified and removed recipes are pushed to the machines
+	TSet<FName> ChangedRecipes = {};
+	for(const TPair<FName, FRecipeData>& Pair : CachedRecipesData)
+	{
+		const FRecipeData* PreviousRecipeData = PreviousRecipesData.Find(Pair.Key);
+		if(!PreviousRecipeData || !PreviousRecipeData->IsSameRecipe(Pair.Value))
+		{
+			ChangedRecipes.Add(Pair.Key);
+		}
+	}
+	for(const TPair<FName, FRecipeData>& Pair : PreviousRecipesData)
+	{
+		if(!CachedRecipesData.Contains(Pair.Key))
+		{
+			ChangedRecipes.Add(Pair.Key);
+		}
+	}
+
+	if(ChangedRecipes.IsEmpty())
+	{
+		return;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("URecipeSubsystem::OnRecipeDataTableChanged - Reloading %d recipes"), ChangedRecipes.Num());
+	for(const TPair<FString, AMachineActor*>& Pair : Machines)
+	{
+		if(Pair.Value)
+		{
+			Pair.Value->RefreshRecipes(ChangedRecipes);
+		}
+	}
+
+	RebuildReadiness();
+	OnRecipeDataReloaded.Broadcast();
+}
+
+void URecipeSubsystem::OnShapeDataTableChanged()
+{
+	const int32 PreviousNumShapes = CachedShapesData.Num();
+	CachedShapesData.Reset();
+	BuildShapeCache();
+
+	// Existing ids must stay valid while the world runs, new shapes are appended
+	for(const TPair<FName, FShapeData>& Pair : CachedShapesData)
+	{
+		if(!ShapeIdsByName.Contains(Pair.Key))
+		{
+			ShapeIdsByName.Add(Pair.Key, ShapeNamesById.Add(Pair.Key));
+		}
+	}
+	CompileIngredients();
+
+	UE_LOG(LogTemp, Log, TEXT("URecipeSubsystem::OnShapeDataTableChanged - Reloaded %d shapes (previously %d)"), CachedShapesData.Num(), PreviousNumShapes);
+
+	// Removed shapes keep their inventory key so the shapes in progress aren't lost
+	const TArray<FName> ShapeNames = GetAllShapeNames();
+	for(const TPair<FString, AMachineActor*>& Pair : Machines)
+	{
+		if(Pair.Value)
+		{
+			Pair.Value->RefreshShapeKeys(ShapeNames);
+		}
+	}
+
+	// Classes of modified shapes are streamed again on demand
+	ShapeClassHandles.Reset();
+	PreloadedMachines.Reset();
+
+	RebuildReadiness();
+
+	OnRecipeDataReloaded.Broadcast();
 }
 
 void URecipeSubsystem::CacheVfx(const URecipeSettings* RecipeSettings)
@@ -98,6 +319,8 @@ void URecipeSubsystem::InitMachineCollection(UWorld& InWorld)
 	}
 
 	ensure(Machines.Num() > 0);
+
+	RebuildReadiness();
 }
 
 void URecipeSubsystem::SetupDynamicDelegates()
@@ -108,127 +331,1364 @@ void URecipeSubsystem::SetupDynamicDelegates()
 
 void URecipeSubsystem::OnRecipeSpawn(FText RecipeName)
 {
-	const FRecipeData RecipeData = GetRecipeDataByName(RecipeName);
-	
-	SpawnShapeByName(UHelperClass::ConvertToName(RecipeData.OutputShape), *GetSelectedMachine().Get());
+	AMachineActor* Machine = GetSelectedMachine().Get();
+	if(!Machine)
+	{
+		return;
+	}
+
+	if(IsNetClient())
+	{
+		PredictRecipeSpawn(*Machine, RecipeName);
+		return;
+	}
+
+	SpawnRecipe(*Machine, RecipeName);
 }
 
 void URecipeSubsystem::OnToggleRecipe(FText RecipeName, bool bIsActivated)
 {
-	GetSelectedMachine()->SetRecipeAvailability(RecipeName, bIsActivated);
+	AMachineActor* Machine = GetSelectedMachine().Get();
+	if(!Machine)
+	{
+		return;
+	}
+
+	if(IsNetClient())
+	{
+		PredictRecipeToggle(*Machine, RecipeName, bIsActivated);
+		return;
+	}
 
-	GetSelectedMachine()->ProcessValidRecipes();
+	ToggleRecipe(*Machine, RecipeName, bIsActivated);
 }
 
-TArray<FRecipeData> URecipeSubsystem::GetRecipeDataByNames(const TArray<FText>& RecipeNames)
+int32 URecipeSubsystem::SpawnRecipe(AMachineActor& MachineActor, const FText& RecipeName, APlayerState* PredictingPlayer, int32 PredictionKey)
 {
-	TArray<FRecipeData> Recipes = {};
-	for(const FText Name : RecipeNames)
+	// Not checked, the recipe name may come from a client request
+	const FRecipeData* RecipeData = CachedRecipesData.Find(UHelperClass::ConvertToName(RecipeName));
+	if(!RecipeData)
 	{
-		Recipes.Add(GetRecipeDataByName(Name));
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnRecipe - Unknown recipe : %s"), *RecipeName.ToString());
+		return INDEX_NONE;
 	}
+
+	EventRecorder.RecordSpawnClick(MachineActor, UHelperClass::ConvertToName(RecipeName));
 	
-	return Recipes;
+	return SpawnConversionOutput(UHelperClass::ConvertToName(RecipeData->OutputShape), MachineActor, PredictingPlayer, PredictionKey);
 }
 
-FRecipeData URecipeSubsystem::GetRecipeDataByName(const FText& InRecipeName)
+bool URecipeSubsystem::ToggleRecipe(AMachineActor& MachineActor, const FText& RecipeName, bool bIsActivated)
 {
-	return CachedRecipesData.FindChecked(UHelperClass::ConvertToName(InRecipeName));
+	if(!MachineActor.SetRecipeAvailability(RecipeName, bIsActivated))
+	{
+		return false;
+	}
+
+	EventRecorder.RecordToggle(MachineActor, UHelperClass::ConvertToName(RecipeName), bIsActivated);
+	MachineActor.ProcessValidRecipes();
+	return true;
 }
 
-TSubclassOf<AShapeActor> URecipeSubsystem::GetShapeActorClassByName(const FName& InShapeName)
+int32 URecipeSubsystem::SpawnConversionOutput(const FName& ShapeName, AMachineActor& MachineActor, APlayerState* PredictingPlayer, int32 PredictionKey)
 {
-	TSubclassOf<AShapeActor> ShapeActorClass = CachedShapesData.FindChecked(InShapeName).ShapeActorClass;
-	if(!ensure(ShapeActorClass))
+	// The id tags the spawned shape so the predicting client knows which provisional shape it replaces
+	const int32 ConversionId = NextConversionId++;
+
+	// A stacked output only adds a unit to a shape clients already have, no new shape will be replicated
+	const bool bIsOutputStacked = MachineActor.StackOutput(ShapeName);
+	if(bIsOutputStacked)
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::GetShapeActorClassByName - ShapeActorClass invalid"));
-		return {};
+		SpawnSpawnVfx(MachineActor.GetActorLocation());
+	}
+	else if(!SpawnShapeByName(ShapeName, MachineActor, ConversionId))
+	{
+		return INDEX_NONE;
+	}
+
+	MachineActor.MulticastConversionPerformed(ConversionId, PredictingPlayer, PredictionKey, bIsOutputStacked);
+
+	return ConversionId;
+}
+
+bool URecipeSubsystem::IsNetClient() const
+{
+	const UWorld* World = GetWorld();
+	return World && World->GetNetMode() == NM_Client;
+}
+
+UMachineControlComponent* URecipeSubsystem::GetLocalMachineControl() const
+{
+	const UWorld* World = GetWorld();
+	const APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+	const APawn* Pawn = PlayerController ? PlayerController->GetPawn() : nullptr;
+	if(!Pawn)
+	{
+		return nullptr;
+	}
+
+	return Pawn->FindComponentByClass<UMachineControlComponent>();
+}
+
+void URecipeSubsystem::PredictRecipeSpawn(AMachineActor& MachineActor, const FText& RecipeName)
+{
+	UMachineControlComponent* MachineControl = GetLocalMachineControl();
+	if(!ensure(MachineControl))
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::PredictRecipeSpawn - No MachineControlComponent on the local pawn"));
+		return;
 	}
+
+	const FRecipeData RecipeData = GetRecipeDataByName(RecipeName);
 	
-	return ShapeActorClass;
+	const int32 PredictionKey = NextPredictionKey++;
+	FPredictedConversion& Prediction = PendingConversions.Add(PredictionKey);
+	Prediction.Machine = &MachineActor;
+	Prediction.ProvisionalShape = SpawnProvisionalShape(UHelperClass::ConvertToName(RecipeData.OutputShape), MachineActor);
+	Prediction.Timestamp = GetWorld()->GetTimeSeconds();
+	
+	SpawnSpawnVfx(MachineActor.GetActorLocation());
+	
+	MachineControl->ServerSpawnRecipe(&MachineActor, RecipeName, PredictionKey);
+	StartPredictionTimeout();
 }
 
-TArray<FName> URecipeSubsystem::GetAllShapeNames() const
+void URecipeSubsystem::PredictRecipeToggle(AMachineActor& MachineActor, const FText& RecipeName, bool bIsActivated)
 {
-	TArray<FName> OutShapeNames = {};	
-	CachedShapesData.GetKeys(OutShapeNames);
+	UMachineControlComponent* MachineControl = GetLocalMachineControl();
+	if(!ensure(MachineControl))
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::PredictRecipeToggle - No MachineControlComponent on the local pawn"));
+		return;
+	}
 
-	return OutShapeNames;
+	if(!MachineActor.SetRecipeAvailability(RecipeName, bIsActivated))
+	{
+		return;
+	}
+
+	FPredictedToggle& Prediction = PendingToggles.AddDefaulted_GetRef();
+	Prediction.PredictionKey = NextPredictionKey++;
+	Prediction.Machine = &MachineActor;
+	Prediction.RecipeName = RecipeName;
+	Prediction.bIsActivated = bIsActivated;
+	Prediction.Timestamp = GetWorld()->GetTimeSeconds();
+
+	MachineControl->ServerToggleRecipe(&MachineActor, RecipeName, bIsActivated, Prediction.PredictionKey);
+	StartPredictionTimeout();
 }
 
-TSoftObjectPtr<AMachineActor> URecipeSubsystem::GetSelectedMachine() const
+void URecipeSubsystem::AcknowledgePredictedToggle(int32 PredictionKey, bool bAccepted)
 {
-	if(!ensure(SelectedMachine.IsValid()))
+	const int32 PredictionIndex = PendingToggles.IndexOfByPredicate([PredictionKey](const FPredictedToggle& Prediction)
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::GetSelectedMachine - SelectedMachine is invalid"));
-		return nullptr;
+		return Prediction.PredictionKey == PredictionKey;
+	});
+
+	// The prediction already expired and was rolled back
+	if(PredictionIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	const TWeakObjectPtr<AMachineActor> Machine = PendingToggles[PredictionIndex].Machine;
+	PendingToggles.RemoveAt(PredictionIndex);
+
+	// An accepted toggle will come back through the replicated recipe states, nothing to reconcile
+	if(!bAccepted && Machine.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("URecipeSubsystem::AcknowledgePredictedToggle - Toggle refused by the server, rolling back machine %s"), *Machine->GetMachineName());
+		RollbackRecipeStates(*Machine);
 	}
-	return SelectedMachine;
 }
 
-TSoftObjectPtr<AMachineActor> URecipeSubsystem::GetMachineActorByName(const FString& MachineName) const
+void URecipeSubsystem::ConfirmPredictedConversion(int32 PredictionKey, int32 ConversionId)
 {
-	const TSoftObjectPtr<AMachineActor> Machine = Machines.FindChecked(MachineName);
-	if(!ensure(Machine.IsValid()))
+	FPredictedConversion Prediction;
+	if(!PendingConversions.RemoveAndCopyValue(PredictionKey, Prediction))
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::GetMachineActorByName - World is nullptr. Failed to spawn shape."));
-		return TSoftObjectPtr<AMachineActor>();
+		return;
 	}
 
-	return Machine;
+	if(ConversionId == INDEX_NONE)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("URecipeSubsystem::ConfirmPredictedConversion - Conversion refused by the server, rolling back prediction %d"), PredictionKey);
+		if(Prediction.ProvisionalShape.IsValid())
+		{
+			Prediction.ProvisionalShape->Destroy();
+		}
+		return;
+	}
+
+	AwaitConversionOutput(ConversionId, Prediction);
 }
 
-bool URecipeSubsystem::SpawnOutputShape(const TSubclassOf<AShapeActor> ShapeClass, AMachineActor& MachineActor) const
+void URecipeSubsystem::HandleRemoteConversion(AMachineActor& MachineActor, int32 ConversionId, const APlayerState* PredictingPlayer, int32 PredictionKey, bool bIsOutputStacked)
 {
-	UWorld* World = GetWorld();
-	if(!World)
+	// Our own prediction, its VFX was already played. The notification may arrive before or after the confirmation.
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	if(PredictingPlayer && PlayerController && PlayerController->PlayerState == PredictingPlayer)
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnShape - World is nullptr. Failed to spawn shape."));
-		return false;
+		// The unit shows up on the replicated stack, no other shape will take over from the provisional one
+		if(bIsOutputStacked)
+		{
+			DiscardProvisionalShape(ConversionId, PredictionKey);
+			return;
+		}
+
+		// The notification beat the confirmation, the output shape may now arrive at any time
+		FPredictedConversion Prediction;
+		if(PendingConversions.RemoveAndCopyValue(PredictionKey, Prediction))
+		{
+			AwaitConversionOutput(ConversionId, Prediction);
+		}
+		return;
 	}
-	
-	FActorSpawnParameters SpawnParameters;
-	SpawnParameters.Owner = Cast<AActor>(&MachineActor);
-	SpawnParameters.Instigator = MachineActor.GetInstigator();
-	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
-	
-	
-	const AActor* SpawnedActor = World->SpawnActor<AActor>(ShapeClass, MachineActor.GetActorLocation(), FRotator(), SpawnParameters);
-	if (!SpawnedActor)
+
+	SpawnSpawnVfx(MachineActor.GetActorLocation());
+}
+
+void URecipeSubsystem::HandleConversionOutputReplicated(AMachineActor& MachineActor, int32 ConversionId)
+{
+	const FPredictedConversion* Prediction = ConfirmedConversions.Find(ConversionId);
+	if(Prediction && Prediction->Machine.Get() == &MachineActor)
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnShape - Spawning class %s failed"), *ShapeClass.Get()->GetName());
-		return false;
+		if(Prediction->ProvisionalShape.IsValid())
+		{
+			Prediction->ProvisionalShape->Destroy();
+		}
+		ConfirmedConversions.Remove(ConversionId);
+		return;
 	}
 
-	return true;
+	// The output may belong to one of our predictions the server didn't confirm yet, it is matched once confirmed
+	if(!PendingConversions.IsEmpty())
+	{
+		FPredictedConversion& ArrivedOutput = ArrivedConversionOutputs.Add(ConversionId);
+		ArrivedOutput.Machine = &MachineActor;
+		ArrivedOutput.Timestamp = GetWorld()->GetTimeSeconds();
+	}
 }
 
-bool URecipeSubsystem::SpawnShapeByName(const FName& ShapeName, AMachineActor& MachineActor)
-{ 
-	const TSubclassOf<AShapeActor> ShapeClass = GetShapeActorClassByName(ShapeName);
-	if(!ShapeClass)
+void URecipeSubsystem::AwaitConversionOutput(int32 ConversionId, const FPredictedConversion& Prediction)
+{
+	LastConfirmedConversionId = FMath::Max(LastConfirmedConversionId, ConversionId);
+
+	FPredictedConversion ArrivedOutput;
+	if(ArrivedConversionOutputs.RemoveAndCopyValue(ConversionId, ArrivedOutput) && ArrivedOutput.Machine == Prediction.Machine)
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnShapeByName - Invalid ShapeClass associated with Shape Name : %s"), *(ShapeName.ToString()));
-		return false;
+		if(Prediction.ProvisionalShape.IsValid())
+		{
+			Prediction.ProvisionalShape->Destroy();
+		}
+		return;
 	}
-	
-	const bool IsSpawned = SpawnOutputShape(ShapeClass, MachineActor);
-	if(IsSpawned)
+
+	// Keep the provisional shape until the replicated output begins play, so the output never blinks
+	if(Prediction.ProvisionalShape.IsValid())
 	{
-		SpawnSpawnVfx(MachineActor.GetActorLocation());
+		FPredictedConversion& ConfirmedPrediction = ConfirmedConversions.Add(ConversionId, Prediction);
+		ConfirmedPrediction.Timestamp = GetWorld()->GetTimeSeconds();
 	}
-	return IsSpawned;
 }
 
-void URecipeSubsystem::SpawnSpawnVfx(const FVector& SpawnLocation) const
+void URecipeSubsystem::DiscardProvisionalShape(int32 ConversionId, int32 PredictionKey)
 {
-	UWorld* World = GetWorld();
-	if(!World)
+	FPredictedConversion Prediction;
+	if(!PendingConversions.RemoveAndCopyValue(PredictionKey, Prediction) && !ConfirmedConversions.RemoveAndCopyValue(ConversionId, Prediction))
 	{
-		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnSpawnVfx - World is nullptr. Failed to spawn shape."));
 		return;
 	}
-	
-	// Spawn VFX
-	UNiagaraFunctionLibrary::SpawnSystemAtLocation(World, CachedSpawnVfx, SpawnLocation);
+
+	LastConfirmedConversionId = FMath::Max(LastConfirmedConversionId, ConversionId);
+	if(Prediction.ProvisionalShape.IsValid())
+	{
+		Prediction.ProvisionalShape->Destroy();
+	}
+}
+
+void URecipeSubsystem::NotifyShapeEvent(AMachineActor& MachineActor, EMachineShapeEvent Event, const FName& ShapeName, int32 Count)
+{
+	// The recorder replays the machine logic, only what enters or leaves the inventory matters to it
+	if(Event == EMachineShapeEvent::Arrive)
+	{
+		EventRecorder.RecordShapeArrive(MachineActor, ShapeName, Count);
+	}
+	else if(Event == EMachineShapeEvent::Leave)
+	{
+		EventRecorder.RecordShapeLeave(MachineActor, ShapeName, Count);
+	}
+
+	OnMachineShapeEvent.Broadcast(MachineActor, Event, ShapeName, Count);
 }
+
+void URecipeSubsystem::ReapplyPredictedToggles(AMachineActor& MachineActor)
+{
+	for(const FPredictedToggle& Prediction : PendingToggles)
+	{
+		if(Prediction.Machine.Get() == &MachineActor)
+		{
+			MachineActor.SetRecipeAvailability(Prediction.RecipeName, Prediction.bIsActivated);
+		}
+	}
+
+	OnRecipeStatesReconciled.Broadcast(&MachineActor);
+}
+
+void URecipeSubsystem::RollbackRecipeStates(AMachineActor& MachineActor)
+{
+	MachineActor.ApplyAuthoritativeRecipeStates();
+	ReapplyPredictedToggles(MachineActor);
+}
+
+AShapeActor* URecipeSubsystem::SpawnProvisionalShape(const FName& ShapeName, AMachineActor& MachineActor)
+{
+	UWorld* World = GetWorld();
+	const FShapeData* ShapeData = CachedShapesData.Find(ShapeName);
+	if(!World || !ShapeData || ShapeData->ShapeActorClass.IsNull())
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnProvisionalShape - Failed to spawn provisional shape %s"), *ShapeName.ToString());
+		return nullptr;
+	}
+
+	// Not worth a hitch, the replicated output will show up anyway
+	if(!ShapeData->ShapeActorClass.Get())
+	{
+		RequestShapeActorClass(ShapeName);
+		return nullptr;
+	}
+
+	// Spawned deferred so the shape never exists with collision enabled
+	const FTransform SpawnTransform(MachineActor.GetActorLocation());
+	AShapeActor* ProvisionalShape = World->SpawnActorDeferred<AShapeActor>(ShapeData->ShapeActorClass.Get(), SpawnTransform, &MachineActor, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	if(!ProvisionalShape)
+	{
+		return nullptr;
+	}
+
+	ProvisionalShape->SetIsProvisional(true);
+	ProvisionalShape->FinishSpawning(SpawnTransform);
+	
+	return ProvisionalShape;
+}
+
+void URecipeSubsystem::StartPredictionTimeout()
+{
+	FTimerManager& TimerManager = GetWorld()->GetTimerManager();
+	if(!TimerManager.IsTimerActive(PredictionTimeoutHandle))
+	{
+		TimerManager.SetTimer(PredictionTimeoutHandle, this, &URecipeSubsystem::ExpireStalePredictions, CachedPredictionTimeout * 0.5f, true);
+	}
+}
+
+void URecipeSubsystem::ExpireStalePredictions()
+{
+	const double ExpirationTime = GetWorld()->GetTimeSeconds() - CachedPredictionTimeout;
+
+	TArray<TWeakObjectPtr<AMachineActor>> MachinesToRollback = {};
+	PendingToggles.RemoveAll([ExpirationTime, &MachinesToRollback](const FPredictedToggle& Prediction)
+	{
+		if(Prediction.Timestamp > ExpirationTime)
+		{
+			return false;
+		}
+		MachinesToRollback.AddUnique(Prediction.Machine);
+		return true;
+	});
+	
+	for(const TWeakObjectPtr<AMachineActor>& Machine : MachinesToRollback)
+	{
+		if(Machine.IsValid())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("URecipeSubsystem::ExpireStalePredictions - No answer from the server, rolling back machine %s"), *Machine->GetMachineName());
+			RollbackRecipeStates(*Machine);
+		}
+	}
+
+	const auto ExpireConversions = [ExpirationTime](TMap<int32, FPredictedConversion>& Conversions)
+	{
+		for(auto It = Conversions.CreateIterator(); It; ++It)
+		{
+			if(It.Value().Timestamp <= ExpirationTime)
+			{
+				if(It.Value().ProvisionalShape.IsValid())
+				{
+					It.Value().ProvisionalShape->Destroy();
+				}
+				It.RemoveCurrent();
+			}
+		}
+	};
+	ExpireConversions(PendingConversions);
+	ExpireConversions(ConfirmedConversions);
+	ExpireConversions(ArrivedConversionOutputs);
+
+	if(PendingToggles.IsEmpty() && PendingConversions.IsEmpty() && ConfirmedConversions.IsEmpty() && ArrivedConversionOutputs.IsEmpty())
+	{
+		GetWorld()->GetTimerManager().ClearTimer(PredictionTimeoutHandle);
+	}
+}
+
+TArray<FRecipeData> URecipeSubsystem::GetRecipeDataByNames(const TArray<FText>& RecipeNames)
+{
+	TArray<FRecipeData> Recipes = {};
+	for(const FText Name : RecipeNames)
+	{
+		Recipes.Add(GetRecipeDataByName(Name));
+	}
+	
+	return Recipes;
+}
+
+FRecipeData URecipeSubsystem::GetRecipeDataByName(const FText& InRecipeName)
+{
+	return CachedRecipesData.FindChecked(UHelperClass::ConvertToName(InRecipeName));
+}
+
+const FRecipeData* URecipeSubsystem::FindRecipeData(const FName& RecipeName) const
+{
+	return CachedRecipesData.Find(RecipeName);
+}
+
+TSubclassOf<AShapeActor> URecipeSubsystem::GetShapeActorClassByName(const FName& InShapeName)
+{
+	// Not checked, the shape may have been removed from the DataTable while the world runs
+	const FShapeData* ShapeData = CachedShapesData.Find(InShapeName);
+	if(!ensure(ShapeData && !ShapeData->ShapeActorClass.IsNull()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::GetShapeActorClassByName - ShapeActorClass invalid"));
+		return {};
+	}
+
+	TSubclassOf<AShapeActor> ShapeActorClass = ShapeData->ShapeActorClass.Get();
+	if(!ShapeActorClass)
+	{
+		RequestShapeActorClass(InShapeName);
+	}
+	return ShapeActorClass;
+}
+
+TSubclassOf<AShapeActor> URecipeSubsystem::LoadShapeActorClass(const FName& ShapeName)
+{
+	const FShapeData* ShapeData = CachedShapesData.Find(ShapeName);
+	if(!ShapeData || ShapeData->ShapeActorClass.IsNull())
+	{
+		return {};
+	}
+
+	const TSubclassOf<AShapeActor> ShapeActorClass = ShapeData->ShapeActorClass.LoadSynchronous();
+	if(ShapeActorClass && !ShapeClassHandles.Contains(ShapeName))
+	{
+		// Kept loaded like a streamed class, the request completes right away
+		ShapeClassHandles.Add(ShapeName, UAssetManager::GetStreamableManager().RequestSyncLoad(ShapeData->ShapeActorClass.ToSoftObjectPath()));
+	}
+	return ShapeActorClass;
+}
+
+void URecipeSubsystem::RequestShapeActorClass(const FName& ShapeName)
+{
+	const FShapeData* ShapeData = CachedShapesData.Find(ShapeName);
+	if(!ShapeData || ShapeData->ShapeActorClass.IsNull())
+	{
+		return;
+	}
+
+	const TSharedPtr<FStreamableHandle>* ShapeClassHandle = ShapeClassHandles.Find(ShapeName);
+	if(ShapeClassHandle && ShapeClassHandle->IsValid() && (*ShapeClassHandle)->IsActive())
+	{
+		return;
+	}
+
+	ShapeClassHandles.Add(ShapeName, UAssetManager::GetStreamableManager().RequestAsyncLoad(
+		ShapeData->ShapeActorClass.ToSoftObjectPath(),
+		FStreamableDelegate::CreateUObject(this, &URecipeSubsystem::OnShapeActorClassLoaded, ShapeName)));
+}
+
+void URecipeSubsystem::OnShapeActorClassLoaded(FName ShapeName)
+{
+	TArray<FPendingShapeSpawn> PendingSpawns = {};
+	if(!PendingShapeSpawns.RemoveAndCopyValue(ShapeName, PendingSpawns))
+	{
+		return;
+	}
+
+	const FShapeData* ShapeData = CachedShapesData.Find(ShapeName);
+	const TSubclassOf<AShapeActor> ShapeClass = ShapeData ? ShapeData->ShapeActorClass.Get() : nullptr;
+	if(!ShapeClass)
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::OnShapeActorClassLoaded - Failed to stream the class of shape %s, %d spawns dropped"), *ShapeName.ToString(), PendingSpawns.Num());
+		return;
+	}
+
+	for(const FPendingShapeSpawn& PendingSpawn : PendingSpawns)
+	{
+		AMachineActor* Machine = PendingSpawn.Machine.Get();
+		if(Machine && SpawnOutputShape(ShapeClass, *Machine, PendingSpawn.ConversionId))
+		{
+			SpawnSpawnVfx(Machine->GetActorLocation());
+		}
+	}
+}
+
+void URecipeSubsystem::PreloadMachineShapes(const AMachineActor& MachineActor)
+{
+	for(const URecipeDataItem* RecipeItem : MachineActor.GetRecipeEntries())
+	{
+		for(const FText& InputName : RecipeItem->InputNames)
+		{
+			RequestShapeActorClass(UHelperClass::ConvertToName(InputName));
+		}
+
+		// Any shape matching a wildcard ingredient may be spawned for it
+		for(const int32 QueryIndex : RecipeItem->InputQueries)
+		{
+			for(int32 ShapeId = 0; ShapeId < ShapeNamesById.Num(); ++ShapeId)
+			{
+				if(IngredientCatalog.Matches(ShapeId, QueryIndex))
+				{
+					RequestShapeActorClass(ShapeNamesById[ShapeId]);
+				}
+			}
+		}
+		RequestShapeActorClass(UHelperClass::ConvertToName(RecipeItem->OutputShape));
+	}
+}
+
+void URecipeSubsystem::UpdateProximityPreload(float DeltaTime)
+{
+	ShapePreloadCountdown -= DeltaTime;
+	if(ShapePreloadCountdown > 0.f || PreloadedMachines.Num() == Machines.Num())
+	{
+		return;
+	}
+	ShapePreloadCountdown = CachedShapePreloadInterval;
+
+	// Every player on the server, the local ones on clients
+	TArray<FVector, TInlineAllocator<8>> PlayerLocations = {};
+	for(FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		const APawn* Pawn = Iterator->IsValid() ? (*Iterator)->GetPawn() : nullptr;
+		if(Pawn)
+		{
+			PlayerLocations.Add(Pawn->GetActorLocation());
+		}
+	}
+
+	const float PreloadRadiusSquared = FMath::Square(CachedShapePreloadRadius);
+	for(const TPair<FString, AMachineActor*>& Pair : Machines)
+	{
+		if(!Pair.Value || PreloadedMachines.Contains(Pair.Value))
+		{
+			continue;
+		}
+
+		const FVector MachineLocation = Pair.Value->GetActorLocation();
+		for(const FVector& PlayerLocation : PlayerLocations)
+		{
+			if(FVector::DistSquared(MachineLocation, PlayerLocation) <= PreloadRadiusSquared)
+			{
+				PreloadMachineShapes(*Pair.Value);
+				PreloadedMachines.Add(Pair.Value);
+				break;
+			}
+		}
+	}
+}
+
+FTimerWheelHandle URecipeSubsystem::ScheduleMachineTimer(AMachineActor& Machine, int32 JobId, float DelaySeconds)
+{
+	return MachineTimers.Schedule(FMachineTimer{&Machine, JobId}, DelaySeconds);
+}
+
+void URecipeSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	MachineTimers.Advance(DeltaTime, [](const FMachineTimer& Timer)
+	{
+		if(AMachineActor* Machine = Timer.Machine.Get())
+		{
+			Machine->OnMachineTimerExpired(Timer.JobId);
+		}
+	});
+
+	UpdateProximityPreload(DeltaTime);
+	SweepReadiness(DeltaTime);
+	MergeShapeStacks(DeltaTime);
+	EnforcePopulationPolicies(DeltaTime);
+
+	ShapeActorQueue.Process(CachedShapeActorQueueBudget / 1000.);
+	RecipeScratch.EndTick();
+}
+
+TStatId URecipeSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(URecipeSubsystem, STATGROUP_Tickables);
+}
+
+float URecipeSubsystem::GetShapeValue(const FName& ShapeName) const
+{
+	const FShapeData* ShapeData = CachedShapesData.Find(ShapeName);
+	return ShapeData ? ShapeData->Value : 0.f;
+}
+
+TArray<FName> URecipeSubsystem::GetAllShapeNames() const
+{
+	TArray<FName> OutShapeNames = {};	
+	CachedShapesData.GetKeys(OutShapeNames);
+
+	return OutShapeNames;
+}
+
+TArray<FName> URecipeSubsystem::GetAllRecipeNames() const
+{
+	TArray<FName> OutRecipeNames = {};
+	CachedRecipesData.GetKeys(OutRecipeNames);
+
+	return OutRecipeNames;
+}
+
+TSoftObjectPtr<AMachineActor> URecipeSubsystem::GetSelectedMachine() const
+{
+	if(!ensure(SelectedMachine.IsValid()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::GetSelectedMachine - SelectedMachine is invalid"));
+		return nullptr;
+	}
+	return SelectedMachine;
+}
+
+TSoftObjectPtr<AMachineActor> URecipeSubsystem::GetMachineActorByName(const FString& MachineName) const
+{
+	const TSoftObjectPtr<AMachineActor> Machine = Machines.FindChecked(MachineName);
+	if(!ensure(Machine.IsValid()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::GetMachineActorByName - World is nullptr. Failed to spawn shape."));
+		return TSoftObjectPtr<AMachineActor>();
+	}
+
+	return Machine;
+}
+
+bool URecipeSubsystem::SpawnOutputShape(const TSubclassOf<AShapeActor> ShapeClass, AMachineActor& MachineActor, int32 ConversionId)
+{
+	UWorld* World = GetWorld();
+	if(!World)
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnShape - World is nullptr. Failed to spawn shape."));
+		return false;
+	}
+	
+	// The shape overlaps the machine once its spawn is finished, within a later frame budget. The next outputs pile onto it meanwhile
+	if(bIsShapeActorQueueEnabled)
+	{
+		AShapeActor* QueuedShape = ShapeActorQueue.EnqueueSpawn(*World, ShapeClass, FTransform(MachineActor.GetActorLocation()), &MachineActor, MachineActor.GetInstigator());
+		if(!QueuedShape)
+		{
+			UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnShape - Spawning class %s failed"), *ShapeClass.Get()->GetName());
+			return false;
+		}
+		QueuedShape->SetConversionId(ConversionId);
+		MachineActor.SetOutputStack(*QueuedShape);
+		NotifyShapeEvent(MachineActor, EMachineShapeEvent::Drop, QueuedShape->GetShapeKey());
+		return true;
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.Owner = Cast<AActor>(&MachineActor);
+	SpawnParameters.Instigator = MachineActor.GetInstigator();
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	
+	
+	AShapeActor* SpawnedActor = World->SpawnActor<AShapeActor>(ShapeClass, MachineActor.GetActorLocation(), FRotator(), SpawnParameters);
+	if (!SpawnedActor)
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnShape - Spawning class %s failed"), *ShapeClass.Get()->GetName());
+		return false;
+	}
+
+	// Set within the spawn frame, before the shape is first replicated
+	SpawnedActor->SetConversionId(ConversionId);
+	MachineActor.SetOutputStack(*SpawnedActor);
+	NotifyShapeEvent(MachineActor, EMachineShapeEvent::Drop, SpawnedActor->GetShapeKey());
+	return true;
+}
+
+void URecipeSubsystem::DestroyShape(AShapeActor& Shape)
+{
+	// A retired shape no longer counts against the caps, even while it waits in the queue
+	ShapePopulation.Remove(Shape);
+
+	if(bIsShapeActorQueueEnabled)
+	{
+		ShapeActorQueue.EnqueueDestroy(Shape);
+		return;
+	}
+	Shape.Destroy();
+}
+
+bool URecipeSubsystem::SpawnShapeByName(const FName& ShapeName, AMachineActor& MachineActor, int32 ConversionId)
+{ 
+	const FShapeData* ShapeData = CachedShapesData.Find(ShapeName);
+	if(!ShapeData || ShapeData->ShapeActorClass.IsNull())
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnShapeByName - Invalid ShapeClass associated with Shape Name : %s"), *(ShapeName.ToString()));
+		return false;
+	}
+
+	// The output of the last spawn is still next to the machine, it only gains a unit
+	if(MachineActor.StackOutput(ShapeName))
+	{
+		SpawnSpawnVfx(MachineActor.GetActorLocation());
+		return true;
+	}
+
+	// First output of its kind, the spawn waits for the class to be streamed instead of hitching
+	const TSubclassOf<AShapeActor> ShapeClass = ShapeData->ShapeActorClass.Get();
+	if(!ShapeClass)
+	{
+		PendingShapeSpawns.FindOrAdd(ShapeName).Add({&MachineActor, ConversionId});
+		RequestShapeActorClass(ShapeName);
+		return true;
+	}
+	
+	const bool IsSpawned = SpawnOutputShape(ShapeClass, MachineActor, ConversionId);
+	if(IsSpawned)
+	{
+		SpawnSpawnVfx(MachineActor.GetActorLocation());
+	}
+	return IsSpawned;
+}
+
+void URecipeSubsystem::SpawnSpawnVfx(const FVector& SpawnLocation) const
+{
+	UWorld* World = GetWorld();
+	if(!World)
+	{
+		UE_LOG(LogTemp, Error, TEXT("URecipeSubsystem::SpawnSpawnVfx - World is nullptr. Failed to spawn shape."));
+		return;
+	}
+	
+	// Spawn VFX
+	UNiagaraFunctionLibrary::SpawnSystemAtLocation(World, CachedSpawnVfx, SpawnLocation);
+}
+
+void URecipeSubsystem::RebuildReadiness()
+{
+	// Ingredient queries get a column after the shapes, holding the count of every matching shape
+	const int32 NumShapes = ShapeNamesById.Num();
+	ReadinessEvaluator.Reset(NumShapes + IngredientCatalog.GetNumQueries());
+	ReadinessRecipeNames.Reset();
+	ReadinessRecipeDurations.Reset();
+	ReadinessRecipeIndices.Reset();
+	for(const TPair<FName, FRecipeData>& Pair : CachedRecipesData)
+	{
+		// A recipe needing an unknown shape is never ready
+		TArray<TPair<int32, int32>, TInlineAllocator<4>> Requirements = {};
+		bool bAreInputsKnown = true;
+		for(const FText& InputName : Pair.Value.InputShape)
+		{
+			const int32 ShapeId = GetShapeId(UHelperClass::ConvertToName(InputName));
+			bAreInputsKnown &= ShapeId != INDEX_NONE;
+			Requirements.Emplace(ShapeId, 1);
+		}
+		for(const int32 QueryIndex : GetIngredientQueries(Pair.Key))
+		{
+			Requirements.Emplace(NumShapes + QueryIndex, 1);
+		}
+
+		const int32 RecipeIndex = bAreInputsKnown ? ReadinessEvaluator.AddRecipe(Requirements) : INDEX_NONE;
+		if(RecipeIndex != INDEX_NONE)
+		{
+			ReadinessRecipeNames.Add(Pair.Key);
+			ReadinessRecipeDurations.Add(Pair.Value.Duration);
+			ReadinessRecipeIndices.Add(Pair.Key, RecipeIndex);
+		}
+	}
+
+	ReadinessQueriesByShape.Reset();
+	ReadinessQueriesByShape.SetNum(NumShapes);
+	for(int32 ShapeId = 0; ShapeId < NumShapes; ++ShapeId)
+	{
+		for(int32 QueryIndex = 0; QueryIndex < IngredientCatalog.GetNumQueries(); ++QueryIndex)
+		{
+			if(IngredientCatalog.Matches(ShapeId, QueryIndex))
+			{
+				ReadinessQueriesByShape[ShapeId].Add(QueryIndex);
+			}
+		}
+	}
+
+	ReadinessMachines.Reset();
+	ReadinessRows.Reset();
+	for(const TPair<FString, AMachineActor*>& Pair : Machines)
+	{
+		if(Pair.Value)
+		{
+			ReadinessRows.Add(Pair.Value, ReadinessEvaluator.AddMachine());
+			ReadinessMachines.Add(Pair.Value);
+		}
+	}
+
+	// Machines may not have begun play yet, their rows are copied on the first evaluation
+	DirtyReadinessRows.Init(true, ReadinessMachines.Num());
+	DirtyReadinessRecipes.Init(false, ReadinessMachines.Num());
+}
+
+void URecipeSubsystem::MarkReadinessDirty(const AMachineActor& Machine)
+{
+	if(const int32* MachineIndex = ReadinessRows.Find(&Machine))
+	{
+		DirtyReadinessRows[*MachineIndex] = true;
+	}
+}
+
+void URecipeSubsystem::MarkReadinessRecipesDirty(const AMachineActor& Machine)
+{
+	if(const int32* MachineIndex = ReadinessRows.Find(&Machine))
+	{
+		DirtyReadinessRecipes[*MachineIndex] = true;
+	}
+}
+
+void URecipeSubsystem::UpdateReadinessCount(const AMachineActor& Machine, const FName& ShapeName, int32 Delta)
+{
+	// A row waiting to be copied gets the change along with the rest of the inventory
+	const int32* MachineIndex = ReadinessRows.Find(&Machine);
+	const int32 ShapeId = GetShapeId(ShapeName);
+	if(!MachineIndex || DirtyReadinessRows[*MachineIndex] || !ReadinessQueriesByShape.IsValidIndex(ShapeId) || Delta == 0)
+	{
+		return;
+	}
+
+	ReadinessEvaluator.AddCount(*MachineIndex, ShapeId, Delta);
+	for(const int32 QueryIndex : ReadinessQueriesByShape[ShapeId])
+	{
+		ReadinessEvaluator.AddCount(*MachineIndex, ReadinessQueriesByShape.Num() + QueryIndex, Delta);
+	}
+}
+
+void URecipeSubsystem::RefreshReadinessRow(int32 MachineIndex)
+{
+	const AMachineActor* Machine = ReadinessMachines[MachineIndex];
+	if(Machine)
+	{
+		const int32 NumShapes = ReadinessQueriesByShape.Num();
+		for(int32 QueryIndex = 0; QueryIndex < IngredientCatalog.GetNumQueries(); ++QueryIndex)
+		{
+			ReadinessEvaluator.SetCount(MachineIndex, NumShapes + QueryIndex, 0);
+		}
+
+		// Shapes shared with the exact inputs are counted twice, machines check their inputs before converting
+		for(int32 ShapeId = 0; ShapeId < NumShapes; ++ShapeId)
+		{
+			const int32 ShapeCount = Machine->GetShapeCount(ShapeNamesById[ShapeId]);
+			ReadinessEvaluator.SetCount(MachineIndex, ShapeId, ShapeCount);
+			for(const int32 QueryIndex : ReadinessQueriesByShape[ShapeId])
+			{
+				ReadinessEvaluator.AddCount(MachineIndex, NumShapes + QueryIndex, ShapeCount);
+			}
+		}
+	}
+	RefreshReadinessRecipes(MachineIndex);
+}
+
+void URecipeSubsystem::RefreshReadinessRecipes(int32 MachineIndex)
+{
+	TArray<int32, TInlineAllocator<8>> RecipeIndices = {};
+	if(const AMachineActor* Machine = ReadinessMachines[MachineIndex])
+	{
+		for(const TPair<FName, URecipeDataItem*>& Pair : Machine->GetRecipeEntryMap())
+		{
+			const int32* RecipeIndex = Pair.Value->bIsActivated ? ReadinessRecipeIndices.Find(Pair.Key) : nullptr;
+			if(RecipeIndex)
+			{
+				RecipeIndices.Add(*RecipeIndex);
+			}
+		}
+	}
+	ReadinessEvaluator.SetMachineRecipes(MachineIndex, RecipeIndices);
+}
+
+void URecipeSubsystem::EvaluateReadiness(TArray<FReadyRecipe>& OutReadyRecipes)
+{
+	// Counts are kept up to date by the machines, only the rows flagged as a whole are copied again
+	for(TConstSetBitIterator<> It(DirtyReadinessRows); It; ++It)
+	{
+		RefreshReadinessRow(It.GetIndex());
+	}
+	for(TConstSetBitIterator<> It(DirtyReadinessRecipes); It; ++It)
+	{
+		if(!DirtyReadinessRows[It.GetIndex()])
+		{
+			RefreshReadinessRecipes(It.GetIndex());
+		}
+	}
+	DirtyReadinessRows.Init(false, ReadinessMachines.Num());
+	DirtyReadinessRecipes.Init(false, ReadinessMachines.Num());
+
+	ReadinessEvaluator.Evaluate(OutReadyRecipes);
+}
+
+void URecipeSubsystem::MergeShapeStacks(float DeltaTime)
+{
+	if(CachedMaxStackSize <= 1 || GetWorld()->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	StackMergeCountdown -= DeltaTime;
+	if(StackMergeCountdown > 0.f)
+	{
+		return;
+	}
+	StackMergeCountdown = CachedStackMergeInterval;
+
+	// Stacks are bucketed by shape and by cell of the merge radius, each one merges into the first stack of its bucket with room left
+	TMap<TPair<FName, FIntVector>, AShapeActor*> StacksByCell = {};
+	int32 NumMerged = 0;
+	for(TActorIterator<AShapeActor> ShapeItr(GetWorld()); ShapeItr; ++ShapeItr)
+	{
+		// Stacks held by a machine are merged when they enter it, deferred spawns once they are finished
+		AShapeActor* Shape = *ShapeItr;
+		if(!Shape->CanStack() || Shape->IsInInventory() || !Shape->HasActorBegunPlay())
+		{
+			continue;
+		}
+
+		const FVector Cell = Shape->GetActorLocation() / CachedStackMergeRadius;
+		AShapeActor*& CellStack = StacksByCell.FindOrAdd({Shape->GetShapeKey(), FIntVector(FMath::FloorToInt(Cell.X), FMath::FloorToInt(Cell.Y), FMath::FloorToInt(Cell.Z))});
+		if(!CellStack || CellStack->GetStackCount() + Shape->GetStackCount() > CachedMaxStackSize)
+		{
+			CellStack = Shape;
+			continue;
+		}
+
+		CellStack->AddToStack(Shape->GetStackCount());
+		DestroyShape(*Shape);
+		++NumMerged;
+	}
+
+	if(NumMerged > 0)
+	{
+		UE_LOG(LogTemp, Verbose, TEXT("URecipeSubsystem::MergeShapeStacks - %d stacks merged"), NumMerged);
+	}
+}
+
+void URecipeSubsystem::EnforcePopulationPolicies(float DeltaTime)
+{
+	if(!bArePopulationPoliciesEnabled || GetWorld()->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	PopulationSweepCountdown -= DeltaTime;
+	if(PopulationSweepCountdown > 0.f)
+	{
+		return;
+	}
+	PopulationSweepCountdown = CachedPopulationSweepInterval;
+
+	// Only the oldest shapes are visited, the eviction orders are kept up to date as shapes are touched
+	const double ExpireTime = CachedShapeIdleLifetime > 0.f ? GetWorld()->GetTimeSeconds() - CachedShapeIdleLifetime : -DBL_MAX;
+	ShapePopulation.GetEvictionCandidates(ExpireTime, CachedMaxShapeActors, [this](const FName& ShapeName)
+	{
+		return GetShapeActorLimit(ShapeName);
+	}, ShapeClaims, PopulationCandidates);
+
+	for(const FShapeEvictionCandidate& Candidate : PopulationCandidates)
+	{
+		if(AShapeActor* Shape = Candidate.Shape.Get())
+		{
+			EvictShape(*Shape, Candidate.bIsExpired);
+		}
+	}
+	PopulationCandidates.Reset();
+}
+
+int32 URecipeSubsystem::GetShapeActorLimit(const FName& ShapeName) const
+{
+	const int32* Limit = CachedShapeActorLimits.Find(ShapeName);
+	return Limit ? *Limit : CachedMaxShapeActorsPerShape;
+}
+
+void URecipeSubsystem::EvictShape(AShapeActor& Shape, bool bIsExpired)
+{
+	if(Shape.IsRetired() || Shape.IsInInventory() || Shape.IsWaiting())
+	{
+		return;
+	}
+
+	// Retired first, so that no output stacks onto the shape in the meantime
+	const FName ShapeName = Shape.GetShapeKey();
+	const FVector Location = Shape.GetActorLocation();
+	int32 NumUnits = Shape.GetStackCount();
+	DestroyShape(Shape);
+
+	FShapePopulationStats& Stats = ShapePopulation.GetStats();
+	if(bIsExpired)
+	{
+		++Stats.NumExpired;
+	}
+	else
+	{
+		++Stats.NumEvicted;
+	}
+
+	AMachineActor* ClosestMachine = nullptr;
+	double ClosestDistSquared = FMath::Square(CachedEvictionRadius);
+	for(const TPair<FString, AMachineActor*>& Pair : Machines)
+	{
+		AMachineActor* Machine = Pair.Value;
+		if(!Machine || !Machine->HasAuthority() || !Machine->IsConsumedByRecipes(ShapeName))
+		{
+			continue;
+		}
+
+		const double DistSquared = FVector::DistSquared(Machine->GetActorLocation(), Location);
+		if(DistSquared <= ClosestDistSquared)
+		{
+			ClosestMachine = Machine;
+			ClosestDistSquared = DistSquared;
+		}
+	}
+
+	if(ClosestMachine)
+	{
+		const int32 NumAccepted = ClosestMachine->AddShapes(ShapeName, NumUnits);
+		Stats.NumUnitsToMachines += NumAccepted;
+		NumUnits -= NumAccepted;
+	}
+	if(NumUnits > 0)
+	{
+		AddToSink(ShapeName, NumUnits);
+		Stats.NumUnitsToSinks += NumUnits;
+	}
+
+	UE_LOG(LogTemp, Verbose, TEXT("URecipeSubsystem::EvictShape - %s evicted (%s), %d units sent to the sink"),
+		*ShapeName.ToString(), bIsExpired ? TEXT("expired") : TEXT("over cap"), NumUnits);
+}
+
+void URecipeSubsystem::SweepReadiness(float DeltaTime)
+{
+	if(!bIsReadinessSweepEnabled || GetWorld()->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	ReadinessSweepCountdown -= DeltaTime;
+	if(ReadinessSweepCountdown > 0.f)
+	{
+		return;
+	}
+	ReadinessSweepCountdown = CachedReadinessSweepInterval;
+
+	TArray<FReadyRecipe> ReadyRecipes = {};
+	EvaluateReadiness(ReadyRecipes);
+
+	// Machines convert as soon as their inputs are there, a ready recipe means an event was missed
+	const AMachineActor* PreviousMachine = nullptr;
+	for(const FReadyRecipe& ReadyRecipe : ReadyRecipes)
+	{
+		AMachineActor* Machine = ReadinessMachines[ReadyRecipe.MachineIndex];
+		if(!Machine || Machine == PreviousMachine || Machine->GetSimulationLod() == EMachineSimulationLod::Analytical)
+		{
+			continue;
+		}
+
+		// Timed recipes also wait for a slot
+		if(ReadinessRecipeDurations[ReadyRecipe.RecipeIndex] > 0.f && !Machine->HasIdleSlot())
+		{
+			continue;
+		}
+
+		PreviousMachine = Machine;
+		Machine->ProcessValidRecipes();
+	}
+}
+
+int32 URecipeSubsystem::FastForward(float ElapsedSeconds, const TMap<FString, TMap<FName, float>>& SupplyRates)
+{
+	if(GetWorld()->GetNetMode() == NM_Client || ElapsedSeconds <= 0.f)
+	{
+		return 0;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Kahn's algorithm on the output links, every machine has at most one downstream machine
+	TMap<AMachineActor*, int32> NumUpstreamMachines = {};
+	for(const TPair<FString, AMachineActor*>& Pair : Machines)
+	{
+		if(Pair.Value)
+		{
+			NumUpstreamMachines.FindOrAdd(Pair.Value);
+			if(AMachineActor* DownstreamMachine = Pair.Value->GetDownstreamMachine())
+			{
+				++NumUpstreamMachines.FindOrAdd(DownstreamMachine);
+			}
+		}
+	}
+
+	TArray<AMachineActor*> SortedMachines = {};
+	for(const TPair<AMachineActor*, int32>& Pair : NumUpstreamMachines)
+	{
+		if(Pair.Value == 0)
+		{
+			SortedMachines.Add(Pair.Key);
+		}
+	}
+	for(int32 MachineIndex = 0; MachineIndex < SortedMachines.Num(); ++MachineIndex)
+	{
+		AMachineActor* DownstreamMachine = SortedMachines[MachineIndex]->GetDownstreamMachine();
+		if(DownstreamMachine && --NumUpstreamMachines.FindChecked(DownstreamMachine) == 0)
+		{
+			SortedMachines.Add(DownstreamMachine);
+		}
+	}
+
+	// Machines in a loop never reach zero, they are advanced last
+	for(const TPair<AMachineActor*, int32>& Pair : NumUpstreamMachines)
+	{
+		if(Pair.Value > 0)
+		{
+			SortedMachines.Add(Pair.Key);
+		}
+	}
+
+	TMap<AMachineActor*, TMap<FName, float>> MachineSupplyRates = {};
+	for(const TPair<FString, TMap<FName, float>>& Pair : SupplyRates)
+	{
+		if(AMachineActor* const* Machine = Machines.Find(Pair.Key))
+		{
+			MachineSupplyRates.Add(*Machine, Pair.Value);
+		}
+	}
+
+	// Products are passed as counts, a rate would lose units to rounding
+	TMap<AMachineActor*, TMap<FName, int32>> MachineSuppliedShapes = {};
+
+	int32 NumConversions = 0;
+	TSet<AMachineActor*> AdvancedMachines = {};
+	for(AMachineActor* Machine : SortedMachines)
+	{
+		TMap<FName, int32> Products = {};
+		const TMap<FName, float>* MachineSupplyRate = MachineSupplyRates.Find(Machine);
+		const TMap<FName, int32>* MachineSuppliedShape = MachineSuppliedShapes.Find(Machine);
+		NumConversions += Machine->FastForward(ElapsedSeconds, MachineSupplyRate ? *MachineSupplyRate : TMap<FName, float>(),
+			MachineSuppliedShape ? *MachineSuppliedShape : TMap<FName, int32>(), Products);
+		AdvancedMachines.Add(Machine);
+
+		AMachineActor* DownstreamMachine = Machine->GetDownstreamMachine();
+		for(const TPair<FName, int32>& Product : Products)
+		{
+			if(AdvancedMachines.Contains(DownstreamMachine))
+			{
+				DownstreamMachine->AddShapes(Product.Key, Product.Value);
+			}
+			else
+			{
+				MachineSuppliedShapes.FindOrAdd(DownstreamMachine).FindOrAdd(Product.Key) += Product.Value;
+			}
+		}
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("URecipeSubsystem::FastForward - Advanced %d machines by %.1f s, %d conversions in %.2f ms"),
+		SortedMachines.Num(), ElapsedSeconds, NumConversions, (FPlatformTime::Seconds() - StartTime) * 1000.);
+
+	OnFactoryFastForwarded.Broadcast(ElapsedSeconds);
+	return NumConversions;
+}
+
+FThroughputReport URecipeSubsystem::SolveThroughput(const FName& TargetShape, const TMap<FName, float>& SupplyRates) const
+{
+	FThroughputProblem Problem;
+	Problem.TargetShape = TargetShape;
+	Problem.SupplyRates = SupplyRates;
+	Problem.AddIngredients(IngredientCatalog, ShapeNamesById);
+	for(const TPair<FName, FRecipeData>& Pair : CachedRecipesData)
+	{
+		TArray<FName> IngredientNames = {};
+		for(const int32 QueryIndex : GetIngredientQueries(Pair.Key))
+		{
+			IngredientNames.Add(IngredientCatalog.GetQueryName(QueryIndex));
+		}
+		Problem.AddRecipe(Pair.Value, IngredientNames);
+	}
+
+	for(const TPair<FString, AMachineActor*>& Pair : Machines)
+	{
+		if(!Pair.Value)
+		{
+			continue;
+		}
+
+		FThroughputMachine& Machine = Problem.Machines.AddDefaulted_GetRef();
+		Machine.Name = Pair.Key;
+		Machine.Slots = Pair.Value->GetParallelSlots();
+		for(const URecipeDataItem* Recipe : Pair.Value->GetRecipeEntries())
+		{
+			const int32 RecipeIndex = Recipe && Recipe->bIsActivated ? Problem.FindRecipe(UHelperClass::ConvertToName(Recipe->Name)) : INDEX_NONE;
+			if(RecipeIndex != INDEX_NONE)
+			{
+				Machine.Recipes.Add(RecipeIndex);
+			}
+		}
+	}
+
+	return FThroughputSolver::Solve(Problem);
+}
+
+namespace RecipeInventoryCommands
+{
+	/**
+	 * Runs an inventory command on a machine found by name. Usage: <MachineName> <ShapeName> [Count]
+	 */
+	void RunInventoryCommand(const TArray<FString>& Args, UWorld* World, const TCHAR* CommandName, TFunctionRef<int32(AMachineActor&, const FName&, int32)> Command)
+	{
+		URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr;
+		AMachineActor* const* Machine = RecipeSubsystem && Args.Num() > 1 ? RecipeSubsystem->GetMachinesData().Find(Args[0]) : nullptr;
+		if(!Machine || !*Machine)
+		{
+			UE_LOG(LogTemp, Error, TEXT("%s - Usage: %s <MachineName> <ShapeName> [Count]"), CommandName, CommandName);
+			return;
+		}
+
+		const int32 Count = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 1;
+		const int32 NumShapes = Command(**Machine, FName(*Args[1]), Count);
+		UE_LOG(LogTemp, Log, TEXT("%s - %d/%d %s on machine %s"), CommandName, NumShapes, Count, *Args[1], *Args[0]);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs AddShapesCommand(
+	TEXT("IB.Machines.AddShapes"),
+	TEXT("Adds shapes to a machine inventory without spawning any actor. Usage: IB.Machines.AddShapes <MachineName> <ShapeName> [Count]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		RecipeInventoryCommands::RunInventoryCommand(Args, World, TEXT("IB.Machines.AddShapes"), [](AMachineActor& Machine, const FName& ShapeName, int32 Count)
+		{
+			return Machine.AddShapes(ShapeName, Count);
+		});
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs TakeShapesCommand(
+	TEXT("IB.Machines.TakeShapes"),
+	TEXT("Removes shapes from a machine inventory. Usage: IB.Machines.TakeShapes <MachineName> <ShapeName> [Count]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		RecipeInventoryCommands::RunInventoryCommand(Args, World, TEXT("IB.Machines.TakeShapes"), [](AMachineActor& Machine, const FName& ShapeName, int32 Count)
+		{
+			return Machine.TakeShapes(ShapeName, Count);
+		});
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs FastForwardCommand(
+	TEXT("IB.Machines.FastForward"),
+	TEXT("Advances every machine by a period at once, on counts. Usage: IB.Machines.FastForward <Seconds>"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr;
+		if(!RecipeSubsystem || Args.Num() < 1)
+		{
+			UE_LOG(LogTemp, Error, TEXT("IB.Machines.FastForward - Usage: IB.Machines.FastForward <Seconds>"));
+			return;
+		}
+
+		RecipeSubsystem->FastForward(FCString::Atof(*Args[0]));
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs ThroughputCommand(
+	TEXT("IB.Factory.Throughput"),
+	TEXT("Logs the maximum output rate of a shape with the machines of the world. Usage: IB.Factory.Throughput <Shape> [SuppliedShape:Rate...]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr;
+		if(!RecipeSubsystem || Args.Num() < 1)
+		{
+			UE_LOG(LogTemp, Error, TEXT("IB.Factory.Throughput - Usage: IB.Factory.Throughput <Shape> [SuppliedShape:Rate...]"));
+			return;
+		}
+
+		TMap<FName, float> SupplyRates = {};
+		for(int32 ArgIndex = 1; ArgIndex < Args.Num(); ++ArgIndex)
+		{
+			FString ShapeName;
+			FString Rate;
+			if(Args[ArgIndex].Split(TEXT(":"), &ShapeName, &Rate))
+			{
+				SupplyRates.Add(FName(*ShapeName), FCString::Atof(*Rate));
+			}
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("IB.Factory.Throughput - %s"), *RecipeSubsystem->SolveThroughput(FName(*Args[0]), SupplyRates).ToString());
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs ShapeQueueCommand(
+	TEXT("IB.Shapes.Queue"),
+	TEXT("Logs the backlog of the shape actor queue. Usage: IB.Shapes.Queue [Flush]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr;
+		if(!RecipeSubsystem)
+		{
+			return;
+		}
+
+		if(Args.Num() > 0 && Args[0] == TEXT("Flush"))
+		{
+			RecipeSubsystem->GetShapeActorQueue().Flush();
+		}
+		UE_LOG(LogTemp, Log, TEXT("IB.Shapes.Queue - %s"), *RecipeSubsystem->GetShapeActorQueue().GetStats(World->GetTimeSeconds()).ToString());
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs ScratchCommand(
+	TEXT("IB.Machines.Scratch"),
+	TEXT("Logs the scratch memory of the recipe evaluations, growths past the warm-up are heap allocations of the conversion path"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if(URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr)
+		{
+			UE_LOG(LogTemp, Log, TEXT("IB.Machines.Scratch - %s"), *RecipeSubsystem->GetRecipeScratch().GetStats().ToString());
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs PopulationCommand(
+	TEXT("IB.Shapes.Population"),
+	TEXT("Logs the shape actors alive on the server and the shapes evicted by the population policies"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if(URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr)
+		{
+			const FShapePopulation& ShapePopulation = RecipeSubsystem->GetShapePopulation();
+			UE_LOG(LogTemp, Log, TEXT("IB.Shapes.Population - %s"), *ShapePopulation.GetStats().ToString());
+			for(const TPair<FName, int32>& Pair : ShapePopulation.GetNumByShape())
+			{
+				UE_LOG(LogTemp, Log, TEXT("IB.Shapes.Population - %s: %d"), *Pair.Key.ToString(), Pair.Value);
+			}
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs ReadinessCommand(
+	TEXT("IB.Machines.Readiness"),
+	TEXT("Evaluates which recipes every machine can convert and logs them with the evaluation time"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		URecipeSubsystem* RecipeSubsystem = World ? World->GetSubsystem<URecipeSubsystem>() : nullptr;
+		if(!RecipeSubsystem)
+		{
+			return;
+		}
+
+		TArray<FReadyRecipe> ReadyRecipes = {};
+		const double StartTime = FPlatformTime::Seconds();
+		RecipeSubsystem->EvaluateReadiness(ReadyRecipes);
+		const double EvaluationMicroseconds = (FPlatformTime::Seconds() - StartTime) * 1000000.;
+
+		for(const FReadyRecipe& ReadyRecipe : ReadyRecipes)
+		{
+			const AMachineActor* Machine = RecipeSubsystem->GetReadinessMachine(ReadyRecipe.MachineIndex);
+			UE_LOG(LogTemp, Log, TEXT("IB.Machines.Readiness - %s: %s x%d"), Machine ? *Machine->GetMachineName() : TEXT("None"),
+				*RecipeSubsystem->GetReadinessRecipeName(ReadyRecipe.RecipeIndex).ToString(), ReadyRecipe.MaxBatches);
+		}
+		UE_LOG(LogTemp, Log, TEXT("IB.Machines.Readiness - %d ready recipes in %.1f us"), ReadyRecipes.Num(), EvaluationMicroseconds);
+	}));
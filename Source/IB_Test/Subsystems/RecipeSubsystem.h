@@ -6,23 +6,110 @@
 #include "IB_Test/Actors/MachineActor.h"
 #include "IB_Test/Settings/RecipeSettings.h"
 #include "Subsystems/WorldSubsystem.h"
+#include "Engine/StreamableManager.h"
 #include "IB_Test/Datas/ShapeData.h"
 #include "IB_Test/Datas/RecipeData.h"
+#include "IB_Test/Diagnostics/MachineEventRecorder.h"
+#include "IB_Test/Simulation/IngredientCatalog.h"
+#include "IB_Test/Simulation/ReadinessEvaluator.h"
+#include "IB_Test/Simulation/RecipeScratch.h"
+#include "IB_Test/Simulation/ShapeActorQueue.h"
+#include "IB_Test/Simulation/ShapeClaimTable.h"
+#include "IB_Test/Simulation/ShapePopulation.h"
+#include "IB_Test/Simulation/ThroughputSolver.h"
+#include "IB_Test/Simulation/TimerWheel.h"
 #include "RecipeSubsystem.generated.h"
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnSpawnRecipe, FText, RecipeName);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnToggleRecipeAvailability, FText, RecipeName, bool, bIsActivated);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnRecipeStatesReconciled, AMachineActor*, Machine);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnRecipeDataReloaded);
+/**
+ * Change of the shapes held by a machine or lying next to it
+ */
+enum class EMachineShapeEvent : uint8
+{
+	Arrive,		// Units entered the machine inventory
+	Leave,		// Units left the machine inventory without being consumed
+	PickUp,		// A loose shape was taken by the machine, no longer lying in the world. Its units arrive separately
+	Drop		// Units were released as a loose shape next to the machine, they left separately if they were held
+};
+
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnRecipeConverted, AMachineActor& /*Machine*/, const FName& /*RecipeName*/, TConstArrayView<FName> /*Inputs*/);
+DECLARE_MULTICAST_DELEGATE_FourParams(FOnMachineShapeEvent, AMachineActor& /*Machine*/, EMachineShapeEvent /*Event*/, const FName& /*ShapeName*/, int32 /*Count*/);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnFactoryFastForwarded, float /*ElapsedSeconds*/);
 
 class UNiagaraSystem;
 class AMachineActor;
 class UDataTable;
 class AShapeActor;
+class APlayerState;
+class UMachineControlComponent;
+
+/**
+ * Conversion predicted by a client, waiting for the server to confirm or refuse it.
+ */
+struct FPredictedConversion
+{
+	/** Machine on which the conversion was predicted */
+	TWeakObjectPtr<AMachineActor> Machine = nullptr;
+
+	/** Local-only output shape displayed until the replicated one arrives */
+	TWeakObjectPtr<AShapeActor> ProvisionalShape = nullptr;
+
+	/** World time at which the prediction was made (or confirmed) */
+	double Timestamp = 0.;
+};
+
+/**
+ * Recipe toggle predicted by a client, waiting for the server to acknowledge it.
+ */
+struct FPredictedToggle
+{
+	/** Key sent along with the server request */
+	int32 PredictionKey = INDEX_NONE;
+
+	/** Machine owning the recipe */
+	TWeakObjectPtr<AMachineActor> Machine = nullptr;
+
+	/** Name of the toggled recipe */
+	FText RecipeName = FText();
+
+	/** Predicted activation state */
+	bool bIsActivated = true;
+
+	/** World time at which the prediction was made */
+	double Timestamp = 0.;
+};
+
+/**
+ * Output spawn waiting for its shape class to be streamed
+ */
+struct FPendingShapeSpawn
+{
+	/** Machine spawning the output */
+	TWeakObjectPtr<AMachineActor> Machine = nullptr;
+
+	/** Conversion the output is spawned for, INDEX_NONE if it isn't one */
+	int32 ConversionId = INDEX_NONE;
+};
+
+/**
+ * Timer of a machine driven by the subsystem timer wheel
+ */
+struct FMachineTimer
+{
+	TWeakObjectPtr<AMachineActor> Machine;
+
+	/** Job finishing when the timer expires, INDEX_NONE for the output emission cooldown */
+	int32 JobId = INDEX_NONE;
+};
 
 /**
  * Subsystem responsible for managing recipes, shapes, and related functionalities within the game world.
  */
 UCLASS()
-class IB_TEST_API URecipeSubsystem : public UWorldSubsystem
+class IB_TEST_API URecipeSubsystem : public UTickableWorldSubsystem
 {
 	GENERATED_BODY()
 
@@ -32,7 +119,30 @@ public:
 
 	// Delegate used to send enable/disable any recipe for the selected machine
 	FOnToggleRecipeAvailability OnToggleRecipeAvailability;
+
+	// Delegate broadcast on clients when predicted recipe states were reconciled with the server ones
+	FOnRecipeStatesReconciled OnRecipeStatesReconciled;
+
+	// Delegate broadcast when the recipe or shape DataTable was reloaded while the world runs
+	FOnRecipeDataReloaded OnRecipeDataReloaded;
+
+	// Delegate broadcast on the server each time a machine converted its inputs through a recipe
+	FOnRecipeConverted OnRecipeConverted;
+
+	// Delegate broadcast on the server each time shapes enter, leave or are released next to a machine
+	FOnMachineShapeEvent OnMachineShapeEvent;
+
+	// Delegate broadcast on the server after a fast-forward, its conversions aren't broadcast one by one
+	FOnFactoryFastForwarded OnFactoryFastForwarded;
 	
+	/**
+	 * @brief Replaces the DataTables of the recipe settings, e.g. with generated ones. Must be called before the world begins play.
+	 *
+	 * @param InRecipeDataTable DataTable of FRecipeData rows.
+	 * @param InShapeDataTable DataTable of FShapeData rows.
+	 */
+	void OverrideDataTables(UDataTable* InRecipeDataTable, UDataTable* InShapeDataTable);
+
 	/**
 	 * Get an array of recipe data based on provided recipe names.
 	 *
@@ -50,13 +160,51 @@ public:
 	FRecipeData GetRecipeDataByName(const FText& RecipeName);
 
 	/**
-	 * Get the shape actor class based on a provided shape name.
+	 * Find recipe data based on a provided recipe name.
+	 *
+	 * @param RecipeName The name of the recipe to retrieve.
+	 * @return The recipe data, nullptr if the recipe doesn't exist.
+	 */
+	const FRecipeData* FindRecipeData(const FName& RecipeName) const;
+
+	/**
+	 * Get the shape actor class based on a provided shape name. A class not loaded yet is streamed in the background.
 	 *
 	 * @param ShapeName The name of the shape to retrieve.
-	 * @return The class of the shape actor.
+	 * @return The class of the shape actor, nullptr while it is streamed.
 	 */
 	TSubclassOf<AShapeActor> GetShapeActorClassByName(const FName& InShapeName);
 
+	/**
+	 * @brief Loads a shape actor class right away, only meant for loading steps where a hitch is expected.
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @return The class of the shape actor, nullptr if the shape is unknown.
+	 */
+	TSubclassOf<AShapeActor> LoadShapeActorClass(const FName& ShapeName);
+
+	/**
+	 * @brief Streams a shape actor class in the background, nothing happens if it is loaded or loading.
+	 *
+	 * @param ShapeName The name of the shape.
+	 */
+	void RequestShapeActorClass(const FName& ShapeName);
+
+	/**
+	 * @brief Streams the classes of every shape consumed or produced by the recipes of a machine.
+	 *
+	 * @param MachineActor The machine about to be used.
+	 */
+	void PreloadMachineShapes(const AMachineActor& MachineActor);
+
+	/**
+	 * Get the value of a shape, used to allocate inputs between competing recipes.
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @return The value of the shape, 0 if the shape doesn't exist.
+	 */
+	float GetShapeValue(const FName& ShapeName) const;
+
 	/**
 	 * Get an array of all shape names.
 	 *
@@ -64,6 +212,77 @@ public:
 	 */
 	TArray<FName> GetAllShapeNames() const;
 
+	/**
+	 * Get an array of all recipe names.
+	 *
+	 * @return An array of recipe names.
+	 */
+	TArray<FName> GetAllRecipeNames() const;
+
+	/**
+	 * Get the compact id of a shape, ids are dense and ordered by shape name.
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @return The id of the shape, INDEX_NONE if unknown.
+	 */
+	int32 GetShapeId(const FName& ShapeName) const
+	{
+		const int32* ShapeId = ShapeIdsByName.Find(ShapeName);
+		return ShapeId ? *ShapeId : INDEX_NONE;
+	}
+
+	/**
+	 * Get every shape name indexed by its compact id. Shapes removed from the DataTable while the world runs
+	 * keep their id.
+	 *
+	 * @return The shape names indexed by id.
+	 */
+	const TArray<FName>& GetShapeNamesById() const
+	{
+		return ShapeNamesById;
+	}
+
+	/**
+	 * Get the name of a shape from its compact id.
+	 *
+	 * @param ShapeId The id of the shape.
+	 * @return The name of the shape, NAME_None if unknown.
+	 */
+	FName GetShapeNameById(int32 ShapeId) const
+	{
+		return ShapeNamesById.IsValidIndex(ShapeId) ? ShapeNamesById[ShapeId] : NAME_None;
+	}
+
+	/**
+	 * @brief Gets the wildcard ingredients of a recipe.
+	 *
+	 * @param RecipeName The name of the recipe.
+	 * @return Indices of its ingredient queries in the ingredient catalog, one per consumed shape, valid until the recipes are cached again.
+	 */
+	TConstArrayView<int32> GetIngredientQueries(const FName& RecipeName) const
+	{
+		const TArray<int32>* QueryIndices = IngredientQueriesByRecipe.Find(RecipeName);
+		return QueryIndices ? TConstArrayView<int32>(*QueryIndices) : TConstArrayView<int32>();
+	}
+
+	/**
+	 * @param ShapeName The name of the shape.
+	 * @param QueryIndex Index of an ingredient query, see GetIngredientQueries().
+	 * @return True if the tags of the shape match the ingredient query.
+	 */
+	bool DoesShapeMatchIngredient(const FName& ShapeName, int32 QueryIndex) const
+	{
+		return IngredientCatalog.Matches(GetShapeId(ShapeName), QueryIndex);
+	}
+
+	/**
+	 * @return The ingredient queries of every recipe, compiled against the shape tags.
+	 */
+	const FIngredientCatalog& GetIngredientCatalog() const
+	{
+		return IngredientCatalog;
+	}
+
 	/**
 	 * @brief Gets a const reference to the map of machine data.
 	 *
@@ -94,15 +313,282 @@ public:
 	TSoftObjectPtr<AMachineActor> GetMachineActorByName(const FString& MachineName) const;
 	
 	/**
-	 * Spawn a shape by its name.
+	 * Spawn a shape by its name. If its class is still streamed, the shape is spawned once it is loaded.
 	 *
 	 * @param ShapeName The name of the shape to be spawned.
-	 * @return True if the shape was successfully spawned, false otherwise.
+	 * @param ConversionId Conversion the shape is spawned for, INDEX_NONE if it isn't one.
+	 * @return True if the shape was successfully spawned or will be, false otherwise.
+	 */
+	bool SpawnShapeByName(const FName& ShapeName, AMachineActor& MachineActor, int32 ConversionId = INDEX_NONE);
+
+	/**
+	 * @brief Spawns the output of a conversion and notifies clients about it (server only).
+	 *
+	 * @param ShapeName The name of the shape to be spawned.
+	 * @param MachineActor Reference to the machine performing the conversion.
+	 * @param PredictingPlayer Player who predicted the conversion, nullptr if it wasn't predicted.
+	 * @param PredictionKey Key of the client prediction, INDEX_NONE if it wasn't predicted.
+	 * @return The id of the conversion, INDEX_NONE if the output couldn't be spawned.
+	 */
+	int32 SpawnConversionOutput(const FName& ShapeName, AMachineActor& MachineActor, APlayerState* PredictingPlayer = nullptr, int32 PredictionKey = INDEX_NONE);
+
+	/**
+	 * @return The table of shape ownership shared by every machine.
+	 */
+	FShapeClaimTable& GetShapeClaims()
+	{
+		return ShapeClaims;
+	}
+
+	/**
+	 * @brief Destroys a consumed shape, through the shape actor queue when it is enabled.
+	 *
+	 * @param Shape The shape to destroy, hidden right away and destroyed within a later frame budget.
+	 */
+	void DestroyShape(AShapeActor& Shape);
+
+	/**
+	 * @return The queue spreading the shape spawns and destructions across frames.
+	 */
+	FShapeActorQueue& GetShapeActorQueue()
+	{
+		return ShapeActorQueue;
+	}
+
+	/**
+	 * @return The scratch memory shared by the recipe evaluations of every machine.
+	 */
+	FRecipeScratchArena& GetRecipeScratch()
+	{
+		return RecipeScratch;
+	}
+
+	/**
+	 * @return The registry of the shape actors alive on the server.
+	 */
+	FShapePopulation& GetShapePopulation()
+	{
+		return ShapePopulation;
+	}
+
+	/**
+	 * @brief Removes a loose shape from the world and stores its units in the closest machine consuming them, in the sink otherwise (server only).
+	 *
+	 * @param Shape The shape to evict.
+	 * @param bIsExpired True if the shape is evicted for being idle, false for a population cap.
+	 */
+	void EvictShape(AShapeActor& Shape, bool bIsExpired);
+
+	/**
+	 * @brief Advances every machine by a long period at once, e.g. after the players were away or the level was streamed out (server only).
+	 *
+	 * Machines are advanced upstream first, the products of a machine are supplied to its downstream machine over the
+	 * period. Machines in a loop receive the products of the machines advanced after them as stored counts.
+	 * The cost is O(machines x recipes), whatever the period.
+	 *
+	 * @param ElapsedSeconds The time to advance.
+	 * @param SupplyRates Shapes per second delivered from outside the factory, by machine name then shape name.
+	 * @return The number of conversions.
+	 */
+	int32 FastForward(float ElapsedSeconds, const TMap<FString, TMap<FName, float>>& SupplyRates = {});
+
+	/**
+	 * @brief Computes the maximum steady-state output rate of a shape with the machines of the world and their enabled recipes.
+	 *
+	 * @param TargetShape The shape whose output rate is maximized.
+	 * @param SupplyRates Shapes per second delivered from outside the factory, by shape name.
+	 * @return The rates, bottlenecks, cycles and unreachable shapes of the recipe graph.
+	 */
+	FThroughputReport SolveThroughput(const FName& TargetShape, const TMap<FName, float>& SupplyRates) const;
+
+	/**
+	 * @brief Flags the whole inventory of a machine as changed, its row of the readiness matrix is copied again lazily.
+	 *
+	 * @param Machine The changed machine.
+	 */
+	void MarkReadinessDirty(const AMachineActor& Machine);
+
+	/**
+	 * @brief Flags the activated recipes of a machine as changed, only its recipes are copied again lazily.
+	 *
+	 * @param Machine The changed machine.
+	 */
+	void MarkReadinessRecipesDirty(const AMachineActor& Machine);
+
+	/**
+	 * @brief Updates the cells of a shape and of its matching ingredients in the row of a machine.
+	 *
+	 * @param Machine The changed machine.
+	 * @param ShapeName The name of the shape.
+	 * @param Delta The number of shapes the machine gained, negative if it lost some.
+	 */
+	void UpdateReadinessCount(const AMachineActor& Machine, const FName& ShapeName, int32 Delta);
+
+	/**
+	 * @brief Computes which recipes every machine can convert, in a single vectorized pass over the whole factory.
+	 *
+	 * @param OutReadyRecipes Filled with the recipes of each machine having all their inputs, see GetReadinessMachine().
+	 */
+	void EvaluateReadiness(TArray<FReadyRecipe>& OutReadyRecipes);
+
+	/**
+	 * @param MachineIndex Index of a machine in the ready recipes.
+	 * @return The machine, nullptr if it was destroyed.
+	 */
+	AMachineActor* GetReadinessMachine(int32 MachineIndex) const
+	{
+		return ReadinessMachines.IsValidIndex(MachineIndex) ? ReadinessMachines[MachineIndex] : nullptr;
+	}
+
+	/**
+	 * @param RecipeIndex Index of a recipe in the ready recipes.
+	 * @return The name of the recipe, NAME_None if unknown.
+	 */
+	FName GetReadinessRecipeName(int32 RecipeIndex) const
+	{
+		return ReadinessRecipeNames.IsValidIndex(RecipeIndex) ? ReadinessRecipeNames[RecipeIndex] : NAME_None;
+	}
+
+	/**
+	 * @brief Counts shapes leaving the factory, e.g. outputs of machines routed to the sink.
+	 *
+	 * @param ShapeName The name of the shape.
+	 * @param Count The number of shapes.
+	 */
+	void AddToSink(const FName& ShapeName, int32 Count)
+	{
+		SinkCounts.FindOrAdd(ShapeName) += Count;
+	}
+
+	/**
+	 * @return The number of shapes of each kind received by the sink.
+	 */
+	const TMap<FName, int32>& GetSinkCounts() const
+	{
+		return SinkCounts;
+	}
+
+	/**
+	 * @brief Spawns the output of a recipe on a machine (server only).
+	 *
+	 * @param MachineActor Reference to the target machine.
+	 * @param RecipeName The name of the recipe to spawn.
+	 * @param PredictingPlayer Player who predicted the conversion, nullptr if it wasn't predicted.
+	 * @param PredictionKey Key of the client prediction, INDEX_NONE if it wasn't predicted.
+	 * @return The id of the conversion, INDEX_NONE if the recipe couldn't be spawned.
+	 */
+	int32 SpawnRecipe(AMachineActor& MachineActor, const FText& RecipeName, APlayerState* PredictingPlayer = nullptr, int32 PredictionKey = INDEX_NONE);
+
+	/**
+	 * @brief Changes the activation state of a recipe and processes the machine again (server only).
+	 *
+	 * @param MachineActor Reference to the target machine.
+	 * @param RecipeName The name of the recipe to toggle.
+	 * @param bIsActivated The new activation state of the recipe.
+	 * @return True if the recipe exists on the machine, false otherwise.
+	 */
+	bool ToggleRecipe(AMachineActor& MachineActor, const FText& RecipeName, bool bIsActivated);
+
+	/**
+	 * @brief Called on clients when the server answered a predicted toggle.
+	 *
+	 * @param PredictionKey Key of the predicted toggle.
+	 * @param bAccepted False if the toggle was refused and must be rolled back.
+	 */
+	void AcknowledgePredictedToggle(int32 PredictionKey, bool bAccepted);
+
+	/**
+	 * @brief Called on clients when the server answered a predicted conversion.
+	 *
+	 * @param PredictionKey Key of the predicted conversion.
+	 * @param ConversionId Server-side id of the conversion, INDEX_NONE if it was refused.
+	 */
+	void ConfirmPredictedConversion(int32 PredictionKey, int32 ConversionId);
+
+	/**
+	 * @brief Called on clients when the server notified a conversion on a machine.
+	 *
+	 * @param MachineActor The machine which performed the conversion.
+	 * @param ConversionId Server-side id of the conversion.
+	 * @param PredictingPlayer Player who predicted the conversion, nullptr if it wasn't predicted.
+	 * @param PredictionKey Key of the client prediction, INDEX_NONE if it wasn't predicted.
+	 * @param bIsOutputStacked True if the output only added a unit to a shape already replicated.
+	 */
+	void HandleRemoteConversion(AMachineActor& MachineActor, int32 ConversionId, const APlayerState* PredictingPlayer, int32 PredictionKey, bool bIsOutputStacked);
+
+	/**
+	 * @brief Called on clients when the output shape of a conversion is replicated, it replaces the matching provisional shape.
+	 *
+	 * @param MachineActor The machine which performed the conversion.
+	 * @param ConversionId Server-side id of the conversion.
+	 */
+	void HandleConversionOutputReplicated(AMachineActor& MachineActor, int32 ConversionId);
+
+	/**
+	 * @brief Re-applies on a machine the predicted toggles still waiting for the server.
+	 *
+	 * @param MachineActor The machine whose replicated recipe states just changed.
+	 */
+	void ReapplyPredictedToggles(AMachineActor& MachineActor);
+
+	/**
+	 * @return The recorder capturing the events fed to every machine.
+	 */
+	FMachineEventRecorder& GetEventRecorder()
+	{
+		return EventRecorder;
+	}
+
+	/**
+	 * @brief Reports shapes entering, leaving or released next to a machine to the event recorder and OnMachineShapeEvent (server only).
+	 *
+	 * @param MachineActor The machine whose shapes changed.
+	 * @param Event What happened to the shapes.
+	 * @param ShapeName The name of the shapes.
+	 * @param Count The number of units.
+	 */
+	void NotifyShapeEvent(AMachineActor& MachineActor, EMachineShapeEvent Event, const FName& ShapeName, int32 Count = 1);
+
+	/**
+	 * @brief Schedules a machine timer on the timer wheel shared by every machine.
+	 *
+	 * @param Machine The machine notified through OnMachineTimerExpired.
+	 * @param JobId The job given back to the machine.
+	 * @param DelaySeconds Time before expiration, rounded up to the wheel resolution.
+	 * @return Handle used to cancel the timer.
+	 */
+	FTimerWheelHandle ScheduleMachineTimer(AMachineActor& Machine, int32 JobId, float DelaySeconds);
+
+	/**
+	 * @brief Cancels a machine timer, the handle is invalidated.
+	 */
+	void CancelMachineTimer(FTimerWheelHandle& Handle)
+	{
+		MachineTimers.Cancel(Handle);
+	}
+
+	/**
+	 * @return The number of machine timers in flight.
 	 */
-	bool SpawnShapeByName(const FName& ShapeName, AMachineActor& MachineActor);
+	int32 GetNumMachineTimers() const
+	{
+		return MachineTimers.Num();
+	}
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/**
+	 * @return The id of the last conversion confirmed by the server for one of our predictions.
+	 */
+	int32 GetLastConfirmedConversionId() const
+	{
+		return LastConfirmedConversionId;
+	}
 
 protected:
 	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
 
 	/**
 	 * @brief Initializes subsystem-specific details when the world begins play.
@@ -145,18 +631,43 @@ private:
 	void SetupDynamicDelegates();
 
 	/**
-	 * @brief Caches shape-related data from the provided recipe settings.
+	 * @brief Caches shape-related data from the provided DataTable.
 	 *
-	 * @param RecipeSettings The settings containing shape-related data to be cached.
+	 * @param ShapeDataTable The DataTable of FShapeData rows to be cached.
 	 */
-	void CacheShapeData(const URecipeSettings* RecipeSettings);
+	void CacheShapeData(UDataTable* ShapeDataTable);
 
 	/**
-	 * @brief Caches recipe-related data from the provided recipe settings.
+	 * @brief Caches recipe-related data from the provided DataTable.
 	 *
-	 * @param RecipeSettings The settings containing recipe-related data to be cached.
+	 * @param RecipeDataTable The DataTable of FRecipeData rows to be cached.
+	 */
+	void CacheRecipeData(UDataTable* RecipeDataTable);
+
+	/**
+	 * @brief Fills the shape cache from the cached shape DataTable.
+	 */
+	void BuildShapeCache();
+
+	/**
+	 * @brief Fills the recipe cache from the cached recipe DataTable.
+	 */
+	void BuildRecipeCache();
+
+	/**
+	 * @brief Evaluates the ingredient queries of the recipes against the tags of every shape.
+	 */
+	void CompileIngredients();
+
+	/**
+	 * @brief Rebuilds the recipe cache and pushes the changed recipes to every machine.
+	 */
+	void OnRecipeDataTableChanged();
+
+	/**
+	 * @brief Rebuilds the shape cache and pushes the new inventory keys to every machine.
 	 */
-	void CacheRecipeData(const URecipeSettings* RecipeSettings);
+	void OnShapeDataTableChanged();
 
 	/**
 	 * @brief Caches visual effects (VFX) data from the provided recipe settings.
@@ -165,14 +676,84 @@ private:
 	 */
 	void CacheVfx(const URecipeSettings* RecipeSettings);
 
+	/**
+	 * @return True if the world runs as a network client, meaning requests must be predicted and sent to the server.
+	 */
+	bool IsNetClient() const;
+
+	/**
+	 * @return The machine control component of the local player, nullptr if none.
+	 */
+	UMachineControlComponent* GetLocalMachineControl() const;
+
+	/**
+	 * @brief Predicts locally the spawn of a recipe and sends the request to the server.
+	 *
+	 * @param MachineActor Reference to the target machine.
+	 * @param RecipeName The name of the recipe to spawn.
+	 */
+	void PredictRecipeSpawn(AMachineActor& MachineActor, const FText& RecipeName);
+
+	/**
+	 * @brief Predicts locally a recipe toggle and sends the request to the server.
+	 *
+	 * @param MachineActor Reference to the target machine.
+	 * @param RecipeName The name of the recipe to toggle.
+	 * @param bIsActivated The new activation state of the recipe.
+	 */
+	void PredictRecipeToggle(AMachineActor& MachineActor, const FText& RecipeName, bool bIsActivated);
+
+	/**
+	 * @brief Rolls back a machine to its replicated recipe states, keeping the predictions still pending.
+	 *
+	 * @param MachineActor The machine to roll back.
+	 */
+	void RollbackRecipeStates(AMachineActor& MachineActor);
+
+	/**
+	 * @brief Spawns a local-only provisional shape standing for a predicted output.
+	 *
+	 * @param ShapeName The name of the shape to be spawned.
+	 * @param MachineActor Reference to the target machine.
+	 * @return The provisional shape, nullptr if it couldn't be spawned.
+	 */
+	AShapeActor* SpawnProvisionalShape(const FName& ShapeName, AMachineActor& MachineActor);
+
+	/**
+	 * @brief Starts the timer rolling back predictions the server never answered.
+	 */
+	void StartPredictionTimeout();
+
+	/**
+	 * @brief Rolls back every prediction older than the prediction timeout.
+	 */
+	void ExpireStalePredictions();
+
+	/**
+	 * @brief Keeps the provisional shape of a confirmed conversion until its replicated output arrives.
+	 *
+	 * @param ConversionId Server-side id of the conversion.
+	 * @param Prediction The confirmed prediction.
+	 */
+	void AwaitConversionOutput(int32 ConversionId, const FPredictedConversion& Prediction);
+
+	/**
+	 * @brief Destroys the provisional shape of a conversion, wherever its prediction stands.
+	 *
+	 * @param ConversionId Server-side id of the conversion.
+	 * @param PredictionKey Key of the client prediction.
+	 */
+	void DiscardProvisionalShape(int32 ConversionId, int32 PredictionKey);
+
 	/**
 	 * @brief Spawns an output shape for a given machine (only used internally for now).
 	 *
 	 * @param ShapeClass The class of the shape to spawn.
 	 * @param MachineActor Reference to the target machine.
+	 * @param ConversionId Conversion the shape is spawned for, INDEX_NONE if it isn't one.
 	 * @return True if successful, false otherwise.
 	 */
-	bool SpawnOutputShape(const TSubclassOf<AShapeActor> ShapeClass, AMachineActor& MachineActor) const;
+	bool SpawnOutputShape(const TSubclassOf<AShapeActor> ShapeClass, AMachineActor& MachineActor, int32 ConversionId = INDEX_NONE);
 	
 	/**
 	 * @brief Spawns the cached visual effects at a specified location (only used internally for now).
@@ -180,6 +761,66 @@ private:
 	 * @param SpawnLocation The location at which to spawn the visual effects.
 	 */
 	void SpawnSpawnVfx(const FVector& SpawnLocation) const;
+
+	/**
+	 * @brief Spawns the shapes waiting for their class once it is streamed.
+	 *
+	 * @param ShapeName The name of the loaded shape.
+	 */
+	void OnShapeActorClassLoaded(FName ShapeName);
+
+	/**
+	 * @brief Streams the shapes of the machines players come close to, at the preload interval.
+	 *
+	 * @param DeltaTime Time elapsed since the last frame.
+	 */
+	void UpdateProximityPreload(float DeltaTime);
+
+	/**
+	 * @brief Builds the readiness matrix again from the current machines, recipes and shapes.
+	 */
+	void RebuildReadiness();
+
+	/**
+	 * @brief Copies the counts and activated recipes of a machine to its row of the readiness matrix.
+	 *
+	 * @param MachineIndex The row of the machine.
+	 */
+	void RefreshReadinessRow(int32 MachineIndex);
+
+	/**
+	 * @brief Copies the activated recipes of a machine to the readiness matrix.
+	 *
+	 * @param MachineIndex The row of the machine.
+	 */
+	void RefreshReadinessRecipes(int32 MachineIndex);
+
+	/**
+	 * @brief Processes the machines left with convertible inputs, at the sweep interval.
+	 *
+	 * @param DeltaTime Time elapsed since the last frame.
+	 */
+	void SweepReadiness(float DeltaTime);
+
+	/**
+	 * @brief Merges the loose stacks of the same shape lying close to each other, at the stack merge interval (server only).
+	 *
+	 * @param DeltaTime Time elapsed since the last frame.
+	 */
+	void MergeShapeStacks(float DeltaTime);
+
+	/**
+	 * @brief Evicts the idle loose shapes and the least recently touched ones over the population caps, at the population sweep interval (server only).
+	 *
+	 * @param DeltaTime Time elapsed since the last frame.
+	 */
+	void EnforcePopulationPolicies(float DeltaTime);
+
+	/**
+	 * @param ShapeName The name of the shape.
+	 * @return The maximum number of actors of this shape, 0 if there is no cap.
+	 */
+	int32 GetShapeActorLimit(const FName& ShapeName) const;
 	
 	/**
 	 * @brief Collection of machines mapped by their name.
@@ -199,9 +840,225 @@ private:
 	UPROPERTY(Transient)
 	TSoftObjectPtr<AMachineActor> SelectedMachine = nullptr;
 
+	UPROPERTY(Transient)
+	TObjectPtr<UDataTable> CachedRecipeDataTable = nullptr;
+
+	UPROPERTY(Transient)
+	TObjectPtr<UDataTable> CachedShapeDataTable = nullptr;
+
 	UPROPERTY(Transient)
 	TMap<FName, FRecipeData> CachedRecipesData;
 
 	UPROPERTY(Transient)
 	TMap<FName, FShapeData> CachedShapesData;
+
+	/*
+	 * Shape names indexed by their compact id
+	 */
+	TArray<FName> ShapeNamesById;
+
+	/*
+	 * Compact shape ids mapped by shape name
+	 */
+	TMap<FName, int32> ShapeIdsByName;
+
+	/*
+	 * Ingredient queries of every recipe with their per-shape bitsets
+	 */
+	FIngredientCatalog IngredientCatalog;
+
+	/*
+	 * Ingredient query indices mapped by recipe name
+	 */
+	TMap<FName, TArray<int32>> IngredientQueriesByRecipe;
+
+	/*
+	 * Cached value of the prediction timeout from settings
+	 */
+	float CachedPredictionTimeout = 1.f;
+
+	/*
+	 * Id given by the server to the next conversion
+	 */
+	int32 NextConversionId = 0;
+
+	/*
+	 * Key given by the client to the next prediction
+	 */
+	int32 NextPredictionKey = 0;
+
+	/*
+	 * Id of the last conversion confirmed by the server for one of our predictions
+	 */
+	int32 LastConfirmedConversionId = INDEX_NONE;
+
+	/*
+	 * Conversions predicted by this client, mapped by prediction key
+	 */
+	TMap<int32, FPredictedConversion> PendingConversions;
+
+	/*
+	 * Conversions confirmed by the server whose replicated output did not arrive yet, mapped by conversion id
+	 */
+	TMap<int32, FPredictedConversion> ConfirmedConversions;
+
+	/*
+	 * Replicated outputs which arrived before the conversion was confirmed, mapped by conversion id. Only the machine and timestamp are set.
+	 */
+	TMap<int32, FPredictedConversion> ArrivedConversionOutputs;
+
+	/*
+	 * Toggles predicted by this client, in the order they were sent to the server
+	 */
+	TArray<FPredictedToggle> PendingToggles;
+
+	/*
+	 * Timer rolling back the predictions the server never answered
+	 */
+	FTimerHandle PredictionTimeoutHandle;
+
+	/*
+	 * Recorder of machine events, idle until a recording is started
+	 */
+	FMachineEventRecorder EventRecorder;
+
+	/*
+	 * Single scheduler of every timed conversion, whatever the number of machines
+	 */
+	TTimerWheel<FMachineTimer> MachineTimers;
+
+	/*
+	 * Shapes received by the sink, by shape name
+	 */
+	TMap<FName, int32> SinkCounts;
+
+	/*
+	 * Machine owning each shape actor
+	 */
+	FShapeClaimTable ShapeClaims;
+
+	/*
+	 * Streaming requests of shape classes, they keep the classes loaded
+	 */
+	TMap<FName, TSharedPtr<FStreamableHandle>> ShapeClassHandles;
+
+	/*
+	 * Machines waiting for a shape class to be streamed to spawn their output, by shape name
+	 */
+	TMap<FName, TArray<FPendingShapeSpawn>> PendingShapeSpawns;
+
+	/*
+	 * Machines whose shapes were already preloaded
+	 */
+	TSet<TObjectKey<AMachineActor>> PreloadedMachines;
+
+	/*
+	 * Cached values of the preload settings
+	 */
+	float CachedShapePreloadRadius = 3000.f;
+	float CachedShapePreloadInterval = 0.5f;
+
+	/*
+	 * Time left before the next proximity check
+	 */
+	float ShapePreloadCountdown = 0.f;
+
+	/*
+	 * Inventories of every machine as a dense matrix, see EvaluateReadiness()
+	 */
+	FReadinessEvaluator ReadinessEvaluator;
+
+	/*
+	 * Machines indexed by their row of the readiness matrix
+	 */
+	UPROPERTY(Transient)
+	TArray<AMachineActor*> ReadinessMachines;
+
+	/*
+	 * Rows of the readiness matrix mapped by machine
+	 */
+	TMap<const AMachineActor*, int32> ReadinessRows;
+
+	/*
+	 * Rows whose machine changed since they were copied, and rows whose activated recipes only changed
+	 */
+	TBitArray<> DirtyReadinessRows;
+	TBitArray<> DirtyReadinessRecipes;
+
+	/*
+	 * Ingredient queries matching each shape id, the columns updated along with the shape one
+	 */
+	TArray<TArray<int32, TInlineAllocator<4>>> ReadinessQueriesByShape;
+
+	/*
+	 * Recipe names and durations indexed like the readiness recipes, and the reverse lookup
+	 */
+	TArray<FName> ReadinessRecipeNames;
+	TArray<float> ReadinessRecipeDurations;
+	TMap<FName, int32> ReadinessRecipeIndices;
+
+	/*
+	 * Cached values of the readiness sweep settings
+	 */
+	bool bIsReadinessSweepEnabled = true;
+	float CachedReadinessSweepInterval = 0.f;
+
+	/*
+	 * Time left before the next readiness sweep
+	 */
+	float ReadinessSweepCountdown = 0.f;
+
+	/*
+	 * Output spawns and input destructions waiting for their frame budget
+	 */
+	FShapeActorQueue ShapeActorQueue;
+
+	/*
+	 * Cached values of the shape actor queue settings
+	 */
+	bool bIsShapeActorQueueEnabled = true;
+	float CachedShapeActorQueueBudget = 1.f;
+
+	/*
+	 * Buffers of the machine allocation passes, reused from frame to frame
+	 */
+	FRecipeScratchArena RecipeScratch;
+
+	/*
+	 * Cached values of the shape stack settings
+	 */
+	int32 CachedMaxStackSize = 1;
+	float CachedStackMergeRadius = 100.f;
+	float CachedStackMergeInterval = 1.f;
+
+	/*
+	 * Time left before the next stack merge
+	 */
+	float StackMergeCountdown = 0.f;
+
+	/*
+	 * Shape actors alive on the server
+	 */
+	FShapePopulation ShapePopulation;
+
+	/*
+	 * Cached values of the population settings
+	 */
+	bool bArePopulationPoliciesEnabled = true;
+	int32 CachedMaxShapeActors = 0;
+	int32 CachedMaxShapeActorsPerShape = 0;
+	TMap<FName, int32> CachedShapeActorLimits = {};
+	float CachedShapeIdleLifetime = 0.f;
+	float CachedPopulationSweepInterval = 1.f;
+	float CachedEvictionRadius = 2000.f;
+
+	/*
+	 * Time left before the next population sweep
+	 */
+	float PopulationSweepCountdown = 0.f;
+
+	/*
+	 * Shapes evicted by the last population sweep, reused from sweep to sweep
+	 */
+	TArray<FShapeEvictionCandidate> PopulationCandidates = {};
 };
@@ -0,0 +1,225 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "SimulationLodSubsystem.h"
+
+#include "EngineUtils.h"
+#include "SignificanceManager.h"
+#include "IB_Test/Settings/RecipeSettings.h"
+
+const FName USimulationLodSubsystem::MachineSignificanceTag = FName("Machine");
+
+void USimulationLodSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	// Conversions are server-authoritative, clients have nothing to simulate
+	if(InWorld.GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	bUsesSignificanceManager = USignificanceManager::Get(&InWorld) != nullptr;
+
+	// Machines register themselves when they begin play, the ones already playing are gathered here
+	for(TActorIterator<AMachineActor> ActorItr(&InWorld); ActorItr; ++ActorItr)
+	{
+		if(ActorItr->HasActorBegunPlay())
+		{
+			RegisterMachine(**ActorItr);
+		}
+	}
+}
+
+void USimulationLodSubsystem::RegisterMachine(AMachineActor& Machine)
+{
+	// Conversions are server-authoritative, clients have nothing to simulate
+	if(!GetWorld() || GetWorld()->GetNetMode() == NM_Client || ManagedMachines.Contains(&Machine))
+	{
+		return;
+	}
+	ManagedMachines.Add(&Machine);
+
+	// The next update picks the level of detail of the new machine
+	SignificanceCountdown = 0.f;
+
+	USignificanceManager* SignificanceManager = bUsesSignificanceManager ? USignificanceManager::Get(GetWorld()) : nullptr;
+	if(!SignificanceManager)
+	{
+		return;
+	}
+
+	// The manager keeps the highest significance of all viewpoints, the opposite distance makes it the closest player
+	SignificanceManager->RegisterObject(&Machine, MachineSignificanceTag,
+		[](USignificanceManager::FManagedObjectInfo* ObjectInfo, const FTransform& Viewpoint)
+		{
+			return -FVector::Dist(CastChecked<AActor>(ObjectInfo->GetObject())->GetActorLocation(), Viewpoint.GetLocation());
+		},
+		USignificanceManager::EPostSignificanceType::Sequential,
+		[this](USignificanceManager::FManagedObjectInfo* ObjectInfo, float OldSignificance, float Significance, bool bFinal)
+		{
+			AMachineActor* ManagedMachine = CastChecked<AMachineActor>(ObjectInfo->GetObject());
+			ManagedMachine->SetSimulationLod(GetLodForDistance(-Significance, ManagedMachine->GetSimulationLod()));
+		});
+}
+
+void USimulationLodSubsystem::Deinitialize()
+{
+	if(bUsesSignificanceManager)
+	{
+		if(USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld()))
+		{
+			SignificanceManager->UnregisterAll(MachineSignificanceTag);
+		}
+	}
+	ManagedMachines.Reset();
+
+	Super::Deinitialize();
+}
+
+void USimulationLodSubsystem::UnregisterMachine(AMachineActor& Machine)
+{
+	if(ManagedMachines.RemoveSingleSwap(&Machine) == 0)
+	{
+		return;
+	}
+
+	if(bUsesSignificanceManager)
+	{
+		if(USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld()))
+		{
+			SignificanceManager->UnregisterObject(&Machine);
+		}
+	}
+}
+
+int32 USimulationLodSubsystem::GetNumMachines(EMachineSimulationLod SimulationLod) const
+{
+	int32 NumMachines = 0;
+	for(const AMachineActor* Machine : ManagedMachines)
+	{
+		NumMachines += Machine && Machine->GetSimulationLod() == SimulationLod ? 1 : 0;
+	}
+	return NumMachines;
+}
+
+void USimulationLodSubsystem::SetForcedLod(TOptional<EMachineSimulationLod> InForcedLod)
+{
+	ForcedLod = InForcedLod;
+	SignificanceCountdown = 0.f;
+}
+
+EMachineSimulationLod USimulationLodSubsystem::GetLodForDistance(float Distance, EMachineSimulationLod CurrentLod) const
+{
+	const URecipeSettings* RecipeSettings = GetDefault<URecipeSettings>();
+
+	// A machine is demoted further away than it is promoted
+	const auto IsBeyond = [Distance, CurrentLod, RecipeSettings](float Threshold, EMachineSimulationLod Lod)
+	{
+		return Distance > Threshold + (CurrentLod < Lod ? RecipeSettings->SignificanceHysteresis : 0.f);
+	};
+
+	if(IsBeyond(RecipeSettings->AnalyticalDistance, EMachineSimulationLod::Analytical))
+	{
+		return EMachineSimulationLod::Analytical;
+	}
+	if(IsBeyond(RecipeSettings->CountOnlyDistance, EMachineSimulationLod::CountOnly))
+	{
+		return EMachineSimulationLod::CountOnly;
+	}
+	return EMachineSimulationLod::Full;
+}
+
+void USimulationLodSubsystem::UpdateSignificance()
+{
+	if(ForcedLod.IsSet())
+	{
+		for(AMachineActor* Machine : ManagedMachines)
+		{
+			if(Machine)
+			{
+				Machine->SetSimulationLod(ForcedLod.GetValue());
+			}
+		}
+		return;
+	}
+
+	// Every player on the server
+	TArray<FTransform, TInlineAllocator<8>> Viewpoints = {};
+	for(FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		if(Iterator->IsValid() && (*Iterator)->GetPawn())
+		{
+			FVector ViewLocation = FVector::ZeroVector;
+			FRotator ViewRotation = FRotator::ZeroRotator;
+			(*Iterator)->GetPlayerViewPoint(ViewLocation, ViewRotation);
+			Viewpoints.Emplace(ViewRotation, ViewLocation);
+		}
+	}
+
+	if(bUsesSignificanceManager && !Viewpoints.IsEmpty())
+	{
+		if(USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld()))
+		{
+			SignificanceManager->Update(Viewpoints);
+			return;
+		}
+	}
+
+	for(AMachineActor* Machine : ManagedMachines)
+	{
+		if(!Machine)
+		{
+			continue;
+		}
+
+		// Without any player, every machine is far away
+		float ClosestDistance = TNumericLimits<float>::Max();
+		for(const FTransform& Viewpoint : Viewpoints)
+		{
+			ClosestDistance = FMath::Min(ClosestDistance, FVector::Dist(Machine->GetActorLocation(), Viewpoint.GetLocation()));
+		}
+		Machine->SetSimulationLod(GetLodForDistance(ClosestDistance, Machine->GetSimulationLod()));
+	}
+}
+
+void USimulationLodSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if(ManagedMachines.IsEmpty())
+	{
+		return;
+	}
+
+	const URecipeSettings* RecipeSettings = GetDefault<URecipeSettings>();
+
+	SignificanceCountdown -= DeltaTime;
+	if(SignificanceCountdown <= 0.f)
+	{
+		SignificanceCountdown = RecipeSettings->SignificanceUpdateInterval;
+		UpdateSignificance();
+	}
+
+	AnalyticalElapsedSeconds += DeltaTime;
+	if(AnalyticalElapsedSeconds < RecipeSettings->AnalyticalStepInterval)
+	{
+		return;
+	}
+
+	// Indexed, a conversion may destroy a machine and unregister it
+	const float StepSeconds = AnalyticalElapsedSeconds;
+	AnalyticalElapsedSeconds = 0.f;
+	for(int32 MachineIndex = 0; MachineIndex < ManagedMachines.Num(); ++MachineIndex)
+	{
+		AMachineActor* Machine = ManagedMachines[MachineIndex];
+		if(Machine && Machine->GetSimulationLod() == EMachineSimulationLod::Analytical)
+		{
+			Machine->AdvanceAnalytically(StepSeconds);
+		}
+	}
+}
+
+TStatId USimulationLodSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USimulationLodSubsystem, STATGROUP_Tickables);
+}
@@ -0,0 +1,97 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "IB_Test/Actors/MachineActor.h"
+#include "SimulationLodSubsystem.generated.h"
+
+/**
+ * Server subsystem deciding how closely each machine is simulated from its distance to the players.
+ * Machines are registered in the significance manager when the plugin created one, the distances are computed here otherwise.
+ */
+UCLASS()
+class IB_TEST_API USimulationLodSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Starts managing a machine when it begins play, including the ones spawned after the world (server only).
+	 *
+	 * @param Machine The machine to manage.
+	 */
+	void RegisterMachine(AMachineActor& Machine);
+
+	/**
+	 * @brief Stops managing a machine, e.g. when it is destroyed.
+	 *
+	 * @param Machine The machine to forget.
+	 */
+	void UnregisterMachine(AMachineActor& Machine);
+
+	/**
+	 * @param SimulationLod The simulation level of detail to count.
+	 * @return The number of managed machines simulated at this level of detail.
+	 */
+	int32 GetNumMachines(EMachineSimulationLod SimulationLod) const;
+
+	/**
+	 * @brief Simulates every machine at the same level of detail whatever the players distance, e.g. for benchmarks.
+	 *
+	 * @param InForcedLod The level of detail to force, unset to go back to the distance-based one.
+	 */
+	void SetForcedLod(TOptional<EMachineSimulationLod> InForcedLod);
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+protected:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+private:
+	/**
+	 * @param Distance Distance between the machine and the closest player.
+	 * @param CurrentLod The current simulation level of detail of the machine.
+	 * @return The simulation level of detail for this distance.
+	 */
+	EMachineSimulationLod GetLodForDistance(float Distance, EMachineSimulationLod CurrentLod) const;
+
+	/**
+	 * Updates the simulation level of detail of every managed machine.
+	 */
+	void UpdateSignificance();
+
+	/*
+	* Tag of the machines in the significance manager
+	*/
+	static const FName MachineSignificanceTag;
+
+	/*
+	* Every machine whose simulation level of detail is managed
+	*/
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<AMachineActor>> ManagedMachines;
+
+	/*
+	* Level of detail of every machine when set
+	*/
+	TOptional<EMachineSimulationLod> ForcedLod;
+
+	/*
+	* True when the machines are registered in the significance manager
+	*/
+	bool bUsesSignificanceManager = false;
+
+	/*
+	* Time left before the next significance update
+	*/
+	float SignificanceCountdown = 0.f;
+
+	/*
+	* Time accumulated since the previous analytical step
+	*/
+	float AnalyticalElapsedSeconds = 0.f;
+};
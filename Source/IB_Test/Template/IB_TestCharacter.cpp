@@ -7,6 +7,7 @@
 #include "Components/CapsuleComponent.h"
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
+#include "IB_Test/Components/MachineControlComponent.h"
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -35,6 +36,9 @@ AIB_TestCharacter::AIB_TestCharacter()
 	//Mesh1P->SetRelativeRotation(FRotator(0.9f, -19.19f, 5.2f));
 	Mesh1P->SetRelativeLocation(FVector(-30.f, 0.f, -150.f));
 
+	// Create the component relaying machine UI requests to the server
+	MachineControl = CreateDefaultSubobject<UMachineControlComponent>(TEXT("MachineControl"));
+
 }
 
 void AIB_TestCharacter::BeginPlay()
@@ -13,6 +13,7 @@ class USceneComponent;
 class UCameraComponent;
 class UAnimMontage;
 class USoundBase;
+class UMachineControlComponent;
 
 UCLASS(config=Game)
 class AIB_TestCharacter : public ACharacter
@@ -39,6 +40,10 @@ class AIB_TestCharacter : public ACharacter
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Input, meta=(AllowPrivateAccess = "true"))
 	class UInputAction* MoveAction;
 
+	/** Network channel used by the machine UI to reach the server */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Machine, meta = (AllowPrivateAccess = "true"))
+	UMachineControlComponent* MachineControl;
+
 	
 public:
 	AIB_TestCharacter();
@@ -9,6 +9,8 @@
 #include "Kismet/GameplayStatics.h"
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
+#include "IB_Test/Settings/RecipeSettings.h"
+#include "IB_Test/Subsystems/ProjectileSubsystem.h"
 
 // Sets default values for this component's properties
 UTP_WeaponComponent::UTP_WeaponComponent()
@@ -40,8 +42,16 @@ void UTP_WeaponComponent::Fire()
 			FActorSpawnParameters ActorSpawnParams;
 			ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
 	
-			// Spawn the projectile at the muzzle
-			World->SpawnActor<AIB_TestProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+			// Simulate the projectile in the projectile subsystem, or spawn it at the muzzle
+			UProjectileSubsystem* ProjectileSubsystem = World->GetSubsystem<UProjectileSubsystem>();
+			if (ProjectileSubsystem != nullptr && GetDefault<URecipeSettings>()->bUseProjectileSubsystem)
+			{
+				ProjectileSubsystem->FireProjectile(ProjectileClass, SpawnLocation, SpawnRotation, Character);
+			}
+			else
+			{
+				World->SpawnActor<AIB_TestProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+			}
 		}
 	}
 	
@@ -0,0 +1,335 @@
+﻿// Copyright Yoan Rock 2023. All Rights Reserved.
+
+#include "Misc/AutomationTest.h"
+#include "Engine/DataTable.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/MemoryBase.h"
+#include "IB_Test/Actors/MachineActor.h"
+#include "IB_Test/Actors/ShapeActor.h"
+#include "IB_Test/Datas/RecipeData.h"
+#include "IB_Test/Datas/ShapeData.h"
+#include "IB_Test/Simulation/RecipeAllocator.h"
+#include "IB_Test/Simulation/RecipeScratch.h"
+#include "IB_Test/Subsystems/RecipeSubsystem.h"
+#include "IB_Test/Subsystems/SimulationLodSubsystem.h"
+#include "UObject/Package.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RecipeScratchTests
+{
+	/**
+	 * Forwards to the engine allocator and counts the allocations made by the game thread while installed as GMalloc.
+	 */
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+		explicit FCountingMalloc(FMalloc& InInnerMalloc) : InnerMalloc(InInnerMalloc)
+		{
+		}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return InnerMalloc.Malloc(Count, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return InnerMalloc.TryMalloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return InnerMalloc.Realloc(Original, Count, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return InnerMalloc.TryRealloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override
+		{
+			InnerMalloc.Free(Original);
+		}
+
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override
+		{
+			return InnerMalloc.QuantizeSize(Count, Alignment);
+		}
+
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override
+		{
+			return InnerMalloc.GetAllocationSize(Original, SizeOut);
+		}
+
+		virtual bool IsInternallyThreadSafe() const override
+		{
+			return InnerMalloc.IsInternallyThreadSafe();
+		}
+
+		virtual const TCHAR* GetDescriptiveName() override
+		{
+			return TEXT("RecipeScratchTests::FCountingMalloc");
+		}
+
+		int64 GetNumAllocations() const
+		{
+			return NumAllocations;
+		}
+
+	private:
+		void CountAllocation()
+		{
+			// Worker threads keep allocating for their own tasks, only the machine code runs on the game thread
+			if(IsInGameThread())
+			{
+				++NumAllocations;
+			}
+		}
+
+		FMalloc& InnerMalloc;
+
+		int64 NumAllocations = 0;
+	};
+
+	/**
+	 * Counts the allocations of the game thread for the lifetime of the scope.
+	 */
+	class FAllocationCounterScope : public FNoncopyable
+	{
+	public:
+		FAllocationCounterScope() : CountingMalloc(*GMalloc), PreviousMalloc(GMalloc)
+		{
+			GMalloc = &CountingMalloc;
+		}
+
+		~FAllocationCounterScope()
+		{
+			GMalloc = PreviousMalloc;
+		}
+
+		int64 GetNumAllocations() const
+		{
+			return CountingMalloc.GetNumAllocations();
+		}
+
+	private:
+		FCountingMalloc CountingMalloc;
+
+		FMalloc* PreviousMalloc = nullptr;
+	};
+
+	/**
+	 * Recipe of the test factory, by shape name
+	 */
+	struct FTestRecipe
+	{
+		FName Name;
+		TArray<FName> Inputs;
+		FName Output;
+		int32 Priority = 0;
+	};
+
+	/**
+	 * An empty world with a single machine sending its outputs to the sink, built like the factory benchmark.
+	 */
+	class FTestFactory : public FNoncopyable
+	{
+	public:
+		FTestFactory(const TArray<FName>& ShapeNames, const TArray<FTestRecipe>& Recipes, ERecipeAllocationMode AllocationMode)
+		{
+			World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("RecipeScratchTests"));
+			if(!World)
+			{
+				return;
+			}
+			GEngine->CreateNewWorldContext(EWorldType::Game).SetCurrentWorld(World);
+
+			RecipeSubsystem = World->GetSubsystem<URecipeSubsystem>();
+			if(!RecipeSubsystem)
+			{
+				return;
+			}
+
+			UDataTable* ShapeDataTable = NewObject<UDataTable>(GetTransientPackage());
+			ShapeDataTable->RowStruct = FShapeData::StaticStruct();
+			for(const FName& ShapeName : ShapeNames)
+			{
+				ShapeDataTable->AddRow(ShapeName, FShapeData(FText::FromName(ShapeName), FText::GetEmpty(), AShapeActor::StaticClass()));
+			}
+
+			TArray<FText> AffectedRecipes = {};
+			UDataTable* RecipeDataTable = NewObject<UDataTable>(GetTransientPackage());
+			RecipeDataTable->RowStruct = FRecipeData::StaticStruct();
+			for(const FTestRecipe& Recipe : Recipes)
+			{
+				TArray<FText> Inputs = {};
+				for(const FName& Input : Recipe.Inputs)
+				{
+					Inputs.Add(FText::FromName(Input));
+				}
+
+				FRecipeData RecipeData(FText::FromName(Recipe.Name), Inputs, FText::FromName(Recipe.Output));
+				RecipeData.Priority = Recipe.Priority;
+				RecipeDataTable->AddRow(Recipe.Name, RecipeData);
+				AffectedRecipes.Add(FText::FromName(Recipe.Name));
+			}
+			RecipeSubsystem->OverrideDataTables(RecipeDataTable, ShapeDataTable);
+
+			FURL URL;
+			World->SetGameMode(URL);
+			World->InitializeActorsForPlay(URL);
+			World->BeginPlay();
+
+			if(USimulationLodSubsystem* SimulationLodSubsystem = World->GetSubsystem<USimulationLodSubsystem>())
+			{
+				SimulationLodSubsystem->SetForcedLod(EMachineSimulationLod::Full);
+			}
+
+			Machine = World->SpawnActorDeferred<AMachineActor>(AMachineActor::StaticClass(), FTransform::Identity);
+			if(Machine)
+			{
+				Machine->SetupMachine(FText::FromString(TEXT("Machine")), AffectedRecipes, EMachineOutputTarget::Sink);
+				Machine->SetupPipeline(AllocationMode, 1, 0, 0, 0.f);
+				Machine->FinishSpawning(FTransform::Identity);
+			}
+		}
+
+		~FTestFactory()
+		{
+			if(World)
+			{
+				World->BeginTearingDown();
+				GEngine->DestroyWorldContext(World);
+				World->DestroyWorld(false);
+			}
+		}
+
+		UWorld* World = nullptr;
+
+		URecipeSubsystem* RecipeSubsystem = nullptr;
+
+		AMachineActor* Machine = nullptr;
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRecipeScratchSteadyStateTest, "IB_Test.Machines.RecipeScratch.SteadyState",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRecipeScratchSteadyStateTest::RunTest(const FString& Parameters)
+{
+	using namespace RecipeScratchTests;
+
+	const FName Cube = TEXT("Cube");
+	const FName Sphere = TEXT("Sphere");
+	const FName Cone = TEXT("Cone");
+
+	// Two recipes competing for cubes, the machine is fed a steady stream of shapes
+	const TArray<FTestRecipe> Recipes = {
+		{TEXT("ConeRecipe"), {Cube, Sphere}, Cone, 1},
+		{TEXT("SphereRecipe"), {Cube, Cube}, Sphere, 0}
+	};
+	const FName CycleShapes[] = {Cube, Cube, Sphere, Cube, Cube, Sphere};
+
+	const ERecipeAllocationMode AllocationModes[] = {ERecipeAllocationMode::Priority, ERecipeAllocationMode::WeightedRoundRobin, ERecipeAllocationMode::MaximizeValue};
+	for(const ERecipeAllocationMode AllocationMode : AllocationModes)
+	{
+		FTestFactory Factory({Cube, Sphere, Cone}, Recipes, AllocationMode);
+		if(!TestNotNull(TEXT("Machine"), Factory.Machine))
+		{
+			return false;
+		}
+
+		int32 NumConversions = 0;
+		const FDelegateHandle RecipeConvertedHandle = Factory.RecipeSubsystem->OnRecipeConverted.AddLambda([&NumConversions](AMachineActor&, const FName&, TConstArrayView<FName>)
+		{
+			++NumConversions;
+		});
+
+		// The first cycles warm the scratch frames, the sink and the delegates up, the following ones must not allocate
+		constexpr int32 NumWarmupCycles = 10;
+		constexpr int32 NumCycles = 100;
+		for(int32 Cycle = 0; Cycle < NumWarmupCycles; ++Cycle)
+		{
+			for(const FName& Shape : CycleShapes)
+			{
+				Factory.Machine->AddShapes(Shape, 1);
+			}
+		}
+
+		const int32 NumWarmupConversions = NumConversions;
+		int64 NumAllocations = 0;
+		{
+			FAllocationCounterScope AllocationCounter;
+			for(int32 Cycle = 0; Cycle < NumCycles; ++Cycle)
+			{
+				for(const FName& Shape : CycleShapes)
+				{
+					Factory.Machine->AddShapes(Shape, 1);
+				}
+			}
+			NumAllocations = AllocationCounter.GetNumAllocations();
+		}
+
+		Factory.RecipeSubsystem->OnRecipeConverted.Remove(RecipeConvertedHandle);
+
+		TestTrue(TEXT("The cycles convert shapes"), NumConversions > NumWarmupConversions);
+		TestEqual(TEXT("Allocations after the warm-up"), NumAllocations, 0ll);
+		TestEqual(TEXT("Requirement spills"), Factory.RecipeSubsystem->GetRecipeScratch().GetStats().NumRequirementSpills, 0ll);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRecipeScratchRequirementSpillTest, "IB_Test.Machines.RecipeScratch.RequirementSpill",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRecipeScratchRequirementSpillTest::RunTest(const FString& Parameters)
+{
+	using namespace RecipeScratchTests;
+
+	// A recipe with more distinct inputs than held inline allocates on every pass, even with warm frames
+	TArray<FName> ShapeNames = {};
+	FTestRecipe Recipe;
+	Recipe.Name = TEXT("SpillRecipe");
+	Recipe.Output = TEXT("Output");
+	for(int32 Shape = 0; Shape <= FAllocationRecipe::NumInlineRequirements; ++Shape)
+	{
+		Recipe.Inputs.Add(*FString::Printf(TEXT("Shape%d"), Shape));
+	}
+	ShapeNames = Recipe.Inputs;
+	ShapeNames.Add(Recipe.Output);
+
+	FTestFactory Factory(ShapeNames, {Recipe}, ERecipeAllocationMode::Priority);
+	if(!TestNotNull(TEXT("Machine"), Factory.Machine))
+	{
+		return false;
+	}
+
+	for(const FName& Input : Recipe.Inputs)
+	{
+		Factory.Machine->AddShapes(Input, 1);
+	}
+
+	// The recipe only competes once every input arrived, the pass of the last one spills again
+	int64 NumAllocations = 0;
+	{
+		FAllocationCounterScope AllocationCounter;
+		for(const FName& Input : Recipe.Inputs)
+		{
+			Factory.Machine->AddShapes(Input, 1);
+		}
+		NumAllocations = AllocationCounter.GetNumAllocations();
+	}
+
+	TestTrue(TEXT("The spilling pass allocates"), NumAllocations > 0);
+	TestTrue(TEXT("Spills are counted"), Factory.RecipeSubsystem->GetRecipeScratch().GetStats().NumRequirementSpills > 0);
+	return true;
+}
+
+#endif
@@ -5,6 +5,11 @@
 #include "CoreMinimal.h"
 #include "RecipeDataEntry.generated.h"
 
+/**
+ * Shapes consumed by one conversion, inline so evaluating a recipe doesn't touch the heap
+ */
+using FRecipeInputs = TArray<FName, TInlineAllocator<8>>;
+
 /**
  * Object used by a ListView containing all necessary information for a recipe in the UI.
  */
@@ -16,12 +21,32 @@ class URecipeDataItem : public UObject
 public:
 	URecipeDataItem() = default;
 
-	void Initialize(const FText& InName,const TArray<FText>& InInputShape, const FText& InOutputShape)
+	void Initialize(const FText& InName,const TArray<FText>& InInputShape, const FText& InOutputShape, int32 InPriority = 0, int32 InWeight = 1, float InDuration = 0.f)
 	{
 		Name = InName;
 		InputNames = InInputShape;
 		OutputShape = InOutputShape;
+		Priority = InPriority;
+		Weight = InWeight;
+		Duration = InDuration;
 		bIsActivated = true;
+
+		// Converted once here, the conversion path only compares names
+		NameKey = FName(*Name.ToString());
+		OutputKey = FName(*OutputShape.ToString());
+		InputKeys.Reset();
+		for(const FText& InputName : InputNames)
+		{
+			InputKeys.Add(FName(*InputName.ToString()));
+		}
+	}
+
+	/**
+	 * @return True if the recipe consumes at least one shape, exact or wildcard.
+	 */
+	bool HasInputs() const
+	{
+		return !InputNames.IsEmpty() || !InputQueries.IsEmpty();
 	}
 
 	/**
@@ -36,15 +61,60 @@ public:
 	UPROPERTY(EditAnywhere)
 	TArray<FText> InputNames = {};
 
+	/**
+	 * Wildcard ingredients, indices in the ingredient catalog of the Recipe Subsystem.
+	 */
+	UPROPERTY(EditAnywhere)
+	TArray<int32> InputQueries = {};
+
+	/**
+	 * Names of the wildcard ingredients, displayed after the input shapes.
+	 */
+	UPROPERTY(EditAnywhere)
+	TArray<FText> InputQueryNames = {};
+
 	/**
 	 * Shapes produced by the recipe.
 	 */
 	UPROPERTY(EditAnywhere)
 	FText OutputShape = FText();
 
+	/**
+	 * Allocation priority of the recipe.
+	 */
+	UPROPERTY(EditAnywhere)
+	int32 Priority = 0;
+
+	/**
+	 * Allocation weight of the recipe.
+	 */
+	UPROPERTY(EditAnywhere)
+	int32 Weight = 1;
+
+	/**
+	 * Processing time of the recipe, 0 if instant.
+	 */
+	UPROPERTY(EditAnywhere)
+	float Duration = 0.f;
+
 	/**
 	 * Recipe's state
 	 */
 	UPROPERTY(EditAnywhere)
 	bool bIsActivated = true;
+
+	/**
+	 * Name of the recipe as a key, set by Initialize().
+	 */
+	FName NameKey = NAME_None;
+
+	/**
+	 * Output shape as a key, set by Initialize().
+	 */
+	FName OutputKey = NAME_None;
+
+	/**
+	 * Exact input shapes as keys, set by Initialize().
+	 */
+	FRecipeInputs InputKeys = {};
 };
\ No newline at end of file
@@ -34,6 +34,9 @@ void UUIControlMachineWidget::NativeConstruct()
 		UE_LOG(LogTemp, Error, TEXT("UUIControlMachineWidget::NativeConstruct - RecipeSubsystem is invalid"));
 		return;
 	}
+
+	RecipeSubsystem->OnRecipeStatesReconciled.AddDynamic(this, &UUIControlMachineWidget::HandleRecipeStatesReconciled);
+	RecipeSubsystem->OnRecipeDataReloaded.AddDynamic(this, &UUIControlMachineWidget::HandleRecipeDataReloaded);
 	
 	// Retrieve Machine names
 	TArray<FString> OutMachineNames = {};
@@ -114,3 +117,25 @@ void UUIControlMachineWidget::HandleSelectionChanged(FString SelectedItem, ESele
 	
 	ListView->SetListItems(SelectedMachineFound->GetRecipeEntries());
 }
+
+void UUIControlMachineWidget::HandleRecipeStatesReconciled(AMachineActor* Machine)
+{
+	if(!RecipeSubsystem.IsValid() || RecipeSubsystem->GetSelectedMachine().Get() != Machine)
+	{
+		return;
+	}
+
+	// Entries read their checkbox state from the recipe items, regenerating them is enough
+	ListView->RegenerateAllEntries();
+}
+
+void UUIControlMachineWidget::HandleRecipeDataReloaded()
+{
+	if(!RecipeSubsystem.IsValid() || !RecipeSubsystem->GetSelectedMachine().IsValid())
+	{
+		return;
+	}
+
+	// Recipes may have been added or removed, the whole list is rebuilt
+	ListView->SetListItems(RecipeSubsystem->GetSelectedMachine()->GetRecipeEntries());
+}
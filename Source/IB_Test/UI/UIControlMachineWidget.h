@@ -37,6 +37,20 @@ public:
 	UFUNCTION()
 	void HandleSelectionChanged(FString SelectedItem, ESelectInfo::Type SelectionType);
 
+	/**
+	 * @brief Refreshes the recipe entries when predicted recipe states were reconciled with the server.
+	 *
+	 * @param Machine The machine whose recipe states changed.
+	 */
+	UFUNCTION()
+	void HandleRecipeStatesReconciled(AMachineActor* Machine);
+
+	/**
+	 * @brief Rebuilds the recipe entries when the recipe data was reloaded.
+	 */
+	UFUNCTION()
+	void HandleRecipeDataReloaded();
+
 private:
 	
 	UPROPERTY(meta = (BindWidget))
@@ -48,6 +48,14 @@ void UUIRecipeEntry::SetInputList(const URecipeDataItem* Item)
 		// Add the created input item to the array
 		InputItems.Add(RecipeInputItem);
 	}
+
+	// Wildcard ingredients are listed by their query
+	for(const FText& InputQueryName : Item->InputQueryNames)
+	{
+		URecipeInputItem* RecipeInputItem = NewObject<URecipeInputItem>(this);
+		RecipeInputItem->Initialize(InputQueryName);
+		InputItems.Add(RecipeInputItem);
+	}
 	
 	// Set the list of input items in the input list view
 	InputListView->SetListItems(InputItems);